@@ -0,0 +1,934 @@
+/*
+ * Headless frame benchmark.
+ * Renders a fixed set of scenes offscreen at several resolutions and thread counts,
+ * and prints the frame time statistics as JSON.
+ *
+ * usage: SRBenchmark [--scenes a,b] [--resolutions 800x600,1920x1080] [--threads 1,4]
+ *                    [--frames N] [--warmup N] [--output file.json] [--trace prefix] [--heatmap prefix]
+ *                    [--capture prefix] [--pipeline depth] [--linear-textures] [--mesh-files prefix]
+ *                    [--stream-budget bytes] [--tile-order zigzag|morton|hilbert]
+ *                    [--tile-scheduling static|cost-history] [--page-budget bytes]
+ *                    [--submit immediate|queue] [--record-threads N]
+ * thread count 0 means SRThreadPool::DefaultThreadCount().
+ * --trace writes the measured frames of every run to prefix_scene_WxH_threads.json (Chrome trace).
+ * --heatmap writes the tile counters of the last frame to prefix_scene_WxH_threads.csv / .ppm (cycles).
+ * --capture records the measured frames of every run to prefix_scene_WxH_threads.srcap, see SRReplay.
+ * --pipeline sets SRRasterizerDesc::PipelineDepth, streaming the triangles to the tile workers.
+ * --tile-order sets SRRasterizerDesc::TileOrder, zigzag by default.
+ * --tile-scheduling sets SRRasterizerDesc::TileScheduling, cost-history by default.
+ * --linear-textures stores the textures row-major instead of swizzled.
+ * --mesh-files writes the indexed scenes to prefix_scene.srmf, 16 bit indices when they fit,
+ *              and draws them from the mapping SRLoadMeshFile creates.
+ * --stream-budget sets the geometry pool of streamed_terrain, 1 MB by default, far less than the terrain needs.
+ *              its cluster file is written to prefix_streamed_terrain.srcl, SRBenchmark_streamed_terrain.srcl
+ *              without --mesh-files, removed after the run.
+ * --page-budget sets the memory budget of the virtual texture of virtual_floor, 4 MB by default,
+ *              a fraction of its 2048 * 2048 texels.
+ * --submit queue records the frames into SRCommandLists, the draw split over --record-threads lists
+ *              (1 by default) recorded on as many threads, and plays them back through an SRCommandQueue.
+ *              the lists of frame N are reused once the fence of frame N - 2 has completed, so a frame
+ *              is timed from one submission to the next.
+ *              after the measured frames one frame is drawn with the immediate calls, the run fails
+ *              if its checksum differs. streamed_terrain and virtual_floor are always immediate.
+ *              after the warmup two invalid lists are submitted, one with a handle never allocated and
+ *              one drawing without a pipeline state: the run fails unless both are rejected and skipped,
+ *              the errors they report are expected.
+ *
+ * A frame is clear + draw + SREndFrame. Throughput is based on the median frame:
+ * triangles/s counts submitted triangles, pixels/s counts render target pixels.
+ * checksum is the FNV-1a hash of the render target after the last frame, equal between runs that render the same image
+ * (for streamed_terrain, once the loads have caught up with the camera).
+ * virtual_floor is textured_floor sampling a virtual texture whose pages are faulted in at SREndFrame.
+ * textured_floor generates the mips of its texture with SRGenerateMips, once more before the measured frames to time it.
+ * streamed_terrain adds SRGeometryStream::Update to its frames and submits the triangles selected by the last one.
+ */
+#include "SRBenchmarkShaders.h"
+#include "SRCommandQueue.h"
+#include "SRGeometryStream.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace DirectX;
+
+/*
+ * scenes
+ */
+struct Scene {
+	const char* Name;
+	std::vector<Vertex> Vertices;
+	std::vector<UINT32> Indices;		// empty for non-indexed draw
+	bool UseCamera = false;				// false: positions are already in clip space
+	bool Textured = false;				// Color.xy is the uv of a mipmapped checker texture
+	bool Streamed = false;				// drawn by SRGeometryStream from a cluster file, the camera moves away
+	bool Virtual = false;				// Textured from a virtual texture, larger than the page budget
+};
+
+static const XMFLOAT4 White(1.0f, 1.0f, 1.0f, 1.0f);
+static const XMFLOAT4 Black(0.0f, 0.0f, 0.0f, 1.0f);
+static const XMFLOAT4 Red(1.0f, 0.0f, 0.0f, 1.0f);
+static const XMFLOAT4 Green(0.0f, 0.5f, 0.0f, 1.0f);
+static const XMFLOAT4 Blue(0.0f, 0.0f, 1.0f, 1.0f);
+static const XMFLOAT4 Yellow(1.0f, 1.0f, 0.0f, 1.0f);
+static const XMFLOAT4 Cyan(0.0f, 1.0f, 1.0f, 1.0f);
+static const XMFLOAT4 Magenta(1.0f, 0.0f, 1.0f, 1.0f);
+
+// the cube sample
+static Scene CreateCube() {
+	Scene scene;
+	scene.Name = "cube";
+	scene.UseCamera = true;
+	scene.Vertices = {
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), White },
+		{ XMFLOAT3(-1.0f, +1.0f, -1.0f), Black },
+		{ XMFLOAT3(+1.0f, +1.0f, -1.0f), Red },
+		{ XMFLOAT3(+1.0f, -1.0f, -1.0f), Green },
+		{ XMFLOAT3(-1.0f, -1.0f, +1.0f), Blue },
+		{ XMFLOAT3(-1.0f, +1.0f, +1.0f), Yellow },
+		{ XMFLOAT3(+1.0f, +1.0f, +1.0f), Cyan },
+		{ XMFLOAT3(+1.0f, -1.0f, +1.0f), Magenta }
+	};
+	scene.Indices = {
+		0, 1, 2,  0, 2, 3,
+		4, 6, 5,  4, 7, 6,
+		4, 5, 1,  4, 1, 0,
+		3, 2, 6,  3, 6, 7,
+		1, 5, 6,  1, 6, 2,
+		4, 0, 3,  4, 3, 7
+	};
+	return scene;
+}
+
+// TestDepth of the cube sample: two intersecting triangles
+static Scene CreateTestDepth() {
+	Scene scene;
+	scene.Name = "test_depth";
+	scene.UseCamera = true;
+	scene.Vertices = {
+		{ XMFLOAT3(-1.0f, -1.0f, +1.0f), White },
+		{ XMFLOAT3(+1.0f, -1.0f, +1.0f), Cyan },
+		{ XMFLOAT3(+0.0f, +1.0f, -1.0f), Red },
+		{ XMFLOAT3(+1.0f, +1.0f, +1.0f), Green },
+		{ XMFLOAT3(-1.0f, +1.0f, +1.0f), Blue },
+		{ XMFLOAT3(+0.0f, -1.0f, -1.0f), Yellow }
+	};
+	return scene;
+}
+
+// a grid of about 1M triangles covering the screen, a few pixels each
+static Scene CreateSmallTriangles() {
+	const UINT Cells = 708;		// 708 * 708 * 2 > 1M triangles
+	Scene scene;
+	scene.Name = "small_triangles_1m";
+	scene.Vertices.reserve((Cells + 1) * (Cells + 1));
+	for (UINT j = 0; j <= Cells; j++) {
+		for (UINT i = 0; i <= Cells; i++) {
+			float x = -1.0f + 2.0f * i / Cells;
+			float y = 1.0f - 2.0f * j / Cells;
+			XMFLOAT4 color(float(i) / Cells, float(j) / Cells, 0.5f, 1.0f);
+			scene.Vertices.push_back({ XMFLOAT3(x, y, 0.5f), color });
+		}
+	}
+	scene.Indices.reserve(Cells * Cells * 6);
+	for (UINT j = 0; j < Cells; j++) {
+		for (UINT i = 0; i < Cells; i++) {
+			UINT32 v0 = j * (Cells + 1) + i;
+			UINT32 v1 = v0 + 1;
+			UINT32 v2 = v0 + Cells + 1;
+			UINT32 v3 = v2 + 1;
+			scene.Indices.insert(scene.Indices.end(), { v0, v2, v1, v1, v2, v3 });
+		}
+	}
+	return scene;
+}
+
+// full screen quads drawn back to front, every layer passes the depth test
+static Scene CreateOverdraw() {
+	const UINT Layers = 32;
+	Scene scene;
+	scene.Name = "overdraw_32";
+	for (UINT n = 0; n < Layers; n++) {
+		float z = 1.0f - (n + 1.0f) / (Layers + 1.0f);
+		XMFLOAT4 color(float(n) / Layers, 1.0f - float(n) / Layers, 0.5f, 1.0f);
+		UINT32 base = UINT32(scene.Vertices.size());
+		scene.Vertices.push_back({ XMFLOAT3(-1.0f, +1.0f, z), color });
+		scene.Vertices.push_back({ XMFLOAT3(+1.0f, +1.0f, z), color });
+		scene.Vertices.push_back({ XMFLOAT3(-1.0f, -1.0f, z), color });
+		scene.Vertices.push_back({ XMFLOAT3(+1.0f, -1.0f, z), color });
+		scene.Indices.insert(scene.Indices.end(), { base, base + 2, base + 1, base + 1, base + 2, base + 3 });
+	}
+	return scene;
+}
+
+// long and thin triangles across the whole screen,
+// large bounding boxes with very few covered pixels
+static Scene CreateThinTriangles() {
+	const UINT Count = 4096;
+	Scene scene;
+	scene.Name = "thin_triangles";
+	for (UINT n = 0; n < Count; n++) {
+		float t = float(n) / Count;
+		float angle = t * 3.14159265f;
+		float dx = cosf(angle), dy = sinf(angle);
+		// about a pixel wide at 1080p
+		float wx = -dy * 0.002f, wy = dx * 0.002f;
+		XMFLOAT4 color(t, 0.5f, 1.0f - t, 1.0f);
+		scene.Vertices.push_back({ XMFLOAT3(-dx + wx, -dy + wy, 0.5f), color });
+		scene.Vertices.push_back({ XMFLOAT3(-dx - wx, -dy - wy, 0.5f), color });
+		scene.Vertices.push_back({ XMFLOAT3(dx, dy, 0.5f), color });
+	}
+	return scene;
+}
+
+// a ground plane running into the distance, every mip level of the texture is used
+static Scene CreateTexturedFloor() {
+	const float Near = 3.0f, Far = -200.0f, HalfWidth = 20.0f, Repeat = 0.5f;
+	Scene scene;
+	scene.Name = "textured_floor";
+	scene.UseCamera = true;
+	scene.Textured = true;
+	scene.Vertices = {
+		{ XMFLOAT3(-HalfWidth, -1.0f, Near), XMFLOAT4(-HalfWidth * Repeat, Near * Repeat, 0.0f, 1.0f) },
+		{ XMFLOAT3(+HalfWidth, -1.0f, Near), XMFLOAT4(+HalfWidth * Repeat, Near * Repeat, 0.0f, 1.0f) },
+		{ XMFLOAT3(-HalfWidth, -1.0f, Far), XMFLOAT4(-HalfWidth * Repeat, Far * Repeat, 0.0f, 1.0f) },
+		{ XMFLOAT3(+HalfWidth, -1.0f, Far), XMFLOAT4(+HalfWidth * Repeat, Far * Repeat, 0.0f, 1.0f) }
+	};
+	scene.Indices = { 0, 1, 2,  1, 3, 2 };
+	return scene;
+}
+
+// the ground plane with a checker of 2048 * 2048 texels repeated every 16 units, the camera moves along it
+// and the pages are faulted in as the frames sample them
+static Scene CreateVirtualFloor() {
+	Scene scene = CreateTexturedFloor();
+	scene.Name = "virtual_floor";
+	scene.Virtual = true;
+	for (Vertex& vertex : scene.Vertices) {
+		vertex.Color.x /= 8.0f;
+		vertex.Color.y /= 8.0f;
+	}
+	return scene;
+}
+
+// a 300 * 300 height field seen from close by to far away, streamed through a small geometry pool
+static Scene CreateStreamedTerrain() {
+	const UINT Cells = 300;
+	Scene scene;
+	scene.Name = "streamed_terrain";
+	scene.UseCamera = true;
+	scene.Streamed = true;
+	scene.Vertices.reserve((Cells + 1) * (Cells + 1));
+	for (UINT j = 0; j <= Cells; j++) {
+		for (UINT i = 0; i <= Cells; i++) {
+			float x = -1.0f + 2.0f * i / Cells;
+			float z = -1.0f + 2.0f * j / Cells;
+			float y = 0.15f * sinf(9.0f * x) * cosf(7.0f * z) + 0.05f * sinf(40.0f * x + 33.0f * z);
+			XMFLOAT4 color(0.5f + 3.0f * y, 0.5f - 2.0f * y, 0.5f + 0.3f * x, 1.0f);
+			scene.Vertices.push_back({ XMFLOAT3(x, y, z), color });
+		}
+	}
+	scene.Indices.reserve(Cells * Cells * 6);
+	for (UINT j = 0; j < Cells; j++) {
+		for (UINT i = 0; i < Cells; i++) {
+			UINT32 v0 = j * (Cells + 1) + i;
+			UINT32 v1 = v0 + 1;
+			UINT32 v2 = v0 + Cells + 1;
+			UINT32 v3 = v2 + 1;
+			scene.Indices.insert(scene.Indices.end(), { v0, v2, v1, v1, v2, v3 });
+		}
+	}
+	return scene;
+}
+
+// 8 * 8 checker of 32 texels, level 0 of the full mip chain, the others are left to SRGenerateMips
+static std::vector<BYTE> CreateCheckerTexture(UINT size, UINT* pMipLevels) {
+	std::vector<BYTE> texels(size_t(size) * size * 4);
+	for (UINT y = 0; y < size; y++) {
+		for (UINT x = 0; x < size; x++) {
+			bool isWhite = ((x / 32) ^ (y / 32)) & 1;
+			BYTE* texel = texels.data() + (size_t(y) * size + x) * 4;
+			texel[0] = isWhite ? 230 : 40;
+			texel[1] = isWhite ? 230 : 90;
+			texel[2] = isWhite ? 230 : 160;
+			texel[3] = 255;
+		}
+	}
+	*pMipLevels = SRFullMipLevels(size, size);
+	return texels;
+}
+
+// the row-major mip chain the pages of a virtual texture are copied from
+struct PageSource {
+	std::vector<BYTE> Texels;
+	size_t Offsets[SRMaxMipLevels];
+	UINT Size;
+};
+
+static bool PageFault(void* pContext, UINT /*handle*/, const SRVirtualPage& page, BYTE* pPage) {
+	const PageSource& source = *static_cast<const PageSource*>(pContext);
+	const UINT levelSize = (std::max)(source.Size >> page.Level, 1u);
+	const UINT pageSide = page.RowPitch / 4;
+	for (UINT y = 0; y < page.Height; y++) {
+		const size_t texel = size_t(page.Y * pageSide + y) * levelSize + page.X * pageSide;
+		memcpy(pPage + y * page.RowPitch, source.Texels.data() + source.Offsets[page.Level] + texel * 4, page.Width * 4);
+	}
+	return true;
+}
+
+static XMFLOAT4X4 CameraMatrix(const Scene& scene, UINT width, UINT height) {
+	XMFLOAT4X4 matrix;
+	if (!scene.UseCamera) {
+		XMStoreFloat4x4(&matrix, XMMatrixIdentity());
+		return matrix;
+	}
+	// initial camera of the cube sample
+	const float theta = 0.5f * XM_PI, phi = XM_PIDIV2, radius = 5.0f;
+	XMMATRIX view = XMMatrixLookAtRH(
+		XMVectorSet(radius * sinf(phi) * cosf(theta), radius * cosf(phi), radius * sinf(phi) * sinf(theta), 1.0f),
+		XMVectorZero(),
+		XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX proj = XMMatrixPerspectiveFovRH(0.25f * XM_PI, float(width) / height, 1.0f, 1000.0f);
+	XMStoreFloat4x4(&matrix, view * proj);
+	return matrix;
+}
+
+// frame n of count of streamed_terrain, from 0.3 to 6 units away over the first half of the frames
+static XMFLOAT4X4 StreamedCameraMatrix(UINT n, UINT count, UINT width, UINT height, SRGeometryView& view) {
+	const float t = (std::min)(2.0f * n / count, 1.0f);
+	const float distance = 0.3f + 5.7f * t;
+	const float fovY = 0.25f * XM_PI;
+	XMVECTOR eye = XMVectorSet(0.0f, 0.3f + 0.6f * distance, -distance, 1.0f);
+	XMMATRIX viewProj = XMMatrixLookAtRH(eye, XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) *
+		XMMatrixPerspectiveFovRH(fovY, float(width) / height, 0.05f, 100.0f);
+	XMFLOAT4X4 matrix;
+	XMStoreFloat4x4(&matrix, viewProj);
+	view.WorldViewProj = matrix;
+	XMStoreFloat3(&view.Eye, eye);
+	view.PixelsPerUnit = height / (2.0f * tanf(0.5f * fovY));
+	return matrix;
+}
+
+// frame n of virtual_floor, a unit above the floor and moving forward a quarter unit per frame
+static XMFLOAT4X4 FloorCameraMatrix(UINT n, UINT width, UINT height) {
+	const float z = 2.0f - 0.25f * n;
+	XMMATRIX view = XMMatrixLookAtRH(XMVectorSet(0.0f, 0.0f, z, 1.0f), XMVectorSet(0.0f, -0.5f, z - 4.0f, 1.0f),
+		XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX proj = XMMatrixPerspectiveFovRH(0.25f * XM_PI, float(width) / height, 0.1f, 1000.0f);
+	XMFLOAT4X4 matrix;
+	XMStoreFloat4x4(&matrix, view * proj);
+	return matrix;
+}
+
+/*
+ * measurement
+ */
+struct Result {
+	std::string Scene;
+	UINT Width, Height;
+	UINT Threads;
+	UINT Frames;
+	double MinMs, MedianMs, P99Ms, MeanMs;
+	UINT64 Triangles;				// submitted per frame
+	UINT64 Checksum;				// of the render target after the last frame
+	SRRasterizerStatistics Stats;	// accumulated over the measured frames
+	SRPipelineStatistics Pipeline;	// ditto
+	SRTileOrder TileOrder;
+	SRTileScheduling TileScheduling;
+	UINT RecordThreads = 0;			// 0 for the immediate calls
+	bool Textured = false;
+	double GenerateMipsMs = 0.0;	// SRGenerateMips of the texture before the measured frames
+	bool Streamed = false;
+	UINT64 StreamBudget = 0;
+	SRGeometryStreamStatistics Stream;	// after the last frame
+	bool Virtual = false;
+	UINT64 PageBudget = 0;
+	SRVirtualTextureStatistics Pages;	// ditto
+};
+
+// FNV-1a over the row-major texels
+static UINT64 Checksum(SRDevice& device, SRResourceHandle target, UINT width, UINT height) {
+	std::vector<BYTE> texels(size_t(width) * height * 4);
+	device.SRCopyFromResource(target, texels.data(), UINT(texels.size()));
+	UINT64 hash = 14695981039346656037ull;
+	for (BYTE texel : texels) {
+		hash = (hash ^ texel) * 1099511628211ull;
+	}
+	return hash;
+}
+
+static bool RunScene(const Scene& scene, UINT width, UINT height, UINT threads,
+	UINT warmup, UINT frames, const SRRasterizerDesc& rasterizerDesc, UINT recordThreads, SRResourceLayout textureLayout, const char* tracePrefix, const char* heatmapPrefix,
+	const char* capturePrefix, const char* meshPrefix, UINT64 streamBudget, UINT64 pageBudget,
+	Result& result)
+{
+	SRDevice device;
+	if (!device.Initialize(threads))
+		return false;
+	device.SREnableDebugLayer();
+	device.SRSetRasterizerDesc(rasterizerDesc);
+	if (!device.SRAllocateResource(7))
+		return false;
+
+	SRResourceHandle target, depth, vertexBuffer, indexBuffer, constBuffer, texture, virtualTexture;
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT;
+	SRResourceDescription desc;
+	desc.DIMENSION = SRResourceDimensionTexture2D;
+	desc.FORMAT = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.WIDTH = width;
+	desc.HEIGHT = height;
+	desc.DEPTH = 1;
+	if (!device.SRCreateResource(desc, &target))
+		return false;
+	desc.FORMAT = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	if (!device.SRCreateResource(desc, &depth))
+		return false;
+
+	desc.DIMENSION = SRResourceDimensionBuffer;
+	desc.FORMAT = DXGI_FORMAT_UNKNOWN;
+	desc.HEIGHT = 1;
+	std::unique_ptr<SRGeometryStream> stream;
+	char clusterName[512];
+	if (scene.Streamed) {
+		// the stream binds its pool as the vertex and index buffers
+		snprintf(clusterName, sizeof(clusterName), "%s_%s.srcl", meshPrefix != nullptr ? meshPrefix : "SRBenchmark", scene.Name);
+		SRMeshFileDesc meshDesc;
+		meshDesc.pStreams[0] = scene.Vertices.data();
+		meshDesc.StreamStrides[0] = sizeof(Vertex);
+		meshDesc.VertexCount = UINT(scene.Vertices.size());
+		meshDesc.pIndices = scene.Indices.data();
+		meshDesc.IndexCount = UINT(scene.Indices.size());
+		SRGeometryStreamDesc streamDesc;
+		streamDesc.MemoryBudget = streamBudget;
+		stream.reset(new SRGeometryStream(device));
+		if (!SRWriteClusterFile(clusterName, meshDesc) || !stream->Open(clusterName, streamDesc))
+			return false;
+	}
+	else if (meshPrefix != nullptr && !scene.Indices.empty()) {
+		char meshName[512];
+		snprintf(meshName, sizeof(meshName), "%s_%s.srmf", meshPrefix, scene.Name);
+		SRMeshFileDesc meshDesc;
+		meshDesc.pStreams[0] = scene.Vertices.data();
+		meshDesc.StreamStrides[0] = sizeof(Vertex);
+		meshDesc.VertexCount = UINT(scene.Vertices.size());
+		meshDesc.IndexCount = UINT(scene.Indices.size());
+		std::vector<UINT16> shortIndices;
+		if (scene.Vertices.size() <= 0x10000) {
+			shortIndices.assign(scene.Indices.begin(), scene.Indices.end());
+			meshDesc.pIndices = shortIndices.data();
+			meshDesc.IndexFormat = DXGI_FORMAT_R16_UINT;
+		}
+		else {
+			meshDesc.pIndices = scene.Indices.data();
+		}
+		SRMesh mesh;
+		if (!SRWriteMeshFile(meshName, meshDesc) || !device.SRLoadMeshFile(meshName, &mesh))
+			return false;
+		vertexBuffer = mesh.Streams[0];
+		indexBuffer = mesh.IndexBuffer;
+		indexFormat = mesh.IndexFormat;
+		device.SRIASetVertexBuffers(vertexBuffer);
+		device.SRIASetIndexBuffers(indexBuffer, indexFormat);
+	}
+	else {
+		desc.WIDTH = UINT(scene.Vertices.size() * sizeof(Vertex));
+		if (!device.SRCreateResource(desc, &vertexBuffer))
+			return false;
+		device.SRCopyToResource(vertexBuffer, scene.Vertices.data(), desc.WIDTH);
+		device.SRIASetVertexBuffers(vertexBuffer);
+	}
+
+	if (!scene.Indices.empty() && meshPrefix == nullptr && !scene.Streamed) {
+		desc.WIDTH = UINT(scene.Indices.size() * sizeof(UINT32));
+		if (!device.SRCreateResource(desc, &indexBuffer))
+			return false;
+		device.SRCopyToResource(indexBuffer, scene.Indices.data(), desc.WIDTH);
+		device.SRIASetIndexBuffers(indexBuffer);
+	}
+
+	XMFLOAT4X4 camera = CameraMatrix(scene, width, height);
+	desc.WIDTH = UINT(sizeof(camera));
+	if (!device.SRCreateResource(desc, &constBuffer))
+		return false;
+	device.SRCopyToResource(constBuffer, &camera, sizeof(camera));
+	device.SRIASetConstantBuffers(0, constBuffer);
+
+	PageSource pageSource;
+	if (scene.Textured) {
+		const UINT textureSize = scene.Virtual ? 2048 : 256;
+		std::vector<BYTE> texels = CreateCheckerTexture(textureSize, &desc.MIPLEVELS);
+		desc.DIMENSION = SRResourceDimensionTexture2D;
+		desc.FORMAT = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.WIDTH = textureSize;
+		desc.HEIGHT = textureSize;
+		desc.LAYOUT = textureLayout;
+		if (!device.SRCreateResource(desc, &texture))
+			return false;
+		device.SRCopyToResource(texture, texels.data(), UINT(texels.size()));
+		if (!device.SRGenerateMips(texture))
+			return false;
+		device.SRPSSetShaderResources(0, texture);
+		device.SRPSSetSamplers(0, SRSamplerDesc());
+	}
+	if (scene.Virtual) {
+		// the pages are copied from the mips of the resident texture
+		pageSource.Size = desc.WIDTH;
+		pageSource.Texels.resize(SRTextureLayout(desc.DIMENSION, desc.FORMAT, desc.WIDTH, desc.HEIGHT, 1, desc.MIPLEVELS,
+			SRResourceLayoutRowMajor, pageSource.Offsets));
+		device.SRCopyFromResource(texture, pageSource.Texels.data(), UINT(pageSource.Texels.size()));
+		desc.LAYOUT = SRResourceLayoutVirtual;
+		if (!device.SRCreateResource(desc, &virtualTexture))
+			return false;
+		SRVirtualTextureDesc virtualDesc;
+		virtualDesc.MemoryBudget = pageBudget;
+		virtualDesc.PageFault = &PageFault;
+		virtualDesc.pContext = &pageSource;
+		device.SRSetVirtualTextureDesc(virtualDesc);
+		device.SRPSSetShaderResources(0, virtualTexture);
+	}
+
+	SRPipelineState pso;
+	pso.VSInputByteStride = sizeof(Vertex);
+	pso.VSOutputByteCount = 8 * sizeof(float);
+	pso.VS = &BenchVS;
+	pso.PS = &BenchPS;
+	pso.NumConstantBuffer = 1;
+	if (scene.Textured) {
+		pso.PS = &BenchTexturedPS;
+		pso.NumShaderResources = 1;
+		pso.NumSamplers = 1;
+		pso.PSDerivativeCount = 2;
+	}
+	pso.EnableZPrePass = true;
+	device.SRSetPipelineState(pso);
+
+	device.SREnableTileHeatmap(heatmapPrefix != nullptr);
+
+	const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	UINT frameIndex = 0;
+	auto frame = [&]() {
+		device.SRClearRenderTargetView(target, clearColor);
+		device.SRClearDepthStencilView(depth, SRClearFlagDepthStencil, 1.0f, 0);
+		device.SROMSetRenderTarget(target, depth, true);
+		if (scene.Streamed) {
+			SRGeometryView view;
+			camera = StreamedCameraMatrix(frameIndex++, warmup + frames, width, height, view);
+			device.SRCopyToResource(constBuffer, &camera, sizeof(camera));
+			stream->Update(view);
+			stream->Draw();
+		}
+		else if (scene.Virtual) {
+			camera = FloorCameraMatrix(frameIndex++, width, height);
+			device.SRCopyToResource(constBuffer, &camera, sizeof(camera));
+			device.SRDrawIndexedInstanced(UINT(scene.Indices.size()), 1, 0, 0, 0);
+		}
+		else if (scene.Indices.empty())
+			device.SRDrawInstanced(UINT(scene.Vertices.size()), 1, 0, 0);
+		else
+			device.SRDrawIndexedInstanced(UINT(scene.Indices.size()), 1, 0, 0, 0);
+		device.SREndFrame();
+	};
+
+	// the same frame recorded into lists, two sets of them to record one while the other is played back
+	if (scene.Streamed || scene.Virtual)
+		recordThreads = 0;
+	std::vector<std::unique_ptr<SRCommandList>> lists;
+	for (UINT i = 0; i < 2 * recordThreads; i++) {
+		lists.emplace_back(new SRCommandList(device));
+	}
+	std::unique_ptr<SRCommandQueue> queue;
+	if (recordThreads != 0)
+		queue.reset(new SRCommandQueue(device));
+	SRFence fence;
+	UINT64 fenceValue = 0;
+	bool isRecorded = true;
+	auto record = [&](SRCommandList& list, UINT part) {
+		list.SRReset();
+		if (part == 0) {
+			list.SRClearRenderTargetView(target, clearColor);
+			list.SRClearDepthStencilView(depth, SRClearFlagDepthStencil, 1.0f, 0);
+		}
+		list.SROMSetRenderTarget(target, depth, part == 0);
+		list.SRSetPipelineState(pso);
+		list.SRIASetVertexBuffers(vertexBuffer);
+		list.SRIASetConstantBuffers(0, constBuffer);
+		if (scene.Textured) {
+			list.SRPSSetShaderResources(0, texture);
+			list.SRPSSetSamplers(0, SRSamplerDesc());
+		}
+		// a contiguous share of the triangles per list, played back in order
+		const UINT triangles = UINT((scene.Indices.empty() ? scene.Vertices.size() : scene.Indices.size()) / 3);
+		const UINT begin = UINT(UINT64(triangles) * part / recordThreads) * 3;
+		const UINT end = UINT(UINT64(triangles) * (part + 1) / recordThreads) * 3;
+		if (scene.Indices.empty()) {
+			list.SRDrawInstanced(end - begin, 1, begin, 0);
+		}
+		else {
+			list.SRIASetIndexBuffers(indexBuffer, indexFormat);
+			list.SRDrawIndexedInstanced(end - begin, 1, begin, 0, 0);
+		}
+		return list.SRClose();
+	};
+	auto queueFrame = [&]() {
+		// the set of frame N - 2
+		if (fenceValue >= 2)
+			fence.SRWait(fenceValue - 1);
+		std::vector<SRCommandList*> set(recordThreads);
+		for (UINT part = 0; part < recordThreads; part++) {
+			set[part] = lists[(fenceValue % 2) * recordThreads + part].get();
+		}
+		std::vector<std::thread> recorders;
+		std::vector<char> isClosed(recordThreads);
+		for (UINT part = 1; part < recordThreads; part++) {
+			recorders.emplace_back([&, part]() { isClosed[part] = record(*set[part], part); });
+		}
+		isClosed[0] = record(*set[0], 0);
+		for (auto& recorder : recorders) {
+			recorder.join();
+		}
+		isRecorded = isRecorded && std::find(isClosed.begin(), isClosed.end(), 0) == isClosed.end();
+		queue->SRExecuteCommandLists(recordThreads, set.data());
+		queue->SREndFrame();
+		queue->SRSignal(&fence, ++fenceValue);
+	};
+	std::function<void()> runFrame = frame;
+	if (queue != nullptr)
+		runFrame = queueFrame;
+
+	for (UINT n = 0; n < warmup; n++) {
+		runFrame();
+	}
+	// the statistics belong to the device until the warmup frames are done
+	if (queue != nullptr)
+		queue->SRFlush();
+	if (queue != nullptr) {
+		// both clear the target before their invalid call, which would change the checksum if they were played back
+		const UINT64 checksum = Checksum(device, target, width, height);
+		const float rejectedColor[4] = { 1.0f, 0.0f, 1.0f, 1.0f };
+		SRCommandList badHandle(device), noPipeline(device);
+		SRCommandList* rejected[] = { &badHandle, &noPipeline };
+		for (SRCommandList* list : rejected) {
+			list->SRClearRenderTargetView(target, rejectedColor);
+			list->SROMSetRenderTarget(target, depth, false);
+		}
+		badHandle.SRSetPipelineState(pso);
+		badHandle.SRIASetVertexBuffers(SRResourceHandle(1000));
+		badHandle.SRDrawInstanced(3, 1, 0, 0);
+		noPipeline.SRIASetVertexBuffers(vertexBuffer);
+		noPipeline.SRDrawInstanced(3, 1, 0, 0);
+		const bool isRejected = !badHandle.SRClose() && !noPipeline.SRClose();
+		queue->SRExecuteCommandLists(2, rejected);
+		queue->SRFlush();
+		if (!isRejected || Checksum(device, target, width, height) != checksum) {
+			fprintf(stderr, "%s: invalid command lists were played back\n", scene.Name);
+			return false;
+		}
+	}
+	device.SRResetRasterizerStatistics();
+	device.SRBeginPipelineStatisticsQuery();
+	if (tracePrefix != nullptr) {
+		char traceName[512];
+		snprintf(traceName, sizeof(traceName), "%s_%s_%ux%u_%u.json", tracePrefix, scene.Name, width, height, threads);
+		if (!device.SRBeginTrace(traceName))
+			return false;
+	}
+	SRShaderRegistry registry;
+	RegisterBenchmarkShaders(registry);
+	if (capturePrefix != nullptr) {
+		char captureName[512];
+		snprintf(captureName, sizeof(captureName), "%s_%s_%ux%u_%u.srcap", capturePrefix, scene.Name, width, height, threads);
+		if (!device.SRBeginCapture(captureName, &registry))
+			return false;
+	}
+
+	// generated again from the same level 0, timed and traced / captured with the measured frames
+	if (scene.Textured) {
+		auto start = std::chrono::steady_clock::now();
+		device.SRGenerateMips(texture);
+		result.Textured = true;
+		result.GenerateMipsMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	std::vector<double> times(frames);
+	for (UINT n = 0; n < frames; n++) {
+		auto start = std::chrono::steady_clock::now();
+		runFrame();
+		times[n] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	if (queue != nullptr)
+		queue->SRFlush();
+	device.SREndPipelineStatisticsQuery(&result.Pipeline);
+	device.SREndTrace();
+	device.SREndCapture();
+	if (heatmapPrefix != nullptr) {
+		char heatmapName[512];
+		snprintf(heatmapName, sizeof(heatmapName), "%s_%s_%ux%u_%u.csv", heatmapPrefix, scene.Name, width, height, threads);
+		if (!device.SRSaveTileHeatmap(heatmapName, SRHeatmapCounterCycles, SRHeatmapFormatCSV))
+			return false;
+		snprintf(heatmapName, sizeof(heatmapName), "%s_%s_%ux%u_%u.ppm", heatmapPrefix, scene.Name, width, height, threads);
+		if (!device.SRSaveTileHeatmap(heatmapName, SRHeatmapCounterCycles, SRHeatmapFormatFalseColor))
+			return false;
+	}
+
+	result.Scene = scene.Name;
+	result.Width = width;
+	result.Height = height;
+	result.Threads = threads != 0 ? threads : SRThreadPool::DefaultThreadCount();
+	result.Frames = frames;
+	result.TileOrder = rasterizerDesc.TileOrder;
+	result.TileScheduling = rasterizerDesc.TileScheduling;
+	result.MeanMs = 0.0;
+	for (double t : times) {
+		result.MeanMs += t;
+	}
+	result.MeanMs /= frames;
+	std::sort(times.begin(), times.end());
+	result.MinMs = times.front();
+	result.MedianMs = frames % 2 == 1 ? times[frames / 2] : 0.5 * (times[frames / 2 - 1] + times[frames / 2]);
+	result.P99Ms = times[std::min(frames - 1, UINT(ceil(0.99 * frames)) - 1)];
+	result.Triangles = (scene.Indices.empty() ? scene.Vertices.size() : scene.Indices.size()) / 3;
+	result.Checksum = Checksum(device, target, width, height);
+	device.SRGetRasterizerStatistics(&result.Stats);
+	result.RecordThreads = recordThreads;
+	if (queue != nullptr) {
+		// the lists against the immediate calls
+		if (!isRecorded) {
+			fprintf(stderr, "%s: a command list failed its validation\n", scene.Name);
+			return false;
+		}
+		frame();
+		if (Checksum(device, target, width, height) != result.Checksum) {
+			fprintf(stderr, "%s: the command lists and the immediate calls differ\n", scene.Name);
+			return false;
+		}
+	}
+	if (scene.Streamed) {
+		result.Streamed = true;
+		result.StreamBudget = streamBudget;
+		stream->GetStatistics(&result.Stream);
+		result.Triangles = result.Stream.SelectedTriangles;
+		stream.reset();
+		if (meshPrefix == nullptr)
+			remove(clusterName);
+	}
+	if (scene.Virtual) {
+		result.Virtual = true;
+		result.PageBudget = pageBudget;
+		device.SRGetVirtualTextureStatistics(&result.Pages);
+	}
+	return true;
+}
+
+/*
+ * command line
+ */
+static std::vector<std::string> Split(const char* list) {
+	std::vector<std::string> items;
+	std::string item;
+	for (const char* c = list; ; c++) {
+		if (*c == ',' || *c == '\0') {
+			if (!item.empty())
+				items.push_back(item);
+			item.clear();
+			if (*c == '\0')
+				break;
+		}
+		else {
+			item += *c;
+		}
+	}
+	return items;
+}
+
+static const char* TileOrderNames[] = { "zigzag", "morton", "hilbert" };
+static const char* TileSchedulingNames[] = { "static", "cost-history" };
+
+// index of name in names
+template <size_t N>
+static bool ParseName(const char* name, const char* const (&names)[N], UINT* pIndex) {
+	for (UINT i = 0; i < N; i++) {
+		if (strcmp(name, names[i]) == 0) {
+			*pIndex = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void WriteResult(FILE* file, const Result& r, bool last) {
+	double seconds = r.MedianMs / 1000.0;
+	fprintf(file,
+		"    {\"scene\": \"%s\", \"width\": %u, \"height\": %u, \"threads\": %u, \"frames\": %u, \"checksum\": \"%016llx\",\n"
+		"     \"submit\": \"%s\", \"record_threads\": %u,\n"
+		"     \"frame_ms\": {\"min\": %.4f, \"median\": %.4f, \"p99\": %.4f, \"mean\": %.4f},\n"
+		"     \"triangles_per_frame\": %llu, \"triangles_per_second\": %.1f, \"pixels_per_second\": %.1f,\n"
+		"     \"rasterizer\": {\"tile_order\": \"%s\", \"tile_scheduling\": \"%s\", \"small\": %llu, \"tiled\": %llu, "
+		"\"inline\": %llu, \"batched\": %llu, \"batches\": %llu, \"pipelined\": %llu},\n"
+		"     \"pipeline\": {\"ia_vertices\": %llu, \"ia_primitives\": %llu, \"vs_invocations\": %llu, "
+		"\"c_invocations\": %llu, \"c_primitives\": %llu, \"ps_invocations\": %llu, \"near_plane_clipped\": %llu, "
+		"\"culled\": %llu, \"tiles_tested\": %llu, \"tiles_rejected_edge\": %llu, \"tiles_rejected_hiz\": %llu, "
+		"\"pixels_depth_clipped\": %llu, \"pixels_zprepass_failed\": %llu, \"pixels_depth_failed\": %llu, "
+		"\"pixels_written\": %llu}",
+		r.Scene.c_str(), r.Width, r.Height, r.Threads, r.Frames, (unsigned long long)r.Checksum,
+		r.RecordThreads != 0 ? "queue" : "immediate", r.RecordThreads,
+		r.MinMs, r.MedianMs, r.P99Ms, r.MeanMs,
+		(unsigned long long)r.Triangles, r.Triangles / seconds, double(r.Width) * r.Height / seconds,
+		TileOrderNames[r.TileOrder], TileSchedulingNames[r.TileScheduling], (unsigned long long)r.Stats.SmallTriangles, (unsigned long long)r.Stats.TiledTriangles,
+		(unsigned long long)r.Stats.InlineTriangles, (unsigned long long)r.Stats.BatchedTriangles,
+		(unsigned long long)r.Stats.Batches, (unsigned long long)r.Stats.PipelinedTriangles,
+		(unsigned long long)r.Pipeline.IAVertices, (unsigned long long)r.Pipeline.IAPrimitives,
+		(unsigned long long)r.Pipeline.VSInvocations, (unsigned long long)r.Pipeline.CInvocations,
+		(unsigned long long)r.Pipeline.CPrimitives, (unsigned long long)r.Pipeline.PSInvocations,
+		(unsigned long long)r.Pipeline.NearPlaneClippedPrimitives, (unsigned long long)r.Pipeline.CulledPrimitives,
+		(unsigned long long)r.Pipeline.TilesTested, (unsigned long long)r.Pipeline.TilesRejectedByEdge,
+		(unsigned long long)r.Pipeline.TilesRejectedByHiZ, (unsigned long long)r.Pipeline.DepthClippedPixels,
+		(unsigned long long)r.Pipeline.ZPrePassFailedPixels, (unsigned long long)r.Pipeline.DepthTestFailedPixels,
+		(unsigned long long)r.Pipeline.PixelsWritten);
+	if (r.Streamed) {
+		fprintf(file,
+			",\n     \"stream\": {\"budget\": %llu, \"resident_nodes\": %llu, \"resident_bytes\": %llu, \"loads\": %llu, "
+			"\"failed_loads\": %llu, \"evictions\": %llu, \"pending_loads\": %llu, \"selected_nodes\": %llu, "
+			"\"selected_triangles\": %llu, \"missing_nodes\": %llu, \"coarse_nodes\": %llu}",
+			(unsigned long long)r.StreamBudget, (unsigned long long)r.Stream.ResidentNodes,
+			(unsigned long long)r.Stream.ResidentBytes, (unsigned long long)r.Stream.Loads,
+			(unsigned long long)r.Stream.FailedLoads, (unsigned long long)r.Stream.Evictions,
+			(unsigned long long)r.Stream.PendingLoads, (unsigned long long)r.Stream.SelectedNodes,
+			(unsigned long long)r.Stream.SelectedTriangles, (unsigned long long)r.Stream.MissingNodes,
+			(unsigned long long)r.Stream.CoarseNodes);
+	}
+	if (r.Virtual) {
+		fprintf(file,
+			",\n     \"virtual_texture\": {\"budget\": %llu, \"resident_pages\": %llu, \"resident_bytes\": %llu, "
+			"\"page_faults\": %llu, \"failed_page_faults\": %llu, \"evictions\": %llu, \"missing_pages\": %llu}",
+			(unsigned long long)r.PageBudget, (unsigned long long)r.Pages.ResidentPages,
+			(unsigned long long)r.Pages.ResidentBytes, (unsigned long long)r.Pages.PageFaults,
+			(unsigned long long)r.Pages.FailedPageFaults, (unsigned long long)r.Pages.Evictions,
+			(unsigned long long)r.Pages.MissingPages);
+	}
+	if (r.Textured)
+		fprintf(file, ",\n     \"texture\": {\"generate_mips_ms\": %.4f}", r.GenerateMipsMs);
+	fprintf(file, "}%s\n", last ? "" : ",");
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> sceneNames;
+	std::vector<std::string> resolutions = { "800x600", "1920x1080" };
+	std::vector<std::string> threadCounts = { "1", "0" };
+	UINT frames = 50;
+	UINT warmup = 5;
+	const char* output = nullptr;
+	const char* tracePrefix = nullptr;
+	const char* heatmapPrefix = nullptr;
+	const char* capturePrefix = nullptr;
+	const char* meshPrefix = nullptr;
+	UINT64 streamBudget = UINT64(1) << 20;
+	UINT64 pageBudget = UINT64(4) << 20;
+	SRRasterizerDesc rasterizerDesc;
+	bool isQueued = false;
+	UINT recordThreads = 1;
+	SRResourceLayout textureLayout = SRResourceLayoutSwizzled;
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		UINT index = 0;
+		if (strcmp(argv[i], "--scenes") == 0 && hasValue)
+			sceneNames = Split(argv[++i]);
+		else if (strcmp(argv[i], "--resolutions") == 0 && hasValue)
+			resolutions = Split(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+			threadCounts = Split(argv[++i]);
+		else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+			frames = UINT(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+			warmup = UINT(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--output") == 0 && hasValue)
+			output = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+			tracePrefix = argv[++i];
+		else if (strcmp(argv[i], "--heatmap") == 0 && hasValue)
+			heatmapPrefix = argv[++i];
+		else if (strcmp(argv[i], "--capture") == 0 && hasValue)
+			capturePrefix = argv[++i];
+		else if (strcmp(argv[i], "--pipeline") == 0 && hasValue)
+			rasterizerDesc.PipelineDepth = UINT(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--tile-order") == 0 && hasValue && ParseName(argv[++i], TileOrderNames, &index))
+			rasterizerDesc.TileOrder = SRTileOrder(index);
+		else if (strcmp(argv[i], "--tile-scheduling") == 0 && hasValue && ParseName(argv[++i], TileSchedulingNames, &index))
+			rasterizerDesc.TileScheduling = SRTileScheduling(index);
+		else if (strcmp(argv[i], "--linear-textures") == 0)
+			textureLayout = SRResourceLayoutRowMajor;
+		else if (strcmp(argv[i], "--mesh-files") == 0 && hasValue)
+			meshPrefix = argv[++i];
+		else if (strcmp(argv[i], "--stream-budget") == 0 && hasValue)
+			streamBudget = UINT64(atoll(argv[++i]));
+		else if (strcmp(argv[i], "--submit") == 0 && hasValue && (strcmp(argv[i + 1], "immediate") == 0 || strcmp(argv[i + 1], "queue") == 0))
+			isQueued = strcmp(argv[++i], "queue") == 0;
+		else if (strcmp(argv[i], "--record-threads") == 0 && hasValue)
+			recordThreads = (std::max)(UINT(atoi(argv[++i])), 1u);
+		else if (strcmp(argv[i], "--page-budget") == 0 && hasValue)
+			pageBudget = UINT64(atoll(argv[++i]));
+		else {
+			fprintf(stderr, "usage: %s [--scenes a,b] [--resolutions WxH,...] [--threads n,...] "
+				"[--frames N] [--warmup N] [--output file.json] [--trace prefix] [--heatmap prefix] [--capture prefix] "
+				"[--pipeline depth] [--linear-textures] [--mesh-files prefix] [--stream-budget bytes] "
+				"[--tile-order zigzag|morton|hilbert] [--tile-scheduling static|cost-history] "
+				"[--page-budget bytes] [--submit immediate|queue] [--record-threads N]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (frames == 0)
+		frames = 1;
+
+	std::vector<std::function<Scene()>> factories = {
+		CreateCube, CreateTestDepth, CreateSmallTriangles, CreateOverdraw, CreateThinTriangles, CreateTexturedFloor,
+		CreateVirtualFloor, CreateStreamedTerrain
+	};
+
+	std::vector<Result> results;
+	for (auto& factory : factories) {
+		Scene scene = factory();
+		if (!sceneNames.empty() &&
+			std::find(sceneNames.begin(), sceneNames.end(), scene.Name) == sceneNames.end())
+			continue;
+
+		for (auto& resolution : resolutions) {
+			UINT width = 0, height = 0;
+			if (sscanf(resolution.c_str(), "%ux%u", &width, &height) != 2 || width == 0 || height == 0) {
+				fprintf(stderr, "invalid resolution %s\n", resolution.c_str());
+				return 1;
+			}
+			for (auto& threads : threadCounts) {
+				Result result;
+				if (!RunScene(scene, width, height, UINT(atoi(threads.c_str())), warmup, frames, rasterizerDesc, isQueued ? recordThreads : 0,
+					textureLayout, tracePrefix, heatmapPrefix, capturePrefix, meshPrefix, streamBudget, pageBudget, result)) {
+					fprintf(stderr, "%s %s failed\n", scene.Name, resolution.c_str());
+					return 1;
+				}
+				fprintf(stderr, "%-20s %5ux%-5u %2u threads  median %8.3f ms\n",
+					scene.Name, width, height, result.Threads, result.MedianMs);
+				results.push_back(result);
+			}
+		}
+	}
+
+	FILE* file = output != nullptr ? fopen(output, "w") : stdout;
+	if (file == nullptr) {
+		fprintf(stderr, "unable to open %s\n", output);
+		return 1;
+	}
+	fprintf(file, "{\n  \"hardware_threads\": %u,\n  \"results\": [\n", SRThreadPool::DefaultThreadCount());
+	for (size_t i = 0; i < results.size(); i++) {
+		WriteResult(file, results[i], i + 1 == results.size());
+	}
+	fprintf(file, "  ]\n}\n");
+	if (file != stdout)
+		fclose(file);
+	return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+/*
+ * Shaders of the frame benchmark, shared with the replay tool
+ * which has to find them by the names of the capture.
+ */
+#include "SRCapture.h"
+
+struct Vertex {
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT4 Color;
+};
+
+inline void BenchVS(const BYTE* vsInput, BYTE* vsOutput, const BYTE*const* constBuffer) {
+	using namespace DirectX;
+	XMFLOAT4* posH = reinterpret_cast<XMFLOAT4*>(vsOutput);
+	XMFLOAT4* color = reinterpret_cast<XMFLOAT4*>(vsOutput + sizeof(XMFLOAT4));
+	const Vertex& vertex = *reinterpret_cast<const Vertex*>(vsInput);
+	const XMFLOAT4X4& WVP = *reinterpret_cast<const XMFLOAT4X4*>(constBuffer[0]);
+
+	XMStoreFloat4(posH, XMVector4Transform(XMVectorSet(vertex.Pos.x, vertex.Pos.y, vertex.Pos.z, 1.0f), XMLoadFloat4x4(&WVP)));
+	*color = vertex.Color;
+}
+
+inline void BenchPS(BYTE* psInput, DirectX::XMFLOAT4* pixelColor, const BYTE*const* constBuffer) {
+	*pixelColor = *reinterpret_cast<DirectX::XMFLOAT4*>(psInput + sizeof(DirectX::XMFLOAT4));
+}
+
+// Color.xy is the uv of the texture in slot 0, its derivatives follow the 4 attributes.
+inline void BenchTexturedPS(BYTE* psInput, DirectX::XMFLOAT4* pixelColor, const BYTE*const* constBuffer) {
+	using namespace DirectX;
+	const float* input = reinterpret_cast<const float*>(psInput);
+	const SRTextureView& texture = *reinterpret_cast<const SRTextureView*>(constBuffer[1]);
+	const SRSamplerDesc& sampler = *reinterpret_cast<const SRSamplerDesc*>(constBuffer[2]);
+	XMStoreFloat4(pixelColor, SRSampleGrad(texture, sampler,
+		XMFLOAT2(input[4], input[5]), XMFLOAT2(input[8], input[9]), XMFLOAT2(input[10], input[11])));
+}
+
+inline void RegisterBenchmarkShaders(SRShaderRegistry& registry) {
+	registry.Register("BenchVS", &BenchVS);
+	registry.Register("BenchPS", &BenchPS);
+	registry.Register("BenchTexturedPS", &BenchTexturedPS);
+}
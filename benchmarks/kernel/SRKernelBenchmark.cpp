@@ -0,0 +1,836 @@
+/*
+ * Microbenchmarks of the rasterizer building blocks.
+ * Every kernel runs over a pre-generated input set until --min-time is reached,
+ * and reports ns/op and cycles/op (rdtsc) as JSON.
+ *
+ * usage: SRKernelBenchmark [--kernels a,b] [--size tiny|small|medium|large|thin|mixed]
+ *                          [--perspective] [--resolution WxH] [--count N] [--attributes N]
+ *                          [--threads N] [--min-time seconds] [--seed N] [--output file.json]
+ *
+ * --size        screen space extent of the generated triangles, mixed picks one per triangle
+ * --perspective random w in [1, 8] instead of w = 1
+ * --count       size of the input set
+ * --attributes  floats interpolated after SV_POSITION
+ * --threads     worker threads of the device used for the clears and InitHiZCache
+ *
+ * sample_cube_quad and sample_volume_quad check their quads against the single lookups at level 0 first.
+ * heap_churn replays 200k random allocate / reallocate / free calls on an SRHeap. they are run once
+ * with every block tagged and checked (alignment, no overlap, contents kept by Reallocate, all freed)
+ * before being timed, the benchmark fails if a check does not hold.
+ */
+#include "SRDevice.h"
+#include "SRUtils.h"
+#include "SRDraw.inl"
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * input generation
+ */
+enum TriangleSize {
+	TriangleSizeTiny = 0,		// 1 - 2 pixels, many cover no pixel center
+	TriangleSizeSmall = 1,		// 2 - 8 pixels, inside one or a few tiles
+	TriangleSizeMedium = 2,		// 8 - 64 pixels
+	TriangleSizeLarge = 3,		// 64 - 512 pixels
+	TriangleSizeThin = 4,		// half the screen long, about a pixel wide
+	TriangleSizeMixed = 5
+};
+
+static const char* SizeNames[] = { "tiny", "small", "medium", "large", "thin", "mixed" };
+
+struct Config {
+	std::vector<std::string> Kernels;
+	TriangleSize Size = TriangleSizeMixed;
+	bool Perspective = false;
+	UINT Width = 1920;
+	UINT Height = 1080;
+	UINT Count = 4096;
+	UINT Attributes = 4;
+	UINT Threads = 1;
+	double MinTime = 0.2;
+	UINT Seed = 1;
+};
+
+// vsOutput of one triangle, SV_POSITION followed by the attributes
+struct TriangleInput {
+	std::vector<float> Vertices[3];
+};
+
+static std::vector<TriangleInput> GenerateTriangles(const Config& config, std::mt19937& random) {
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<TriangleInput> triangles(config.Count);
+	const float W = float(config.Width), H = float(config.Height);
+
+	for (auto& triangle : triangles) {
+		TriangleSize size = config.Size;
+		if (size == TriangleSizeMixed)
+			size = TriangleSize(random() % TriangleSizeMixed);
+
+		float cx = unit(random) * W;
+		float cy = unit(random) * H;
+		float sx[3], sy[3];
+		if (size == TriangleSizeThin) {
+			float angle = unit(random) * 6.2831853f;
+			float length = 0.25f * (std::min)(W, H);
+			float dx = cosf(angle), dy = sinf(angle);
+			sx[0] = cx - dx * length;	sy[0] = cy - dy * length;
+			sx[1] = cx + dx * length;	sy[1] = cy + dy * length;
+			sx[2] = cx - dy;			sy[2] = cy + dx;
+		}
+		else {
+			static const float MinExtent[] = { 1.0f, 2.0f, 8.0f, 64.0f };
+			static const float MaxExtent[] = { 2.0f, 8.0f, 64.0f, 512.0f };
+			float extent = MinExtent[size] + unit(random) * (MaxExtent[size] - MinExtent[size]);
+			for (int v = 0; v < 3; v++) {
+				float angle = unit(random) * 6.2831853f;
+				sx[v] = cx + 0.5f * extent * cosf(angle);
+				sy[v] = cy + 0.5f * extent * sinf(angle);
+			}
+		}
+
+		// keep the winding the rasterizer does not cull
+		float cross = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+		if (cross > 0.0f) {
+			std::swap(sx[1], sx[2]);
+			std::swap(sy[1], sy[2]);
+		}
+
+		for (int v = 0; v < 3; v++) {
+			float w = config.Perspective ? 1.0f + 7.0f * unit(random) : 1.0f;
+			auto& vertex = triangle.Vertices[v];
+			vertex.resize(4 + config.Attributes);
+			vertex[0] = (sx[v] / W * 2.0f - 1.0f) * w;
+			vertex[1] = (1.0f - sy[v] / H * 2.0f) * w;
+			vertex[2] = unit(random) * w;
+			vertex[3] = w;
+			for (UINT a = 0; a < config.Attributes; a++) {
+				vertex[4 + a] = unit(random);
+			}
+		}
+	}
+	return triangles;
+}
+
+/*
+ * measurement
+ */
+struct KernelResult {
+	const char* Name;
+	const char* Op;
+	UINT64 Ops;
+	double NsPerOp;
+	double CyclesPerOp;
+};
+
+// run pass() until minTime is reached, every pass performs opsPerPass ops.
+template<typename Pass>
+static KernelResult Measure(const char* name, const char* op, UINT64 opsPerPass, double minTime, Pass pass) {
+	// warm up the caches and the branch predictors
+	pass();
+
+	UINT64 ops = 0;
+	UINT64 cycles = 0;
+	double seconds = 0.0;
+	do {
+		auto start = std::chrono::steady_clock::now();
+		UINT64 startCycle = readCycleCounter();
+		pass();
+		cycles += readCycleCounter() - startCycle;
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		ops += opsPerPass;
+	} while (seconds < minTime);
+
+	KernelResult result;
+	result.Name = name;
+	result.Op = op;
+	result.Ops = ops;
+	result.NsPerOp = seconds * 1e9 / ops;
+	result.CyclesPerOp = double(cycles) / ops;
+	return result;
+}
+
+// keeps the results of the kernels alive
+static volatile float gSink;
+
+static bool IsSelected(const Config& config, const char* name) {
+	if (config.Kernels.empty())
+		return true;
+	for (auto& kernel : config.Kernels) {
+		if (kernel == name)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * kernels
+ */
+static void BenchmarkRasterizer(const Config& config, std::mt19937& random, std::vector<KernelResult>& results) {
+	std::vector<TriangleInput> triangles = GenerateTriangles(config, random);
+	std::vector<XMFLOAT3> interpolateData(size_t(config.Count) * (std::max)(config.Attributes, 1u));
+	// SRTriangleSetup holds XMVECTORs, keep it aligned like the batch of SRDevice
+	SRTriangleSetup* setups = (SRTriangleSetup*)_aligned_malloc(config.Count * sizeof(SRTriangleSetup), 64);
+	for (UINT n = 0; n < config.Count; n++) {
+		setups[n].pRenderTarget = nullptr;
+		setups[n].pDepthStencil = nullptr;
+		setups[n].width = config.Width;
+		setups[n].height = config.Height;
+	}
+
+	if (IsSelected(config, "triangle_setup")) {
+		results.push_back(Measure("triangle_setup", "triangle", config.Count, config.MinTime, [&]() {
+			UINT culled = 0;
+			for (UINT n = 0; n < config.Count; n++) {
+				const TriangleInput& triangle = triangles[n];
+				if (!setupTriangle(
+					reinterpret_cast<const BYTE*>(triangle.Vertices[0].data()),
+					reinterpret_cast<const BYTE*>(triangle.Vertices[1].data()),
+					reinterpret_cast<const BYTE*>(triangle.Vertices[2].data()),
+					config.Attributes, &interpolateData[size_t(n) * config.Attributes], setups[n]))
+					culled++;
+			}
+			gSink = float(culled);
+		}));
+	}
+
+	// the following kernels work on the triangles surviving setup
+	std::vector<UINT> visible;
+	for (UINT n = 0; n < config.Count; n++) {
+		const TriangleInput& triangle = triangles[n];
+		if (setupTriangle(
+			reinterpret_cast<const BYTE*>(triangle.Vertices[0].data()),
+			reinterpret_cast<const BYTE*>(triangle.Vertices[1].data()),
+			reinterpret_cast<const BYTE*>(triangle.Vertices[2].data()),
+			config.Attributes, &interpolateData[size_t(n) * config.Attributes], setups[n]))
+			visible.push_back(n);
+	}
+	if (visible.empty()) {
+		fprintf(stderr, "every triangle is culled, skip the tile and pixel kernels\n");
+		_aligned_free(setups);
+		return;
+	}
+
+	// one tile and one pixel center in the bounding box of every triangle
+	std::vector<XMFLOAT2> tiles(visible.size());
+	std::vector<XMFLOAT2> pixels(visible.size());
+	for (size_t n = 0; n < visible.size(); n++) {
+		const SRTriangleSetup& setup = setups[visible[n]];
+		UINT i = setup.minX / 8 + random() % (setup.maxX / 8 - setup.minX / 8 + 1);
+		UINT j = setup.minY / 8 + random() % (setup.maxY / 8 - setup.minY / 8 + 1);
+		tiles[n] = XMFLOAT2(float(8 * i) + 0.5f, float(8 * j) + 0.5f);
+		UINT px = setup.minX + random() % (setup.maxX - setup.minX + 1);
+		UINT py = setup.minY + random() % (setup.maxY - setup.minY + 1);
+		pixels[n] = XMFLOAT2(float(px) + 0.5f, float(py) + 0.5f);
+	}
+
+	if (IsSelected(config, "tile_edge_test")) {
+		results.push_back(Measure("tile_edge_test", "tile", visible.size(), config.MinTime, [&]() {
+			UINT accepted = 0, covered = 0;
+			for (size_t n = 0; n < visible.size(); n++) {
+				const SRTriangleSetup& setup = setups[visible[n]];
+				XMMATRIX edgeXcornersT = XMMatrixTranspose(tileCornerEdges(setup, tiles[n].x, tiles[n].y));
+				XMVECTOR edgeMax = selectMaxCorner(edgeXcornersT, setup.cornerSelect1, setup.cornerSelect2);
+				if (isTopLeftMask(edgeMax, setup.topLeftMask) != 0xf)
+					continue;
+				accepted++;
+				XMVECTOR edgeMin = selectMinCorner(edgeXcornersT, setup.cornerSelect1, setup.cornerSelect2);
+				if (isTopLeftMask(edgeMin, setup.topLeftMask) == 0xf)
+					covered++;
+			}
+			gSink = float(accepted + covered);
+		}));
+	}
+
+	if (IsSelected(config, "pixel_interpolation")) {
+		std::vector<float> input(4 + config.Attributes);
+		results.push_back(Measure("pixel_interpolation", "pixel", visible.size(), config.MinTime, [&]() {
+			float sum = 0.0f;
+			for (size_t n = 0; n < visible.size(); n++) {
+				const SRTriangleSetup& setup = setups[visible[n]];
+				XMVECTOR ks = XMVectorAdd(setup.edgeC, XMVectorAdd(
+					XMVectorScale(setup.edgeA, pixels[n].x), XMVectorScale(setup.edgeB, pixels[n].y)));
+				input[0] = pixels[n].x;
+				input[1] = pixels[n].y;
+				XMVECTOR k = perspectiveBarycentric(setup, ks, input.data());
+				interpolateAttributes(setup, k, config.Attributes, input.data());
+				sum += input[2] + input[3 + config.Attributes];
+			}
+			gSink = sum;
+		}));
+	}
+
+	if (IsSelected(config, "interpolate_line")) {
+		// near plane clipping interpolates whole vsOutputs, 4 floats of SV_POSITION included
+		const int count = int(4 + config.Attributes);
+		std::vector<float> parameters(triangles.size());
+		for (auto& t : parameters) {
+			t = float(random() % 1024) / 1024.0f;
+		}
+		std::vector<float> output(count);
+		results.push_back(Measure("interpolate_line", "vertex", triangles.size(), config.MinTime, [&]() {
+			for (size_t n = 0; n < triangles.size(); n++) {
+				InterpolateLine(
+					reinterpret_cast<BYTE*>(triangles[n].Vertices[0].data()),
+					reinterpret_cast<BYTE*>(triangles[n].Vertices[1].data()),
+					parameters[n], count, reinterpret_cast<BYTE*>(output.data()));
+			}
+			gSink = output[0];
+		}));
+	}
+
+	_aligned_free(setups);
+}
+
+// bilinear lookups along oblique scanlines of a texture much larger than the caches,
+// RGBA8 in the row-major and the swizzled layout, then BC1 and BC3 decoded through the block cache,
+// then RGBA8 in fully populated virtual pages
+static void BenchmarkSampling(const Config& config, std::mt19937& random, std::vector<KernelResult>& results) {
+	const int Count = 5;
+	const char* Names[Count] = { "sample_bilinear_row_major", "sample_bilinear_swizzled", "sample_bilinear_bc1",
+		"sample_bilinear_bc3", "sample_bilinear_virtual" };
+	const SRResourceLayout Layouts[Count] = { SRResourceLayoutRowMajor, SRResourceLayoutSwizzled, SRResourceLayoutRowMajor,
+		SRResourceLayoutRowMajor, SRResourceLayoutVirtual };
+	const DXGI_FORMAT Formats[Count] = { DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_BC1_UNORM,
+		DXGI_FORMAT_BC3_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM };
+	bool isAnySelected = false;
+	for (int n = 0; n < Count; n++) {
+		isAnySelected |= IsSelected(config, Names[n]);
+	}
+	if (!isAnySelected)
+		return;
+
+	const UINT Size = 2048, Screen = 1024;
+	std::vector<UINT32> rowMajor(size_t(Size) * Size);
+	for (auto& texel : rowMajor) {
+		texel = UINT32(random());
+	}
+
+	// the scanlines run at 80 degrees across the texture, 1.5 texels per pixel
+	std::vector<XMFLOAT2> uvs(size_t(Screen) * Screen);
+	const float angle = 80.0f / 180.0f * 3.14159265f, step = 1.5f / Size;
+	for (UINT y = 0; y < Screen; y++) {
+		for (UINT x = 0; x < Screen; x++) {
+			uvs[size_t(y) * Screen + x] = XMFLOAT2(
+				0.1f + (x * cosf(angle) - y * sinf(angle)) * step,
+				0.1f + (x * sinf(angle) + y * cosf(angle)) * step);
+		}
+	}
+
+	SRSamplerDesc sampler;
+	sampler.Filter = SRFilterBilinear;
+	for (int n = 0; n < Count; n++) {
+		if (!IsSelected(config, Names[n]))
+			continue;
+		std::vector<BYTE> texels(SRTextureLayout(SRResourceDimensionTexture2D, Formats[n],
+			Size, Size, 1, 1, Layouts[n], nullptr));
+		// pages of the virtual texture, all populated
+		std::vector<std::vector<BYTE>> pages;
+		if (Layouts[n] == SRResourceLayoutVirtual) {
+			const UINT shift = SRVirtualPageShift(Formats[n]), side = 1u << shift, pagesPerRow = Size >> shift;
+			pages.resize(SRVirtualPageCount(Formats[n], Size, Size, 1, nullptr));
+			for (size_t page = 0; page < pages.size(); page++) {
+				pages[page].resize(SRVirtualPageSize);
+				const UINT x = UINT(page % pagesPerRow) * side, y = UINT(page / pagesPerRow) * side;
+				for (UINT row = 0; row < side; row++) {
+					memcpy(pages[page].data() + row * side * 4, &rowMajor[size_t(y + row) * Size + x], side * 4);
+				}
+				reinterpret_cast<BYTE**>(texels.data())[page] = pages[page].data();
+			}
+		}
+		else if (SRIsBlockCompressed(Formats[n])) {
+			// any bytes are valid blocks
+			for (auto& byte : texels) {
+				byte = BYTE(random());
+			}
+		}
+		else if (Layouts[n] == SRResourceLayoutSwizzled) {
+			for (UINT y = 0; y < Size; y++) {
+				SRSwizzleRow(texels.data(), reinterpret_cast<const BYTE*>(&rowMajor[size_t(y) * Size]), Size, 4, y, Size);
+			}
+		}
+		else {
+			memcpy(texels.data(), rowMajor.data(), texels.size());
+		}
+
+		SRTextureView view = {};
+		view.ptr = texels.data();
+		view.Width = Size;
+		view.Height = Size;
+		view.Depth = 1;
+		view.MipLevels = 1;
+		view.Format = Formats[n];
+		view.Dimension = SRResourceDimensionTexture2D;
+		view.Layout = Layouts[n];
+		view.Generation = SRDecodedBlocksGeneration();
+		if (Layouts[n] == SRResourceLayoutVirtual)
+			view.Feedback = reinterpret_cast<std::atomic<UINT32>*>(texels.data() + pages.size() * sizeof(BYTE*));
+		results.push_back(Measure(Names[n], "sample", uvs.size(), config.MinTime, [&]() {
+			XMVECTOR sum = XMVectorZero();
+			for (const XMFLOAT2& uv : uvs) {
+				sum = XMVectorAdd(sum, SRSampleLevel(view, sampler, uv, 0.0f));
+			}
+			gSink = XMVectorGetX(sum);
+		}));
+	}
+}
+
+// the view the device hands the pixel shaders for the texture in slot 0, taken by drawing a triangle
+static SRTextureView gBoundView;
+
+static void BoundViewVS(const BYTE* vsInput, BYTE* vsOutput, const BYTE*const* constBuffer) {
+	memcpy(vsOutput, vsInput, sizeof(XMFLOAT4));
+	memset(vsOutput + sizeof(XMFLOAT4), 0, sizeof(XMFLOAT4));
+}
+
+static void BoundViewPS(BYTE* psInput, XMFLOAT4* pixelColor, const BYTE*const* constBuffer) {
+	gBoundView = *reinterpret_cast<const SRTextureView*>(constBuffer[0]);
+	*pixelColor = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+// the texture is created, filled and bound through the API, as the pixel shaders get it
+static bool CreateBoundTexture(SRDevice& device, const SRResourceDescription& desc, const std::vector<BYTE>& texels,
+	SRTextureView& view) {
+	SRResourceHandle texture, target, depth, vertices;
+	if (!device.SRCreateResource(desc, &texture))
+		return false;
+	device.SRCopyToResource(texture, texels.data(), UINT(texels.size()));
+
+	SRResourceDescription targetDesc;
+	targetDesc.DIMENSION = SRResourceDimensionTexture2D;
+	targetDesc.FORMAT = DXGI_FORMAT_R8G8B8A8_UNORM;
+	targetDesc.WIDTH = 8;
+	targetDesc.HEIGHT = 8;
+	targetDesc.DEPTH = 1;
+	if (!device.SRCreateResource(targetDesc, &target))
+		return false;
+	targetDesc.FORMAT = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	if (!device.SRCreateResource(targetDesc, &depth))
+		return false;
+	// a triangle over the target in both windings, one of them is not culled
+	const XMFLOAT4 corners[6] = {
+		XMFLOAT4(-1.0f, -1.0f, 0.5f, 1.0f), XMFLOAT4(3.0f, -1.0f, 0.5f, 1.0f), XMFLOAT4(-1.0f, 3.0f, 0.5f, 1.0f),
+		XMFLOAT4(-1.0f, -1.0f, 0.5f, 1.0f), XMFLOAT4(-1.0f, 3.0f, 0.5f, 1.0f), XMFLOAT4(3.0f, -1.0f, 0.5f, 1.0f)
+	};
+	SRResourceDescription bufferDesc;
+	bufferDesc.DIMENSION = SRResourceDimensionBuffer;
+	bufferDesc.FORMAT = DXGI_FORMAT_UNKNOWN;
+	bufferDesc.WIDTH = sizeof(corners);
+	bufferDesc.HEIGHT = 1;
+	bufferDesc.DEPTH = 1;
+	if (!device.SRCreateResource(bufferDesc, &vertices))
+		return false;
+	device.SRCopyToResource(vertices, corners, sizeof(corners));
+
+	SRPipelineState pso;
+	pso.VS = &BoundViewVS;
+	pso.PS = &BoundViewPS;
+	pso.VSInputByteStride = sizeof(XMFLOAT4);
+	pso.VSOutputByteCount = 2 * sizeof(XMFLOAT4);
+	pso.NumShaderResources = 1;
+	device.SRSetPipelineState(pso);
+	device.SRIASetVertexBuffers(vertices);
+	device.SRPSSetShaderResources(0, texture);
+	device.SROMSetRenderTarget(target, depth, true);
+	gBoundView = SRTextureView();
+	device.SRDrawInstanced(6, 1, 0, 0);
+	device.SREndFrame();
+	view = gBoundView;
+	return view.ptr != nullptr && view.Dimension == desc.DIMENSION;
+}
+
+// the quads against the single lookups of their 4 coordinates at level 0, where both filter the same texels
+template<typename QuadLookup, typename SingleLookup>
+static bool QuadsMatch(const std::vector<XMFLOAT3>& coordinates, QuadLookup quad, SingleLookup single) {
+	XMVECTOR color[4];
+	for (size_t q = 0; q < coordinates.size(); q += 4) {
+		quad(&coordinates[q], color);
+		for (UINT i = 0; i < 4; i++) {
+			if (!XMVector4NearEqual(color[i], single(coordinates[q + i]), XMVectorReplicate(1e-5f)))
+				return false;
+		}
+	}
+	return true;
+}
+
+// quads of an environment map lookup sweeping all faces of an RGBA8 cube with mips,
+// and of a 3D color grading lookup in a 32^3 RGBA8 LUT
+static bool BenchmarkCubeVolume(const Config& config, std::mt19937& random, std::vector<KernelResult>& results) {
+	const bool isCube = IsSelected(config, "sample_cube_quad");
+	const bool isVolume = IsSelected(config, "sample_volume_quad");
+	if (!isCube && !isVolume)
+		return true;
+
+	SRDevice device;
+	if (!device.Initialize(config.Threads))
+		return false;
+	device.SREnableDebugLayer();
+	if (!device.SRAllocateResource(8))
+		return false;
+
+	const UINT Quads = 1 << 18;
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<XMFLOAT3> coordinates(size_t(Quads) * 4);
+	if (isCube) {
+		const UINT Size = 512;
+		SRResourceDescription desc;
+		desc.DIMENSION = SRResourceDimensionTextureCube;
+		desc.FORMAT = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.WIDTH = Size;
+		desc.HEIGHT = Size;
+		desc.DEPTH = 6;
+		desc.MIPLEVELS = SRFullMipLevels(Size, Size);
+		std::vector<BYTE> texels(SRTextureLayout(desc.DIMENSION, desc.FORMAT, Size, Size, 6, desc.MIPLEVELS,
+			SRResourceLayoutRowMajor, nullptr));
+		for (auto& byte : texels) {
+			byte = BYTE(random());
+		}
+		SRTextureView view;
+		if (!CreateBoundTexture(device, desc, texels, view))
+			return false;
+
+		// reflection vectors of neighbouring pixels, about a texel apart
+		for (UINT q = 0; q < Quads; q++) {
+			XMFLOAT3 origin(2.0f * unit(random) - 1.0f, 2.0f * unit(random) - 1.0f, 2.0f * unit(random) - 1.0f);
+			const float step = 2.0f / Size;
+			coordinates[q * 4] = origin;
+			coordinates[q * 4 + 1] = XMFLOAT3(origin.x, origin.y + step, origin.z);
+			coordinates[q * 4 + 2] = XMFLOAT3(origin.x + step, origin.y, origin.z);
+			coordinates[q * 4 + 3] = XMFLOAT3(origin.x + step, origin.y + step, origin.z);
+		}
+		SRSamplerDesc sampler;
+		SRSamplerDesc levelZero;
+		levelZero.Filter = SRFilterBilinear;
+		levelZero.MaxLOD = 0.0f;
+		if (!QuadsMatch(coordinates,
+			[&](const XMFLOAT3* directions, XMVECTOR* color) { SRSampleCubeQuad(view, levelZero, directions, color); },
+			[&](XMFLOAT3 direction) { return SRSampleCubeLevel(view, levelZero, direction, 0.0f); }))
+		{
+			fprintf(stderr, "sample_cube_quad: the quad and the single lookups differ\n");
+			return false;
+		}
+		results.push_back(Measure("sample_cube_quad", "sample", coordinates.size(), config.MinTime, [&]() {
+			XMVECTOR sum = XMVectorZero();
+			XMVECTOR color[4];
+			for (UINT q = 0; q < Quads; q++) {
+				SRSampleCubeQuad(view, sampler, &coordinates[q * 4], color);
+				sum = XMVectorAdd(sum, XMVectorAdd(XMVectorAdd(color[0], color[1]), XMVectorAdd(color[2], color[3])));
+			}
+			gSink = XMVectorGetX(sum);
+		}));
+	}
+
+	if (isVolume) {
+		const UINT Size = 32;
+		SRResourceDescription desc;
+		desc.DIMENSION = SRResourceDimensionTexture3D;
+		desc.FORMAT = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.WIDTH = Size;
+		desc.HEIGHT = Size;
+		desc.DEPTH = Size;
+		std::vector<BYTE> texels(SRTextureLayout(desc.DIMENSION, desc.FORMAT, Size, Size, Size, 1,
+			SRResourceLayoutRowMajor, nullptr));
+		for (auto& byte : texels) {
+			byte = BYTE(random());
+		}
+		SRTextureView view;
+		if (!CreateBoundTexture(device, desc, texels, view))
+			return false;
+
+		// the colors of neighbouring pixels differ a little
+		for (UINT q = 0; q < Quads; q++) {
+			XMFLOAT3 color(unit(random), unit(random), unit(random));
+			for (UINT i = 0; i < 4; i++) {
+				coordinates[q * 4 + i] = XMFLOAT3(color.x + 0.002f * i, color.y, color.z - 0.001f * i);
+			}
+		}
+		SRSamplerDesc sampler;
+		sampler.Filter = SRFilterBilinear;
+		sampler.AddressU = sampler.AddressV = sampler.AddressW = SRTextureAddressClamp;
+		SRSamplerDesc levelZero = sampler;
+		levelZero.MaxLOD = 0.0f;
+		if (!QuadsMatch(coordinates,
+			[&](const XMFLOAT3* uvw, XMVECTOR* color) { SRSampleVolumeQuad(view, levelZero, uvw, color); },
+			[&](XMFLOAT3 uvw) { return SRSampleVolumeLevel(view, levelZero, uvw, 0.0f); }))
+		{
+			fprintf(stderr, "sample_volume_quad: the quad and the single lookups differ\n");
+			return false;
+		}
+		results.push_back(Measure("sample_volume_quad", "sample", coordinates.size(), config.MinTime, [&]() {
+			XMVECTOR sum = XMVectorZero();
+			XMVECTOR color[4];
+			for (UINT q = 0; q < Quads; q++) {
+				SRSampleVolumeQuad(view, sampler, &coordinates[q * 4], color);
+				sum = XMVectorAdd(sum, XMVectorAdd(XMVectorAdd(color[0], color[1]), XMVectorAdd(color[2], color[3])));
+			}
+			gSink = XMVectorGetX(sum);
+		}));
+	}
+	return true;
+}
+
+// one call of heap_churn on a slot of live blocks: a new block when it is empty, else freed or resized
+struct HeapOp {
+	UINT Slot;
+	size_t Size;		// 0 frees
+};
+
+// byte tag at 0, every 4 KB and the last byte, enough to see blocks overlap without touching all of them
+static void TagBlock(BYTE* ptr, size_t size, BYTE tag) {
+	for (size_t offset = 0; offset < size; offset += 4096) {
+		ptr[offset] = tag;
+	}
+	ptr[size - 1] = tag;
+}
+
+// the tags of a block of size bytes within its first kept bytes
+static bool IsTagged(const BYTE* ptr, size_t size, size_t kept, BYTE tag) {
+	for (size_t offset = 0; offset < kept; offset += 4096) {
+		if (ptr[offset] != tag)
+			return false;
+	}
+	return size > kept || ptr[size - 1] == tag;
+}
+
+// false if a check fails, only checked when isChecked
+static bool RunHeapOps(const std::vector<HeapOp>& ops, UINT slotCount, bool isChecked) {
+	SRHeap heap;
+	std::vector<BYTE*> blocks(slotCount, nullptr);
+	std::vector<size_t> sizes(slotCount, 0);
+	std::vector<BYTE> tags(slotCount, 0);
+	bool isValid = true;
+	for (const HeapOp& op : ops) {
+		BYTE*& block = blocks[op.Slot];
+		if (isChecked && block != nullptr)
+			isValid = isValid && IsTagged(block, sizes[op.Slot], sizes[op.Slot], tags[op.Slot]);
+		if (block == nullptr)
+			block = heap.Allocate(op.Size);
+		else if (op.Size == 0)
+			heap.Free(block), block = nullptr;
+		else if (BYTE* resized = heap.Reallocate(block, op.Size)) {
+			// the smaller size is kept, tagged again below
+			if (isChecked)
+				isValid = isValid && IsTagged(resized, sizes[op.Slot], (std::min)(sizes[op.Slot], op.Size), tags[op.Slot]);
+			block = resized;
+		}
+		else
+			isValid = false;
+		if (op.Size != 0 && block == nullptr)
+			isValid = false;
+		if (isChecked && block != nullptr) {
+			isValid = isValid && reinterpret_cast<uintptr_t>(block) % SRHeapAlignment == 0;
+			sizes[op.Slot] = op.Size;
+			tags[op.Slot] = BYTE(tags[op.Slot] + op.Slot * 2 + 1);
+			TagBlock(block, op.Size, tags[op.Slot]);
+		}
+	}
+	for (BYTE* block : blocks) {
+		heap.Free(block);
+	}
+	SRHeapStatistics stats;
+	heap.GetStatistics(&stats);
+	return isValid && stats.Allocations == 0 && stats.AllocatedBytes == 0;
+}
+
+static bool BenchmarkHeap(const Config& config, std::mt19937& random, std::vector<KernelResult>& results) {
+	if (!IsSelected(config, "heap_churn"))
+		return true;
+
+	// mostly small buffers, some up to a quarter of the default slab, a few of their own slab
+	const UINT OpCount = 200000, SlotCount = 256;
+	std::vector<HeapOp> ops(OpCount);
+	std::vector<bool> isLive(SlotCount, false);
+	for (HeapOp& op : ops) {
+		op.Slot = random() % SlotCount;
+		const UINT kind = random() % 100;
+		if (isLive[op.Slot] && random() % 2 == 0)
+			op.Size = 0;
+		else if (kind < 80)
+			op.Size = 64 + random() % (16 << 10);
+		else if (kind < 99)
+			op.Size = (16 << 10) + random() % (1 << 20);
+		else
+			op.Size = (4 << 20) + random() % (16 << 20);
+		isLive[op.Slot] = op.Size != 0;
+	}
+	if (!RunHeapOps(ops, SlotCount, true)) {
+		fprintf(stderr, "heap_churn: a block was misplaced or lost its contents\n");
+		return false;
+	}
+	results.push_back(Measure("heap_churn", "heap call", OpCount, config.MinTime, [&]() {
+		RunHeapOps(ops, SlotCount, false);
+	}));
+	return true;
+}
+
+// the public API is the only way into the clears and InitHiZCache
+static bool BenchmarkDevice(const Config& config, std::mt19937& random, std::vector<KernelResult>& results) {
+	bool IsClearRenderTarget = IsSelected(config, "clear_render_target");
+	bool IsClearDepthStencil = IsSelected(config, "clear_depth_stencil");
+	bool IsInitHiZ = IsSelected(config, "init_hiz_cache");
+	bool IsInitHiZConstant = IsSelected(config, "init_hiz_cache_constant");
+	if (!IsClearRenderTarget && !IsClearDepthStencil && !IsInitHiZ && !IsInitHiZConstant)
+		return true;
+
+	SRDevice device;
+	if (!device.Initialize(config.Threads))
+		return false;
+	device.SREnableDebugLayer();
+	if (!device.SRAllocateResource(2))
+		return false;
+
+	SRResourceHandle target, depth;
+	SRResourceDescription desc;
+	desc.DIMENSION = SRResourceDimensionTexture2D;
+	desc.FORMAT = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.WIDTH = config.Width;
+	desc.HEIGHT = config.Height;
+	desc.DEPTH = 1;
+	if (!device.SRCreateResource(desc, &target))
+		return false;
+	desc.FORMAT = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	if (!device.SRCreateResource(desc, &depth))
+		return false;
+
+	// random depth, so that the Hi-Z scan sees real data
+	std::vector<UINT32> depthData(size_t(config.Width) * config.Height);
+	for (auto& value : depthData) {
+		value = UINT32(random() & DepthMax) << 8;
+	}
+	device.SRCopyToResource(depth, depthData.data(), UINT(depthData.size() * sizeof(UINT32)));
+
+	const float color[4] = { 0.2f, 0.4f, 0.6f, 1.0f };
+	if (IsClearRenderTarget) {
+		results.push_back(Measure("clear_render_target", "clear", 1, config.MinTime, [&]() {
+			device.SRClearRenderTargetView(target, color);
+		}));
+	}
+	if (IsClearDepthStencil) {
+		results.push_back(Measure("clear_depth_stencil", "clear", 1, config.MinTime, [&]() {
+			device.SRClearDepthStencilView(depth, SRClearFlagDepthStencil, 1.0f, 0);
+		}));
+	}
+
+	device.SRCopyToResource(depth, depthData.data(), UINT(depthData.size() * sizeof(UINT32)));
+	if (IsInitHiZ) {
+		results.push_back(Measure("init_hiz_cache", "render target bind", 1, config.MinTime, [&]() {
+			device.SROMSetRenderTarget(target, depth, false);
+		}));
+	}
+	if (IsInitHiZConstant) {
+		results.push_back(Measure("init_hiz_cache_constant", "render target bind", 1, config.MinTime, [&]() {
+			device.SROMSetRenderTarget(target, depth, true);
+		}));
+	}
+	return true;
+}
+
+/*
+ * command line
+ */
+static std::vector<std::string> Split(const char* list) {
+	std::vector<std::string> items;
+	std::string item;
+	for (const char* c = list; ; c++) {
+		if (*c == ',' || *c == '\0') {
+			if (!item.empty())
+				items.push_back(item);
+			item.clear();
+			if (*c == '\0')
+				break;
+		}
+		else {
+			item += *c;
+		}
+	}
+	return items;
+}
+
+static bool ParseArguments(int argc, char** argv, Config& config, const char*& output) {
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--kernels") == 0 && hasValue)
+			config.Kernels = Split(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && hasValue) {
+			const char* name = argv[++i];
+			int size = 0;
+			while (size <= TriangleSizeMixed && strcmp(SizeNames[size], name) != 0)
+				size++;
+			if (size > TriangleSizeMixed)
+				return false;
+			config.Size = TriangleSize(size);
+		}
+		else if (strcmp(argv[i], "--perspective") == 0)
+			config.Perspective = true;
+		else if (strcmp(argv[i], "--resolution") == 0 && hasValue) {
+			if (sscanf(argv[++i], "%ux%u", &config.Width, &config.Height) != 2 ||
+				config.Width == 0 || config.Height == 0)
+				return false;
+		}
+		else if (strcmp(argv[i], "--count") == 0 && hasValue)
+			config.Count = UINT(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--attributes") == 0 && hasValue)
+			config.Attributes = UINT(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+			config.Threads = UINT(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--min-time") == 0 && hasValue)
+			config.MinTime = atof(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+			config.Seed = UINT(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--output") == 0 && hasValue)
+			output = argv[++i];
+		else
+			return false;
+	}
+	return config.Count != 0;
+}
+
+int main(int argc, char** argv) {
+	Config config;
+	const char* output = nullptr;
+	if (!ParseArguments(argc, argv, config, output)) {
+		fprintf(stderr, "usage: %s [--kernels a,b] [--size tiny|small|medium|large|thin|mixed] [--perspective]\n"
+			"       [--resolution WxH] [--count N] [--attributes N] [--threads N] [--min-time seconds]\n"
+			"       [--seed N] [--output file.json]\n", argv[0]);
+		return 1;
+	}
+
+	std::mt19937 random(config.Seed);
+	std::vector<KernelResult> results;
+	BenchmarkRasterizer(config, random, results);
+	BenchmarkSampling(config, random, results);
+	if (!BenchmarkCubeVolume(config, random, results) || !BenchmarkDevice(config, random, results)) {
+		fprintf(stderr, "device setup or check failed\n");
+		return 1;
+	}
+	if (!BenchmarkHeap(config, random, results))
+		return 1;
+
+	for (auto& result : results) {
+		fprintf(stderr, "%-24s %12.2f ns/%-18s %12.1f cycles/op\n",
+			result.Name, result.NsPerOp, result.Op, result.CyclesPerOp);
+	}
+
+	FILE* file = output != nullptr ? fopen(output, "w") : stdout;
+	if (file == nullptr) {
+		fprintf(stderr, "unable to open %s\n", output);
+		return 1;
+	}
+	fprintf(file, "{\n  \"config\": {\"size\": \"%s\", \"perspective\": %s, \"width\": %u, \"height\": %u, "
+		"\"count\": %u, \"attributes\": %u, \"threads\": %u, \"seed\": %u},\n  \"kernels\": [\n",
+		SizeNames[config.Size], config.Perspective ? "true" : "false", config.Width, config.Height,
+		config.Count, config.Attributes, config.Threads, config.Seed);
+	for (size_t i = 0; i < results.size(); i++) {
+		const KernelResult& r = results[i];
+		fprintf(file, "    {\"name\": \"%s\", \"op\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.3f, \"cycles_per_op\": %.1f}%s\n",
+			r.Name, r.Op, (unsigned long long)r.Ops, r.NsPerOp, r.CyclesPerOp, i + 1 == results.size() ? "" : ",");
+	}
+	fprintf(file, "  ]\n}\n");
+	if (file != stdout)
+		fclose(file);
+	return 0;
+}
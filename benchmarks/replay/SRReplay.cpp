@@ -0,0 +1,120 @@
+/*
+ * Headless replay of a capture written by SRBeginCapture (SRBenchmark --capture).
+ * The initial state is replayed once, then the captured calls loop N times.
+ * Prints the time of every loop, per call type and per call as JSON.
+ *
+ * usage: SRReplay capture.srcap [--loops N] [--threads N] [--output file.json]
+ * thread count 0 means SRThreadPool::DefaultThreadCount().
+ *
+ * Shaders are looked up by name, the replayer knows the shaders of SRBenchmark.
+ */
+#include "SRBenchmarkShaders.h"
+#include <algorithm>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// calls of one type, over all loops
+struct OpResult {
+	UINT Calls = 0;
+	double TotalNs = 0.0;
+};
+
+int main(int argc, char** argv) {
+	const char* input = nullptr;
+	const char* output = nullptr;
+	UINT loops = 10;
+	UINT threads = 0;
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--loops") == 0 && hasValue)
+			loops = UINT(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+			threads = UINT(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--output") == 0 && hasValue)
+			output = argv[++i];
+		else if (argv[i][0] != '-' && input == nullptr)
+			input = argv[i];
+		else
+			input = nullptr, i = argc;
+	}
+	if (input == nullptr) {
+		fprintf(stderr, "usage: %s capture.srcap [--loops N] [--threads N] [--output file.json]\n", argv[0]);
+		return 1;
+	}
+	if (loops == 0)
+		loops = 1;
+
+	SRShaderRegistry registry;
+	RegisterBenchmarkShaders(registry);
+
+	SRReplayer replayer;
+	if (!replayer.Load(input)) {
+		fprintf(stderr, "%s: %s\n", input, replayer.GetError());
+		return 1;
+	}
+	SRDevice device;
+	if (!device.Initialize(threads))
+		return 1;
+	device.SREnableDebugLayer();
+	if (!replayer.Replay(device, registry, loops)) {
+		fprintf(stderr, "%s: %s\n", input, replayer.GetError());
+		return 1;
+	}
+
+	const std::vector<SRReplayCall>& calls = replayer.GetCalls();
+	std::vector<double> loopMs = replayer.GetLoopMs();
+	OpResult ops[SRCaptureOpCount];
+	for (const SRReplayCall& call : calls) {
+		ops[call.Op].Calls++;
+		ops[call.Op].TotalNs += call.TotalNs;
+	}
+	std::vector<double> sorted = loopMs;
+	std::sort(sorted.begin(), sorted.end());
+	double meanMs = 0.0;
+	for (double t : loopMs) {
+		meanMs += t;
+	}
+	meanMs /= loops;
+	double medianMs = loops % 2 == 1 ? sorted[loops / 2] : 0.5 * (sorted[loops / 2 - 1] + sorted[loops / 2]);
+
+	fprintf(stderr, "%zu calls, %u loops  min %.3f ms  median %.3f ms\n", calls.size(), loops, sorted.front(), medianMs);
+	for (UINT op = 0; op < SRCaptureOpCount; op++) {
+		if (ops[op].Calls != 0)
+			fprintf(stderr, "%-24s %6u calls %12.3f ms/loop\n",
+				SRReplayer::OpName(SRCaptureOp(op)), ops[op].Calls, ops[op].TotalNs * 1e-6 / loops);
+	}
+
+	FILE* file = output != nullptr ? fopen(output, "w") : stdout;
+	if (file == nullptr) {
+		fprintf(stderr, "unable to open %s\n", output);
+		return 1;
+	}
+	fprintf(file, "{\n  \"capture\": \"%s\", \"threads\": %u, \"loops\": %u,\n", input,
+		threads != 0 ? threads : SRThreadPool::DefaultThreadCount(), loops);
+	fprintf(file, "  \"loop_ms\": {\"min\": %.4f, \"median\": %.4f, \"mean\": %.4f, \"max\": %.4f},\n",
+		sorted.front(), medianMs, meanMs, sorted.back());
+
+	fprintf(file, "  \"ops\": [\n");
+	bool isFirst = true;
+	for (UINT op = 0; op < SRCaptureOpCount; op++) {
+		if (ops[op].Calls == 0)
+			continue;
+		fprintf(file, "%s    {\"op\": \"%s\", \"calls\": %u, \"ms_per_loop\": %.4f}", isFirst ? "" : ",\n",
+			SRReplayer::OpName(SRCaptureOp(op)), ops[op].Calls, ops[op].TotalNs * 1e-6 / loops);
+		isFirst = false;
+	}
+	fprintf(file, "\n  ],\n  \"calls\": [\n");
+	for (size_t i = 0; i < calls.size(); i++) {
+		const SRReplayCall& call = calls[i];
+		fprintf(file, "    {\"index\": %zu, \"op\": \"%s\", \"mean_us\": %.3f, \"min_us\": %.3f, \"max_us\": %.3f}%s\n",
+			i, SRReplayer::OpName(call.Op), call.TotalNs * 1e-3 / call.Count, call.MinNs * 1e-3, call.MaxNs * 1e-3,
+			i + 1 == calls.size() ? "" : ",");
+	}
+	fprintf(file, "  ]\n}\n");
+	if (file != stdout)
+		fclose(file);
+	return 0;
+}
@@ -1,4 +1,4 @@
-#include "SRDevice.h"
+#include "SRWindowDevice.h"
 #include <DirectXColors.h>
 #include <array>
 #include "MathHelper.h"
@@ -14,13 +14,13 @@ struct ObjectConstants {
 	XMFLOAT4X4 WorldViewProj = MathHelper::Identity4x4;
 };
 
-class SRApp : public SRDevice
+class SRApp : public SRWindowDevice
 {
 public:
-	SRApp(HINSTANCE hInstance) : SRDevice(hInstance) {};
+	SRApp(HINSTANCE hInstance) : SRWindowDevice(hInstance) {};
 	~SRApp() {};
 
-	virtual bool Initialize() override;
+	virtual bool Initialize(UINT NumWorkerThreads = 0) override;
 
 private:
 	virtual void Update(const GameTimer& gt) override;
@@ -59,7 +59,6 @@ private:
 	XMFLOAT4X4 mView = MathHelper::Identity4x4;
 	XMFLOAT4X4 mProj = MathHelper::Identity4x4;
 
-	ObjectConstants mObjectCB;
 };
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, int showCmd) {
@@ -80,8 +79,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, in
 	}
 }
 
-bool SRApp::Initialize() {
-	if (!SRDevice::Initialize())
+bool SRApp::Initialize(UINT NumWorkerThreads) {
+	if (!SRWindowDevice::Initialize(NumWorkerThreads))
 		return false;
 	
 #if defined(DEBUG) || defined(_DEBUG)
@@ -170,7 +169,9 @@ bool SRApp::Initialize() {
 	SRIASetIndexBuffers(mIndexBuffer);
 
 
-	desc.WIDTH = UINT(sizeof(XMFLOAT4X4));
+	// written every frame through SRMapResource, in a version of its own
+	desc.WIDTH = UINT(sizeof(ObjectConstants));
+	desc.VERSIONS = 2;
 	if (!SRCreateResource(desc, &mConstBuffer))
 		return false;
 	SRIASetConstantBuffers(0, mConstBuffer);
@@ -209,9 +210,13 @@ void SRApp::Update(const GameTimer& gt) {
 
 	XMMATRIX wordViewProj = XMLoadFloat4x4(&mWorld) * view * XMLoadFloat4x4(&mProj);
 
-	XMStoreFloat4x4(&mObjectCB.WorldViewProj, wordViewProj);
-	
-	SRCopyToResource(mConstBuffer, &mObjectCB, sizeof(mObjectCB));
+	// nothing of the previous version is read
+	const SRRange noRead = { 0, 0 };
+	void* pData;
+	if (!SRMapResource(mConstBuffer, &noRead, &pData))
+		return;
+	XMStoreFloat4x4(&static_cast<ObjectConstants*>(pData)->WorldViewProj, wordViewProj);
+	SRUnmapResource(mConstBuffer, nullptr);
 }
 
 void SRApp::OnKeyboardInput(const GameTimer& gt) {
@@ -271,7 +276,7 @@ void SRApp::DrawScene(const GameTimer& gt) {
 }
 
 void SRApp::OnResize() {
-	SRDevice::OnResize();
+	SRWindowDevice::OnResize();
 
 	if (mBackHandle != SRDevice::InvalidHandle &&
 		(mTargetWidth != GetClientWidth() ||
@@ -1,9 +1,9 @@
-#include "SRDevice.h"
+#include "SRWindowDevice.h"
 #include "d3dUtil.h"
 
 using namespace Microsoft::WRL;
 
-void SRDevice::SRSetMagMode(bool EnableMag, UINT MagLevel) {
+void SRWindowDevice::SRSetMagMode(bool EnableMag, UINT MagLevel) {
 	if (!EnableMag || MagLevel == 0) {
 		mMagPresent = false;
 		mMagLevel = 0;
@@ -14,7 +14,7 @@ void SRDevice::SRSetMagMode(bool EnableMag, UINT MagLevel) {
 	}
 }
 
-void SRDevice::InitializeMagPresent() {
+void SRWindowDevice::InitializeMagPresent() {
 	// descriptor heaps
 	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
 	heapDesc.NumDescriptors = mInternalSwapChainNum;
@@ -94,7 +94,7 @@ void SRDevice::InitializeMagPresent() {
 	TF(md3dDevice->CreateGraphicsPipelineState(&linePsoDesc, IID_PPV_ARGS(&mMagLinePSO)));
 }
 
-void SRDevice::CreateMagDescriptor() {
+void SRWindowDevice::CreateMagDescriptor() {
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
 	srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
@@ -112,7 +112,7 @@ void SRDevice::CreateMagDescriptor() {
 }
 
 
-void SRDevice::MagnificationPresent(ID3D12Resource* presentResource) {
+void SRWindowDevice::MagnificationPresent(ID3D12Resource* presentResource) {
 	if (mUMA) {
 		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
 			CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT,
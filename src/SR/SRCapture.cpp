@@ -0,0 +1,702 @@
+#include "SRCapture.h"
+#include <chrono>
+#include <string.h>
+
+static const char CaptureMagic[4] = { 'S', 'R', 'C', 'P' };
+static const UINT32 CaptureVersion = 7;
+
+/*
+ * shader registry
+ */
+bool SRShaderRegistry::Register(const char* name, ShaderType type, Function function) {
+	if (name == nullptr || name[0] == '\0' || function == nullptr)
+		return false;
+	for (auto& entry : mEntries) {
+		if (entry.type == type && (entry.name == name || entry.function == function))
+			return false;
+	}
+	mEntries.push_back({ name, type, function });
+	return true;
+}
+
+const char* SRShaderRegistry::FindName(ShaderType type, Function function) const {
+	for (auto& entry : mEntries) {
+		if (entry.type == type && entry.function == function)
+			return entry.name.c_str();
+	}
+	return nullptr;
+}
+
+SRShaderRegistry::Function SRShaderRegistry::Find(ShaderType type, const char* name) const {
+	for (auto& entry : mEntries) {
+		if (entry.type == type && entry.name == name)
+			return entry.function;
+	}
+	return nullptr;
+}
+
+/*
+ * capture
+ */
+SRCapture::~SRCapture() {
+	Close();
+}
+
+bool SRCapture::Open(const char* fileName, const SRShaderRegistry* registry) {
+	Close();
+	mFile = fopen(fileName, "wb");
+	if (mFile == nullptr)
+		return false;
+	mRegistry = registry;
+	mIsFailed = false;
+	fwrite(CaptureMagic, 1, sizeof(CaptureMagic), mFile);
+	fwrite(&CaptureVersion, sizeof(CaptureVersion), 1, mFile);
+	return true;
+}
+
+bool SRCapture::Close() {
+	if (mFile == nullptr)
+		return true;
+	bool isSucceeded = !mIsFailed && fclose(mFile) == 0;
+	if (mIsFailed)
+		fclose(mFile);
+	mFile = nullptr;
+	return isSucceeded;
+}
+
+void SRCapture::Begin(SRCaptureOp op) {
+	// op and payload size, the size is filled by End
+	UINT32 header[2] = { UINT32(op), 0 };
+	mRecord.resize(sizeof(header));
+	memcpy(mRecord.data(), header, sizeof(header));
+}
+
+void SRCapture::Put(const void* pData, size_t size) {
+	const BYTE* bytes = reinterpret_cast<const BYTE*>(pData);
+	mRecord.insert(mRecord.end(), bytes, bytes + size);
+}
+
+void SRCapture::Put(const char* string) {
+	UINT32 length = string != nullptr ? UINT32(strlen(string)) : 0;
+	Put(length);
+	Put(string, length);
+}
+
+void SRCapture::Put(const SRResourceDescription& desc) {
+	Put(desc.WIDTH);
+	Put(desc.HEIGHT);
+	Put(desc.DEPTH);
+	Put(UINT32(desc.FORMAT));
+	Put(UINT32(desc.DIMENSION));
+	Put(desc.MIPLEVELS);
+	Put(UINT32(desc.LAYOUT));
+	Put(desc.VERSIONS);
+}
+
+void SRCapture::End() {
+	UINT32 size = UINT32(mRecord.size() - 2 * sizeof(UINT32));
+	memcpy(mRecord.data() + sizeof(UINT32), &size, sizeof(size));
+	if (fwrite(mRecord.data(), 1, mRecord.size(), mFile) != mRecord.size())
+		mIsFailed = true;
+}
+
+void SRCapture::AllocateResource(UINT number) {
+	Begin(SRCaptureOpAllocateResource);
+	Put(number);
+	End();
+}
+
+void SRCapture::CreateResource(const SRResourceDescription& desc, SRResourceHandle handle) {
+	Begin(SRCaptureOpCreateResource);
+	Put(desc);
+	Put(handle);
+	End();
+}
+
+void SRCapture::CopyToResource(SRResourceHandle handle, const void* pData, UINT len) {
+	Begin(SRCaptureOpCopyToResource);
+	Put(handle);
+	Put(len);
+	Put(pData, len);
+	End();
+}
+
+void SRCapture::WriteToResource(SRResourceHandle handle, UINT size, UINT offset, const void* pData, UINT len) {
+	Begin(SRCaptureOpWriteToResource);
+	Put(handle);
+	Put(size);
+	Put(offset);
+	Put(len);
+	Put(pData, len);
+	End();
+}
+
+void SRCapture::ReleaseResource(SRResourceHandle handle) {
+	Begin(SRCaptureOpReleaseResource);
+	Put(handle);
+	End();
+}
+
+void SRCapture::GenerateMips(SRResourceHandle handle) {
+	Begin(SRCaptureOpGenerateMips);
+	Put(handle);
+	End();
+}
+
+void SRCapture::ResizeResource(SRResourceHandle handle, const SRResourceDescription& desc) {
+	Begin(SRCaptureOpResizeResource);
+	Put(handle);
+	Put(desc);
+	End();
+}
+
+void SRCapture::ClearRenderTargetView(SRResourceHandle handle, const float color[4]) {
+	Begin(SRCaptureOpClearRenderTargetView);
+	Put(handle);
+	Put(color, 4 * sizeof(float));
+	End();
+}
+
+void SRCapture::ClearDepthStencilView(SRResourceHandle handle, SRClearFlags flag, float depth, UINT8 stencil) {
+	Begin(SRCaptureOpClearDepthStencilView);
+	Put(handle);
+	Put(UINT32(flag));
+	Put(depth);
+	Put(UINT32(stencil));
+	End();
+}
+
+bool SRCapture::SetPipelineState(const SRPipelineState& state) {
+	const char* vs = state.VS != nullptr ? mRegistry->FindName(state.VS) : "";
+	const char* ps = state.PS != nullptr ? mRegistry->FindName(state.PS) : "";
+	const char* quadPS = state.QuadPS != nullptr ? mRegistry->FindName(state.QuadPS) : "";
+	bool isRegistered = vs != nullptr && ps != nullptr && quadPS != nullptr;
+
+	Begin(SRCaptureOpSetPipelineState);
+	Put(vs != nullptr ? vs : "");
+	Put(ps != nullptr ? ps : "");
+	Put(quadPS != nullptr ? quadPS : "");
+	Put(state.VSInputByteStride);
+	Put(state.VSOutputByteCount);
+	Put(state.NumConstantBuffer);
+	Put(state.NumShaderResources);
+	Put(state.NumSamplers);
+	Put(state.PSDerivativeCount);
+	Put(UINT32(state.EnableZPrePass));
+	Put(UINT32(state.EnableQuadPixelShader));
+	End();
+	return isRegistered;
+}
+
+void SRCapture::SetRasterizerDesc(const SRRasterizerDesc& desc) {
+	Begin(SRCaptureOpSetRasterizerDesc);
+	Put(desc.InlineTileThreshold);
+	Put(desc.BatchSize);
+	Put(UINT32(desc.TileScheduling));
+	Put(UINT32(desc.TileOrder));
+	Put(desc.PipelineDepth);
+	End();
+}
+
+void SRCapture::IASetVertexBuffers(SRResourceHandle handle) {
+	Begin(SRCaptureOpIASetVertexBuffers);
+	Put(handle);
+	End();
+}
+
+void SRCapture::IASetIndexBuffers(SRResourceHandle handle, DXGI_FORMAT format) {
+	Begin(SRCaptureOpIASetIndexBuffers);
+	Put(handle);
+	Put(UINT32(format));
+	End();
+}
+
+void SRCapture::IASetConstantBuffers(UINT index, SRResourceHandle handle) {
+	Begin(SRCaptureOpIASetConstantBuffers);
+	Put(index);
+	Put(handle);
+	End();
+}
+
+void SRCapture::IASetPrimitiveTopology(SRPrimitiveTopology primitive) {
+	Begin(SRCaptureOpIASetPrimitiveTopology);
+	Put(UINT32(primitive));
+	End();
+}
+
+void SRCapture::PSSetShaderResources(UINT index, SRResourceHandle handle) {
+	Begin(SRCaptureOpPSSetShaderResources);
+	Put(index);
+	Put(handle);
+	End();
+}
+
+void SRCapture::PSSetSamplers(UINT index, const SRSamplerDesc& desc) {
+	Begin(SRCaptureOpPSSetSamplers);
+	Put(index);
+	Put(UINT32(desc.Filter));
+	Put(UINT32(desc.AddressU));
+	Put(UINT32(desc.AddressV));
+	Put(UINT32(desc.AddressW));
+	Put(desc.MipLODBias);
+	Put(desc.MaxLOD);
+	End();
+}
+
+void SRCapture::OMSetRenderTarget(SRResourceHandle target, SRResourceHandle depth, bool isAllDepthInitToOne) {
+	Begin(SRCaptureOpOMSetRenderTarget);
+	Put(target);
+	Put(depth);
+	Put(UINT32(isAllDepthInitToOne));
+	End();
+}
+
+void SRCapture::DrawInstanced(UINT vertexCount, UINT instanceCount, UINT startVertex, UINT startInstance) {
+	Begin(SRCaptureOpDrawInstanced);
+	Put(vertexCount);
+	Put(instanceCount);
+	Put(startVertex);
+	Put(startInstance);
+	End();
+}
+
+void SRCapture::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, UINT baseVertex, UINT startInstance) {
+	Begin(SRCaptureOpDrawIndexedInstanced);
+	Put(indexCount);
+	Put(instanceCount);
+	Put(startIndex);
+	Put(baseVertex);
+	Put(startInstance);
+	End();
+}
+
+void SRCapture::EndFrame() {
+	Begin(SRCaptureOpEndFrame);
+	End();
+}
+
+void SRCapture::BeginStream() {
+	Begin(SRCaptureOpBeginStream);
+	End();
+}
+
+/*
+ * replay
+ */
+
+// bounds checked reading of one record payload
+class SRCaptureReader
+{
+public:
+	SRCaptureReader(const BYTE* pData, size_t size) : mData(pData), mLeft(size) {};
+
+	bool Get(void* pData, size_t size) {
+		if (size > mLeft) {
+			mIsValid = false;
+			return false;
+		}
+		memcpy(pData, mData, size);
+		mData += size;
+		mLeft -= size;
+		return true;
+	}
+	UINT32 GetUInt() { UINT32 value = 0; Get(&value, sizeof(value)); return value; };
+	float GetFloat() { float value = 0.0f; Get(&value, sizeof(value)); return value; };
+	std::string GetString() {
+		UINT32 length = GetUInt();
+		if (length > mLeft) {
+			mIsValid = false;
+			return std::string();
+		}
+		std::string string(reinterpret_cast<const char*>(mData), length);
+		mData += length;
+		mLeft -= length;
+		return string;
+	}
+	SRResourceDescription GetDesc() {
+		SRResourceDescription desc;
+		desc.WIDTH = GetUInt();
+		desc.HEIGHT = GetUInt();
+		desc.DEPTH = GetUInt();
+		desc.FORMAT = DXGI_FORMAT(GetUInt());
+		desc.DIMENSION = SRResourceDimension(GetUInt());
+		desc.MIPLEVELS = GetUInt();
+		desc.LAYOUT = SRResourceLayout(GetUInt());
+		desc.VERSIONS = GetUInt();
+		return desc;
+	}
+	// points into the capture, no copy
+	const BYTE* GetBytes(size_t size) {
+		if (size > mLeft) {
+			mIsValid = false;
+			return nullptr;
+		}
+		const BYTE* pData = mData;
+		mData += size;
+		mLeft -= size;
+		return pData;
+	}
+	bool IsValid() const { return mIsValid; };
+
+private:
+	const BYTE* mData;
+	size_t mLeft;
+	bool mIsValid = true;
+};
+
+const char* SRReplayer::OpName(SRCaptureOp op) {
+	static const char* Names[SRCaptureOpCount] = {
+		"AllocateResource", "CreateResource", "CopyToResource", "ReleaseResource", "ResizeResource",
+		"ClearRenderTargetView", "ClearDepthStencilView", "SetPipelineState", "SetRasterizerDesc",
+		"IASetVertexBuffers", "IASetIndexBuffers", "IASetConstantBuffers", "IASetPrimitiveTopology",
+		"OMSetRenderTarget", "DrawInstanced", "DrawIndexedInstanced", "EndFrame", "BeginStream",
+		"PSSetShaderResources", "PSSetSamplers", "GenerateMips", "WriteToResource"
+	};
+	return op < SRCaptureOpCount ? Names[op] : "Unknown";
+}
+
+bool SRReplayer::Fail(const char* message) {
+	mError = message;
+	return false;
+}
+
+bool SRReplayer::Load(const char* fileName) {
+	mData.clear();
+	FILE* file = fopen(fileName, "rb");
+	if (file == nullptr)
+		return Fail("unable to open the capture");
+	BYTE buffer[64 * 1024];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) != 0) {
+		mData.insert(mData.end(), buffer, buffer + count);
+	}
+	fclose(file);
+
+	UINT32 version = 0;
+	if (mData.size() < sizeof(CaptureMagic) + sizeof(version) ||
+		memcmp(mData.data(), CaptureMagic, sizeof(CaptureMagic)) != 0)
+		return Fail("not a capture file");
+	memcpy(&version, mData.data() + sizeof(CaptureMagic), sizeof(version));
+	if (version != CaptureVersion)
+		return Fail("unsupported capture version");
+
+	// find the beginning of the calls
+	size_t offset = sizeof(CaptureMagic) + sizeof(version);
+	while (offset + 2 * sizeof(UINT32) <= mData.size()) {
+		UINT32 op, size;
+		memcpy(&op, mData.data() + offset, sizeof(op));
+		memcpy(&size, mData.data() + offset + sizeof(op), sizeof(size));
+		offset += 2 * sizeof(UINT32);
+		if (size > mData.size() - offset)
+			return Fail("truncated record");
+		offset += size;
+		if (op == SRCaptureOpBeginStream) {
+			mStreamBegin = offset;
+			return true;
+		}
+	}
+	return Fail("initial state not closed, the capture is incomplete");
+}
+
+SRResourceHandle SRReplayer::MapHandle(UINT32 handle) const {
+	return handle < mHandles.size() ? mHandles[handle] : SRDevice::InvalidHandle;
+}
+
+bool SRReplayer::Replay(SRDevice& device, const SRShaderRegistry& registry, UINT loops) {
+	if (mStreamBegin == 0)
+		return Fail("no capture loaded");
+	mHandles.clear();
+	mCalls.clear();
+	mLoopMs.clear();
+
+	SRCaptureOp op;
+	double ns;
+	size_t offset = sizeof(CaptureMagic) + sizeof(UINT32);
+	while (offset < mStreamBegin) {
+		if (!Execute(device, registry, offset, op, ns, nullptr))
+			return false;
+	}
+
+	std::vector<SRResourceHandle> created;
+	for (UINT loop = 0; loop < loops; loop++) {
+		auto start = std::chrono::steady_clock::now();
+		offset = mStreamBegin;
+		for (UINT n = 0; offset < mData.size(); n++) {
+			if (!Execute(device, registry, offset, op, ns, &created))
+				return false;
+			if (loop == 0) {
+				SRReplayCall call;
+				call.Op = op;
+				call.MinNs = ns;
+				call.MaxNs = ns;
+				mCalls.push_back(call);
+			}
+			SRReplayCall& call = mCalls[n];
+			call.Count++;
+			call.TotalNs += ns;
+			call.MinNs = (std::min)(call.MinNs, ns);
+			call.MaxNs = (std::max)(call.MaxNs, ns);
+		}
+		mLoopMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		for (SRResourceHandle handle : created) {
+			device.SRReleaseResource(handle);
+		}
+		created.clear();
+	}
+	return true;
+}
+
+// decode one record at offset and call it on the device, ns is the time spent in the device.
+bool SRReplayer::Execute(SRDevice& device, const SRShaderRegistry& registry, size_t& offset, SRCaptureOp& op, double& ns,
+	std::vector<SRResourceHandle>* pCreated)
+{
+	if (offset + 2 * sizeof(UINT32) > mData.size())
+		return Fail("truncated record");
+	UINT32 opValue, size;
+	memcpy(&opValue, mData.data() + offset, sizeof(opValue));
+	memcpy(&size, mData.data() + offset + sizeof(opValue), sizeof(size));
+	offset += 2 * sizeof(UINT32);
+	if (size > mData.size() - offset)
+		return Fail("truncated record");
+	SRCaptureReader reader(mData.data() + offset, size);
+	offset += size;
+	op = SRCaptureOp(opValue);
+
+	auto start = std::chrono::steady_clock::now();
+	switch (op) {
+	case SRCaptureOpAllocateResource: {
+		UINT number = reader.GetUInt();
+		start = std::chrono::steady_clock::now();
+		device.SRAllocateResource(number);
+		break;
+	}
+	case SRCaptureOpCreateResource: {
+		SRResourceDescription desc = reader.GetDesc();
+		UINT32 captured = reader.GetUInt();
+		if (!reader.IsValid())
+			break;
+		SRResourceHandle handle;
+		start = std::chrono::steady_clock::now();
+		device.SRCreateResource(desc, &handle);
+		ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		if (captured != SRDevice::InvalidHandle) {
+			if (captured >= mHandles.size())
+				mHandles.resize(captured + 1, SRResourceHandle(SRDevice::InvalidHandle));
+			mHandles[captured] = handle;
+		}
+		if (pCreated != nullptr && handle != SRDevice::InvalidHandle)
+			pCreated->push_back(handle);
+		return true;
+	}
+	case SRCaptureOpCopyToResource: {
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		UINT len = reader.GetUInt();
+		const BYTE* pData = reader.GetBytes(len);
+		if (!reader.IsValid())
+			break;
+		start = std::chrono::steady_clock::now();
+		device.SRCopyToResource(handle, pData, len);
+		break;
+	}
+	case SRCaptureOpWriteToResource: {
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		UINT size = reader.GetUInt();
+		UINT writeOffset = reader.GetUInt();
+		UINT len = reader.GetUInt();
+		const BYTE* pData = reader.GetBytes(len);
+		if (!reader.IsValid())
+			break;
+		if (writeOffset > size || len > size - writeOffset)
+			return Fail("malformed record");
+		// reading the whole resource fails if it is smaller than captured,
+		// and keeps the rest of an upload buffer when it moves on to its next version
+		const SRRange read = { 0, size };
+		const SRRange written = { writeOffset, writeOffset + len };
+		start = std::chrono::steady_clock::now();
+		void* pMapped;
+		if (device.SRMapResource(handle, &read, &pMapped)) {
+			memcpy(reinterpret_cast<BYTE*>(pMapped) + writeOffset, pData, len);
+			device.SRUnmapResource(handle, &written);
+		}
+		break;
+	}
+	case SRCaptureOpReleaseResource: {
+		UINT32 captured = reader.GetUInt();
+		SRResourceHandle handle = MapHandle(captured);
+		start = std::chrono::steady_clock::now();
+		device.SRReleaseResource(handle);
+		ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		if (captured < mHandles.size())
+			mHandles[captured] = SRDevice::InvalidHandle;
+		if (pCreated != nullptr) {
+			for (size_t i = 0; i < pCreated->size(); i++) {
+				if ((*pCreated)[i] == handle) {
+					pCreated->erase(pCreated->begin() + i);
+					break;
+				}
+			}
+		}
+		return reader.IsValid() || Fail("malformed record");
+	}
+	case SRCaptureOpResizeResource: {
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		SRResourceDescription desc = reader.GetDesc();
+		if (!reader.IsValid())
+			break;
+		start = std::chrono::steady_clock::now();
+		device.SRResizeResource(handle, desc);
+		break;
+	}
+	case SRCaptureOpClearRenderTargetView: {
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		float color[4];
+		reader.Get(color, sizeof(color));
+		if (!reader.IsValid())
+			break;
+		start = std::chrono::steady_clock::now();
+		device.SRClearRenderTargetView(handle, color);
+		break;
+	}
+	case SRCaptureOpClearDepthStencilView: {
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		SRClearFlags flag = SRClearFlags(reader.GetUInt());
+		float depth = reader.GetFloat();
+		UINT8 stencil = UINT8(reader.GetUInt());
+		if (!reader.IsValid())
+			break;
+		start = std::chrono::steady_clock::now();
+		device.SRClearDepthStencilView(handle, flag, depth, stencil);
+		break;
+	}
+	case SRCaptureOpSetPipelineState: {
+		std::string vs = reader.GetString();
+		std::string ps = reader.GetString();
+		std::string quadPS = reader.GetString();
+		SRPipelineState state;
+		state.VSInputByteStride = reader.GetUInt();
+		state.VSOutputByteCount = reader.GetUInt();
+		state.NumConstantBuffer = reader.GetUInt();
+		state.NumShaderResources = reader.GetUInt();
+		state.NumSamplers = reader.GetUInt();
+		state.PSDerivativeCount = reader.GetUInt();
+		state.EnableZPrePass = reader.GetUInt() != 0;
+		state.EnableQuadPixelShader = reader.GetUInt() != 0;
+		if (!reader.IsValid())
+			break;
+		state.VS = vs.empty() ? nullptr : registry.FindVertexShader(vs.c_str());
+		state.PS = ps.empty() ? nullptr : registry.FindPixelShader(ps.c_str());
+		state.QuadPS = quadPS.empty() ? nullptr : registry.FindQuadPixelShader(quadPS.c_str());
+		if ((!vs.empty() && state.VS == nullptr) || (!ps.empty() && state.PS == nullptr) ||
+			(!quadPS.empty() && state.QuadPS == nullptr))
+			return Fail("shader of the capture is not registered");
+		start = std::chrono::steady_clock::now();
+		device.SRSetPipelineState(state);
+		break;
+	}
+	case SRCaptureOpSetRasterizerDesc: {
+		SRRasterizerDesc desc;
+		desc.InlineTileThreshold = reader.GetUInt();
+		desc.BatchSize = reader.GetUInt();
+		desc.TileScheduling = SRTileScheduling(reader.GetUInt());
+		desc.TileOrder = SRTileOrder(reader.GetUInt());
+		desc.PipelineDepth = reader.GetUInt();
+		if (!reader.IsValid())
+			break;
+		start = std::chrono::steady_clock::now();
+		device.SRSetRasterizerDesc(desc);
+		break;
+	}
+	case SRCaptureOpIASetVertexBuffers: {
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		start = std::chrono::steady_clock::now();
+		device.SRIASetVertexBuffers(handle);
+		break;
+	}
+	case SRCaptureOpIASetIndexBuffers: {
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		DXGI_FORMAT format = DXGI_FORMAT(reader.GetUInt());
+		start = std::chrono::steady_clock::now();
+		device.SRIASetIndexBuffers(handle, format);
+		break;
+	}
+	case SRCaptureOpIASetConstantBuffers: {
+		UINT index = reader.GetUInt();
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		start = std::chrono::steady_clock::now();
+		device.SRIASetConstantBuffers(index, handle);
+		break;
+	}
+	case SRCaptureOpIASetPrimitiveTopology: {
+		SRPrimitiveTopology primitive = SRPrimitiveTopology(reader.GetUInt());
+		start = std::chrono::steady_clock::now();
+		device.SRIASetPrimitiveTopology(primitive);
+		break;
+	}
+	case SRCaptureOpPSSetShaderResources: {
+		UINT index = reader.GetUInt();
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		start = std::chrono::steady_clock::now();
+		device.SRPSSetShaderResources(index, handle);
+		break;
+	}
+	case SRCaptureOpGenerateMips: {
+		SRResourceHandle handle = MapHandle(reader.GetUInt());
+		start = std::chrono::steady_clock::now();
+		device.SRGenerateMips(handle);
+		break;
+	}
+	case SRCaptureOpPSSetSamplers: {
+		UINT index = reader.GetUInt();
+		SRSamplerDesc desc;
+		desc.Filter = SRFilter(reader.GetUInt());
+		desc.AddressU = SRTextureAddressMode(reader.GetUInt());
+		desc.AddressV = SRTextureAddressMode(reader.GetUInt());
+		desc.AddressW = SRTextureAddressMode(reader.GetUInt());
+		desc.MipLODBias = reader.GetFloat();
+		desc.MaxLOD = reader.GetFloat();
+		if (!reader.IsValid())
+			break;
+		start = std::chrono::steady_clock::now();
+		device.SRPSSetSamplers(index, desc);
+		break;
+	}
+	case SRCaptureOpOMSetRenderTarget: {
+		SRResourceHandle target = MapHandle(reader.GetUInt());
+		SRResourceHandle depth = MapHandle(reader.GetUInt());
+		bool isAllDepthInitToOne = reader.GetUInt() != 0;
+		if (!reader.IsValid())
+			break;
+		start = std::chrono::steady_clock::now();
+		device.SROMSetRenderTarget(target, depth, isAllDepthInitToOne);
+		break;
+	}
+	case SRCaptureOpDrawInstanced: {
+		UINT args[4];
+		reader.Get(args, sizeof(args));
+		if (!reader.IsValid())
+			break;
+		start = std::chrono::steady_clock::now();
+		device.SRDrawInstanced(args[0], args[1], args[2], args[3]);
+		break;
+	}
+	case SRCaptureOpDrawIndexedInstanced: {
+		UINT args[5];
+		reader.Get(args, sizeof(args));
+		if (!reader.IsValid())
+			break;
+		start = std::chrono::steady_clock::now();
+		device.SRDrawIndexedInstanced(args[0], args[1], args[2], args[3], args[4]);
+		break;
+	}
+	case SRCaptureOpEndFrame:
+		device.SREndFrame();
+		break;
+	case SRCaptureOpBeginStream:
+		break;
+	default:
+		return Fail("unknown record");
+	}
+	ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	return reader.IsValid() || Fail("malformed record");
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "SRDevice.h"
+
+/*
+ * Capture and replay of the SR* API stream.
+ *
+ * A capture file starts with the live resources and the bound state at SRBeginCapture,
+ * followed by every state, resource and draw call with the buffer contents.
+ * Shaders are function pointers, they are stored by the name they are registered with.
+ *
+ * file:   "SRCP" UINT32 version, records
+ * record: UINT32 op, UINT32 payload size, payload
+ */
+
+/*
+ * Name <-> function of the shaders of an application.
+ * The capturing and the replaying side have to register the same names.
+ */
+class SRShaderRegistry
+{
+public:
+	bool Register(const char* name, SRVertexShader vs) { return Register(name, ShaderVertex, reinterpret_cast<Function>(vs)); };
+	bool Register(const char* name, SRPixelShader ps) { return Register(name, ShaderPixel, reinterpret_cast<Function>(ps)); };
+	bool Register(const char* name, SRQuadPixelShader quadPS) { return Register(name, ShaderQuadPixel, reinterpret_cast<Function>(quadPS)); };
+
+	// nullptr if the shader is not registered
+	const char* FindName(SRVertexShader vs) const { return FindName(ShaderVertex, reinterpret_cast<Function>(vs)); };
+	const char* FindName(SRPixelShader ps) const { return FindName(ShaderPixel, reinterpret_cast<Function>(ps)); };
+	const char* FindName(SRQuadPixelShader quadPS) const { return FindName(ShaderQuadPixel, reinterpret_cast<Function>(quadPS)); };
+
+	SRVertexShader FindVertexShader(const char* name) const { return reinterpret_cast<SRVertexShader>(Find(ShaderVertex, name)); };
+	SRPixelShader FindPixelShader(const char* name) const { return reinterpret_cast<SRPixelShader>(Find(ShaderPixel, name)); };
+	SRQuadPixelShader FindQuadPixelShader(const char* name) const { return reinterpret_cast<SRQuadPixelShader>(Find(ShaderQuadPixel, name)); };
+
+private:
+	typedef void (*Function)();
+	enum ShaderType {
+		ShaderVertex,
+		ShaderPixel,
+		ShaderQuadPixel
+	};
+	struct Entry {
+		std::string name;
+		ShaderType type;
+		Function function;
+	};
+	std::vector<Entry> mEntries;
+
+	bool Register(const char* name, ShaderType type, Function function);
+	const char* FindName(ShaderType type, Function function) const;
+	Function Find(ShaderType type, const char* name) const;
+};
+
+typedef
+enum SRCaptureOp {
+	SRCaptureOpAllocateResource = 0,
+	SRCaptureOpCreateResource = 1,
+	SRCaptureOpCopyToResource = 2,
+	SRCaptureOpReleaseResource = 3,
+	SRCaptureOpResizeResource = 4,
+	SRCaptureOpClearRenderTargetView = 5,
+	SRCaptureOpClearDepthStencilView = 6,
+	SRCaptureOpSetPipelineState = 7,
+	SRCaptureOpSetRasterizerDesc = 8,
+	SRCaptureOpIASetVertexBuffers = 9,
+	SRCaptureOpIASetIndexBuffers = 10,
+	SRCaptureOpIASetConstantBuffers = 11,
+	SRCaptureOpIASetPrimitiveTopology = 12,
+	SRCaptureOpOMSetRenderTarget = 13,
+	SRCaptureOpDrawInstanced = 14,
+	SRCaptureOpDrawIndexedInstanced = 15,
+	SRCaptureOpEndFrame = 16,
+	SRCaptureOpBeginStream = 17,		// end of the initial state, the calls follow
+	SRCaptureOpPSSetShaderResources = 18,
+	SRCaptureOpPSSetSamplers = 19,
+	SRCaptureOpGenerateMips = 20,
+	SRCaptureOpWriteToResource = 21,	// the range written through a map, replayed through a map
+	SRCaptureOpCount
+} SRCaptureOp;
+
+/*
+ * Writer used by SRDevice while capturing, one method per captured call.
+ */
+class SRCapture
+{
+public:
+	SRCapture() = default;
+	SRCapture(const SRCapture& rhs) = delete;
+	SRCapture& operator=(const SRCapture& rhs) = delete;
+	~SRCapture();
+
+	bool Open(const char* fileName, const SRShaderRegistry* registry);
+	// false if a write failed at any point
+	bool Close();
+
+	void AllocateResource(UINT number);
+	void CreateResource(const SRResourceDescription& desc, SRResourceHandle handle);
+	void CopyToResource(SRResourceHandle handle, const void* pData, UINT len);
+	// len bytes at offset of a mapped resource of size bytes
+	void WriteToResource(SRResourceHandle handle, UINT size, UINT offset, const void* pData, UINT len);
+	void ReleaseResource(SRResourceHandle handle);
+	void ResizeResource(SRResourceHandle handle, const SRResourceDescription& desc);
+	void GenerateMips(SRResourceHandle handle);
+	void ClearRenderTargetView(SRResourceHandle handle, const float color[4]);
+	void ClearDepthStencilView(SRResourceHandle handle, SRClearFlags flag, float depth, UINT8 stencil);
+	// false if a shader is not registered
+	bool SetPipelineState(const SRPipelineState& state);
+	void SetRasterizerDesc(const SRRasterizerDesc& desc);
+	void IASetVertexBuffers(SRResourceHandle handle);
+	void IASetIndexBuffers(SRResourceHandle handle, DXGI_FORMAT format);
+	void IASetConstantBuffers(UINT index, SRResourceHandle handle);
+	void IASetPrimitiveTopology(SRPrimitiveTopology primitive);
+	void PSSetShaderResources(UINT index, SRResourceHandle handle);
+	void PSSetSamplers(UINT index, const SRSamplerDesc& desc);
+	void OMSetRenderTarget(SRResourceHandle target, SRResourceHandle depth, bool isAllDepthInitToOne);
+	void DrawInstanced(UINT vertexCount, UINT instanceCount, UINT startVertex, UINT startInstance);
+	void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, UINT baseVertex, UINT startInstance);
+	void EndFrame();
+	void BeginStream();
+
+private:
+	FILE* mFile = nullptr;
+	const SRShaderRegistry* mRegistry = nullptr;
+	bool mIsFailed = false;
+	std::vector<BYTE> mRecord;
+
+	void Begin(SRCaptureOp op);
+	void Put(const void* pData, size_t size);
+	void Put(UINT32 value) { Put(&value, sizeof(value)); };
+	void Put(float value) { Put(&value, sizeof(value)); };
+	void Put(const char* string);
+	void Put(const SRResourceDescription& desc);
+	void End();
+};
+
+/*
+ * Time spent in one call of the stream, over all loops.
+ */
+typedef struct SRReplayCall {
+	SRCaptureOp Op;
+	UINT Count = 0;
+	double TotalNs = 0.0;
+	double MinNs = 0.0;
+	double MaxNs = 0.0;
+} SRReplayCall;
+
+/*
+ * Re-executes a capture on a device.
+ * The initial state is replayed once, the calls after it loops times.
+ * Resources created by the calls are released after every loop, so that the loops start alike.
+ */
+class SRReplayer
+{
+public:
+	bool Load(const char* fileName);
+	bool Replay(SRDevice& device, const SRShaderRegistry& registry, UINT loops);
+
+	// one entry per call after the initial state, in stream order
+	const std::vector<SRReplayCall>& GetCalls() const { return mCalls; };
+	const std::vector<double>& GetLoopMs() const { return mLoopMs; };
+	const char* GetError() const { return mError.c_str(); };
+
+	static const char* OpName(SRCaptureOp op);
+
+private:
+	std::vector<BYTE> mData;
+	size_t mStreamBegin = 0;
+	std::vector<SRReplayCall> mCalls;
+	std::vector<double> mLoopMs;
+	std::string mError;
+
+	// captured handle -> replayed handle
+	std::vector<SRResourceHandle> mHandles;
+
+	bool Execute(SRDevice& device, const SRShaderRegistry& registry, size_t& offset, SRCaptureOp& op, double& ns,
+		std::vector<SRResourceHandle>* pCreated);
+	SRResourceHandle MapHandle(UINT32 handle) const;
+	bool Fail(const char* message);
+};
@@ -0,0 +1,448 @@
+#include "SRCommandList.h"
+#include "SRCapture.h"
+#include "SRUtils.h"
+#include <string.h>
+
+/*
+ * recording, validates against the device and the state recorded so far
+ */
+void SRCommandList::SRReset() {
+	mCommands.clear();
+	mPipelineStates.clear();
+	mSamplers.clear();
+	mIsClosed = false;
+	mIsFailed = false;
+
+	mRenderTargetHandle = SRDevice::InvalidHandle;
+	mDepthStencilHandle = SRDevice::InvalidHandle;
+	mVertexBufferHandle = SRDevice::InvalidHandle;
+	mIndexBufferHandle = SRDevice::InvalidHandle;
+	mIndexFormat = DXGI_FORMAT_R32_UINT;
+	for (int i = 0; i < 8; i++) {
+		mConstantsBufferHandle[i] = SRDevice::InvalidHandle;
+		mShaderResourceHandle[i] = SRDevice::InvalidHandle;
+	}
+	mPipelineState = SRPipelineState();
+	mHasPipelineState = false;
+
+	// the list does not inherit the topology of the device
+	mPrimitive = SRPrimitiveTopologyTriangleList;
+	Command command;
+	command.Type = CommandSetPrimitiveTopology;
+	command.Primitive = mPrimitive;
+	mCommands.push_back(command);
+}
+
+bool SRCommandList::SRClose() {
+	if (mIsClosed) {
+		Error(L"Command list is already closed.");
+		return false;
+	}
+	mIsClosed = true;
+	return !mIsFailed;
+}
+
+void SRCommandList::Error(const wchar_t* message) {
+	mIsFailed = true;
+	if (mDevice.mDebugLayer)
+		mDevice.ReportError(message, false);
+}
+
+bool SRCommandList::BeginCommand() {
+	if (mIsClosed) {
+		Error(L"Recording into a closed command list.");
+		return false;
+	}
+	return true;
+}
+
+void SRCommandList::SRClearRenderTargetView(SRResourceHandle ResourceHandle, const float color[4]) {
+	if (!BeginCommand())
+		return;
+	if (!mDevice.ValidRenderTarget(ResourceHandle)) {
+		Error(L"Invalid render target hanlde");
+		return;
+	}
+	Command command;
+	command.Type = CommandClearRenderTarget;
+	command.ClearRenderTarget.Handle = ResourceHandle;
+	memcpy(command.ClearRenderTarget.Color, color, sizeof(command.ClearRenderTarget.Color));
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRGenerateMips(SRResourceHandle ResourceHandle) {
+	if (!BeginCommand())
+		return;
+	if (!mDevice.ValidMipGeneration(ResourceHandle)) {
+		Error(L"Mips can not be generated for the resource.");
+		return;
+	}
+	Command command;
+	command.Type = CommandGenerateMips;
+	command.Resource = ResourceHandle;
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRClearDepthStencilView(SRResourceHandle ResourceHandle,
+	SRClearFlags flag, float depth, UINT8 stencil)
+{
+	if (!BeginCommand())
+		return;
+	UINT32 mask;
+	if (!mDevice.ValidDepthStencil(ResourceHandle)) {
+		Error(L"Invalid DepthStencil handle.");
+		return;
+	}
+	if (!SRDevice::DepthStencilClearMask(flag, mask)) {
+		Error(L"Unknwon Flag.");
+		return;
+	}
+	Command command;
+	command.Type = CommandClearDepthStencil;
+	command.ClearDepthStencil = { ResourceHandle, flag, depth, stencil };
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRSetPipelineState(SRPipelineState PipelineState) {
+	if (!BeginCommand())
+		return;
+	if (PipelineState.VS == nullptr ||
+		(PipelineState.EnableQuadPixelShader ? PipelineState.QuadPS == nullptr : PipelineState.PS == nullptr))
+	{
+		Error(L"Pipeline state without shader.");
+		mHasPipelineState = false;
+		return;
+	}
+	if (PipelineState.VSOutputByteCount < 4 * sizeof(float) || PipelineState.VSOutputByteCount % 4 != 0 ||
+		!SRDevice::ValidPipelineState(PipelineState))
+	{
+		Error(L"Invalid pipeline state.");
+		mHasPipelineState = false;
+		return;
+	}
+	mPipelineState = PipelineState;
+	mHasPipelineState = true;
+
+	Command command;
+	command.Type = CommandSetPipelineState;
+	command.PipelineState = UINT(mPipelineStates.size());
+	mPipelineStates.push_back(PipelineState);
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRIASetVertexBuffers(SRResourceHandle ResourceHandle) {
+	if (!BeginCommand())
+		return;
+	if (!mDevice.ValidBuffer(ResourceHandle)) {
+		Error(L"Invalid vertex buffer.");
+		mVertexBufferHandle = SRDevice::InvalidHandle;
+		return;
+	}
+	mVertexBufferHandle = ResourceHandle;
+
+	Command command;
+	command.Type = CommandSetVertexBuffer;
+	command.Buffer = { 0, ResourceHandle };
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRIASetIndexBuffers(SRResourceHandle ResourceHandle, DXGI_FORMAT Format) {
+	if (!BeginCommand())
+		return;
+	if (!mDevice.ValidBuffer(ResourceHandle) || !SRDevice::ValidIndexFormat(Format)) {
+		Error(L"Invalid index buffer.");
+		mIndexBufferHandle = SRDevice::InvalidHandle;
+		return;
+	}
+	mIndexBufferHandle = ResourceHandle;
+	mIndexFormat = Format;
+
+	Command command;
+	command.Type = CommandSetIndexBuffer;
+	command.Buffer = { UINT(Format), ResourceHandle };
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRIASetConstantBuffers(UINT Index, SRResourceHandle ResourceHandle) {
+	if (!BeginCommand())
+		return;
+	if (Index >= 8) {
+		Error(L"Only support 8 constant buffers.");
+		return;
+	}
+	if (ResourceHandle >= mDevice.mResources.size() ||
+		mDevice.mResources[ResourceHandle].ptr == nullptr)
+	{
+		Error(L"Invalid handle.");
+		return;
+	}
+	mConstantsBufferHandle[Index] = ResourceHandle;
+
+	Command command;
+	command.Type = CommandSetConstantBuffer;
+	command.Buffer = { Index, ResourceHandle };
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRIASetPrimitiveTopology(SRPrimitiveTopology Primitive) {
+	if (!BeginCommand())
+		return;
+	if (Primitive >= SRPrimitiveCount) {
+		Error(L"Unknown Primitive.");
+		return;
+	}
+	mPrimitive = Primitive;
+
+	Command command;
+	command.Type = CommandSetPrimitiveTopology;
+	command.Primitive = Primitive;
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRPSSetShaderResources(UINT Index, SRResourceHandle ResourceHandle) {
+	if (!BeginCommand())
+		return;
+	if (Index >= 8) {
+		Error(L"Only support 8 shader resources.");
+		return;
+	}
+	if (!mDevice.ValidShaderResource(ResourceHandle)) {
+		Error(L"Invalid shader resource.");
+		return;
+	}
+	mShaderResourceHandle[Index] = ResourceHandle;
+
+	Command command;
+	command.Type = CommandSetShaderResource;
+	command.Buffer = { Index, ResourceHandle };
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRPSSetSamplers(UINT Index, SRSamplerDesc Desc) {
+	if (!BeginCommand())
+		return;
+	if (Index >= 8) {
+		Error(L"Only support 8 samplers.");
+		return;
+	}
+	if (!SRDevice::ValidSampler(Desc)) {
+		Error(L"Invalid sampler.");
+		return;
+	}
+
+	Command command;
+	command.Type = CommandSetSampler;
+	command.Sampler = { Index, UINT(mSamplers.size()) };
+	mSamplers.push_back(Desc);
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SROMSetRenderTarget(SRResourceHandle TargetHandle, SRResourceHandle DepthHandle, bool IsAllDepthInitToOne) {
+	if (!BeginCommand())
+		return;
+	if (!mDevice.ValidDrawTarget(TargetHandle, DepthHandle)) {
+		Error(L"Invalid render target handle or depth handle");
+		mRenderTargetHandle = SRDevice::InvalidHandle;
+		mDepthStencilHandle = SRDevice::InvalidHandle;
+		return;
+	}
+	mRenderTargetHandle = TargetHandle;
+	mDepthStencilHandle = DepthHandle;
+
+	Command command;
+	command.Type = CommandSetRenderTarget;
+	command.RenderTarget = { TargetHandle, DepthHandle, IsAllDepthInitToOne };
+	mCommands.push_back(command);
+}
+
+// everything but the input ranges, those depend on the kind of draw
+bool SRCommandList::ValidDraw(UINT InstanceCount) {
+	if (!BeginCommand())
+		return false;
+	if (mRenderTargetHandle == SRDevice::InvalidHandle ||
+		mDepthStencilHandle == SRDevice::InvalidHandle ||
+		mVertexBufferHandle == SRDevice::InvalidHandle ||
+		!mHasPipelineState)
+	{
+		Error(L"Invalid buffer setting.");
+		return false;
+	}
+	// only support one instance now.
+	if (InstanceCount != 1) {
+		Error(L"Only support one instance.");
+		return false;
+	}
+	if (mPrimitive != SRPrimitiveTopologyTriangleList) {
+		Error(L"Unsupport Primitive.");
+		return false;
+	}
+	for (UINT i = 0; i < mPipelineState.NumConstantBuffer; i++) {
+		if (mConstantsBufferHandle[i] == SRDevice::InvalidHandle) {
+			Error(L"Constant buffer of the pipeline state is not bound.");
+			return false;
+		}
+	}
+	for (UINT i = 0; i < mPipelineState.NumShaderResources; i++) {
+		if (mShaderResourceHandle[i] == SRDevice::InvalidHandle) {
+			Error(L"Shader resource of the pipeline state is not bound.");
+			return false;
+		}
+	}
+	return true;
+}
+
+void SRCommandList::SRDrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation, UINT StartInstanceLocation) {
+	if (!ValidDraw(InstanceCount))
+		return;
+	const SRResource& vertexBuffer = mDevice.mResources[mVertexBufferHandle];
+	if ((UINT64(StartVertexLocation) + VertexCountPerInstance) * mPipelineState.VSInputByteStride > vertexBuffer.WIDTH) {
+		Error(L"Draw out of the vertex buffer.");
+		return;
+	}
+
+	Command command;
+	command.Type = CommandDraw;
+	command.Draw = { VertexCountPerInstance, StartVertexLocation, 0 };
+	mCommands.push_back(command);
+}
+
+void SRCommandList::SRDrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, UINT BaseVertexLocation, UINT StartInstanceLocation) {
+	if (!ValidDraw(InstanceCount))
+		return;
+	if (mIndexBufferHandle == SRDevice::InvalidHandle) {
+		Error(L"Invalid buffer setting.");
+		return;
+	}
+	const SRResource& indexBuffer = mDevice.mResources[mIndexBufferHandle];
+	const UINT64 indexSize = mIndexFormat == DXGI_FORMAT_R16_UINT ? sizeof(UINT16) : sizeof(UINT32);
+	if ((UINT64(StartIndexLocation) + IndexCountPerInstance) * indexSize > indexBuffer.WIDTH) {
+		Error(L"Draw out of the index buffer.");
+		return;
+	}
+	if (!mDevice.ValidMeshFileDraw(mVertexBufferHandle, mPipelineState.VSInputByteStride, mIndexBufferHandle, mIndexFormat,
+		StartIndexLocation, IndexCountPerInstance, BaseVertexLocation))
+	{
+		Error(L"Draw past the buffers of a mesh file.");
+		return;
+	}
+
+	Command command;
+	command.Type = CommandDrawIndexed;
+	command.Draw = { IndexCountPerInstance, StartIndexLocation, BaseVertexLocation };
+	mCommands.push_back(command);
+}
+
+/*
+ * playback, trusts the validation of the recording
+ */
+void SRDevice::SRExecuteCommandLists(UINT NumCommandLists, SRCommandList* const* ppCommandLists) {
+	for (UINT n = 0; n < NumCommandLists; n++) {
+		if (ValidCommandList(*ppCommandLists[n]))
+			ExecuteCommandList(*ppCommandLists[n], nullptr);
+	}
+}
+
+bool SRDevice::ValidCommandList(const SRCommandList& list) {
+	if (&list.mDevice != this) {
+		SRError(L"Command list of another device.");
+		return false;
+	}
+	if (!list.mIsClosed || list.mIsFailed) {
+		SRError(L"Command list is not closed or failed its validation.");
+		return false;
+	}
+	return true;
+}
+
+void SRDevice::ExecuteCommandList(const SRCommandList& list, const BYTE* const* pBuffers) {
+	SRTrace(mTracer, 0, "ExecuteCommandList", UINT(list.mCommands.size()));
+	UINT bufferIndex = 0;
+	for (const SRCommandList::Command& command : list.mCommands) {
+		switch (command.Type) {
+		case SRCommandList::CommandClearRenderTarget: {
+			auto& args = command.ClearRenderTarget;
+			if (mCapture != nullptr)
+				mCapture->ClearRenderTargetView(args.Handle, args.Color);
+			ClearRenderTarget(args.Handle, args.Color);
+			break;
+		}
+		case SRCommandList::CommandClearDepthStencil: {
+			auto& args = command.ClearDepthStencil;
+			if (mCapture != nullptr)
+				mCapture->ClearDepthStencilView(args.Handle, args.Flag, args.Depth, args.Stencil);
+			UINT32 mask = 0;
+			DepthStencilClearMask(args.Flag, mask);
+			ClearDepthStencil(args.Handle, mask, args.Depth, args.Stencil);
+			break;
+		}
+		case SRCommandList::CommandGenerateMips:
+			if (mCapture != nullptr)
+				mCapture->GenerateMips(command.Resource);
+			GenerateMips(command.Resource);
+			break;
+		case SRCommandList::CommandSetPipelineState:
+			mPipelineState = list.mPipelineStates[command.PipelineState];
+			if (mCapture != nullptr && !mCapture->SetPipelineState(mPipelineState))
+				SRError(L"Shader of the pipeline state is not registered for the capture.");
+			break;
+		case SRCommandList::CommandSetVertexBuffer:
+			if (mCapture != nullptr)
+				mCapture->IASetVertexBuffers(command.Buffer.Handle);
+			mVertexBufferHandle = command.Buffer.Handle;
+			mInternalVertexSnapshot = pBuffers != nullptr ? pBuffers[bufferIndex++] : nullptr;
+			break;
+		case SRCommandList::CommandSetIndexBuffer:
+			if (mCapture != nullptr)
+				mCapture->IASetIndexBuffers(command.Buffer.Handle, DXGI_FORMAT(command.Buffer.Index));
+			mIndexBufferHandle = command.Buffer.Handle;
+			mIndexFormat = DXGI_FORMAT(command.Buffer.Index);
+			mInternalIndexSnapshot = pBuffers != nullptr ? pBuffers[bufferIndex++] : nullptr;
+			break;
+		case SRCommandList::CommandSetConstantBuffer:
+			if (mCapture != nullptr)
+				mCapture->IASetConstantBuffers(command.Buffer.Index, command.Buffer.Handle);
+			mConstantsBufferHandle[command.Buffer.Index] = command.Buffer.Handle;
+			mInternalConstantsSnapshot[command.Buffer.Index] = pBuffers != nullptr ? pBuffers[bufferIndex++] : nullptr;
+			break;
+		case SRCommandList::CommandSetPrimitiveTopology:
+			if (mCapture != nullptr)
+				mCapture->IASetPrimitiveTopology(command.Primitive);
+			mPrimitive = command.Primitive;
+			break;
+		case SRCommandList::CommandSetShaderResource:
+			if (mCapture != nullptr)
+				mCapture->PSSetShaderResources(command.Buffer.Index, command.Buffer.Handle);
+			mShaderResourceHandle[command.Buffer.Index] = command.Buffer.Handle;
+			break;
+		case SRCommandList::CommandSetSampler:
+			mSamplers[command.Sampler.Index] = list.mSamplers[command.Sampler.Sampler];
+			if (mCapture != nullptr)
+				mCapture->PSSetSamplers(command.Sampler.Index, mSamplers[command.Sampler.Index]);
+			break;
+		case SRCommandList::CommandSetRenderTarget: {
+			auto& args = command.RenderTarget;
+			if (mCapture != nullptr)
+				mCapture->OMSetRenderTarget(args.Target, args.Depth, args.IsAllDepthInitToOne);
+			SetRenderTarget(args.Target, args.Depth, args.IsAllDepthInitToOne);
+			break;
+		}
+		case SRCommandList::CommandDraw:
+			if (mCapture != nullptr)
+				mCapture->DrawInstanced(command.Draw.Count, 1, command.Draw.Start, 0);
+			DrawInstanced(command.Draw.Count, command.Draw.Start);
+			break;
+		case SRCommandList::CommandDrawIndexed:
+			if (mCapture != nullptr)
+				mCapture->DrawIndexedInstanced(command.Draw.Count, 1, command.Draw.Start, command.Draw.BaseVertex, 0);
+			DrawIndexedInstanced(command.Draw.Count, command.Draw.Start, command.Draw.BaseVertex);
+			break;
+		}
+	}
+
+	// the copies belong to the submission
+	for (int i = 0; i < 8; i++) {
+		mInternalConstantsSnapshot[i] = nullptr;
+	}
+	mInternalVertexSnapshot = nullptr;
+	mInternalIndexSnapshot = nullptr;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+#include "SRDevice.h"
+
+/*
+ * Deferred render calls, after ID3D12GraphicsCommandList.
+ * The calls are validated against the resources of the device when they are recorded,
+ * SRDevice::SRExecuteCommandLists plays them back without checking them again.
+ *
+ * Every list is recorded by one thread at a time, different lists can be recorded in parallel.
+ * Resources must not be created, resized or released while lists are recorded,
+ * and the resources a list uses must stay alive until it has been executed.
+ * A list starts with nothing bound and the triangle list topology, it does not inherit
+ * the state of the device. The device keeps the state the last executed list left behind.
+ */
+class SRCommandList
+{
+public:
+	explicit SRCommandList(SRDevice& device) : mDevice(device) { SRReset(); };
+	SRCommandList(const SRCommandList& rhs) = delete;
+	SRCommandList& operator=(const SRCommandList& rhs) = delete;
+
+	// drop the recorded calls and start recording again
+	void SRReset();
+	// stop recording, false if a call failed its validation. only closed lists without errors can be executed.
+	bool SRClose();
+
+	void SRClearRenderTargetView(SRResourceHandle ResourceHandle, const float color[4]);
+	void SRClearDepthStencilView(SRResourceHandle ResourceHandle,
+		SRClearFlags flag, float depth, UINT8 stencil);
+	// after rendering into level 0 of a texture, see SRDevice::SRGenerateMips
+	void SRGenerateMips(SRResourceHandle ResourceHandle);
+
+	void SRSetPipelineState(SRPipelineState PipelineState);
+
+	void SRIASetVertexBuffers(SRResourceHandle ResourceHandle);
+	void SRIASetIndexBuffers(SRResourceHandle ResourceHandle, DXGI_FORMAT Format = DXGI_FORMAT_R32_UINT);
+	void SRIASetConstantBuffers(UINT Index, SRResourceHandle ResourceHandle);
+	void SRIASetPrimitiveTopology(SRPrimitiveTopology Primitive);
+
+	void SRPSSetShaderResources(UINT Index, SRResourceHandle ResourceHandle);
+	void SRPSSetSamplers(UINT Index, SRSamplerDesc Desc);
+
+	void SROMSetRenderTarget(SRResourceHandle TargetHandle, SRResourceHandle DepthHandle, bool IsAllDepthInitToOne = false);
+
+	void SRDrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation, UINT StartInstanceLocation);
+	void SRDrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, UINT BaseVertexLocation, UINT StartInstanceLocation);
+
+private:
+	friend class SRDevice;
+	friend class SRCommandQueue;
+
+	typedef enum CommandType {
+		CommandClearRenderTarget,
+		CommandClearDepthStencil,
+		CommandGenerateMips,
+		CommandSetPipelineState,
+		CommandSetVertexBuffer,
+		CommandSetIndexBuffer,
+		CommandSetConstantBuffer,
+		CommandSetPrimitiveTopology,
+		CommandSetShaderResource,
+		CommandSetSampler,
+		CommandSetRenderTarget,
+		CommandDraw,
+		CommandDrawIndexed
+	} CommandType;
+
+	struct ClearRenderTargetArgs {
+		SRResourceHandle Handle;
+		float Color[4];
+	};
+	struct ClearDepthStencilArgs {
+		SRResourceHandle Handle;
+		SRClearFlags Flag;
+		float Depth;
+		UINT8 Stencil;
+	};
+	struct BufferArgs {
+		UINT Index;					// constant buffer / shader resource slot, index format
+		SRResourceHandle Handle;
+	};
+	struct SamplerArgs {
+		UINT Index;
+		UINT Sampler;				// index into mSamplers
+	};
+	struct RenderTargetArgs {
+		SRResourceHandle Target;
+		SRResourceHandle Depth;
+		bool IsAllDepthInitToOne;
+	};
+	struct DrawArgs {
+		UINT Count;					// vertices or indices
+		UINT Start;
+		UINT BaseVertex;
+	};
+	struct Command {
+		CommandType Type;
+		union {
+			ClearRenderTargetArgs ClearRenderTarget;
+			ClearDepthStencilArgs ClearDepthStencil;
+			SRResourceHandle Resource;
+			UINT PipelineState;		// index into mPipelineStates
+			BufferArgs Buffer;
+			SamplerArgs Sampler;
+			SRPrimitiveTopology Primitive;
+			RenderTargetArgs RenderTarget;
+			DrawArgs Draw;
+		};
+	};
+
+	SRDevice& mDevice;
+	std::vector<Command> mCommands;
+	std::vector<SRPipelineState> mPipelineStates;
+	std::vector<SRSamplerDesc> mSamplers;
+	bool mIsClosed = false;
+	bool mIsFailed = false;
+
+	// state recorded so far, the draws are validated against it
+	SRResourceHandle mRenderTargetHandle;
+	SRResourceHandle mDepthStencilHandle;
+	SRResourceHandle mVertexBufferHandle;
+	SRResourceHandle mIndexBufferHandle;
+	DXGI_FORMAT mIndexFormat;
+	SRResourceHandle mConstantsBufferHandle[8];
+	SRResourceHandle mShaderResourceHandle[8];
+	SRPipelineState mPipelineState;
+	bool mHasPipelineState;
+	SRPrimitiveTopology mPrimitive;
+
+	bool BeginCommand();
+	bool ValidDraw(UINT InstanceCount);
+	void Error(const wchar_t* message);
+};
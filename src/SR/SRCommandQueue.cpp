@@ -0,0 +1,138 @@
+#include "SRCommandQueue.h"
+#include "SRUtils.h"
+#include <string.h>
+
+// constant buffer copies are aligned for vector loads
+static const size_t ConstantAlignment = 16;
+
+void SRFence::SRWait(UINT64 Value) {
+	if (SRGetCompletedValue() >= Value)
+		return;
+	std::unique_lock<std::mutex> lock(mMutex);
+	mSignaled.wait(lock, [&]() { return SRGetCompletedValue() >= Value; });
+}
+
+void SRFence::Signal(UINT64 value) {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mValue.store(value, std::memory_order_release);
+	}
+	mSignaled.notify_all();
+}
+
+SRCommandQueue::SRCommandQueue(SRDevice& device) : mDevice(device) {
+	mDevice.mInternalQueue = this;
+	mThread = std::thread(&SRCommandQueue::ThreadMain, this);
+}
+
+SRCommandQueue::~SRCommandQueue() {
+	SRFlush();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWakeUp.notify_one();
+	mThread.join();
+	mDevice.mInternalQueue = nullptr;
+}
+
+void SRCommandQueue::SRExecuteCommandLists(UINT NumCommandLists, SRCommandList* const* ppCommandLists) {
+	for (UINT n = 0; n < NumCommandLists; n++) {
+		const SRCommandList& list = *ppCommandLists[n];
+		if (!mDevice.ValidCommandList(list))
+			continue;
+
+		// versioned buffers: the list reads the contents they have now
+		Submission submission;
+		submission.Type = SubmissionCommandList;
+		submission.List = &list;
+		for (const SRCommandList::Command& command : list.mCommands) {
+			if (command.Type != SRCommandList::CommandSetVertexBuffer && command.Type != SRCommandList::CommandSetIndexBuffer &&
+				command.Type != SRCommandList::CommandSetConstantBuffer)
+				continue;
+			const SRResource& resource = mDevice.mResources[command.Buffer.Handle];
+			if (resource.VERSIONS > 1) {
+				// the next SRMapResource moves on to another version, this one stays as it is
+				submission.Buffers.push_back(resource.ptr);
+				continue;
+			}
+			submission.Buffers.push_back(nullptr);
+			if (command.Type != SRCommandList::CommandSetConstantBuffer)
+				continue;
+			size_t size = SRDevice::SizeOfResource(resource);
+			size_t offset = (submission.Constants.size() + ConstantAlignment - 1) & ~(ConstantAlignment - 1);
+			submission.Constants.resize(offset + size);
+			memcpy(submission.Constants.data() + offset, resource.ptr, size);
+			submission.ConstantCopies.emplace_back(submission.Buffers.size() - 1, offset);
+		}
+		Submit(std::move(submission));
+	}
+}
+
+void SRCommandQueue::SRSignal(SRFence* pFence, UINT64 Value) {
+	Submission submission;
+	submission.Type = SubmissionSignal;
+	submission.Fence = pFence;
+	submission.Value = Value;
+	Submit(std::move(submission));
+}
+
+void SRCommandQueue::SREndFrame() {
+	Submission submission;
+	submission.Type = SubmissionEndFrame;
+	Submit(std::move(submission));
+}
+
+void SRCommandQueue::SRFlush() {
+	std::unique_lock<std::mutex> lock(mMutex);
+	mIdle.wait(lock, [&]() { return mPending.empty() && !mIsBusy; });
+}
+
+void SRCommandQueue::Submit(Submission&& submission) {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPending.push_back(std::move(submission));
+	}
+	mWakeUp.notify_one();
+	if (mDevice.mCapture != nullptr)
+		SRFlush();
+}
+
+void SRCommandQueue::ThreadMain() {
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		mWakeUp.wait(lock, [&]() { return mQuit || !mPending.empty(); });
+		if (mPending.empty())
+			return;
+
+		Submission submission = std::move(mPending.front());
+		mPending.pop_front();
+		mIsBusy = true;
+		lock.unlock();
+		Execute(submission);
+		lock.lock();
+		mIsBusy = false;
+		if (mPending.empty())
+			mIdle.notify_all();
+	}
+}
+
+void SRCommandQueue::Execute(Submission& submission) {
+	// the application thread may use the pool meanwhile, see the ownership rules
+	std::lock_guard<std::mutex> lock(mDevice.mInternalPoolMutex);
+	switch (submission.Type) {
+	case SubmissionCommandList: {
+		for (const auto& copy : submission.ConstantCopies) {
+			submission.Buffers[copy.first] = submission.Constants.data() + copy.second;
+		}
+		mDevice.ExecuteCommandList(*submission.List, submission.Buffers.data());
+		break;
+	}
+	case SubmissionSignal:
+		submission.Fence->Signal(submission.Value);
+		break;
+	case SubmissionEndFrame:
+		mDevice.SREndFrame();
+		break;
+	}
+}
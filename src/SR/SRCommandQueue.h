@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SRCommandList.h"
+
+/*
+ * Completion of the work submitted to an SRCommandQueue, after ID3D12Fence.
+ */
+class SRFence
+{
+public:
+	SRFence() = default;
+	SRFence(const SRFence& rhs) = delete;
+	SRFence& operator=(const SRFence& rhs) = delete;
+
+	UINT64 SRGetCompletedValue() const { return mValue.load(std::memory_order_acquire); };
+	// blocks until the completed value reaches Value
+	void SRWait(UINT64 Value);
+
+private:
+	friend class SRCommandQueue;
+
+	std::atomic<UINT64> mValue{ 0 };
+	std::mutex mMutex;
+	std::condition_variable mSignaled;
+
+	void Signal(UINT64 value);
+};
+
+/*
+ * Asynchronous submission, after ID3D12CommandQueue.
+ * The submit calls return at once, a renderer thread plays the command lists back in order
+ * on the thread pool of the device, so the application can prepare frame N + 1 while frame N rasterizes.
+ *
+ * Ownership until a fence signaled after the submission has completed:
+ * - the queue owns the device, do not call the immediate render API, SREndFrame, or the debug API
+ *   other than the pipeline statistics query, which waits for the submitted work itself.
+ * - the command lists must not be reset or destroyed.
+ * - vertex, index buffers, textures and targets used by the lists must not be written, resized or released.
+ * - constant buffers can be updated with SRCopyToResource right after the submission,
+ *   their contents are copied when the lists are submitted.
+ * - upload buffers (SRResourceDescription::VERSIONS > 1) can be mapped right after the submission,
+ *   the lists read the version mapped before it. VERSIONS - 1 more maps are safe while they run.
+ * - the device calls that run on its thread pool, SRGenerateMips and the copies to / from swizzled textures
+ *   the lists do not use, SRAllocateResource, and creating or releasing virtual textures the lists do not use
+ *   wait for the submission being played back.
+ * - SRAllocateResource moves the resources: not while lists are recorded or submitted on other threads.
+ * One queue per device, destroyed before the device. It waits for the pending work.
+ * While the device captures (SRBeginCapture) the submissions complete before returning,
+ * so that the capture keeps the order of the calls.
+ */
+class SRCommandQueue
+{
+public:
+	explicit SRCommandQueue(SRDevice& device);
+	SRCommandQueue(const SRCommandQueue& rhs) = delete;
+	SRCommandQueue& operator=(const SRCommandQueue& rhs) = delete;
+	~SRCommandQueue();
+
+	// lists that are not closed or failed their validation are skipped
+	void SRExecuteCommandLists(UINT NumCommandLists, SRCommandList* const* ppCommandLists);
+	// the fence reaches Value once the work submitted before is done
+	void SRSignal(SRFence* pFence, UINT64 Value);
+	// SRDevice::SREndFrame, after the work submitted before
+	void SREndFrame();
+	// blocks until all submitted work is done
+	void SRFlush();
+
+private:
+	typedef enum SubmissionType {
+		SubmissionCommandList,
+		SubmissionSignal,
+		SubmissionEndFrame
+	} SubmissionType;
+
+	struct Submission {
+		SubmissionType Type;
+		const SRCommandList* List = nullptr;
+		// what the vertex, index and constant buffer set commands of the list read, in their order:
+		// the mapped version of upload buffers, a copy of the other constant buffers made at submission,
+		// nullptr for the other vertex and index buffers
+		std::vector<const BYTE*> Buffers;
+		std::vector<BYTE> Constants;
+		std::vector<std::pair<size_t, size_t>> ConstantCopies;	// (index in Buffers, offset in Constants)
+		SRFence* Fence = nullptr;
+		UINT64 Value = 0;
+	};
+
+	SRDevice& mDevice;
+	std::thread mThread;
+	std::mutex mMutex;
+	std::condition_variable mWakeUp;
+	std::condition_variable mIdle;
+	std::deque<Submission> mPending;
+	bool mIsBusy = false;
+	bool mQuit = false;
+
+	void Submit(Submission&& submission);
+	void ThreadMain();
+	void Execute(Submission& submission);
+};
@@ -1,10 +1,33 @@
 #include "SRDevice.h"
+#include "SRCapture.h"
+#include "SRCommandQueue.h"
 #include "SRUtils.h"
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
+#ifdef _MSC_VER
 #pragma warning(disable : 4018)
+#endif
+
+// pixels / Hi-Z tiles a worker clears at a time
+static const UINT ClearGrain = 16 * 1024;
+static const UINT HiZInitGrain = 64;
+static const UINT SwizzleGrain = 64;
+static const UINT MipRowGrain = 16;
 
 bool SRDevice::SRAllocateResource(UINT number) {
+	std::lock_guard<std::mutex> lock(mInternalPoolMutex);
+	if (mCapture != nullptr)
+		mCapture->AllocateResource(number);
 	if (number > mResources.size()) {
+		// the new handles go below the free ones, the top of the free handles is handed out next
+		std::vector<SRResourceHandle> handles;
+		for (SRResourceHandle handle = number; handle > mResources.size(); handle--) {
+			handles.push_back(handle - 1);
+		}
+		mInternalFreeHandles.insert(mInternalFreeHandles.begin(), handles.begin(), handles.end());
 		mResources.resize(number);
 	}
 	else if (number < mResources.size()) {
@@ -20,8 +43,8 @@ bool SRDevice::SRAllocateResource(UINT number) {
 		
 		// safe to shrink
 		mResources.resize(number);
-		if (mInternalAllocateHelperHandle >= number)
-			mInternalAllocateHelperHandle = 0;
+		mInternalFreeHandles.erase(std::remove_if(mInternalFreeHandles.begin(), mInternalFreeHandles.end(),
+			[number](SRResourceHandle handle) { return handle >= number; }), mInternalFreeHandles.end());
 	}
 	return true;
 }
@@ -51,7 +74,8 @@ bool SRDevice::FillResouceAttribute(const SRResourceDescription desc, SRResource
 		break;
 
 	case SRResourceDimensionTextureCube:
-		if (desc.DEPTH != 6) return false;
+		// the faces are square for the lookups across their edges
+		if (desc.DEPTH != 6 || desc.WIDTH != desc.HEIGHT) return false;
 		resource.WIDTH = desc.WIDTH;
 		resource.HEIGHT = desc.HEIGHT;
 		resource.DEPTH = 6;
@@ -61,73 +85,308 @@ bool SRDevice::FillResouceAttribute(const SRResourceDescription desc, SRResource
 		SRFatal(L"Unsupport dimension.");
 		return false;
 	}
+
+	// buffers have no levels to shrink to, 3D textures shrink in depth as well
+	UINT fullLevels = desc.DIMENSION == SRResourceDimensionBuffer ? 1 : SRFullMipLevels(desc.WIDTH, desc.HEIGHT);
+	if (desc.DIMENSION == SRResourceDimensionTexture3D)
+		fullLevels = SRFullMipLevels((std::max)(desc.WIDTH, desc.DEPTH), desc.HEIGHT);
+	if (desc.MIPLEVELS > fullLevels) return false;
+	if (desc.LAYOUT == SRResourceLayoutSwizzled &&
+		(desc.DIMENSION != SRResourceDimensionTexture2D || SRIsBlockCompressed(desc.FORMAT) || SizeOfFormat(desc.FORMAT) <= 0))
+		return false;
+	if (desc.LAYOUT == SRResourceLayoutVirtual &&
+		(desc.DIMENSION != SRResourceDimensionTexture2D || !SRIsSampleableFormat(desc.FORMAT) ||
+		 SRVirtualPageShift(desc.FORMAT) == 0))
+		return false;
+	if (desc.LAYOUT != SRResourceLayoutRowMajor && desc.LAYOUT != SRResourceLayoutSwizzled &&
+		desc.LAYOUT != SRResourceLayoutVirtual) return false;
+	if (desc.VERSIONS == 0 || (desc.VERSIONS > 1 && desc.DIMENSION != SRResourceDimensionBuffer)) return false;
+	resource.MIPLEVELS = desc.MIPLEVELS == 0 ? fullLevels : desc.MIPLEVELS;
+	resource.LAYOUT = desc.LAYOUT;
+	resource.VERSIONS = desc.VERSIONS;
+	resource.VERSION = 0;
 	resource.DIMENSION = desc.DIMENSION;
 	resource.FORMAT = desc.FORMAT;
 	return true;
 }
 
-bool SRDevice::SRCreateResource(SRResourceDescription Desc, SRResourceHandle* pHandle) {
-	size_t total = mResources.size();
-	for (UINT i = 0; i < total; i++) {
-		if (mResources[mInternalAllocateHelperHandle].ptr == nullptr) {
-			auto& resource = mResources[mInternalAllocateHelperHandle];
-			if (!FillResouceAttribute(Desc, resource)) {
-				*pHandle = InvalidHandle;
-				SRError(L"Incoorect description.");
-				return false;
-			}
-
-			UINT size = resource.WIDTH  * resource.HEIGHT * resource.DEPTH * SizeOfFormat(resource.FORMAT);
-			if (size == 0) {
-				// if size is 0, then we return true but not create a resource.
-				*pHandle = InvalidHandle;
-				return true;
-			}
-			resource.ptr = (BYTE*)malloc(size);
+size_t SRDevice::SizeOfResource(const SRResource& resource) {
+	return SRTextureLayout(resource.DIMENSION, resource.FORMAT, resource.WIDTH, resource.HEIGHT, resource.DEPTH,
+		resource.MIPLEVELS, resource.LAYOUT, nullptr);
+}
 
-			// point to the next handle inorder to speed up following create
+size_t SRDevice::VersionStride(const SRResource& resource) {
+	// every version starts on a cache line
+	return (SizeOfResource(resource) + SRHeapAlignment - 1) & ~size_t(SRHeapAlignment - 1);
+}
 
-			if (resource.ptr == nullptr) {
-				*pHandle = InvalidHandle;
-				SRError(L"Out of memory");
-				return false;
-			}
-			else {
-				*pHandle = mInternalAllocateHelperHandle;
-				mInternalAllocateHelperHandle = (mInternalAllocateHelperHandle + 1) % total;
-				return true;
+// len bytes of row-major data, the levels one after the other, to / from a swizzled resource.
+// the rows are converted in parallel, a partial texel at the end is left out.
+void SRDevice::CopySwizzled(const SRResource& resource, BYTE* pRowMajor, size_t len, bool isUpload) {
+	const UINT texelSize = SizeOfFormat(resource.FORMAT);
+	size_t rowMajorOffsets[SRMaxMipLevels], swizzledOffsets[SRMaxMipLevels];
+	SRTextureLayout(resource.DIMENSION, resource.FORMAT, resource.WIDTH, resource.HEIGHT, resource.DEPTH,
+		resource.MIPLEVELS, SRResourceLayoutRowMajor, rowMajorOffsets);
+	SRTextureLayout(resource.DIMENSION, resource.FORMAT, resource.WIDTH, resource.HEIGHT, resource.DEPTH,
+		resource.MIPLEVELS, SRResourceLayoutSwizzled, swizzledOffsets);
+
+	std::lock_guard<std::mutex> lock(mInternalPoolMutex);
+	for (UINT level = 0; level < resource.MIPLEVELS && rowMajorOffsets[level] < len; level++) {
+		const UINT width = (std::max)(resource.WIDTH >> level, 1u);
+		const UINT height = (std::max)(resource.HEIGHT >> level, 1u);
+		const size_t rowSize = size_t(width) * texelSize;
+		const size_t available = len - rowMajorOffsets[level];
+		const UINT fullRows = UINT((std::min)(size_t(height), available / rowSize));
+		BYTE* rows = pRowMajor + rowMajorOffsets[level];
+		BYTE* swizzled = resource.ptr + swizzledOffsets[level];
+
+		mThreadPool.ParallelFor(fullRows, SwizzleGrain, [=](UINT begin, UINT end, UINT threadIndex) {
+			for (UINT y = begin; y < end; y++) {
+				if (isUpload)
+					SRSwizzleRow(swizzled, rows + y * rowSize, width, texelSize, y, width);
+				else
+					SRUnswizzleRow(rows + y * rowSize, swizzled, width, texelSize, y, width);
 			}
+		});
+		if (fullRows < height) {
+			UINT texels = UINT((available - fullRows * rowSize) / texelSize);
+			if (isUpload)
+				SRSwizzleRow(swizzled, rows + fullRows * rowSize, width, texelSize, fullRows, texels);
+			else
+				SRUnswizzleRow(rows + fullRows * rowSize, swizzled, width, texelSize, fullRows, texels);
 		}
-		mInternalAllocateHelperHandle = (mInternalAllocateHelperHandle + 1) % total;
 	}
-	*pHandle = InvalidHandle;
-	SRError(L"No available handle.");
-	return false;
+}
+
+bool SRDevice::SRCreateResource(SRResourceDescription Desc, SRResourceHandle* pHandle) {
+	bool isSucceeded = CreateResource(Desc, pHandle);
+	// the handle is recorded, so that the replay can map the handles of the following calls
+	if (mCapture != nullptr)
+		mCapture->CreateResource(Desc, *pHandle);
+	return isSucceeded;
+}
+
+bool SRDevice::CreateResource(SRResourceDescription Desc, SRResourceHandle* pHandle) {
+	if (mInternalFreeHandles.empty()) {
+		*pHandle = InvalidHandle;
+		SRError(L"No available handle.");
+		return false;
+	}
+	const SRResourceHandle handle = mInternalFreeHandles.back();
+	auto& resource = mResources[handle];
+	if (!FillResouceAttribute(Desc, resource)) {
+		*pHandle = InvalidHandle;
+		SRError(L"Incoorect description.");
+		return false;
+	}
+
+	size_t size = SizeOfResource(resource);
+	if (size == 0) {
+		// if size is 0, then we return true but not create a resource.
+		*pHandle = InvalidHandle;
+		return true;
+	}
+	resource.ptr = mHeap.Allocate(resource.VERSIONS > 1 ? VersionStride(resource) * resource.VERSIONS : size);
+	if (resource.ptr == nullptr) {
+		*pHandle = InvalidHandle;
+		SRError(L"Out of memory");
+		return false;
+	}
+
+	mInternalFreeHandles.pop_back();
+	if (resource.LAYOUT == SRResourceLayoutVirtual) {
+		// no page populated and none looked up yet
+		memset(resource.ptr, 0, size);
+		// SREndFrame resolves the page faults on the SRCommandQueue thread
+		std::lock_guard<std::mutex> lock(mInternalPoolMutex);
+		mResidency.Reserve(handle, resource.ptr, resource.FORMAT, resource.WIDTH, resource.HEIGHT, resource.MIPLEVELS);
+	}
+	*pHandle = handle;
+	return true;
 }
 
 void SRDevice::SRCopyToResource(SRResourceHandle Handle, const void* pData, UINT len) {
+	if (mCapture != nullptr)
+		mCapture->CopyToResource(Handle, pData, len);
 	if (Handle >= mResources.size() || mResources[Handle].ptr == nullptr) {
 		SRError(L"Invalid Resource");
 		return;
 	}
 	auto& resources = mResources[Handle];
-	if (len > resources.WIDTH * resources.HEIGHT * resources.DEPTH) {
+	if (resources.LAYOUT == SRResourceLayoutVirtual) {
+		SRError(L"Virtual resources are filled by the page faults.");
+		return;
+	}
+	if (IsReadOnly(Handle)) {
+		SRError(L"Buffers of a mesh file are read-only.");
+		return;
+	}
+	if (resources.LAYOUT == SRResourceLayoutSwizzled) {
+		SRResource rowMajor = resources;
+		rowMajor.LAYOUT = SRResourceLayoutRowMajor;
+		if (len > SizeOfResource(rowMajor)) {
+			SRError(L"Too long, out of border.");
+			return;
+		}
+		CopySwizzled(resources, const_cast<BYTE*>(reinterpret_cast<const BYTE*>(pData)), len, true);
+		return;
+	}
+	if (len > SizeOfResource(resources)) {
 		SRError(L"Too long, out of border.");
 		return; 
 	}
 	memcpy(mResources[Handle].ptr, pData, len);
+	// blocks decoded from the old contents
+	if (SRIsBlockCompressed(resources.FORMAT))
+		SRInvalidateDecodedBlocks();
 	return;
 }
 
+void SRDevice::SRCopyFromResource(SRResourceHandle Handle, void* pData, UINT len) {
+	if (Handle >= mResources.size() || mResources[Handle].ptr == nullptr) {
+		SRError(L"Invalid Resource");
+		return;
+	}
+	auto& resource = mResources[Handle];
+	if (resource.LAYOUT == SRResourceLayoutVirtual) {
+		SRError(L"Virtual resources can not be read back.");
+		return;
+	}
+	if (resource.LAYOUT == SRResourceLayoutSwizzled) {
+		SRResource rowMajor = resource;
+		rowMajor.LAYOUT = SRResourceLayoutRowMajor;
+		if (len > SizeOfResource(rowMajor)) {
+			SRError(L"Too long, out of border.");
+			return;
+		}
+		CopySwizzled(resource, reinterpret_cast<BYTE*>(pData), len, false);
+		return;
+	}
+	if (len > SizeOfResource(resource)) {
+		SRError(L"Too long, out of border.");
+		return;
+	}
+	memcpy(pData, resource.ptr, len);
+}
+
 void SRDevice::SRReleaseResource(SRResourceHandle Handle) {
+	if (mCapture != nullptr)
+		mCapture->ReleaseResource(Handle);
 	if (Handle < mResources.size()) {
 		SRResource& resource = mResources[Handle];
-		free(resource.ptr);
+		if (SRIsBlockCompressed(resource.FORMAT))
+			SRInvalidateDecodedBlocks();
+		if (resource.ptr == nullptr)
+			return;
+		if (resource.LAYOUT == SRResourceLayoutVirtual) {
+			std::lock_guard<std::mutex> lock(mInternalPoolMutex);
+			mResidency.Release(Handle);
+		}
+		if (IsReadOnly(Handle))
+			mInternalMappedFiles.erase(Handle);
+		else
+			mHeap.Free(resource.ptr - resource.VERSION * VersionStride(resource));
 		resource.ptr = nullptr;
+		mInternalFreeHandles.push_back(Handle);
+	}
+}
+
+bool SRDevice::SRMapResource(SRResourceHandle Handle, const SRRange* pReadRange, void** ppData) {
+	*ppData = nullptr;
+	if (Handle >= mResources.size() || mResources[Handle].ptr == nullptr) {
+		SRError(L"Invalid Resource");
+		return false;
+	}
+	SRResource& resource = mResources[Handle];
+	if (resource.LAYOUT != SRResourceLayoutRowMajor) {
+		SRError(L"Only row-major resources can be mapped.");
+		return false;
+	}
+	if (IsReadOnly(Handle)) {
+		SRError(L"Buffers of a mesh file are read-only.");
+		return false;
+	}
+	const size_t size = SizeOfResource(resource);
+	if (pReadRange != nullptr && (pReadRange->Begin > pReadRange->End || pReadRange->End > size)) {
+		SRError(L"Too long, out of border.");
+		return false;
+	}
+	if (resource.VERSIONS > 1) {
+		// the next version, what will be read carried over from the current one
+		const size_t stride = VersionStride(resource);
+		const BYTE* current = resource.ptr;
+		BYTE* versions = resource.ptr - resource.VERSION * stride;
+		resource.VERSION = (resource.VERSION + 1) % resource.VERSIONS;
+		resource.ptr = versions + resource.VERSION * stride;
+		const size_t begin = pReadRange != nullptr ? pReadRange->Begin : 0;
+		const size_t end = pReadRange != nullptr ? pReadRange->End : size;
+		memcpy(resource.ptr + begin, current + begin, end - begin);
+	}
+	*ppData = resource.ptr;
+	return true;
+}
+
+void SRDevice::SRUnmapResource(SRResourceHandle Handle, const SRRange* pWrittenRange) {
+	if (Handle >= mResources.size() || mResources[Handle].ptr == nullptr) {
+		SRError(L"Invalid Resource");
+		return;
+	}
+	const SRResource& resource = mResources[Handle];
+	if (pWrittenRange != nullptr && pWrittenRange->Begin >= pWrittenRange->End)
+		return;
+	// blocks decoded from the old contents
+	if (SRIsBlockCompressed(resource.FORMAT))
+		SRInvalidateDecodedBlocks();
+	// only what was written is recorded
+	const size_t size = SizeOfResource(resource);
+	const size_t begin = pWrittenRange != nullptr ? (std::min)(pWrittenRange->Begin, size) : 0;
+	const size_t end = pWrittenRange != nullptr ? (std::min)(pWrittenRange->End, size) : size;
+	if (mCapture != nullptr && begin < end)
+		mCapture->WriteToResource(Handle, UINT(size), UINT(begin), resource.ptr + begin, UINT(end - begin));
+}
+
+bool SRDevice::SRGenerateMips(SRResourceHandle Handle) {
+	if (mCapture != nullptr)
+		mCapture->GenerateMips(Handle);
+	if (!ValidMipGeneration(Handle)) {
+		SRError(L"Mips can not be generated for the resource.");
+		return false;
+	}
+	// the command lists generate theirs on the queue thread, which holds the lock already
+	std::lock_guard<std::mutex> lock(mInternalPoolMutex);
+	GenerateMips(Handle);
+	return true;
+}
+
+void SRDevice::GenerateMips(SRResourceHandle handle) {
+	SRTrace(mTracer, 0, "GenerateMips");
+	const SRResource& resource = mResources[handle];
+	SRTextureView view;
+	FillTextureView(resource, view);
+
+	// each level is filtered from the one above, so the levels go one after another
+	// and the rows of all faces / slices of a level are spread over the threads
+	for (UINT level = 1; level < resource.MIPLEVELS; level++) {
+		const UINT rows = (std::max)(resource.HEIGHT >> level, 1u);
+		UINT slices = 1;
+		if (resource.DIMENSION == SRResourceDimensionTextureCube)
+			slices = resource.DEPTH;
+		else if (resource.DIMENSION == SRResourceDimensionTexture3D)
+			slices = (std::max)(resource.DEPTH >> level, 1u);
+		mThreadPool.ParallelFor(rows * slices, MipRowGrain, [&](UINT begin, UINT end, UINT threadIndex) {
+			while (begin < end) {
+				const UINT slice = begin / rows;
+				const UINT sliceEnd = (std::min)(end, (slice + 1) * rows);
+				SRGenerateMipRows(view, level, slice, begin - slice * rows, sliceEnd - slice * rows);
+				begin = sliceEnd;
+			}
+		});
 	}
 }
 
 bool SRDevice::SRResizeResource(SRResourceHandle Handle, SRResourceDescription Desc) {
+	if (mCapture != nullptr)
+		mCapture->ResizeResource(Handle, Desc);
 	if (Handle >= mResources.size()) {
 		SRError(L"Handle out of range.");
 		return false;
@@ -143,22 +402,47 @@ bool SRDevice::SRResizeResource(SRResourceHandle Handle, SRResourceDescription D
 		SRError(L"Description doesn't correspond resource.");
 		return false;
 	}
-	if (!FillResouceAttribute(Desc, resource)) {
+	if (resource.LAYOUT == SRResourceLayoutVirtual || Desc.LAYOUT == SRResourceLayoutVirtual) {
+		SRError(L"Virtual resources can not be resized.");
+		return false;
+	}
+	if (resource.VERSIONS > 1 || Desc.VERSIONS > 1) {
+		SRError(L"Upload buffers can not be resized.");
+		return false;
+	}
+	if (IsReadOnly(Handle)) {
+		SRError(L"Buffers of a mesh file can not be resized.");
+		return false;
+	}
+	// the contents are kept as they are, in the layout they were written in
+	if (Desc.LAYOUT != SRResourceLayoutRowMajor && Desc.LAYOUT != resource.LAYOUT) {
+		SRError(L"The layout of a resource can not be changed.");
+		return false;
+	}
+	Desc.LAYOUT = resource.LAYOUT;
+	// the resource is left as it was when the resize fails
+	SRResource resized = resource;
+	if (!FillResouceAttribute(Desc, resized)) {
 		SRError(L"Incorrect Description.");
+		return false;
 	}
-	UINT size = resource.WIDTH  * resource.HEIGHT * resource.DEPTH * SizeOfFormat(resource.FORMAT);
+	if (SRIsBlockCompressed(resource.FORMAT))
+		SRInvalidateDecodedBlocks();
+	size_t size = SizeOfResource(resized);
 	if (size == 0) {
-		free(resource.ptr);
+		mHeap.Free(resource.ptr);
 		resource.ptr = nullptr;
+		mInternalFreeHandles.push_back(Handle);
 		return true;
 	}
-	BYTE* newPtr = (BYTE*)realloc(resource.ptr, size);
+	BYTE* newPtr = mHeap.Reallocate(resource.ptr, size);
 	if (newPtr == nullptr) {
 		SRError(L"Resize failed.");
 		return false;
 	}
 	else {
-		resource.ptr = newPtr;
+		resized.ptr = newPtr;
+		resource = resized;
 		return true;
 	}
 }
@@ -167,7 +451,161 @@ void SRDevice::SREnableDebugLayer() {
 	mDebugLayer = true;
 }
 
-inline bool SRDevice::ValidRenderTarget(const SRResourceHandle handle) {
+void SRDevice::SRGetRasterizerStatistics(SRRasterizerStatistics* pStats) {
+	*pStats = mRasterizerStats;
+	pStats->InlineTileThreshold = mRasterizerDesc.InlineTileThreshold;
+	pStats->BatchSize = mRasterizerDesc.BatchSize;
+	pStats->PipelineDepth = mRasterizerDesc.PipelineDepth;
+}
+
+void SRDevice::SRResetRasterizerStatistics() {
+	mRasterizerStats = SRRasterizerStatistics();
+}
+
+void SRDevice::SRBeginPipelineStatisticsQuery() {
+	if (mInternalQueryActive) {
+		SRError(L"Query already begun.");
+		return;
+	}
+	// the work submitted before is not counted
+	if (mInternalQueue != nullptr)
+		mInternalQueue->SRFlush();
+	for (UINT i = 0; i < mThreadPool.GetThreadCount(); i++) {
+		mInternalThreadStatistics[i].Stats = SRPipelineStatistics();
+	}
+	mInternalQueryActive = true;
+}
+
+void SRDevice::SREndPipelineStatisticsQuery(SRPipelineStatistics* pStats) {
+	if (!mInternalQueryActive) {
+		SRError(L"Query not begun.");
+		return;
+	}
+	mInternalQueryActive = false;
+
+	// the immediate draws are synchronous, the queue counts until the work submitted before is done
+	if (mInternalQueue != nullptr)
+		mInternalQueue->SRFlush();
+	SRPipelineStatistics total;
+	for (UINT i = 0; i < mThreadPool.GetThreadCount(); i++) {
+		const SRPipelineStatistics& stats = mInternalThreadStatistics[i].Stats;
+		total.IAVertices += stats.IAVertices;
+		total.IAPrimitives += stats.IAPrimitives;
+		total.VSInvocations += stats.VSInvocations;
+		total.CInvocations += stats.CInvocations;
+		total.CPrimitives += stats.CPrimitives;
+		total.PSInvocations += stats.PSInvocations;
+		total.NearPlaneClippedPrimitives += stats.NearPlaneClippedPrimitives;
+		total.CulledPrimitives += stats.CulledPrimitives;
+		total.TilesTested += stats.TilesTested;
+		total.TilesRejectedByEdge += stats.TilesRejectedByEdge;
+		total.TilesRejectedByHiZ += stats.TilesRejectedByHiZ;
+		total.DepthClippedPixels += stats.DepthClippedPixels;
+		total.ZPrePassFailedPixels += stats.ZPrePassFailedPixels;
+		total.DepthTestFailedPixels += stats.DepthTestFailedPixels;
+		total.PixelsWritten += stats.PixelsWritten;
+	}
+	*pStats = total;
+}
+
+bool SRDevice::SRBeginTrace(const char* pFileName, UINT EventsPerThread) {
+#ifdef SR_DISABLE_TRACE
+	(void)pFileName;
+	(void)EventsPerThread;
+	SRError(L"Trace is compiled out.");
+	return false;
+#else
+	if (EventsPerThread == 0) {
+		SRError(L"Trace needs room for events.");
+		return false;
+	}
+	if (!mTracer.Begin(pFileName, mThreadPool.GetThreadCount(), EventsPerThread)) {
+		SRError(L"Unable to open the trace file.");
+		return false;
+	}
+	return true;
+#endif
+}
+
+void SRDevice::SREndTrace() {
+	mTracer.End();
+}
+
+bool SRDevice::SRBeginCapture(const char* pFileName, const SRShaderRegistry* pRegistry) {
+	if (mCapture != nullptr) {
+		SRError(L"Capture already in progress.");
+		return false;
+	}
+	if (pRegistry == nullptr) {
+		SRError(L"Capture needs a shader registry.");
+		return false;
+	}
+	mCapture = new SRCapture();
+	if (!mCapture->Open(pFileName, pRegistry)) {
+		delete mCapture;
+		mCapture = nullptr;
+		SRError(L"Unable to open the capture file.");
+		return false;
+	}
+
+	// initial state: the live resources with their contents and what is bound
+	mCapture->AllocateResource(UINT(mResources.size()));
+	for (SRResourceHandle handle = 0; handle < mResources.size(); handle++) {
+		const SRResource& resource = mResources[handle];
+		if (resource.ptr == nullptr)
+			continue;
+		SRResourceDescription desc = { resource.WIDTH, resource.HEIGHT, resource.DEPTH, resource.FORMAT, resource.DIMENSION,
+			resource.MIPLEVELS, resource.LAYOUT, resource.VERSIONS };
+		mCapture->CreateResource(desc, handle);
+		if (resource.LAYOUT == SRResourceLayoutVirtual) {
+			// the pages come from the page faults of the replay
+			continue;
+		}
+		if (resource.LAYOUT == SRResourceLayoutSwizzled) {
+			// the replay uploads row-major data
+			SRResource rowMajor = resource;
+			rowMajor.LAYOUT = SRResourceLayoutRowMajor;
+			std::vector<BYTE> data(SizeOfResource(rowMajor));
+			CopySwizzled(resource, data.data(), data.size(), false);
+			mCapture->CopyToResource(handle, data.data(), UINT(data.size()));
+		}
+		else {
+			mCapture->CopyToResource(handle, resource.ptr, UINT(SizeOfResource(resource)));
+		}
+	}
+	if (!mCapture->SetPipelineState(mPipelineState))
+		SRError(L"Shader of the pipeline state is not registered for the capture.");
+	mCapture->SetRasterizerDesc(mRasterizerDesc);
+	mCapture->IASetPrimitiveTopology(mPrimitive);
+	if (mVertexBufferHandle != InvalidHandle)
+		mCapture->IASetVertexBuffers(mVertexBufferHandle);
+	if (mIndexBufferHandle != InvalidHandle)
+		mCapture->IASetIndexBuffers(mIndexBufferHandle, mIndexFormat);
+	for (UINT i = 0; i < 8; i++) {
+		if (mConstantsBufferHandle[i] != InvalidHandle)
+			mCapture->IASetConstantBuffers(i, mConstantsBufferHandle[i]);
+	}
+	for (UINT i = 0; i < 8; i++) {
+		if (mShaderResourceHandle[i] != InvalidHandle)
+			mCapture->PSSetShaderResources(i, mShaderResourceHandle[i]);
+		mCapture->PSSetSamplers(i, mSamplers[i]);
+	}
+	if (mRenderTargetHandle != InvalidHandle)
+		mCapture->OMSetRenderTarget(mRenderTargetHandle, mDepthStencilHandle, false);
+	mCapture->BeginStream();
+	return true;
+}
+
+void SRDevice::SREndCapture() {
+	if (mCapture == nullptr)
+		return;
+	if (!mCapture->Close())
+		SRError(L"Capture file write failed.");
+	delete mCapture;
+	mCapture = nullptr;
+}
+
+bool SRDevice::ValidRenderTarget(const SRResourceHandle handle) {
 	return handle < mResources.size() && ValidRenderTarget(mResources[handle]);
 }
 
@@ -176,10 +614,11 @@ inline bool SRDevice::ValidRenderTarget(const SRResource& renderTarget) {
 	return renderTarget.ptr != nullptr &&
 		renderTarget.DIMENSION == SRResourceDimensionTexture2D &&
 		renderTarget.FORMAT == DXGI_FORMAT_R8G8B8A8_UNORM &&
+		renderTarget.LAYOUT == SRResourceLayoutRowMajor &&
 		renderTarget.DEPTH == 1;
 }
 
-inline bool SRDevice::ValidDepthStencil(const SRResourceHandle handle) {
+bool SRDevice::ValidDepthStencil(const SRResourceHandle handle) {
 	return handle < mResources.size() && ValidDepthStencil(mResources[handle]);
 }
 
@@ -188,6 +627,7 @@ inline bool SRDevice::ValidDepthStencil(const SRResource& depth) {
 	return depth.ptr != nullptr &&
 		depth.DIMENSION == SRResourceDimensionTexture2D &&
 		depth.FORMAT == DXGI_FORMAT_D24_UNORM_S8_UINT &&
+		depth.LAYOUT == SRResourceLayoutRowMajor &&
 		depth.DEPTH == 1;
 }
 
@@ -198,10 +638,98 @@ inline bool SRDevice::ValidDepthStencil(const SRResource& depth, UINT width, UIN
 		depth.FORMAT == DXGI_FORMAT_D24_UNORM_S8_UINT &&
 		depth.WIDTH == width &&
 		depth.HEIGHT == height &&
+		depth.LAYOUT == SRResourceLayoutRowMajor &&
 		depth.DEPTH == 1;
 }
 
-inline bool SRDevice::ValidDrawTarget(const SRResourceHandle target, const SRResourceHandle depth) {
+bool SRDevice::ValidIndexFormat(DXGI_FORMAT format) {
+	return format == DXGI_FORMAT_R16_UINT || format == DXGI_FORMAT_R32_UINT;
+}
+
+bool SRDevice::ValidBuffer(const SRResourceHandle handle) {
+	if (handle >= mResources.size())
+		return false;
+	auto& resource = mResources[handle];
+	return resource.ptr != nullptr &&
+		resource.DIMENSION == SRResourceDimensionBuffer &&
+		resource.HEIGHT == 1 &&
+		resource.DEPTH == 1;
+}
+
+bool SRDevice::ValidShaderResource(const SRResourceHandle handle) {
+	if (handle >= mResources.size())
+		return false;
+	auto& resource = mResources[handle];
+	return resource.ptr != nullptr &&
+		resource.DIMENSION != SRResourceDimensionBuffer &&
+		SRIsSampleableFormat(resource.FORMAT);
+}
+
+bool SRDevice::ValidMipGeneration(const SRResourceHandle handle) {
+	if (handle >= mResources.size())
+		return false;
+	auto& resource = mResources[handle];
+	return resource.ptr != nullptr &&
+		resource.DIMENSION != SRResourceDimensionBuffer &&
+		resource.LAYOUT != SRResourceLayoutVirtual &&
+		SRIsSampleableFormat(resource.FORMAT) &&
+		!SRIsBlockCompressed(resource.FORMAT);
+}
+
+void SRDevice::FillTextureView(const SRResource& resource, SRTextureView& view) {
+	view.ptr = resource.ptr;
+	view.Width = resource.WIDTH;
+	view.Height = resource.HEIGHT;
+	view.Depth = resource.DEPTH;
+	view.MipLevels = resource.MIPLEVELS;
+	view.Format = resource.FORMAT;
+	view.Dimension = resource.DIMENSION;
+	view.Layout = resource.LAYOUT;
+	view.Generation = SRDecodedBlocksGeneration();
+	SRTextureLayout(resource.DIMENSION, resource.FORMAT, resource.WIDTH, resource.HEIGHT, resource.DEPTH,
+		resource.MIPLEVELS, resource.LAYOUT, view.MipOffsets);
+	view.Feedback = nullptr;
+	if (resource.LAYOUT == SRResourceLayoutVirtual) {
+		// the feedback bits follow the page table
+		size_t pages = SRVirtualPageCount(resource.FORMAT, resource.WIDTH, resource.HEIGHT, resource.MIPLEVELS, nullptr);
+		view.Feedback = reinterpret_cast<std::atomic<UINT32>*>(resource.ptr + pages * sizeof(BYTE*));
+	}
+}
+
+void SRDevice::SRSetVirtualTextureDesc(SRVirtualTextureDesc Desc) {
+	mResidency.SetDesc(Desc);
+}
+
+void SRDevice::SRGetVirtualTextureStatistics(SRVirtualTextureStatistics* pStats) {
+	mResidency.GetStatistics(pStats);
+}
+
+void SRDevice::SRSetHeapDesc(SRHeapDesc Desc) {
+	mHeap.SetDesc(Desc);
+}
+
+void SRDevice::SRGetHeapStatistics(SRHeapStatistics* pStats) {
+	mHeap.GetStatistics(pStats);
+}
+
+bool SRDevice::ValidSampler(const SRSamplerDesc& desc) {
+	return desc.Filter >= SRFilterPoint && desc.Filter <= SRFilterTrilinear &&
+		desc.AddressU >= SRTextureAddressWrap && desc.AddressU <= SRTextureAddressClamp &&
+		desc.AddressV >= SRTextureAddressWrap && desc.AddressV <= SRTextureAddressClamp &&
+		desc.AddressW >= SRTextureAddressWrap && desc.AddressW <= SRTextureAddressClamp;
+}
+
+bool SRDevice::ValidPipelineState(const SRPipelineState& state) {
+	if (state.NumConstantBuffer > 8 || state.NumShaderResources > 8 || state.NumSamplers > 8)
+		return false;
+	// derivatives are taken of the attributes after SV_POSITION
+	if (state.PSDerivativeCount != 0 &&
+		(state.VSOutputByteCount < 4 * sizeof(float) || state.PSDerivativeCount > state.VSOutputByteCount / sizeof(float) - 4))
+		return false;
+	return true;
+}
+
+bool SRDevice::ValidDrawTarget(const SRResourceHandle target, const SRResourceHandle depth) {
 	if (!ValidRenderTarget(target) ||
 		!ValidDepthStencil(depth))
 		return false;
@@ -226,46 +754,15 @@ void SRDevice::ResizeRenderTarget(const SRResource renderTarget) {
 		mInternalRenderTargetWidth = width;
 		mInternalRenderTargetHeight = height;
 
-		FlushCommandQueue();
+		OnRenderTargetResize(width, height);
 
 		if (width * height == 0) {
-			for (UINT i = 0; i < mInternalSwapChainNum; i++) {
-				mRenderTargetHelper[i].Reset();
-			}
 			free(mInternalHiZCache);
+			mInternalHiZCache = nullptr;
+			ResizeTileMaps(0, 0);
 			return;
 		}
 
-		for (UINT i = 0; i < mInternalSwapChainNum; i++) {
-			mRenderTargetHelper[i].Reset();
-			TF(md3dDevice->CreateCommittedResource(
-				mUMA ?
-				&CD3DX12_HEAP_PROPERTIES(D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE, D3D12_MEMORY_POOL_L0) :
-				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-				D3D12_HEAP_FLAG_NONE,
-				&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM,
-					width, height, 1, 1),
-				mUMA ?
-				D3D12_RESOURCE_STATE_GENERIC_READ :
-				D3D12_RESOURCE_STATE_COPY_DEST,
-				nullptr,
-				IID_PPV_ARGS(mRenderTargetHelper[i].GetAddressOf())));
-
-			if (!mUMA) {
-				mRenderTargetUploader[i].Reset();
-				const UINT64 uploadBufferSize = GetRequiredIntermediateSize(mRenderTargetHelper[i].Get(), 0, 1);
-				TF(md3dDevice->CreateCommittedResource(
-					&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-					D3D12_HEAP_FLAG_NONE,
-					&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
-					D3D12_RESOURCE_STATE_GENERIC_READ,
-					nullptr,
-					IID_PPV_ARGS(mRenderTargetUploader[i].GetAddressOf())));
-			}
-		}
-
-		CreateMagDescriptor();
-
 		// HiZ cache
 		// I am not going to alloc UINT32 for every value instead of UINT24,
 		// cause it increase reading time and more complex.
@@ -280,122 +777,187 @@ void SRDevice::ResizeRenderTarget(const SRResource renderTarget) {
 			SRFatal(L"HiZ cache alloc error.");
 			return;
 		}
+
+		ResizeTileMaps(width, height);
+	}
+}
+
+void SRDevice::ResizeTileMaps(UINT width, UINT height) {
+	free(mInternalTileCost);
+	free(mInternalTileCostHistory);
+	free(mInternalTileRank);
+	free(mInternalTileOrder);
+	free(mInternalBatchTiles);
+	free(mInternalTileOwner);
+	mInternalTileCost = nullptr;
+	mInternalTileCostHistory = nullptr;
+	mInternalTileRank = nullptr;
+	mInternalTileOrder = nullptr;
+	mInternalBatchTiles = nullptr;
+	mInternalTileOwner = nullptr;
+
+	const UINT tileCount = ((width + 7) / 8) * ((height + 7) / 8);
+	ResizeTileCounters(tileCount);
+	if (tileCount == 0)
+		return;
+
+	mInternalTileCost = (UINT64*)calloc(tileCount, sizeof(UINT64));
+	mInternalTileCostHistory = (UINT64*)calloc(tileCount, sizeof(UINT64));
+	mInternalTileRank = (UINT*)malloc(tileCount * sizeof(UINT));
+	mInternalTileOrder = (UINT*)malloc(tileCount * sizeof(UINT));
+	mInternalBatchTiles = (UINT*)malloc(tileCount * sizeof(UINT));
+	mInternalTileOwner = (UINT16*)malloc(tileCount * sizeof(UINT16));
+	if (mInternalTileCost == nullptr || mInternalTileCostHistory == nullptr ||
+		mInternalTileRank == nullptr || mInternalTileOrder == nullptr || mInternalBatchTiles == nullptr ||
+		mInternalTileOwner == nullptr)
+	{
+		SRFatal(L"Tile map alloc error.");
+		return;
 	}
+
+	UpdateTileOrder(true);
+}
+
+void SRDevice::SRGetTileCostMap(const UINT64** ppCosts, UINT* pTileWidth, UINT* pTileHeight) {
+	*ppCosts = mInternalTileCostHistory;
+	*pTileWidth = (mInternalRenderTargetWidth + 7) / 8;
+	*pTileHeight = (mInternalRenderTargetHeight + 7) / 8;
 }
 
 void SRDevice::SRClearRenderTargetView(SRResourceHandle ResourceHandle, const float color[4]) {
+	if (mCapture != nullptr)
+		mCapture->ClearRenderTargetView(ResourceHandle, color);
 	if (!ValidRenderTarget(ResourceHandle)) {
 		SRError(L"Invalid render target hanlde");
 		return;
 	}
+	ClearRenderTarget(ResourceHandle, color);
+}
 
-	SRResource& renderTarget = mResources[ResourceHandle];
-	const UINT Step = renderTarget.HEIGHT * renderTarget.WIDTH / 8;
-	const int Left = renderTarget.HEIGHT * renderTarget.WIDTH % 8;
+void SRDevice::ClearRenderTarget(SRResourceHandle handle, const float color[4]) {
+	SRTrace(mTracer, 0, "ClearRenderTarget");
+	SRResource& renderTarget = mResources[handle];
 	BYTE colors[] = {
 		BYTE(clamp(color[0]) * 255),
 		BYTE(clamp(color[1]) * 255),
 		BYTE(clamp(color[2]) * 255),
 		BYTE(clamp(color[3]) * 255) };
-
-#pragma omp parallel for num_threads(8)
-	for (int id = 0; id < 8; id++) {
-		const UINT Count = id < Left ? Step + 1 : Step;
-		BYTE* image = renderTarget.ptr + (id * Step + min(Left, id)) * 4;
-		for (UINT i = 0; i < Count; i++) {
-			image[0] = colors[0];
-			image[1] = colors[1];
-			image[2] = colors[2];
-			image[3] = colors[3];
-			image += 4;
+	UINT32 data;
+	memcpy(&data, colors, sizeof(data));
+
+	UINT32* image = reinterpret_cast<UINT32*>(renderTarget.ptr);
+	mThreadPool.ParallelFor(renderTarget.HEIGHT * renderTarget.WIDTH, ClearGrain,
+		[=](UINT begin, UINT end, UINT threadIndex) {
+		SRTrace(mTracer, threadIndex, "ClearPixels", end - begin);
+		for (UINT i = begin; i < end; i++) {
+			image[i] = data;
 		}
-	}
+	});
 }
 
 void SRDevice::SRClearDepthStencilView(SRResourceHandle ResourceHandle,
 	SRClearFlags flag, float depth, UINT8 stencil)
 {
+	if (mCapture != nullptr)
+		mCapture->ClearDepthStencilView(ResourceHandle, flag, depth, stencil);
 	if (!ValidDepthStencil(ResourceHandle)) {
 		SRError(L"Invalid DepthStencil handle.");
 		return;
 	}
 
-	UINT32 mask = 0;
+	UINT32 mask;
+	if (!DepthStencilClearMask(flag, mask)) {
+		SRError(L"Unknwon Flag.");
+		return;
+	}
+	ClearDepthStencil(ResourceHandle, mask, depth, stencil);
+}
+
+// bits of the d24s8 texel written by a clear, false for an unknown flag
+bool SRDevice::DepthStencilClearMask(SRClearFlags flag, UINT32& mask) {
 	switch (flag) {
 	case SRClearFlagDepth:
 		mask = 0xffffff00;
-		break;
+		return true;
 	case SRClearFlagStencil:
 		mask = 0xff;
-		break;
+		return true;
 	case SRClearFlagDepthStencil:
 		mask = 0xffffffff;
-		break;
+		return true;
 	default:
-		SRError(L"Unknwon Flag.");
-		return;
+		return false;
 	}
+}
+
+void SRDevice::ClearDepthStencil(SRResourceHandle handle, UINT32 mask, float depth, UINT8 stencil) {
 	UINT32 depth24 = float2Depth(clamp(depth));
 	UINT32 data = ((depth24 << 8) + UINT32(stencil)) & mask;
 
-	SRResource& depthStencil = mResources[ResourceHandle];
-	const UINT Step = depthStencil.HEIGHT * depthStencil.WIDTH / 8;
-	const UINT Left = depthStencil.HEIGHT * depthStencil.WIDTH % 8;
-
-#pragma omp parallel for num_threads(8)
-	for (int id = 0; id < 8; id++) {
-		const UINT Count = id < Left ? Step + 1 : Step;
-		UINT32* image = reinterpret_cast<UINT32*>(depthStencil.ptr) + id * Step + min(Left, id);
-		for (UINT i = 0; i < Count; i++) {
-			*image = *image & ~mask | data;
-			image++;
+	SRTrace(mTracer, 0, "ClearDepthStencil");
+	SRResource& depthStencil = mResources[handle];
+	UINT32* image = reinterpret_cast<UINT32*>(depthStencil.ptr);
+	mThreadPool.ParallelFor(depthStencil.HEIGHT * depthStencil.WIDTH, ClearGrain,
+		[=](UINT begin, UINT end, UINT threadIndex) {
+		SRTrace(mTracer, threadIndex, "ClearPixels", end - begin);
+		for (UINT i = begin; i < end; i++) {
+			image[i] = (image[i] & ~mask) | data;
 		}
-	}
+	});
 }
 
 void SRDevice::SRSetPipelineState(SRPipelineState PipelineState) {
+	if (mCapture != nullptr && !mCapture->SetPipelineState(PipelineState))
+		SRError(L"Shader of the pipeline state is not registered for the capture.");
+	if (!ValidPipelineState(PipelineState)) {
+		SRError(L"Invalid pipeline state.");
+		return;
+	}
 	mPipelineState = PipelineState;
 }
 
-void SRDevice::SRIASetVertexBuffers(SRResourceHandle ResourceHandle) {
-	if (ResourceHandle >= mResources.size()) {
-		SRError(L"Invalid handle.");
-		mVertexBufferHandle = InvalidHandle;
+void SRDevice::SRSetRasterizerDesc(SRRasterizerDesc Desc) {
+	if (mCapture != nullptr)
+		mCapture->SetRasterizerDesc(Desc);
+	if (Desc.BatchSize == 0) {
+		SRError(L"Batch size should be at least 1.");
 		return;
 	}
-	
-	auto& resource = mResources[ResourceHandle];
-	if (resource.ptr == nullptr ||
-		resource.DIMENSION != SRResourceDimensionBuffer ||
-		resource.HEIGHT != 1 ||
-		resource.DEPTH != 1) {
+	bool IsOrderChange = Desc.TileOrder != mRasterizerDesc.TileOrder ||
+		Desc.TileScheduling != mRasterizerDesc.TileScheduling;
+	mRasterizerDesc = Desc;
+	if (IsOrderChange && mInternalTileRank != nullptr)
+		UpdateTileOrder(true);
+}
+
+void SRDevice::SRIASetVertexBuffers(SRResourceHandle ResourceHandle) {
+	if (mCapture != nullptr)
+		mCapture->IASetVertexBuffers(ResourceHandle);
+	if (!ValidBuffer(ResourceHandle)) {
 		SRError(L"Invalid vertex buffer.");
 		mVertexBufferHandle = InvalidHandle;
 		return;
 	}
 	mVertexBufferHandle = ResourceHandle;
+	mInternalVertexSnapshot = nullptr;
 }
 
-void SRDevice::SRIASetIndexBuffers(SRResourceHandle ResourceHandle) {
-	if (ResourceHandle >= mResources.size()) {
-		SRError(L"Invalid handle.");
-		mIndexBufferHandle = InvalidHandle;
-		return;
-	}
-
-	auto& resource = mResources[ResourceHandle];
-	if (resource.ptr == nullptr ||
-		resource.DIMENSION != SRResourceDimensionBuffer ||
-		resource.HEIGHT != 1 ||
-		resource.DEPTH != 1) {
+void SRDevice::SRIASetIndexBuffers(SRResourceHandle ResourceHandle, DXGI_FORMAT Format) {
+	if (mCapture != nullptr)
+		mCapture->IASetIndexBuffers(ResourceHandle, Format);
+	if (!ValidBuffer(ResourceHandle) || !ValidIndexFormat(Format)) {
 		SRError(L"Invalid index buffer.");
 		mIndexBufferHandle = InvalidHandle;
 		return;
 	}
 	mIndexBufferHandle = ResourceHandle;
+	mIndexFormat = Format;
+	mInternalIndexSnapshot = nullptr;
 }
 
 void SRDevice::SRIASetConstantBuffers(UINT Index, SRResourceHandle ResourceHandle) {
+	if (mCapture != nullptr)
+		mCapture->IASetConstantBuffers(Index, ResourceHandle);
 	if (Index >= 8) {
 		SRError(L"Only support 8 constant buffers.");
 		return;
@@ -407,10 +969,41 @@ void SRDevice::SRIASetConstantBuffers(UINT Index, SRResourceHandle ResourceHandl
 		return;
 	}
 	mConstantsBufferHandle[Index] = ResourceHandle;
+	mInternalConstantsSnapshot[Index] = nullptr;
+}
+
+void SRDevice::SRPSSetShaderResources(UINT Index, SRResourceHandle ResourceHandle) {
+	if (mCapture != nullptr)
+		mCapture->PSSetShaderResources(Index, ResourceHandle);
+	if (Index >= 8) {
+		SRError(L"Only support 8 shader resources.");
+		return;
+	}
+	if (!ValidShaderResource(ResourceHandle)) {
+		SRError(L"Invalid shader resource.");
+		return;
+	}
+	mShaderResourceHandle[Index] = ResourceHandle;
+}
+
+void SRDevice::SRPSSetSamplers(UINT Index, SRSamplerDesc Desc) {
+	if (mCapture != nullptr)
+		mCapture->PSSetSamplers(Index, Desc);
+	if (Index >= 8) {
+		SRError(L"Only support 8 samplers.");
+		return;
+	}
+	if (!ValidSampler(Desc)) {
+		SRError(L"Invalid sampler.");
+		return;
+	}
+	mSamplers[Index] = Desc;
 }
 
 void SRDevice::SRIASetPrimitiveTopology(SRPrimitiveTopology Primitive) {
-	if (SRPrimitiveCount >= SRPrimitiveCount) {
+	if (mCapture != nullptr)
+		mCapture->IASetPrimitiveTopology(Primitive);
+	if (Primitive >= SRPrimitiveCount) {
 		SRError(L"Unknown Primitive.");
 		return;
 	}
@@ -418,6 +1011,8 @@ void SRDevice::SRIASetPrimitiveTopology(SRPrimitiveTopology Primitive) {
 }
 
 void SRDevice::SROMSetRenderTarget(SRResourceHandle TargetHandle, SRResourceHandle DepthHandle, bool IsAllDepthInitToOne) {
+	if (mCapture != nullptr)
+		mCapture->OMSetRenderTarget(TargetHandle, DepthHandle, IsAllDepthInitToOne);
 	if (DepthHandle == InvalidHandle ||
 		DepthHandle >= mResources.size() ||
 		!ValidRenderTarget(TargetHandle))
@@ -428,10 +1023,7 @@ void SRDevice::SROMSetRenderTarget(SRResourceHandle TargetHandle, SRResourceHand
 	}
 	else {
 		if (ValidDrawTarget(TargetHandle, DepthHandle)) {
-			mRenderTargetHandle = TargetHandle;
-			mDepthStencilHandle = DepthHandle;
-			ResizeRenderTarget(mResources[mRenderTargetHandle]);
-			InitHiZCache(IsAllDepthInitToOne);
+			SetRenderTarget(TargetHandle, DepthHandle, IsAllDepthInitToOne);
 		}
 		else {
 			mRenderTargetHandle = InvalidHandle;
@@ -441,35 +1033,41 @@ void SRDevice::SROMSetRenderTarget(SRResourceHandle TargetHandle, SRResourceHand
 	}
 }
 
+void SRDevice::SetRenderTarget(SRResourceHandle target, SRResourceHandle depth, bool isAllDepthInitToOne) {
+	mRenderTargetHandle = target;
+	mDepthStencilHandle = depth;
+	ResizeRenderTarget(mResources[mRenderTargetHandle]);
+	InitHiZCache(isAllDepthInitToOne);
+}
+
 void SRDevice::InitHiZCache(bool isAllDepthInitToOne) {
 	auto& depthStencil = mResources[mDepthStencilHandle];
 	const UINT HiZWidth = (depthStencil.WIDTH + 7) / 8;
 	const UINT HiZHeight = (depthStencil.HEIGHT + 7) / 8;
-	const UINT StepHiZ = HiZWidth * HiZHeight / 8;
-	const UINT LeftHiZ = HiZWidth * HiZHeight % 8;
+	UINT32* hiZCache = mInternalHiZCache;
+	SRTrace(mTracer, 0, "InitHiZ");
 
 	if (isAllDepthInitToOne) {
 		const UINT32 depth24 = DepthMax;
-#pragma omp parallel for num_threads(8)
-		for (int id = 0; id < 8; id++) {
-			const UINT Count = id < LeftHiZ ? StepHiZ + 1 : StepHiZ;
-			UINT32* image = mInternalHiZCache + (id * StepHiZ + min(LeftHiZ, id)) * 2;
-			for (UINT i = 0; i < Count; i++) {
+		mThreadPool.ParallelFor(HiZWidth * HiZHeight, ClearGrain,
+			[=](UINT begin, UINT end, UINT threadIndex) {
+			SRTrace(mTracer, threadIndex, "InitHiZTiles", end - begin);
+			UINT32* image = hiZCache + begin * 2;
+			for (UINT i = begin; i < end; i++) {
 				image[0] = depth24;	// min
 				image[1] = depth24;	// max
 				image += 2;
 			}
-		}
+		});
 	}
 	else {
-#pragma omp parallel for num_threads(8)
-		for (int id = 0; id < 8; id++) {
-			const UINT Count = id < LeftHiZ ? StepHiZ + 1 : StepHiZ;
-			const UINT Base = (id * StepHiZ + min(LeftHiZ, id));
-			UINT32* image = mInternalHiZCache + Base * 2;
-			for (UINT i = 0; i < Count; i++) {
-				int tileX = int((Base + i) % HiZWidth) * 8;
-				int tileY = int((Base + i) / HiZWidth) * 8;
+		mThreadPool.ParallelFor(HiZWidth * HiZHeight, HiZInitGrain,
+			[=, &depthStencil](UINT begin, UINT end, UINT threadIndex) {
+			SRTrace(mTracer, threadIndex, "InitHiZTiles", end - begin);
+			UINT32* image = hiZCache + begin * 2;
+			for (UINT n = begin; n < end; n++) {
+				int tileX = int(n % HiZWidth) * 8;
+				int tileY = int(n / HiZWidth) * 8;
 
 				UINT32 minDepth = DepthMax;
 				UINT32 maxDepth = 0;
@@ -477,8 +1075,8 @@ void SRDevice::InitHiZCache(bool isAllDepthInitToOne) {
 				// stupid implementation since I will not really run this subprogram in my project
 				for (int i = 0; i < 8; i++) {
 					for (int j = 0; j < 8; j++) {
-						if ((tileX + i) >= depthStencil.WIDTH ||
-							(tileY + j) >= depthStencil.HEIGHT)
+						if (UINT(tileX + i) >= depthStencil.WIDTH ||
+							UINT(tileY + j) >= depthStencil.HEIGHT)
 							continue;
 
 						UINT32 pixelDepth = *(reinterpret_cast<UINT32*>(depthStencil.ptr) +
@@ -497,134 +1095,49 @@ void SRDevice::InitHiZCache(bool isAllDepthInitToOne) {
 				image[1] = maxDepth;	// max
 				image += 2;
 			}
-		}
+		});
 	}
 }
 
-bool SRDevice::Initialize() {
-	mMainWndCaption = L"SR";
-	if (!D3DApp::Initialize())
+bool SRDevice::Initialize(UINT NumWorkerThreads) {
+	if (!mThreadPool.Initialize(NumWorkerThreads != 0 ? NumWorkerThreads : SRThreadPool::DefaultThreadCount())) {
+		SRFatal(L"Unable to create worker threads.");
 		return false;
-
-	for (int i = 0; i < 8; i++) {
-		mConstantsBufferHandle[i] = InvalidHandle;
 	}
 
-	for (int i = 0; i < mInternalSwapChainNum; i++) {
-		mInternalFences[i] = 0;
-		TF(md3dDevice->CreateCommandAllocator(
-			D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(mInternalCmdListAllocs[i].GetAddressOf())));
+	mInternalThreadStatistics = (SRThreadStatistics*)_aligned_malloc(
+		mThreadPool.GetThreadCount() * sizeof(SRThreadStatistics), 64);
+	if (mInternalThreadStatistics == nullptr) {
+		SRFatal(L"Statistics alloc error.");
+		return false;
 	}
-
-	InitializeMagPresent();
-
-	//mUMA = !mUMA; //uncomment this line to test the other case
-	return true;
-}
-
-void SRDevice::Draw(const GameTimer& gt) {
-	DrawScene(gt);
-
-
-	mInternalSwapChainIndex = (mInternalSwapChainIndex + 1) % mInternalSwapChainNum;
-	UINT64 prevFence= mInternalFences[mInternalSwapChainIndex];
-	if (mFence->GetCompletedValue() < prevFence) {
-		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
-		TF(mFence->SetEventOnCompletion(prevFence, eventHandle));
-		WaitForSingleObject(eventHandle, INFINITE);
-		CloseHandle(eventHandle);
+	for (UINT i = 0; i < mThreadPool.GetThreadCount(); i++) {
+		mInternalThreadStatistics[i].Stats = SRPipelineStatistics();
 	}
+	delete[] mInternalRingCursors;
+	mInternalRingCursors = new SRRingCursor[mThreadPool.GetThreadCount()];
 
-
-	auto& cmdListAlloc = mInternalCmdListAllocs[mInternalSwapChainIndex];
-	auto& helperResource = mRenderTargetHelper[mInternalSwapChainIndex];
-	auto& uploaderResource = mRenderTargetUploader[mInternalSwapChainIndex];
-
-	TF(cmdListAlloc->Reset());
-	if (ValidRenderTarget(mRenderTargetHandle)) {
-		SRResource& renderTarget = mResources[mRenderTargetHandle];
-		UINT rowPitch = sizeof(renderTarget.FORMAT) * renderTarget.WIDTH;
-		UINT depthPitch = rowPitch * renderTarget.HEIGHT;
-
-		mCommandList->Reset(cmdListAlloc.Get(), nullptr);
-
-		if (mUMA) {
-			helperResource->WriteToSubresource(0, nullptr, renderTarget.ptr, rowPitch, depthPitch);
-		}
-		else {
-			D3D12_SUBRESOURCE_DATA data;
-			data.pData = renderTarget.ptr;
-			data.RowPitch = rowPitch;
-			data.SlicePitch = depthPitch;
-			UpdateSubresources(mCommandList.Get(),
-				helperResource.Get(), uploaderResource.Get(), 0, 0, 1, &data);
-		}
-
-		if (!mMagPresent) {
-			DirectPresent(helperResource.Get());
-		}
-		else {
-			MagnificationPresent(helperResource.Get());
-		}
-
-		TF(mCommandList->Close());
-
-		ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-		mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
-
-		TF(mSwapChain->Present(0, GetAllowTearing() ? DXGI_PRESENT_ALLOW_TEARING : 0));
-		mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
-
-		mInternalFences[mInternalSwapChainIndex] = ++mCurrentFence;
-		mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+	for (int i = 0; i < 8; i++) {
+		mConstantsBufferHandle[i] = InvalidHandle;
+		mInternalConstantsSnapshot[i] = nullptr;
+		mShaderResourceHandle[i] = InvalidHandle;
+		mSamplers[i] = SRSamplerDesc();
 	}
+	return true;
 }
 
-void SRDevice::DirectPresent(ID3D12Resource* presentResource) {
-	if (!mUMA) {
-		mCommandList->ResourceBarrier(1,
-			&CD3DX12_RESOURCE_BARRIER::Transition(
-				presentResource, D3D12_RESOURCE_STATE_COPY_DEST,
-				D3D12_RESOURCE_STATE_COPY_SOURCE));
-	}
-
-	D3D12_TEXTURE_COPY_LOCATION src, dest;
-	src.pResource = presentResource;
-	src.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-	src.SubresourceIndex = 0;
-	dest.pResource = CurrentBackBuffer();
-	dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-	dest.SubresourceIndex = 0;
-	D3D12_BOX box = { 0, 0, 0,
-		min(UINT(mClientWidth), UINT(mInternalRenderTargetWidth)),
-		min(UINT(mClientHeight),UINT(mInternalRenderTargetHeight)), 1 };
-	mCommandList->CopyTextureRegion(&dest, 0, 0, 0, &src, &box);
+void SRDevice::ReportError(const wchar_t* message, bool isFatal) {
+	fprintf(stderr, "SR %s: %ls\n", isFatal ? "Fatal" : "Error", message);
+}
 
-	if (mUMA) {
-		mCommandList->ResourceBarrier(1,
-			&CD3DX12_RESOURCE_BARRIER::Transition(
-				CurrentBackBuffer(), D3D12_RESOURCE_STATE_COPY_DEST,
-				D3D12_RESOURCE_STATE_PRESENT));
-	}
-	else {
-		D3D12_RESOURCE_BARRIER barriers[] = {
-			CD3DX12_RESOURCE_BARRIER::Transition(
-				presentResource, D3D12_RESOURCE_STATE_COPY_SOURCE,
-				D3D12_RESOURCE_STATE_COPY_DEST),
-			CD3DX12_RESOURCE_BARRIER::Transition(
-				CurrentBackBuffer(), D3D12_RESOURCE_STATE_COPY_DEST,
-				D3D12_RESOURCE_STATE_PRESENT)
-		};
-		mCommandList->ResourceBarrier(2, barriers);
-	}
+const SRResource* SRDevice::GetRenderTarget() {
+	return ValidRenderTarget(mRenderTargetHandle) ? &mResources[mRenderTargetHandle] : nullptr;
 }
 
 SRDevice::~SRDevice() {
-	for (auto& resource : mResources) {
-		free(resource.ptr);
-	}
+	SREndCapture();
 	free(mInternalHiZCache);
-
-	// flush at here, otherwise render target helper will be release before all command execute.
-	FlushCommandQueue();
+	_aligned_free(mInternalThreadStatistics);
+	delete[] mInternalRingCursors;
+	ResizeTileMaps(0, 0);
 }
@@ -1,7 +1,18 @@
 #pragma once
 
-#include "d3dApp.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <DirectXMath.h>
+#include "SRPlatform.h"
 #include "SRenum.h"
+#include "SRHeap.h"
+#include "SRMeshFile.h"
+#include "SRTexture.h"
+#include "SRThreadPool.h"
+#include "SRTrace.h"
+#include "SRVirtualTexture.h"
 
 typedef struct SRResource{
 	BYTE* ptr;
@@ -10,6 +21,10 @@ typedef struct SRResource{
 	UINT DEPTH;
 	DXGI_FORMAT FORMAT;
 	SRResourceDimension DIMENSION;
+	UINT MIPLEVELS;
+	SRResourceLayout LAYOUT;
+	UINT VERSIONS;
+	UINT VERSION;		// of an upload buffer, the one ptr points to
 } SRResource;
 
 typedef UINT SRResourceHandle;
@@ -20,8 +35,23 @@ typedef struct SRResourceDescription {
 	UINT DEPTH;
 	DXGI_FORMAT FORMAT;
 	SRResourceDimension DIMENSION;
+	// textures only, 0 for the full chain down to 1 * 1. the levels follow each other, the largest first.
+	UINT MIPLEVELS = 1;
+	// Texture2D only. swizzled textures are sampled faster but can't be render targets,
+	// SRCopyToResource / SRCopyFromResource convert from / to row-major.
+	// virtual textures are filled page by page through SRVirtualTextureDesc::PageFault and can only be sampled.
+	SRResourceLayout LAYOUT = SRResourceLayoutRowMajor;
+	// buffers only. more than 1 makes an upload buffer: every SRMapResource hands out the next of its versions,
+	// so that a frame writes its data in place while submitted work still reads the versions of earlier frames.
+	UINT VERSIONS = 1;
 } SRResourceDescription;
 
+// bytes [Begin, End) of a resource, after D3D12_RANGE
+typedef struct SRRange {
+	size_t Begin;
+	size_t End;
+} SRRange;
+
 typedef struct SRBlendDesc {
 	bool BlendEnable;
 	SRBlend SrcBlend;
@@ -33,30 +63,128 @@ typedef struct SRBlendDesc {
 	UINT8 RenderTargetWriteMask;
 } SRBlendDesc;
 
+typedef void (*SRVertexShader)(const BYTE* vsInput, BYTE* vsOutput, const BYTE*const* constBuffer);
+typedef void (*SRPixelShader)(BYTE* psInput, DirectX::XMFLOAT4* pixelColor, const BYTE*const* constBuffer);
+typedef void (*SRQuadPixelShader)(BYTE* psInput[4], DirectX::XMFLOAT4 (*pixelColor)[4], const BYTE*const* constBuffer);
+
 /*
  * only support float format in intermedia data.
  * the first 16 bytes of vsOutput will be interpreted as SV_POSITION.
  */
 typedef struct SRPipelineState {
-	void (*VS)(const BYTE* vsInput, BYTE* vsOutput, const BYTE*const* constBuffer) = nullptr;
-	void (*PS)(BYTE* psInput, DirectX::XMFLOAT4* pixelColor, const BYTE*const* constBuffer) = nullptr;
+	SRVertexShader VS = nullptr;
+	SRPixelShader PS = nullptr;
 	UINT VSInputByteStride = 0;
 	UINT VSOutputByteCount = 0;
 	UINT NumConstantBuffer = 0;
+	// the shaders find the bound textures after the constant buffers in constBuffer,
+	// as const SRTextureView*, and the samplers after the textures as const SRSamplerDesc*.
+	UINT NumShaderResources = 0;
+	UINT NumSamplers = 0;
+	// the first PSDerivativeCount floats after SV_POSITION get their screen space derivatives
+	// appended to the pixel shader input, all ddx then all ddy, taken across the 2 * 2 quad of the pixel.
+	UINT PSDerivativeCount = 0;
 	bool EnableZPrePass = false;
 	bool EnableQuadPixelShader = false;
-	void(*QuadPS)(BYTE* psInput[4], DirectX::XMFLOAT4 (*pixelColor)[4], const BYTE*const* constBuffer) = nullptr;
+	SRQuadPixelShader QuadPS = nullptr;
 } SRPipelineState;
 
-class SRDevice : D3DApp 
+/*
+ * Counters collected by the rasterizer since the last reset, how the visible triangles were dispatched.
+ * The triangles reaching rasterization and the culled ones are SRPipelineStatistics::CPrimitives / CulledPrimitives.
+ */
+typedef struct SRRasterizerStatistics {
+	UINT64 SmallTriangles = 0;		// bounding box inside one tile, took the small triangle path
+	UINT64 TiledTriangles = 0;		// went through tile traversal
+	UINT64 InlineTriangles = 0;		// rasterized on the submitting thread
+	UINT64 BatchedTriangles = 0;	// deferred into a batch for parallel rasterization
+	UINT64 Batches = 0;				// parallel dispatches
+	UINT64 PipelinedTriangles = 0;	// handed to the tile workers through the pipeline ring
+
+	// dispatch thresholds in effect, see SRRasterizerDesc
+	UINT InlineTileThreshold = 0;
+	UINT BatchSize = 0;
+	UINT PipelineDepth = 0;
+} SRRasterizerStatistics;
+
+/*
+ * Result of a pipeline statistics query, after D3D12_QUERY_DATA_PIPELINE_STATISTICS.
+ * There is no geometry, tessellation or compute stage, the counters after
+ * PSInvocations break the rasterizer down further.
+ */
+typedef struct SRPipelineStatistics {
+	UINT64 IAVertices = 0;					// vertices read by the input assembler
+	UINT64 IAPrimitives = 0;				// triangles assembled
+	UINT64 VSInvocations = 0;				// there is no post-transform cache, 3 per triangle
+	UINT64 CInvocations = 0;				// triangles sent to near plane clipping
+	UINT64 CPrimitives = 0;					// triangles leaving clipping, 0 to 2 per input
+	UINT64 PSInvocations = 0;
+
+	UINT64 NearPlaneClippedPrimitives = 0;	// triangles with a vertex behind the near plane
+	UINT64 CulledPrimitives = 0;			// clockwise or covering no pixel center
+	UINT64 TilesTested = 0;					// 8 * 8 tiles entering the tile test
+	UINT64 TilesRejectedByEdge = 0;			// tile outside of the triangle
+	UINT64 TilesRejectedByHiZ = 0;			// tile behind the Hi-Z max depth or in front of the near plane
+	UINT64 DepthClippedPixels = 0;			// depth out of [0, 1]
+	UINT64 ZPrePassFailedPixels = 0;		// depth test failed before the pixel shader
+	UINT64 DepthTestFailedPixels = 0;		// depth test failed after the pixel shader
+	UINT64 PixelsWritten = 0;				// written by the output merger
+} SRPipelineStatistics;
+
+/*
+ * Work done on one 8 * 8 tile during a frame, see SREnableTileHeatmap.
+ */
+typedef struct SRTileCounters {
+	UINT TrianglesTested;		// triangles whose bounding box touches the tile
+	UINT TrianglesAccepted;		// passed the tile edge test and Hi-Z
+	UINT PixelsShaded;			// pixel shader invocations
+	UINT PixelsWritten;			// written by the output merger
+	UINT64 Cycles;				// rasterization time spent on the tile
+} SRTileCounters;
+
+/*
+ * Controls how triangles are handed over to the worker threads.
+ */
+typedef struct SRRasterizerDesc {
+	// triangles whose bounding box touches no more tiles than this are rasterized
+	// on the submitting thread, since waking up the workers costs more than the work.
+	// the default is one chunk of the tile schedule.
+	UINT InlineTileThreshold = 8;
+	// larger triangles are collected and rasterized in parallel this many at a time.
+	UINT BatchSize = 256;
+	// order in which the tiles of a batch are handed to the workers.
+	SRTileScheduling TileScheduling = SRTileSchedulingCostHistory;
+	// order in which tiles are traversed, also splits the tiles into per-worker chunks.
+	// space filling curves keep a worker's tiles close together.
+	SRTileOrder TileOrder = SRTileOrderZigzag;
+	// 0 draws in fork / join batches as above. Otherwise the submitting thread only runs the
+	// vertex shader and the triangle setup, and streams the set-up triangles through a ring of
+	// this many slots (rounded up to a power of 2) to the other threads of the pool, which
+	// rasterize the tiles they own while the next triangles are being set up.
+	// the submitting thread waits while the ring is full. needs at least 2 threads.
+	UINT PipelineDepth = 0;
+} SRRasterizerDesc;
+
+struct SRTriangleSetup;
+class SRCapture;
+class SRCommandList;
+class SRCommandQueue;
+class SRShaderRegistry;
+
+/*
+ * The software renderer itself. It renders into its own resources only,
+ * so it can be used offscreen without any window or GPU.
+ * See SRWindowDevice for presenting the render target in a D3D12 window.
+ */
+class SRDevice
 {
 public:
-	SRDevice() = delete;
+	SRDevice() = default;
 	SRDevice(const SRDevice& rhs) = delete;
 	SRDevice& operator=(const SRDevice& rhs) = delete;
-	SRDevice(HINSTANCE hInstance) : D3DApp(hInstance) {};
-	~SRDevice();
-	virtual bool Initialize();
+	virtual ~SRDevice();
+	// 0 worker thread means one per available core
+	virtual bool Initialize(UINT NumWorkerThreads = 0);
 
 public:
 	/*
@@ -66,12 +194,61 @@ public:
 	bool SRAllocateResource(UINT number);
 	bool SRCreateResource(SRResourceDescription Desc, SRResourceHandle* pHandle);
 	void SRCopyToResource(SRResourceHandle Handle, const void * pData, UINT len);
+	void SRCopyFromResource(SRResourceHandle Handle, void* pData, UINT len);
 	void SRReleaseResource(SRResourceHandle Handle);
+	// the dimension, the format and the layout stay the same, Desc.LAYOUT is the default or the layout of the resource.
+	// the bytes are kept as they are. the resource is left unchanged when the resize fails.
 	bool SRResizeResource(SRResourceHandle Handle, SRResourceDescription Desc);
+	// direct access to a row-major resource, after ID3D12Resource::Map. pReadRange: the bytes that will be read,
+	// nullptr for all. an upload buffer hands out its next version with the bytes in pReadRange copied from the
+	// current one, so pass an empty range when it is rewritten as a whole. no more than VERSIONS - 1 Maps while
+	// submitted work still reads it, typically one per frame. the pointer stays valid until the next Map or release.
+	bool SRMapResource(SRResourceHandle Handle, const SRRange* pReadRange, void** ppData);
+	// pWrittenRange: the bytes written, nullptr for all
+	void SRUnmapResource(SRResourceHandle Handle, const SRRange* pWrittenRange);
+	// levels 1 and up from level 0, in parallel. every face of a cube, every slice of a 3D texture.
+	// for textures of the sampleable formats that are not compressed, see SRGenerateMipRows.
+	bool SRGenerateMips(SRResourceHandle Handle);
 
 	// Debug API
 	void SREnableDebugLayer();
-	void SRSetMagMode(bool EnableMag, UINT MagLevel);
+	void SRGetRasterizerStatistics(SRRasterizerStatistics* pStats);
+	void SRResetRasterizerStatistics();
+	// counters of the draws between begin and end, queries can not be nested.
+	// both wait for the work submitted to the SRCommandQueue of the device, which is counted in between.
+	void SRBeginPipelineStatisticsQuery();
+	void SREndPipelineStatisticsQuery(SRPipelineStatistics* pStats);
+	// timeline of every thread in Chrome trace event format, appended to the file at every frame end.
+	// events beyond EventsPerThread per thread and frame are dropped.
+	bool SRBeginTrace(const char* pFileName, UINT EventsPerThread = 1 << 16);
+	void SREndTrace();
+	// API calls and resource contents written to the file until the end, see SRCapture.h.
+	// the shaders of the pipeline states have to be registered in pRegistry, which has to outlive the capture.
+	bool SRBeginCapture(const char* pFileName, const SRShaderRegistry* pRegistry);
+	void SREndCapture();
+	// cycles spent on each 8 * 8 tile in the previous frame, row-major.
+	// the map stays valid until the next frame ends or the render target is resized.
+	void SRGetTileCostMap(const UINT64** ppCosts, UINT* pTileWidth, UINT* pTileHeight);
+	// per tile counters, collected while enabled. get and save return the previous frame,
+	// valid until the next frame ends or the render target is resized.
+	void SREnableTileHeatmap(bool Enable);
+	void SRGetTileHeatmap(const SRTileCounters** ppCounters, UINT* pTileWidth, UINT* pTileHeight);
+	bool SRSaveTileHeatmap(const char* pFileName, SRHeatmapCounter Counter, SRHeatmapFormat Format);
+
+	// Virtual texture API, see SRVirtualTexture.h. the pages are faulted in and evicted by SREndFrame,
+	// so these must not be called while a SRCommandQueue may be ending a frame.
+	void SRSetVirtualTextureDesc(SRVirtualTextureDesc Desc);
+	void SRGetVirtualTextureStatistics(SRVirtualTextureStatistics* pStats);
+
+	// Heap API, see SRHeap.h. the desc applies to the resources created afterwards.
+	void SRSetHeapDesc(SRHeapDesc Desc);
+	void SRGetHeapStatistics(SRHeapStatistics* pStats);
+
+	// Mesh API, see SRMeshFile.h. the buffers of the mesh point into the mapped file and are read-only:
+	// they can be drawn, read back and released, not written, mapped or resized. the file stays mapped
+	// until all of them are released. files whose submeshes or meshlets lie past the indices are refused,
+	// the index values are checked by the draws and the recorded draws from the buffers, for the indices they read.
+	bool SRLoadMeshFile(const char* pFileName, SRMesh* pMesh);
 
 	// Render API
 	void SRClearRenderTargetView(SRResourceHandle ResourceHandle, const float color[4]);
@@ -79,16 +256,27 @@ public:
 		SRClearFlags flag, float depth, UINT8 stencil);
 
 	void SRSetPipelineState(SRPipelineState PipelineState);
+	void SRSetRasterizerDesc(SRRasterizerDesc Desc);
 
 	void SRIASetVertexBuffers(SRResourceHandle ResourceHandle);
-	void SRIASetIndexBuffers(SRResourceHandle ResourceHandle);
+	// Format: DXGI_FORMAT_R16_UINT or DXGI_FORMAT_R32_UINT
+	void SRIASetIndexBuffers(SRResourceHandle ResourceHandle, DXGI_FORMAT Format = DXGI_FORMAT_R32_UINT);
 	void SRIASetConstantBuffers(UINT Index, SRResourceHandle ResourceHandle);
 	void SRIASetPrimitiveTopology(SRPrimitiveTopology Primitive);
 
+	// Texture1D / 2D / 3D / Cube resources with a format SRIsSampleableFormat accepts
+	void SRPSSetShaderResources(UINT Index, SRResourceHandle ResourceHandle);
+	void SRPSSetSamplers(UINT Index, SRSamplerDesc Desc);
+
 	void SROMSetRenderTarget(SRResourceHandle TargetHandle, SRResourceHandle DepthHandle, bool IsAllDepthInitToOne = false);
 
 	void SRDrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation, UINT StartInstanceLocation);
 	void SRDrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, UINT BaseVertexLocation, UINT StartInstanceLocation);
+	// plays back closed command lists in order, on the calling thread. see SRCommandList.h.
+	void SRExecuteCommandLists(UINT NumCommandLists, SRCommandList* const* ppCommandLists);
+	// frame boundary, the per frame rasterizer history is rotated here.
+	// SRWindowDevice calls it after every DrawScene, offscreen users call it themselves.
+	void SREndFrame();
 
 	/*
 	 * Constants
@@ -96,6 +284,9 @@ public:
 	static const SRResourceHandle InvalidHandle = SRResourceHandle(-1);
 
 private:
+	friend class SRCommandList;
+	friend class SRCommandQueue;
+
 	/*
 	 * Underlying Data
 	 */
@@ -104,87 +295,170 @@ private:
 	SRResourceHandle mDepthStencilHandle = InvalidHandle;
 	SRResourceHandle mVertexBufferHandle = InvalidHandle;
 	SRResourceHandle mIndexBufferHandle = InvalidHandle;
+	DXGI_FORMAT mIndexFormat = DXGI_FORMAT_R32_UINT;
 	SRResourceHandle mConstantsBufferHandle[8];
+	// copies taken by SRCommandQueue at submission, read instead of the bound buffers when not nullptr
+	const BYTE* mInternalConstantsSnapshot[8];
+	// versions of the bound upload buffers taken by SRCommandQueue at submission, same as above
+	const BYTE* mInternalVertexSnapshot = nullptr;
+	const BYTE* mInternalIndexSnapshot = nullptr;
+	SRResourceHandle mShaderResourceHandle[8];
+	SRSamplerDesc mSamplers[8];
 	SRPipelineState mPipelineState;
+	SRRasterizerDesc mRasterizerDesc;
 	SRPrimitiveTopology mPrimitive = SRPrimitiveTopologyTriangleList;
 	bool mDebugLayer = false;
-	bool mMagPresent = false;
-	UINT mMagLevel = 0;
+	SRRasterizerStatistics mRasterizerStats;
 
 
 	/*
 	 * Internal variable
 	 */
-	SRResourceHandle mInternalAllocateHelperHandle = 0;
+	// the handles without a resource, the last one is handed out next
+	std::vector<SRResourceHandle> mInternalFreeHandles;
 	UINT mInternalRenderTargetWidth = 0;
 	UINT mInternalRenderTargetHeight = 0;
-	static constexpr int mInternalSwapChainNum = 3;
-	int mInternalSwapChainIndex = 0;
-	UINT64 mInternalFences[mInternalSwapChainNum];
-	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mInternalCmdListAllocs[mInternalSwapChainNum];
 	UINT32* mInternalHiZCache = nullptr;
+	SRThreadPool mThreadPool;
+	// one ParallelFor at a time: held by the SRCommandQueue thread while it plays back,
+	// and by the calls of the other threads that use the pool or reallocate mResources
+	std::mutex mInternalPoolMutex;
+
+	// pipeline statistics, one cache line aligned slot per thread of the pool,
+	// so the rasterizer counts without atomics. merged at the end of the query.
+	struct alignas(64) SRThreadStatistics {
+		SRPipelineStatistics Stats;
+	};
+	SRThreadStatistics* mInternalThreadStatistics = nullptr;
+	bool mInternalQueryActive = false;
+	SRTracer mTracer;
+	SRCapture* mCapture = nullptr;
+	// the SRCommandQueue of the device while there is one
+	SRCommandQueue* mInternalQueue = nullptr;
+	SRResidencyManager mResidency;
+	SRHeap mHeap;
+	// the read-only buffers of the mapped mesh files, released with the last of their buffers
+	std::unordered_map<SRResourceHandle, std::shared_ptr<SRMappedFile>> mInternalMappedFiles;
+
+	// per tile cycles of the current and the previous frame,
+	// position of every tile along the traversal order,
+	// and the tiles sorted by the previous cost (for SRTileSchedulingCostHistory) then the position.
+	UINT64* mInternalTileCost = nullptr;
+	UINT64* mInternalTileCostHistory = nullptr;
+	UINT* mInternalTileRank = nullptr;
+	UINT* mInternalTileOrder = nullptr;
+	UINT* mInternalBatchTiles = nullptr;
+
+	// tile counters of the current and the previous frame, nullptr while the heatmap is disabled.
+	// like the tile cost a tile is only touched by the thread owning it.
+	bool mTileHeatmap = false;
+	SRTileCounters* mInternalTileCounters = nullptr;
+	SRTileCounters* mInternalTileCountersHistory = nullptr;
+
+	// valid between BeginRasterization and EndRasterization
+	const BYTE*const* mInternalConstBuffers = nullptr;
+	SRTextureView mInternalShaderResourceViews[8];
+	BYTE* mInternalPSInputPool = nullptr;
+	UINT mInternalPSInputStride = 0;
+	SRTriangleSetup* mInternalBatch = nullptr;
+	DirectX::XMFLOAT3* mInternalBatchInterpolate = nullptr;
+	UINT mInternalBatchCount = 0;
+	// tile bounding box of the pending batch
+	UINT mInternalBatchLeft = 0;
+	UINT mInternalBatchRight = 0;
+	UINT mInternalBatchTop = 0;
+	UINT mInternalBatchBottom = 0;
+
+	// geometry / raster pipeline, see SRRasterizerDesc::PipelineDepth.
+	// mInternalBatch is the ring, cursor 0 its head written by the submitting thread,
+	// cursor k the next triangle tile worker k reads. the cursors only grow.
+	struct alignas(64) SRRingCursor {
+		std::atomic<UINT64> Position;
+	};
+	SRRingCursor* mInternalRingCursors = nullptr;
+	std::atomic<bool> mInternalRingClosed{ false };
+	UINT mInternalRingSize = 0;			// 0 while not pipelining
+	UINT64 mInternalRingTail = 0;		// slowest tile worker, as last seen by the submitting thread
+	// tile worker of every tile for the current draw
+	UINT16* mInternalTileOwner = nullptr;
 
 private:
 	/*
 	 * helper function
 	 */
-	inline bool ValidRenderTarget(const SRResourceHandle handle);
+	bool ValidRenderTarget(const SRResourceHandle handle);
 	inline bool ValidRenderTarget(const SRResource& renderTarget);
-	inline bool ValidDepthStencil(const SRResourceHandle handle);
+	bool ValidDepthStencil(const SRResourceHandle handle);
 	inline bool ValidDepthStencil(const SRResource& depth);
 	inline bool ValidDepthStencil(const SRResource& depth, UINT width, UINT height);
-	inline bool ValidDrawTarget(const SRResourceHandle target, const SRResourceHandle depth);
+	bool ValidDrawTarget(const SRResourceHandle target, const SRResourceHandle depth);
+	bool ValidBuffer(const SRResourceHandle handle);
+	static bool ValidIndexFormat(DXGI_FORMAT format);
+	bool ValidShaderResource(const SRResourceHandle handle);
+	bool ValidMipGeneration(const SRResourceHandle handle);
+	static void FillTextureView(const SRResource& resource, SRTextureView& view);
+	static bool ValidSampler(const SRSamplerDesc& desc);
+	static bool ValidPipelineState(const SRPipelineState& state);
+	static size_t SizeOfResource(const SRResource& resource);
+	// bytes from one version of an upload buffer to the next
+	static size_t VersionStride(const SRResource& resource);
+	bool CreateMappedBuffer(const std::shared_ptr<SRMappedFile>& file, UINT64 offset, UINT64 size, SRResourceHandle* pHandle);
+	bool IsReadOnly(SRResourceHandle handle) const { return mInternalMappedFiles.count(handle) != 0; };
+	// false if an indexed draw from the buffers of a mesh file reads past them, the other buffers are not checked
+	bool ValidMeshFileDraw(SRResourceHandle vertexBuffer, UINT stride, SRResourceHandle indexBuffer, DXGI_FORMAT format,
+		UINT start, UINT count, UINT baseVertex);
+	void CopySwizzled(const SRResource& resource, BYTE* pRowMajor, size_t len, bool isUpload);
+	static bool DepthStencilClearMask(SRClearFlags flag, UINT32& mask);
 	void ResizeRenderTarget(const SRResource renderTarget);
 	bool FillResouceAttribute(const SRResourceDescription desc, SRResource& resource);
+	bool CreateResource(SRResourceDescription desc, SRResourceHandle* pHandle);
 	void InitHiZCache(bool isAllDepthInitToOne);
 
-	void DirectPresent(ID3D12Resource* presentResource);
-	void MagnificationPresent(ID3D12Resource* presentResource);
-	void InitializeMagPresent();
-	void CreateMagDescriptor();
+	// the calls after validation, shared by the immediate API and SRExecuteCommandLists
+	void ClearRenderTarget(SRResourceHandle handle, const float color[4]);
+	void ClearDepthStencil(SRResourceHandle handle, UINT32 mask, float depth, UINT8 stencil);
+	void SetRenderTarget(SRResourceHandle target, SRResourceHandle depth, bool isAllDepthInitToOne);
+	void GenerateMips(SRResourceHandle handle);
+	void DrawInstanced(UINT vertexCount, UINT startVertex);
+	void DrawIndexedInstanced(UINT indexCount, UINT startIndex, UINT baseVertex);
+	bool ValidCommandList(const SRCommandList& list);
+	// pBuffers: what each vertex, index and constant buffer set command of the list reads, in order:
+	// a constant buffer copy or an upload buffer version, or nullptr for the buffer itself. nullptr to read all buffers.
+	void ExecuteCommandList(const SRCommandList& list, const BYTE* const* pBuffers);
 
 	// rasterize helper function
+	void BeginRasterization();
+	void EndRasterization();
 	void DrawTriangle(const BYTE* vsInputs[3]);
-	void RasterizeTriangle(const BYTE* vsOutput1, const BYTE* vsOutput2, const BYTE* vsOutput3, const BYTE*const* constBuffers);
+	void RasterizeTriangle(const BYTE* vsOutput1, const BYTE* vsOutput2, const BYTE* vsOutput3);
+	void FlushRasterizationBatch();
+	template<typename Geometry>
+	void RunGeometry(const Geometry& geometry);
+	void PushPipelineTriangle(const BYTE* vsOutput1, const BYTE* vsOutput2, const BYTE* vsOutput3);
+	void RasterizePipelineTiles(UINT threadIndex);
+	void RasterizeBatchTile(UINT i, UINT j, BYTE* psInput, SRPipelineStatistics& stats);
+	void ResizeTileMaps(UINT width, UINT height);
+	void ResizeTileCounters(UINT tileCount);
+	void UpdateTileOrder(bool updateRank);
+	bool SetupTriangle(const BYTE* vsOutput1, const BYTE* vsOutput2, const BYTE* vsOutput3,
+		DirectX::XMFLOAT3* toInterpolate, SRTriangleSetup& setup);
+	void RasterizeTile(const SRTriangleSetup& setup, UINT i, UINT j, BYTE* psInput, const BYTE*const* constBuffers,
+		SRPipelineStatistics& stats);
+	void RasterizeSmallTriangle(const SRTriangleSetup& setup, BYTE* psInput, const BYTE*const* constBuffers,
+		SRPipelineStatistics& stats);
+	inline bool ShadePixel(const SRTriangleSetup& setup, DirectX::FXMVECTOR ks, float px, float py, UINT pos,
+		bool isDepthPass, float* input, const BYTE*const* constBuffers, SRPipelineStatistics& stats,
+		UINT32& depth, UINT32& newDepth);
 	const BYTE*const* AssempleConstantBuffers();
 
-private:
-	/*
-	 * D3D12 Interaction Layer
-	 */
-	virtual void Draw(const GameTimer& gt) override;
-
-	Microsoft::WRL::ComPtr<ID3D12Resource> mRenderTargetUploader[mInternalSwapChainNum];
-	Microsoft::WRL::ComPtr<ID3D12Resource> mRenderTargetHelper[mInternalSwapChainNum];
-
-	// Mag
-	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mMagHeap = nullptr;
-	Microsoft::WRL::ComPtr<ID3D12RootSignature> mMagRootSignature = nullptr;
-	Microsoft::WRL::ComPtr<ID3DBlob> mMagTriVS = nullptr;
-	Microsoft::WRL::ComPtr<ID3DBlob> mMagTriPS = nullptr;
-	Microsoft::WRL::ComPtr<ID3DBlob> mMagLineVS = nullptr;
-	Microsoft::WRL::ComPtr<ID3DBlob> mMagLinePS = nullptr;
-	Microsoft::WRL::ComPtr<ID3D12PipelineState> mMagTriPSO;
-	Microsoft::WRL::ComPtr<ID3D12PipelineState> mMagLinePSO;
-
+protected:
 	/*
-	 * forward functions
+	 * front-end interface
 	 */
-public:
-	int Run() { return D3DApp::Run(); };
-
-protected:
-	virtual void Update(const GameTimer& gt) = 0;
-	virtual void DrawScene(const GameTimer& gt) = 0;
-	virtual void OnResize() { D3DApp::OnResize(); };
-
-	virtual void OnMouseDown(WPARAM btnState, int x, int y) {};
-	virtual void OnMouseUp(WPARAM btnState, int x, int y) {};
-	virtual void OnMouseMove(WPARAM btnState, int x, int y) {};
-
-	int GetClientWidth() { return mClientWidth; };
-	int GetClientHeight() { return mClientHeight; };
-	float GetAspectRatio() const { return AspectRatio(); };
-	HWND GetMainWnd() { return mhMainWnd; };
-	bool GetDebugMode() { return mDebugMode; };
+	// errors are written to stderr by default
+	virtual void ReportError(const wchar_t* message, bool isFatal);
+	// the bound render target changed its size, called before drawing into it
+	virtual void OnRenderTargetResize(UINT /*width*/, UINT /*height*/) {};
+	// nullptr if no valid render target is bound
+	const SRResource* GetRenderTarget();
 };
\ No newline at end of file
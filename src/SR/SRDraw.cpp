@@ -1,14 +1,22 @@
 #include "SRDevice.h"
+#include "SRCapture.h"
 #include "SRUtils.h"
 #include "SRDraw.inl"
-#include <omp.h>
+#include <algorithm>
+#include <atomic>
+#include <string.h>
 
 //#define AllowQuadPS
 
 using namespace DirectX;
 
+// tiles a worker takes at a time
+static const UINT TileGrain = 4;
+
 void SRDevice::SRDrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation, UINT StartInstanceLocation)
 {
+	if (mCapture != nullptr)
+		mCapture->DrawInstanced(VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation);
 	if (mRenderTargetHandle == InvalidHandle ||
 		mDepthStencilHandle == InvalidHandle ||
 		mVertexBufferHandle == InvalidHandle)
@@ -26,10 +34,61 @@ void SRDevice::SRDrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount,
 #endif
 	
 	if (mPrimitive == SRPrimitiveTopologyTriangleList) {
-		// Input Assembler
-		UINT TriangleCount = VertexCountPerInstance / 3;
-		BYTE* vsInput = mResources[mVertexBufferHandle].ptr + StartVertexLocation * mPipelineState.VSInputByteStride;
+		DrawInstanced(VertexCountPerInstance, StartVertexLocation);
+	}
+	else {
+		SRError(L"Unsupport Primitive.");
+	}
+}
+
+// run geometry(), which sets up the triangles of a draw, on the submitting thread.
+// while pipelining the other threads rasterize them at the same time, see RasterizePipelineTiles.
+template<typename Geometry>
+void SRDevice::RunGeometry(const Geometry& geometry) {
+	if (mInternalRingSize == 0) {
+		geometry();
+		return;
+	}
+
+	// deal the tiles to the tile workers along the tile order, one at a time when
+	// they are sorted by cost so that the hot tiles are spread over all workers.
+	const UINT workerCount = mThreadPool.GetThreadCount() - 1;
+	const UINT tileCount = ((mInternalRenderTargetWidth + 7) / 8) * ((mInternalRenderTargetHeight + 7) / 8);
+	const UINT grain = mRasterizerDesc.TileScheduling == SRTileSchedulingCostHistory ? 1 : TileGrain;
+	for (UINT n = 0; n < tileCount; n++) {
+		mInternalTileOwner[mInternalTileOrder[n]] = UINT16(1 + (n / grain) % workerCount);
+	}
+
+	for (UINT k = 0; k <= workerCount; k++) {
+		mInternalRingCursors[k].Position.store(0, std::memory_order_relaxed);
+	}
+	mInternalRingTail = 0;
+	mInternalRingClosed.store(false, std::memory_order_relaxed);
+
+	mThreadPool.RunOnEachThread([&](UINT threadIndex) {
+		if (threadIndex == 0) {
+			geometry();
+			mInternalRingClosed.store(true, std::memory_order_release);
+		}
+		else
+			RasterizePipelineTiles(threadIndex);
+	});
+}
+
+void SRDevice::DrawInstanced(UINT vertexCount, UINT startVertex) {
+	// Input Assembler
+	UINT TriangleCount = vertexCount / 3;
+	const BYTE* vertices = mInternalVertexSnapshot != nullptr ? mInternalVertexSnapshot : mResources[mVertexBufferHandle].ptr;
+	const BYTE* vsInput = vertices + startVertex * mPipelineState.VSInputByteStride;
+
+	SRPipelineStatistics& stats = mInternalThreadStatistics[0].Stats;
+	stats.IAVertices += 3 * TriangleCount;
+	stats.IAPrimitives += TriangleCount;
 
+	SRTrace(mTracer, 0, "Draw", TriangleCount);
+	BeginRasterization();
+
+	RunGeometry([&]() {
 		for (UINT n = 0; n < TriangleCount; n++) {
 			const BYTE* vsInputs[3] = {
 				vsInput,
@@ -39,15 +98,16 @@ void SRDevice::SRDrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount,
 			DrawTriangle(vsInputs);
 			vsInput += 3 * mPipelineState.VSInputByteStride;
 		}
-	}
-	else {
-		SRError(L"Unsupport Primitive.");
-	}
+	});
+
+	EndRasterization();
 }
 
 void SRDevice::SRDrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount,
 	UINT StartIndexLocation, UINT BaseVertexLocation, UINT StartInstanceLocation)
 {
+	if (mCapture != nullptr)
+		mCapture->DrawIndexedInstanced(IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation);
 	if (mRenderTargetHandle == InvalidHandle ||
 		mDepthStencilHandle == InvalidHandle ||
 		mVertexBufferHandle == InvalidHandle ||
@@ -56,6 +116,12 @@ void SRDevice::SRDrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceC
 		SRError(L"Invalid buffer setting.");
 		return;
 	}
+	if (!ValidMeshFileDraw(mVertexBufferHandle, mPipelineState.VSInputByteStride, mIndexBufferHandle, mIndexFormat,
+		StartIndexLocation, IndexCountPerInstance, BaseVertexLocation))
+	{
+		SRError(L"Draw past the buffers of a mesh file.");
+		return;
+	}
 
 	// only support one instance now.
 	assert(InstanceCount == 1);
@@ -66,29 +132,122 @@ void SRDevice::SRDrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceC
 #endif
 
 	if (mPrimitive == SRPrimitiveTopologyTriangleList) {
-		// Input Assembler
-		UINT TriangleCount = IndexCountPerInstance / 3;
-		BYTE* vsInput = mResources[mVertexBufferHandle].ptr + BaseVertexLocation * mPipelineState.VSInputByteStride;
-		UINT32* indexBuffer = reinterpret_cast<UINT32*>(mResources[mIndexBufferHandle].ptr) + StartIndexLocation;
+		DrawIndexedInstanced(IndexCountPerInstance, StartIndexLocation, BaseVertexLocation);
+	}
+	else {
+		SRError(L"Unsupport Primitive.");
+	}
+}
+
+void SRDevice::DrawIndexedInstanced(UINT indexCount, UINT startIndex, UINT baseVertex) {
+	// Input Assembler
+	UINT TriangleCount = indexCount / 3;
+	const BYTE* vertices = mInternalVertexSnapshot != nullptr ? mInternalVertexSnapshot : mResources[mVertexBufferHandle].ptr;
+	const BYTE* indices = mInternalIndexSnapshot != nullptr ? mInternalIndexSnapshot : mResources[mIndexBufferHandle].ptr;
+	const BYTE* vsInput = vertices + baseVertex * mPipelineState.VSInputByteStride;
+	const bool is16Bit = mIndexFormat == DXGI_FORMAT_R16_UINT;
+	const BYTE* indexBuffer = indices + size_t(startIndex) * (is16Bit ? sizeof(UINT16) : sizeof(UINT32));
+	auto index = [=](UINT n) -> UINT {
+		return is16Bit ? reinterpret_cast<const UINT16*>(indexBuffer)[n] : reinterpret_cast<const UINT32*>(indexBuffer)[n];
+	};
+
+	SRPipelineStatistics& stats = mInternalThreadStatistics[0].Stats;
+	stats.IAVertices += 3 * TriangleCount;
+	stats.IAPrimitives += TriangleCount;
 
+	SRTrace(mTracer, 0, "DrawIndexed", TriangleCount);
+	BeginRasterization();
+
+	RunGeometry([&]() {
 		for (UINT n = 0; n < TriangleCount; n++) {
 			const BYTE* vsInputs[3] = {
-				vsInput + mPipelineState.VSInputByteStride * indexBuffer[3 * n],
-				vsInput + mPipelineState.VSInputByteStride * indexBuffer[3 * n + 1],
-				vsInput + mPipelineState.VSInputByteStride * indexBuffer[3 * n + 2]
+				vsInput + mPipelineState.VSInputByteStride * index(3 * n),
+				vsInput + mPipelineState.VSInputByteStride * index(3 * n + 1),
+				vsInput + mPipelineState.VSInputByteStride * index(3 * n + 2)
 			};
 			DrawTriangle(vsInputs);
 		}
+	});
+
+	EndRasterization();
+}
+
+
+// return pointer needs to be freed by caller
+// constant buffers, then the views of the shader resources, then the samplers
+const BYTE*const* SRDevice::AssempleConstantBuffers() {
+	const BYTE** constBuffersTmp = nullptr;
+	const UINT count = mPipelineState.NumConstantBuffer + mPipelineState.NumShaderResources + mPipelineState.NumSamplers;
+	if (count != 0) {
+		constBuffersTmp = (const BYTE**)malloc(count * sizeof(BYTE*));
+		assert(constBuffersTmp != nullptr);
+		UINT n = 0;
+		for (UINT i = 0; i < mPipelineState.NumConstantBuffer; i++) {
+			assert(mConstantsBufferHandle[i] != InvalidHandle);
+			constBuffersTmp[n++] = mInternalConstantsSnapshot[i] != nullptr ?
+				mInternalConstantsSnapshot[i] : mResources[mConstantsBufferHandle[i]].ptr;
+		}
+		for (UINT i = 0; i < mPipelineState.NumShaderResources; i++) {
+			assert(mShaderResourceHandle[i] != InvalidHandle);
+			const SRResource& resource = mResources[mShaderResourceHandle[i]];
+			SRTextureView& view = mInternalShaderResourceViews[i];
+			FillTextureView(resource, view);
+			constBuffersTmp[n++] = reinterpret_cast<const BYTE*>(&view);
+		}
+		for (UINT i = 0; i < mPipelineState.NumSamplers; i++) {
+			constBuffersTmp[n++] = reinterpret_cast<const BYTE*>(&mSamplers[i]);
+		}
 	}
-	else {
-		SRError(L"Unsupport Primitive.");
+	return constBuffersTmp;
+}
+
+void SRDevice::BeginRasterization() {
+	mInternalConstBuffers = AssempleConstantBuffers();
+
+	// size of per-thread pixel shader input and of per-triangle interpolation data
+#ifdef AllowQuadPS
+	mInternalPSInputStride = (((mPipelineState.VSOutputByteCount + 2 * mPipelineState.PSDerivativeCount * sizeof(float)) * 4 + 63) / 64) * 64;
+#else
+	mInternalPSInputStride = ((mPipelineState.VSOutputByteCount + 2 * mPipelineState.PSDerivativeCount * sizeof(float) + 63) / 64) * 64;
+#endif
+	const UINT interpolateCount = mPipelineState.VSOutputByteCount / 4 - 4;
+
+	// the pipeline ring takes the place of the batch
+	UINT batchSize = mRasterizerDesc.BatchSize;
+	mInternalRingSize = 0;
+	if (mRasterizerDesc.PipelineDepth != 0 && mThreadPool.GetThreadCount() > 1 && mInternalTileOwner != nullptr) {
+		mInternalRingSize = 1;
+		while (mInternalRingSize < mRasterizerDesc.PipelineDepth)
+			mInternalRingSize *= 2;
+		batchSize = mInternalRingSize;
 	}
+
+	mInternalPSInputPool = (BYTE*)_aligned_malloc(mThreadPool.GetThreadCount() * mInternalPSInputStride, 64);
+	mInternalBatch = (SRTriangleSetup*)_aligned_malloc(batchSize * sizeof(SRTriangleSetup), 64);
+	mInternalBatchInterpolate = (XMFLOAT3*)malloc(batchSize * (std::max)(interpolateCount, 1u) * sizeof(XMFLOAT3));
+	assert(mInternalPSInputPool != nullptr);
+	assert(mInternalBatch != nullptr);
+	assert(mInternalBatchInterpolate != nullptr);
+	mInternalBatchCount = 0;
 }
 
+void SRDevice::EndRasterization() {
+	FlushRasterizationBatch();
+
+	_aligned_free(mInternalPSInputPool);
+	_aligned_free(mInternalBatch);
+	free(mInternalBatchInterpolate);
+	free(const_cast<BYTE**>(mInternalConstBuffers));
+	mInternalPSInputPool = nullptr;
+	mInternalBatch = nullptr;
+	mInternalBatchInterpolate = nullptr;
+	mInternalConstBuffers = nullptr;
+	mInternalRingSize = 0;
+}
 
 void SRDevice::DrawTriangle(const BYTE* vsInputs[3]) {
 	// pointer setup
-	const BYTE*const* constBuffers = AssempleConstantBuffers();
+	const BYTE*const* constBuffers = mInternalConstBuffers;
 
 	// since we only do the near plane clip,
 	// at most four vertices will be create
@@ -108,6 +267,10 @@ void SRDevice::DrawTriangle(const BYTE* vsInputs[3]) {
 	for (UINT i = 0; i < 3; i++) {
 		(*mPipelineState.VS)(vsInputs[i], vsOutputs[i], constBuffers);
 	}
+	// the submitting thread is thread 0 of the pool
+	SRPipelineStatistics& stats = mInternalThreadStatistics[0].Stats;
+	stats.VSInvocations += 3;
+	stats.CInvocations++;
 
 
 	/**********************
@@ -129,10 +292,12 @@ void SRDevice::DrawTriangle(const BYTE* vsInputs[3]) {
 		else
 			inIndex = i;
 	}
+	if (numOfOutVertex != 0)
+		stats.NearPlaneClippedPrimitives++;
 	
 	// clip base on the number of vertices out of near plane
 	if (numOfOutVertex == 0) {
-		RasterizeTriangle(vsOutputs[0], vsOutputs[1], vsOutputs[2], constBuffers);
+		RasterizeTriangle(vsOutputs[0], vsOutputs[1], vsOutputs[2]);
 	}
 	else if (numOfOutVertex == 1) {
 		int index2 = (outIndex + 1) % 3, index3 = (outIndex + 2) % 3;
@@ -140,8 +305,8 @@ void SRDevice::DrawTriangle(const BYTE* vsInputs[3]) {
 			t1 = IntersectParameter(outputZs[outIndex], outputZs[index3]);
 		InterpolateLine(vsOutputs[outIndex], vsOutputs[index2], t0, mPipelineState.VSOutputByteCount / 4, vsOutputs[3]);
 		InterpolateLine(vsOutputs[outIndex], vsOutputs[index3], t1, mPipelineState.VSOutputByteCount / 4, vsOutputs[outIndex]);
-		RasterizeTriangle(vsOutputs[3], vsOutputs[index2], vsOutputs[index3], constBuffers);
-		RasterizeTriangle(vsOutputs[outIndex], vsOutputs[3], vsOutputs[index3], constBuffers);
+		RasterizeTriangle(vsOutputs[3], vsOutputs[index2], vsOutputs[index3]);
+		RasterizeTriangle(vsOutputs[outIndex], vsOutputs[3], vsOutputs[index3]);
 	}
 	else if (numOfOutVertex == 2) {
 		int index2 = (inIndex + 1) % 3, index3 = (inIndex + 2) % 3;
@@ -149,409 +314,801 @@ void SRDevice::DrawTriangle(const BYTE* vsInputs[3]) {
 			t1 = IntersectParameter(outputZs[inIndex], outputZs[index3]);
 		InterpolateLine(vsOutputs[inIndex], vsOutputs[index2], t0, mPipelineState.VSOutputByteCount / 4, vsOutputs[index2]);
 		InterpolateLine(vsOutputs[inIndex], vsOutputs[index3], t1, mPipelineState.VSOutputByteCount / 4, vsOutputs[index3]);
-		RasterizeTriangle(vsOutputs[0], vsOutputs[1], vsOutputs[2], constBuffers);
+		RasterizeTriangle(vsOutputs[0], vsOutputs[1], vsOutputs[2]);
 	}
 
 	free(vsOutputPool);
-	free(const_cast<BYTE**>(constBuffers));
 }
 
 
-void SRDevice::RasterizeTriangle(const BYTE* vsOutput1, const BYTE* vsOutput2, const BYTE* vsOutput3, const BYTE*const* constBuffers)
+void SRDevice::RasterizeTriangle(const BYTE* vsOutput1, const BYTE* vsOutput2, const BYTE* vsOutput3)
 {
-	// constant setup
-	auto& target = mResources[mRenderTargetHandle];
-	BYTE* pRenderTarget = target.ptr;
-	UINT32* pDepthStencil = reinterpret_cast<UINT32*>(mResources[mDepthStencilHandle].ptr);
-	const UINT w = target.WIDTH, h = target.HEIGHT;
-	const UINT tileWidth = (w + 7) / 8;
-	const bool EnableZPrepass = mPipelineState.EnableZPrePass;
 #ifdef AllowQuadPS
 	const bool EnableQuadPS = mPipelineState.EnableQuadPixelShader;
+#else
+	const bool EnableQuadPS = false;
 #endif
 
-	// pointer setup
+	if (mInternalRingSize != 0) {
+		PushPipelineTriangle(vsOutput1, vsOutput2, vsOutput3);
+		return;
+	}
+
+	// the triangle is set up in the next free batch slot,
+	// it will only take the slot if it turns out to be a large one.
+	if (mInternalBatchCount == mRasterizerDesc.BatchSize)
+		FlushRasterizationBatch();
+
+	const UINT interpolateCount = mPipelineState.VSOutputByteCount / 4 - 4;
+	SRTriangleSetup& setup = mInternalBatch[mInternalBatchCount];
+	XMFLOAT3* toInterpolate = mInternalBatchInterpolate + mInternalBatchCount * interpolateCount;
+
+	SRPipelineStatistics& stats = mInternalThreadStatistics[0].Stats;
+	stats.CPrimitives++;
+
+	bool IsVisible;
+	{
+		SRTrace(mTracer, 0, "TriangleSetup");
+		IsVisible = SetupTriangle(vsOutput1, vsOutput2, vsOutput3, toInterpolate, setup);
+	}
+	if (!IsVisible) {
+		stats.CulledPrimitives++;
+		return;
+	}
+
+	// 8 * 8 tile
+	// axis-aligned bounding box binning
+	const UINT leftMost = setup.minX / 8;
+	const UINT rightMost = setup.maxX / 8;
+	const UINT topMost = setup.minY / 8;
+	const UINT bottomMost = setup.maxY / 8;
+	const UINT tileCount = (bottomMost - topMost + 1) * (rightMost - leftMost + 1);
+
+	const bool IsSmall = !EnableQuadPS && tileCount == 1;
+	if (IsSmall)
+		mRasterizerStats.SmallTriangles++;
+	else
+		mRasterizerStats.TiledTriangles++;
+
+	// Small triangles are cheaper than waking up the workers, so they are rasterized right here.
+	// However, they have to wait in the batch if they overlap a pending triangle,
+	// otherwise the output merger would see them out of order.
+	bool IsOverlapBatch = mInternalBatchCount != 0 &&
+		leftMost <= mInternalBatchRight && rightMost >= mInternalBatchLeft &&
+		topMost <= mInternalBatchBottom && bottomMost >= mInternalBatchTop;
+
+	if (tileCount <= mRasterizerDesc.InlineTileThreshold && !IsOverlapBatch) {
+		mRasterizerStats.InlineTriangles++;
+		SRTrace(mTracer, 0, "RasterizeInline", tileCount);
+		BYTE* psInput = mInternalPSInputPool;
+		const UINT tileWidth = (setup.width + 7) / 8;
+		if (IsSmall) {
+			// the whole triangle lies in one tile,
+			// neither tile level test nor parallel dispatch pays off.
+			UINT64 start = readCycleCounter();
+			RasterizeSmallTriangle(setup, psInput, mInternalConstBuffers, stats);
+			mInternalTileCost[topMost * tileWidth + leftMost] += readCycleCounter() - start;
+		}
+		else if (mRasterizerDesc.TileOrder == SRTileOrderZigzag) {
+			for (UINT j = topMost; j <= bottomMost; j++) {
+				for (UINT t = leftMost; t <= rightMost; t++) {
+					// zigzag
+					UINT i = (j % 2 == 0 ? t : rightMost + leftMost - t);
+					UINT64 start = readCycleCounter();
+					RasterizeTile(setup, i, j, psInput, mInternalConstBuffers, stats);
+					mInternalTileCost[j * tileWidth + i] += readCycleCounter() - start;
+				}
+			}
+		}
+		else {
+			// follow the curve, the batch tile list is free outside of a flush
+			UINT count = 0;
+			for (UINT j = topMost; j <= bottomMost; j++) {
+				for (UINT i = leftMost; i <= rightMost; i++) {
+					mInternalBatchTiles[count++] = j * tileWidth + i;
+				}
+			}
+			const UINT* rank = mInternalTileRank;
+			std::sort(mInternalBatchTiles, mInternalBatchTiles + count, [rank](UINT a, UINT b) {
+				return rank[a] < rank[b];
+			});
+			for (UINT n = 0; n < count; n++) {
+				UINT tile = mInternalBatchTiles[n];
+				UINT64 start = readCycleCounter();
+				RasterizeTile(setup, tile % tileWidth, tile / tileWidth, psInput, mInternalConstBuffers, stats);
+				mInternalTileCost[tile] += readCycleCounter() - start;
+			}
+		}
+		return;
+	}
+
+	mRasterizerStats.BatchedTriangles++;
+	if (mInternalBatchCount == 0) {
+		mInternalBatchLeft = leftMost;
+		mInternalBatchRight = rightMost;
+		mInternalBatchTop = topMost;
+		mInternalBatchBottom = bottomMost;
+	}
+	else {
+		mInternalBatchLeft = (std::min)(mInternalBatchLeft, leftMost);
+		mInternalBatchRight = (std::max)(mInternalBatchRight, rightMost);
+		mInternalBatchTop = (std::min)(mInternalBatchTop, topMost);
+		mInternalBatchBottom = (std::max)(mInternalBatchBottom, bottomMost);
+	}
+	mInternalBatchCount++;
+}
+
+void SRDevice::FlushRasterizationBatch() {
+	if (mInternalBatchCount == 0)
+		return;
+	mRasterizerStats.Batches++;
+	SRTrace(mTracer, 0, "Batch", mInternalBatchCount);
+
+	/*********************
+	 * triangle travelsal
+	 */
+	// Every tile of the batch is owned by exactly one thread, which walks the
+	// triangles overlapping it in submission order. So one fork / join is paid
+	// per batch instead of per triangle, and no tile is touched by two threads.
+	const UINT leftMost = mInternalBatchLeft;
+	const UINT rightMost = mInternalBatchRight;
+	const UINT topMost = mInternalBatchTop;
+	const UINT bottomMost = mInternalBatchBottom;
+
+	if (mRasterizerDesc.TileScheduling == SRTileSchedulingCostHistory ||
+		mRasterizerDesc.TileOrder != SRTileOrderZigzag)
+	{
+		const UINT tileWidth = (mInternalRenderTargetWidth + 7) / 8;
+		const UINT tileCount = tileWidth * ((mInternalRenderTargetHeight + 7) / 8);
+		UINT batchTileCount = 0;
+		for (UINT n = 0; n < tileCount; n++) {
+			UINT tile = mInternalTileOrder[n];
+			UINT i = tile % tileWidth;
+			UINT j = tile / tileWidth;
+			if (i >= leftMost && i <= rightMost && j >= topMost && j <= bottomMost)
+				mInternalBatchTiles[batchTileCount++] = tile;
+		}
+
+		if (mRasterizerDesc.TileScheduling == SRTileSchedulingCostHistory) {
+			// Longest processing time first: the tiles are queued by their cost in the
+			// previous frame, and a free worker always takes the most expensive one left.
+			// So the frame does not end with one worker grinding a hot tile alone.
+			std::atomic<UINT> next(0);
+			mThreadPool.ParallelFor(mThreadPool.GetThreadCount(), 1,
+				[&](UINT begin, UINT end, UINT threadIndex) {
+				BYTE* psInput = mInternalPSInputPool + threadIndex * mInternalPSInputStride;
+				SRPipelineStatistics& stats = mInternalThreadStatistics[threadIndex].Stats;
+				SRTrace(mTracer, threadIndex, "BatchTiles");
+				for (;;) {
+					UINT n = next.fetch_add(1, std::memory_order_relaxed);
+					if (n >= batchTileCount)
+						break;
+					UINT tile = mInternalBatchTiles[n];
+					RasterizeBatchTile(tile % tileWidth, tile / tileWidth, psInput, stats);
+				}
+			});
+		}
+		else {
+			// Every worker starts with a contiguous piece of the curve,
+			// which is a compact patch of the screen instead of a few long rows.
+			mThreadPool.ParallelFor(batchTileCount, TileGrain,
+				[&](UINT begin, UINT end, UINT threadIndex) {
+				BYTE* psInput = mInternalPSInputPool + threadIndex * mInternalPSInputStride;
+				SRPipelineStatistics& stats = mInternalThreadStatistics[threadIndex].Stats;
+				SRTrace(mTracer, threadIndex, "BatchTiles", end - begin);
+				for (UINT n = begin; n < end; n++) {
+					UINT tile = mInternalBatchTiles[n];
+					RasterizeBatchTile(tile % tileWidth, tile / tileWidth, psInput, stats);
+				}
+			});
+		}
+	}
+	else {
+		mThreadPool.ParallelFor((bottomMost - topMost + 1) * (rightMost - leftMost + 1), TileGrain,
+			[&](UINT begin, UINT end, UINT threadIndex) {
+			BYTE* psInput = mInternalPSInputPool + threadIndex * mInternalPSInputStride;
+			SRPipelineStatistics& stats = mInternalThreadStatistics[threadIndex].Stats;
+			SRTrace(mTracer, threadIndex, "BatchTiles", end - begin);
+			for (UINT id = begin; id < end; id++) {
+				UINT i = id % (rightMost - leftMost + 1) + leftMost;
+				UINT j = id / (rightMost - leftMost + 1) + topMost;
+				// zigzag
+				i = (j % 2 == 0 ? i : rightMost + leftMost - i);
+				RasterizeBatchTile(i, j, psInput, stats);
+			}
+		});
+	}
+
+	mInternalBatchCount = 0;
+}
+
+// rasterize every triangle of the pending batch overlapping tile (i, j), in submission order.
+void SRDevice::RasterizeBatchTile(UINT i, UINT j, BYTE* psInput, SRPipelineStatistics& stats) {
 #ifdef AllowQuadPS
-	BYTE* psInputPool = (BYTE*)_aligned_malloc(8 * ((mPipelineState.VSOutputByteCount * 4 + 63) / 64) * 64, 64);
+	const bool EnableQuadPS = mPipelineState.EnableQuadPixelShader;
 #else
-	BYTE* psInputPool = (BYTE*)_aligned_malloc(8 * ((mPipelineState.VSOutputByteCount + 63) / 64) * 64, 64);
+	const bool EnableQuadPS = false;
 #endif
-	XMFLOAT3* toInterpolate = (XMFLOAT3*)malloc((mPipelineState.VSOutputByteCount / 4 - 4) * sizeof(XMFLOAT3));
-	assert(psInputPool != nullptr);
-	assert(toInterpolate != nullptr);
+	UINT64 start = readCycleCounter();
+
+	for (UINT n = 0; n < mInternalBatchCount; n++) {
+		const SRTriangleSetup& setup = mInternalBatch[n];
+		if (i < setup.minX / 8 || i > setup.maxX / 8 ||
+			j < setup.minY / 8 || j > setup.maxY / 8)
+			continue;
+
+		if (!EnableQuadPS && isSingleTile(setup))
+			RasterizeSmallTriangle(setup, psInput, mInternalConstBuffers, stats);
+		else
+			RasterizeTile(setup, i, j, psInput, mInternalConstBuffers, stats);
+	}
+
+	// the tile is owned by this thread during the batch
+	mInternalTileCost[j * ((mInternalRenderTargetWidth + 7) / 8) + i] += readCycleCounter() - start;
+}
+
+// submitting thread side of the pipeline: set the triangle up in the next slot of the ring and publish it.
+void SRDevice::PushPipelineTriangle(const BYTE* vsOutput1, const BYTE* vsOutput2, const BYTE* vsOutput3) {
+	const UINT64 head = mInternalRingCursors[0].Position.load(std::memory_order_relaxed);
+
+	// backpressure: a slot is free again once every tile worker has read it
+	if (head - mInternalRingTail == mInternalRingSize) {
+		SRTrace(mTracer, 0, "PipelineStall");
+		int spin = 0;
+		for (;;) {
+			UINT64 tail = head;
+			for (UINT k = 1; k < mThreadPool.GetThreadCount(); k++) {
+				tail = (std::min)(tail, mInternalRingCursors[k].Position.load(std::memory_order_acquire));
+			}
+			mInternalRingTail = tail;
+			if (head - tail < mInternalRingSize)
+				break;
+			SRThreadPool::Backoff(spin);
+		}
+	}
+
+	const UINT slot = UINT(head & (mInternalRingSize - 1));
+	const UINT interpolateCount = mPipelineState.VSOutputByteCount / 4 - 4;
+	SRTriangleSetup& setup = mInternalBatch[slot];
+	XMFLOAT3* toInterpolate = mInternalBatchInterpolate + slot * interpolateCount;
 
-	// openmp thread local pool
-	BYTE* psInputs[8];
-	for (UINT i = 0; i < 8; i++) {
+	SRPipelineStatistics& stats = mInternalThreadStatistics[0].Stats;
+	stats.CPrimitives++;
+
+	bool IsVisible;
+	{
+		SRTrace(mTracer, 0, "TriangleSetup");
+		IsVisible = SetupTriangle(vsOutput1, vsOutput2, vsOutput3, toInterpolate, setup);
+	}
+	if (!IsVisible) {
+		stats.CulledPrimitives++;
+		return;
+	}
+
+	if (isSingleTile(setup))
+		mRasterizerStats.SmallTriangles++;
+	else
+		mRasterizerStats.TiledTriangles++;
+	mRasterizerStats.PipelinedTriangles++;
+
+	mInternalRingCursors[0].Position.store(head + 1, std::memory_order_release);
+}
+
+// tile worker side of the pipeline. every worker reads all triangles in submission order
+// and rasterizes the part of them in its own tiles, so the output merger of a tile
+// sees the triangles in order without any locking.
+void SRDevice::RasterizePipelineTiles(UINT threadIndex) {
 #ifdef AllowQuadPS
-		psInputs[i] = psInputPool + i * ((mPipelineState.VSOutputByteCount * 4 + 63) / 64) * 64;
+	const bool EnableQuadPS = mPipelineState.EnableQuadPixelShader;
 #else
-		psInputs[i] = psInputPool + i * ((mPipelineState.VSOutputByteCount + 63) / 64) * 64;
+	const bool EnableQuadPS = false;
 #endif
+	SRTrace(mTracer, threadIndex, "PipelineTiles");
+	BYTE* psInput = mInternalPSInputPool + threadIndex * mInternalPSInputStride;
+	SRPipelineStatistics& stats = mInternalThreadStatistics[threadIndex].Stats;
+	std::atomic<UINT64>& cursor = mInternalRingCursors[threadIndex].Position;
+	const UINT tileWidth = (mInternalRenderTargetWidth + 7) / 8;
+
+	UINT64 position = 0;
+	int spin = 0;
+	for (;;) {
+		// the closed flag is read first, a head read after it is final
+		const bool IsClosed = mInternalRingClosed.load(std::memory_order_acquire);
+		const UINT64 head = mInternalRingCursors[0].Position.load(std::memory_order_acquire);
+		if (position == head) {
+			if (IsClosed)
+				break;
+			SRThreadPool::Backoff(spin);
+			continue;
+		}
+		spin = 0;
+
+		for (; position < head; position++) {
+			const SRTriangleSetup& setup = mInternalBatch[position & (mInternalRingSize - 1)];
+			const bool IsSmall = !EnableQuadPS && isSingleTile(setup);
+			for (UINT j = setup.minY / 8; j <= setup.maxY / 8; j++) {
+				for (UINT i = setup.minX / 8; i <= setup.maxX / 8; i++) {
+					const UINT tile = j * tileWidth + i;
+					if (mInternalTileOwner[tile] != threadIndex)
+						continue;
+					UINT64 start = readCycleCounter();
+					if (IsSmall)
+						RasterizeSmallTriangle(setup, psInput, mInternalConstBuffers, stats);
+					else
+						RasterizeTile(setup, i, j, psInput, mInternalConstBuffers, stats);
+					mInternalTileCost[tile] += readCycleCounter() - start;
+				}
+			}
+			cursor.store(position + 1, std::memory_order_release);
+		}
 	}
+}
 
-	/****************
-	 * Rasterization
-	 * screen mapping and triangle setup
-	 */
-	const float* vsOutput1f = reinterpret_cast<const float*>(vsOutput1);
-	const float* vsOutput2f = reinterpret_cast<const float*>(vsOutput2);
-	const float* vsOutput3f = reinterpret_cast<const float*>(vsOutput3);
-
-	XMFLOAT4 p1 = XMFLOAT4(vsOutput1f);
-	XMFLOAT4 p2 = XMFLOAT4(vsOutput2f);
-	XMFLOAT4 p3 = XMFLOAT4(vsOutput3f);
-
-	// 16.8 fixed-point
-	XMStoreFloat4(&p1, XMVectorScale(XMVectorRound(XMVectorScale(XMLoadFloat4(&p1), 256.0f)), 1/256.0f));
-	XMStoreFloat4(&p2, XMVectorScale(XMVectorRound(XMVectorScale(XMLoadFloat4(&p2), 256.0f)), 1/256.0f));
-	XMStoreFloat4(&p3, XMVectorScale(XMVectorRound(XMVectorScale(XMLoadFloat4(&p3), 256.0f)), 1/256.0f));
-
-	XMFLOAT3 s1 = XMFLOAT3((p1.x / p1.w + 1) * w * 0.5f, (1 - p1.y / p1.w) * h * 0.5f, p1.z / p1.w); //(1.0f - p1.z / p1.w) * 0.5f);
-	XMFLOAT3 s2 = XMFLOAT3((p2.x / p2.w + 1) * w * 0.5f, (1 - p2.y / p2.w) * h * 0.5f, p2.z / p2.w); //(1.0f - p2.z / p2.w) * 0.5f);
-	XMFLOAT3 s3 = XMFLOAT3((p3.x / p3.w + 1) * w * 0.5f, (1 - p3.y / p3.w) * h * 0.5f, p3.z / p3.w); //(1.0f - p3.z / p3.w) * 0.5f);
-
-	XMFLOAT3 edge1 = XMFLOAT3(s3.y - s2.y, s2.x - s3.x, s3.x * s2.y - s2.x * s3.y);
-	XMFLOAT3 edge2 = XMFLOAT3(s1.y - s3.y, s3.x - s1.x, s1.x * s3.y - s3.x * s1.y);
-	XMFLOAT3 edge3 = XMFLOAT3(s2.y - s1.y, s1.x - s2.x, s2.x * s1.y - s1.x * s2.y);
-
-	XMVECTOR area = XMVectorReplicate(edge1.z + edge2.z + edge3.z);
-
-	// clockwise culling
-	if (XMVectorGetX(area) <= 0.0f)
-		goto end;
-
-	XMMATRIX edgeMatrix = {
-		XMVectorDivide(XMLoadFloat3(&edge1), area),
-		XMVectorDivide(XMLoadFloat3(&edge2), area),
-		XMVectorDivide(XMLoadFloat3(&edge3), area),
-		g_XMZero
-	};
+void SRDevice::SREndFrame() {
+	if (mCapture != nullptr)
+		mCapture->EndFrame();
+	mTracer.EndFrame();
+	mResidency.Resolve();
 
-	UINT testCorners[3] = {
-		findCorner(edge1),
-		findCorner(edge2),
-		findCorner(edge3)
-	};
-	XMVECTOR cornerSelect1 = indexToSelect1(testCorners);
-	XMVECTOR cornerSelect2 = indexToSelect2(testCorners);
+	const UINT tileWidth = (mInternalRenderTargetWidth + 7) / 8;
+	const UINT tileCount = tileWidth * ((mInternalRenderTargetHeight + 7) / 8);
+	if (tileCount == 0 || mInternalTileCost == nullptr)
+		return;
 
-	// helper variable
-	XMVECTOR reci_pW = XMVectorReciprocal(XMVectorSet(p1.w, p2.w, p3.w, INFINITY));
-	XMVECTOR sZ = XMVectorSet(s1.z, s2.z, s3.z, 0.0f);
-	XMVECTOR topLeftMask = XMVectorSet(isTopLeftEdge(edge1), isTopLeftEdge(edge2), isTopLeftEdge(edge3), -0.0f);
+	if (mInternalTileCounters != nullptr) {
+		for (UINT tile = 0; tile < tileCount; tile++) {
+			mInternalTileCounters[tile].Cycles = mInternalTileCost[tile];
+		}
+		std::swap(mInternalTileCounters, mInternalTileCountersHistory);
+		memset(mInternalTileCounters, 0, tileCount * sizeof(SRTileCounters));
+	}
 
-	XMVECTOR edgeA = _mm_shuffle_ps(edgeMatrix.r[0], edgeMatrix.r[1], _MM_SHUFFLE(1, 0, 1, 0)); // [a1 b1 a2 b2]
-	XMVECTOR edgeB = _mm_shuffle_ps(edgeA, edgeMatrix.r[2], _MM_SHUFFLE(3, 1, 3, 1)); // [b1 b2 b3 0]
-	edgeA = _mm_shuffle_ps(edgeA, edgeMatrix.r[2], _MM_SHUFFLE(3, 0, 2, 0)); // [a1 a2 a3 0]
+	std::swap(mInternalTileCost, mInternalTileCostHistory);
+	memset(mInternalTileCost, 0, tileCount * sizeof(UINT64));
 
+	if (mRasterizerDesc.TileScheduling == SRTileSchedulingCostHistory)
+		UpdateTileOrder(false);
+}
 
-	// value to be interpolated
-	for (UINT i = 0; i < mPipelineState.VSOutputByteCount / 4 - 4; i++) {
-		toInterpolate[i] = XMFLOAT3(
-			vsOutput1f[i + 4],
-			vsOutput2f[i + 4],
-			vsOutput3f[i + 4]);
+// updateRank: recompute the position of every tile along SRRasterizerDesc::TileOrder
+void SRDevice::UpdateTileOrder(bool updateRank) {
+	const UINT tileWidth = (mInternalRenderTargetWidth + 7) / 8;
+	const UINT tileHeight = (mInternalRenderTargetHeight + 7) / 8;
+	const UINT tileCount = tileWidth * tileHeight;
+	if (tileCount == 0 || mInternalTileRank == nullptr)
+		return;
+
+	if (updateRank) {
+		// curves are defined on a power of 2 square, the tiles out of screen are just skipped
+		UINT n = 1;
+		while (n < (std::max)(tileWidth, tileHeight))
+			n *= 2;
+		UINT64* key = (UINT64*)malloc(tileCount * sizeof(UINT64));
+		if (key == nullptr) {
+			SRFatal(L"Tile order alloc error.");
+			return;
+		}
+		for (UINT tile = 0; tile < tileCount; tile++) {
+			UINT i = tile % tileWidth;
+			UINT j = tile / tileWidth;
+			switch (mRasterizerDesc.TileOrder) {
+			case SRTileOrderMorton:
+				key[tile] = mortonIndex(i, j);
+				break;
+			case SRTileOrderHilbert:
+				key[tile] = hilbertIndex(n, i, j);
+				break;
+			default:
+				key[tile] = j * tileWidth + (j % 2 == 0 ? i : tileWidth - 1 - i);
+				break;
+			}
+			mInternalTileOrder[tile] = tile;
+		}
+		std::sort(mInternalTileOrder, mInternalTileOrder + tileCount, [key](UINT a, UINT b) {
+			return key[a] < key[b];
+		});
+		free(key);
+		for (UINT r = 0; r < tileCount; r++) {
+			mInternalTileRank[mInternalTileOrder[r]] = r;
+		}
 	}
 
+	if (mRasterizerDesc.TileScheduling != SRTileSchedulingCostHistory) {
+		for (UINT tile = 0; tile < tileCount; tile++) {
+			mInternalTileOrder[mInternalTileRank[tile]] = tile;
+		}
+		return;
+	}
 
-	/*********************
-	 * triangle travelsal
-	 */
-	// 8 * 8 tile
-	// axis-aligned bounding box binning
-	UINT leftMost = max(UINT(minOf3(s1.x, s2.x, s3.x) / 8), 0);
-	UINT rightMost = min(UINT(maxOf3(s1.x, s2.x, s3.x) / 8), (w - 1) / 8);
-	UINT topMost = max(UINT(minOf3(s1.y, s2.y, s3.y) / 8), 0);
-	UINT bottomMost = min(UINT(maxOf3(s1.y, s2.y, s3.y) / 8), (h - 1) / 8);
-//	for (UINT j = topMost; j <= bottomMost; j++) {
-//		for (UINT i = leftMost; i <= rightMost; i++) {
-#pragma omp parallel for num_threads(8) schedule(dynamic, 8)
-	for (int id = 0; id < int((bottomMost - topMost + 1) * (rightMost - leftMost + 1)); id++) {
-			UINT i = id % (rightMost - leftMost + 1) + leftMost;
-			UINT j = id / (rightMost - leftMost + 1) + topMost;
-			// zigzag
-			i = (j % 2 == 0 ? i : rightMost + leftMost - i);
-			UINT tileXInt = 8 * i;
-			UINT tileYInt = 8 * j;
-			float tileX = float(tileXInt) + 0.5f;
-			float tileY = float(tileYInt) + 0.5f;
-
-			/*
-			 * 0--1
-			 * |  |
-			 * 2--3
-			 */
-			XMMATRIX cornersT = {
-				XMVectorSet(tileX, tileX + 7.0f, tileX, tileX + 7.0f),
-				XMVectorSet(tileY, tileY, tileY + 7.0f, tileY + 7.0f),
-				g_XMOne,
-				g_XMZero
-			};
+	// most expensive first, ties keep the traversal order
+	const UINT64* cost = mInternalTileCostHistory;
+	const UINT* rank = mInternalTileRank;
+	for (UINT n = 0; n < tileCount; n++) {
+		mInternalTileOrder[n] = n;
+	}
+	std::sort(mInternalTileOrder, mInternalTileOrder + tileCount, [&](UINT a, UINT b) {
+		if (cost[a] != cost[b])
+			return cost[a] > cost[b];
+		return rank[a] < rank[b];
+	});
+}
 
-			// tile level edge test
-			XMMATRIX edgeXcorners = XMMatrixMultiply(edgeMatrix, cornersT); // m_ij = j-th point's i-th edge value
-			XMMATRIX edgeXcornersT = XMMatrixTranspose(edgeXcorners);
+bool SRDevice::SetupTriangle(const BYTE* vsOutput1, const BYTE* vsOutput2, const BYTE* vsOutput3,
+	XMFLOAT3* toInterpolate, SRTriangleSetup& setup)
+{
+	// constant setup
+	auto& target = mResources[mRenderTargetHandle];
+	setup.pRenderTarget = target.ptr;
+	setup.pDepthStencil = reinterpret_cast<UINT32*>(mResources[mDepthStencilHandle].ptr);
+	setup.width = target.WIDTH;
+	setup.height = target.HEIGHT;
 
-			XMVECTOR edgeMax = selectMaxCorner(edgeXcornersT, cornerSelect1, cornerSelect2);
-			if (isTopLeftMask(edgeMax, topLeftMask) != 0xf)
-				continue;
+	return setupTriangle(vsOutput1, vsOutput2, vsOutput3,
+		mPipelineState.VSOutputByteCount / 4 - 4, toInterpolate, setup);
+}
+
+inline bool SRDevice::ShadePixel(const SRTriangleSetup& setup, FXMVECTOR ks, float px, float py, UINT pos,
+	bool isDepthPass, float* input, const BYTE*const* constBuffers, SRPipelineStatistics& stats,
+	UINT32& depth, UINT32& newDepth)
+{
+	const bool EnableZPrepass = mPipelineState.EnableZPrePass;
+
+	// SV_POSITION
+	input[0] = px;
+	input[1] = py;
+	XMVECTOR k = perspectiveBarycentric(setup, ks, input);
 
-			XMVECTOR edgeMin = selectMinCorner(edgeXcornersT, cornerSelect1, cornerSelect2);
-			
-			bool IsAllPixelsValid = isTopLeftMask(edgeMin, topLeftMask) == 0xf;
+	if (input[2] > 1.0f || input[2] < 0.0f) {
+		stats.DepthClippedPixels++;
+		return false;
+	}
+	// Z-prepass
+	depth = *(setup.pDepthStencil + pos) >> 8;
+	newDepth = float2Depth(input[2]);
+	if (EnableZPrepass && newDepth >= depth) {
+		stats.ZPrePassFailedPixels++;
+		return false;
+	}
 
+	const UINT attributeCount = mPipelineState.VSOutputByteCount / 4 - 4;
+	interpolateAttributes(setup, k, attributeCount, input);
+	if (mPipelineState.PSDerivativeCount != 0)
+		quadDerivatives(setup, ks, px, py, attributeCount, mPipelineState.PSDerivativeCount, input);
 
-			// tile size depth test
-			XMVECTOR cornerDepths = XMVector3Transform(sZ, edgeXcorners);
-			float minOfFour, maxOfFour;
-			horizontalMinMax(cornerDepths, minOfFour, maxOfFour);
 
-			UINT32 *pTileHiZ = mInternalHiZCache + (j * tileWidth + i) * 2;
-			UINT32 TileHiZMin = *pTileHiZ;
-			UINT32 TileHiZMax = *(pTileHiZ + 1);
-			float TileHiZMinF = depth2Float(TileHiZMin);
-			float TileHiZMaxF = depth2Float(TileHiZMax);
-			// I do not take the minimum z of 3 vertices in to consider.
-			// Since in my implementation, it would not be helpful too often.
-			if (minOfFour >= TileHiZMaxF || maxOfFour < 0.0f)
+	/***************
+	 * pixel shader
+	 */
+	XMFLOAT4 pixel;
+	(*mPipelineState.PS)(reinterpret_cast<BYTE*>(input), &pixel, constBuffers);
+	stats.PSInvocations++;
+
+	/****************
+	 * Output Merger
+	 */
+	if (!EnableZPrepass) {
+		if (input[2] > 1.0f || input[2] < 0.0f) {
+			stats.DepthClippedPixels++;
+			return false;
+		}
+		newDepth = float2Depth(input[2]);
+	}
+	if (EnableZPrepass || isDepthPass || newDepth < depth) {
+		BYTE* imagePos = setup.pRenderTarget + pos * 4;
+		imagePos[0] = BYTE(clamp(pixel.x) * 255);
+		imagePos[1] = BYTE(clamp(pixel.y) * 255);
+		imagePos[2] = BYTE(clamp(pixel.z) * 255);
+		imagePos[3] = BYTE(clamp(pixel.w) * 255);
+
+		*(setup.pDepthStencil + pos) = (newDepth << 8) | (*(setup.pDepthStencil + pos) & 0xff);
+		stats.PixelsWritten++;
+		return true;
+	}
+	stats.DepthTestFailedPixels++;
+	return false;
+}
+
+void SRDevice::RasterizeSmallTriangle(const SRTriangleSetup& setup, BYTE* psInput, const BYTE*const* constBuffers,
+	SRPipelineStatistics& stats)
+{
+	const UINT tileXInt = setup.minX & ~7u;
+	const UINT tileYInt = setup.minY & ~7u;
+	const UINT tileWidth = (setup.width + 7) / 8;
+
+	UINT32 *pTileHiZ = mInternalHiZCache + ((tileYInt / 8) * tileWidth + tileXInt / 8) * 2;
+	UINT32 TileHiZMin = *pTileHiZ;
+	UINT32 TileHiZMax = *(pTileHiZ + 1);
+	bool IsMaxDepthChange = false;
+
+	SRTileCounters* pTileCounters = mInternalTileCounters != nullptr ?
+		mInternalTileCounters + (tileYInt / 8) * tileWidth + tileXInt / 8 : nullptr;
+	const UINT64 shadedBefore = stats.PSInvocations;
+	const UINT64 writtenBefore = stats.PixelsWritten;
+
+	float* input = reinterpret_cast<float*>(psInput);
+
+	// only walk the pixel centers inside the bounding box,
+	// the pixel level edge test is all we need.
+	for (UINT py = setup.minY; py <= setup.maxY; py++) {
+		const float pyF = float(py) + 0.5f;
+		XMVECTOR ksRow = XMVectorAdd(setup.edgeC, XMVectorScale(setup.edgeB, pyF));
+		for (UINT px = setup.minX; px <= setup.maxX; px++) {
+			const float pxF = float(px) + 0.5f;
+			XMVECTOR ks = XMVectorAdd(ksRow, XMVectorScale(setup.edgeA, pxF));
+
+			if (isTopLeftMask(ks, setup.topLeftMask) != 0xf)
 				continue;
 
-			bool IsAllDepthPass = maxOfFour < TileHiZMinF;
+			UINT32 depth, newDepth;
+			if (ShadePixel(setup, ks, pxF, pyF, setup.width * py + px, false, input, constBuffers, stats, depth, newDepth)) {
+				TileHiZMin = (std::min)(newDepth, TileHiZMin);
 
-			if (IsAllPixelsValid) {
-				assert(minOfFour >= 0.0f);
-				TileHiZMin = min(float2Depth(minOfFour), TileHiZMin);
-			
-				if (IsAllDepthPass)
-					TileHiZMax = float2Depth(maxOfFour);
+				if (depth == TileHiZMax)
+					IsMaxDepthChange = true;
 			}
+		}
+	}
 
-			XMVECTOR edgeCorner0 = edgeXcornersT.r[0];
+	if (IsMaxDepthChange) {
+		TileHiZMax = tileMaxDepth(setup.pDepthStencil, setup.width, setup.height, tileXInt, tileYInt, TileHiZMin);
+	}
+	*pTileHiZ = TileHiZMin;
+	*(pTileHiZ + 1) = TileHiZMax;
+
+	if (pTileCounters != nullptr) {
+		// no tile level test on this path
+		pTileCounters->TrianglesTested++;
+		pTileCounters->TrianglesAccepted++;
+		pTileCounters->PixelsShaded += UINT(stats.PSInvocations - shadedBefore);
+		pTileCounters->PixelsWritten += UINT(stats.PixelsWritten - writtenBefore);
+	}
+}
 
-			bool IsMaxDepthChange = false;
+void SRDevice::RasterizeTile(const SRTriangleSetup& setup, UINT i, UINT j, BYTE* psInput, const BYTE*const* constBuffers,
+	SRPipelineStatistics& stats)
+{
+	const UINT w = setup.width, h = setup.height;
+	const UINT tileWidth = (w + 7) / 8;
+	UINT32* pDepthStencil = setup.pDepthStencil;
+	const XMVECTOR edgeA = setup.edgeA;
+	const XMVECTOR edgeB = setup.edgeB;
+	const XMVECTOR topLeftMask = setup.topLeftMask;
+#ifdef AllowQuadPS
+	const bool EnableZPrepass = mPipelineState.EnableZPrePass;
+	const bool EnableQuadPS = mPipelineState.EnableQuadPixelShader;
+	const XMVECTOR reci_pW = setup.reci_pW;
+	const XMVECTOR sZ = setup.sZ;
+	const XMFLOAT3* toInterpolate = setup.toInterpolate;
+#endif
 
-			for (int iy = 0; iy < 4; iy++) {
-				for (int t = 0; t < 4; t++) {
-					// zigzag
-					int ix = iy % 2 == 0 ? t : 3 - t;
+	UINT tileXInt = 8 * i;
+	UINT tileYInt = 8 * j;
+	float tileX = float(tileXInt) + 0.5f;
+	float tileY = float(tileYInt) + 0.5f;
+
+	SRTileCounters* pTileCounters = mInternalTileCounters != nullptr ?
+		mInternalTileCounters + j * tileWidth + i : nullptr;
+	if (pTileCounters != nullptr)
+		pTileCounters->TrianglesTested++;
+
+	// tile level edge test
+	stats.TilesTested++;
+	XMMATRIX edgeXcorners = tileCornerEdges(setup, tileX, tileY);
+	XMMATRIX edgeXcornersT = XMMatrixTranspose(edgeXcorners);
+
+	XMVECTOR edgeMax = selectMaxCorner(edgeXcornersT, setup.cornerSelect1, setup.cornerSelect2);
+	if (isTopLeftMask(edgeMax, topLeftMask) != 0xf) {
+		stats.TilesRejectedByEdge++;
+		return;
+	}
+
+	XMVECTOR edgeMin = selectMinCorner(edgeXcornersT, setup.cornerSelect1, setup.cornerSelect2);
+	
+	bool IsAllPixelsValid = isTopLeftMask(edgeMin, topLeftMask) == 0xf;
+
+
+	// tile size depth test
+	XMVECTOR cornerDepths = XMVector3Transform(setup.sZ, edgeXcorners);
+	float minOfFour, maxOfFour;
+	horizontalMinMax(cornerDepths, minOfFour, maxOfFour);
+
+	UINT32 *pTileHiZ = mInternalHiZCache + (j * tileWidth + i) * 2;
+	UINT32 TileHiZMin = *pTileHiZ;
+	UINT32 TileHiZMax = *(pTileHiZ + 1);
+	float TileHiZMinF = depth2Float(TileHiZMin);
+	float TileHiZMaxF = depth2Float(TileHiZMax);
+	// I do not take the minimum z of 3 vertices in to consider.
+	// Since in my implementation, it would not be helpful too often.
+	if (minOfFour >= TileHiZMaxF || maxOfFour < 0.0f) {
+		stats.TilesRejectedByHiZ++;
+		return;
+	}
+
+	bool IsAllDepthPass = maxOfFour < TileHiZMinF;
+
+	const UINT64 shadedBefore = stats.PSInvocations;
+	const UINT64 writtenBefore = stats.PixelsWritten;
+
+	if (IsAllPixelsValid) {
+		assert(minOfFour >= 0.0f);
+		TileHiZMin = (std::min)(float2Depth(minOfFour), TileHiZMin);
+	
+		if (IsAllDepthPass)
+			TileHiZMax = float2Depth(maxOfFour);
+	}
+
+	XMVECTOR edgeCorner0 = edgeXcornersT.r[0];
+
+	bool IsMaxDepthChange = false;
+
+	for (int iy = 0; iy < 4; iy++) {
+		for (int t = 0; t < 4; t++) {
+			// zigzag
+			int ix = iy % 2 == 0 ? t : 3 - t;
 
 #ifdef AllowQuadPS
-					if (EnableQuadPS) {
-						float* inputs[4];
-						inputs[0] = reinterpret_cast<float*>(psInputs[omp_get_thread_num()]);
-						inputs[1] = inputs[0] + mPipelineState.VSOutputByteCount / 4;
-						inputs[2] = inputs[0] + mPipelineState.VSOutputByteCount / 4 * 2;
-						inputs[3] = inputs[0] + mPipelineState.VSOutputByteCount / 4 * 3;
-						
-						UINT32 depths[4], newDepths[4];
-						bool pixelMask[4] = { true, true, true, true };
-
-						// 2 * 2 quad
-						for (int u = 0; u < 2; u++) {
-							for (int v = 0; v < 2; v++) {
-								UINT pxInt = tileXInt + 2 * ix + u;
-								UINT pyInt = tileYInt + 2 * iy + v;
-								UINT pos = w * pyInt + pxInt;
-								int pixelId = 2 * u + v;
-
-								// out of screen test
-								if (pxInt >= w || pyInt >= h)
-									pixelMask[pixelId] = false;
-
-								// suffix C means coordinate base on upper-left corner
-								float pxC = 2.0f * ix + u, pyC = 2.0f * iy + v;
-
-								// used the linear property of edge equation.
-								// ks.w = 0.0f
-								XMVECTOR ks = XMVectorAdd(edgeCorner0,
-									XMVectorAdd(XMVectorScale(edgeA, pxC), XMVectorScale(edgeB, pyC)));
-
-								// pixel level edge test
-								if (!IsAllPixelsValid) {
-									if (isTopLeftMask(ks, topLeftMask) != 0xf)
-										pixelMask[pixelId] = false;
-								}
-
-								// homogenes berycentric coordinate
-								XMVECTOR k = XMVectorMultiply(ks, reci_pW); // k.w = 0.0f
-								XMVECTOR ksDiv_pWSum = XMVectorSum(k);
-								k = XMVectorDivide(k, ksDiv_pWSum);
-
-								// SV_POSITION
-								float* input = inputs[pixelId];
-								input[0] = tileX + pxC;
-								input[1] = tileY + pyC;
-								input[2] = XMVectorGetX(XMVectorSum(XMVectorMultiply(ks, sZ)));
-								input[3] = XMVectorGetX(XMVectorReciprocal(ksDiv_pWSum));
-
-								if (input[2] > 1.0f || input[2] < 0.0f)
-									pixelMask[pixelId] = false;
-								depths[pixelId] = *(pDepthStencil + pos) >> 8;
-								newDepths[pixelId] = float2Depth(input[2]);
-
-
-								// homogenes linear interploate
-								for (UINT i = 0; i < mPipelineState.VSOutputByteCount / 4 - 4; i++) {
-									input[i + 4] = XMVectorGetX(
-										XMVectorSum(XMVectorMultiply(k, XMLoadFloat3(&toInterpolate[i]))));
-								}
-							}
+			if (EnableQuadPS) {
+				float* inputs[4];
+				inputs[0] = reinterpret_cast<float*>(psInput);
+				inputs[1] = inputs[0] + mPipelineState.VSOutputByteCount / 4;
+				inputs[2] = inputs[0] + mPipelineState.VSOutputByteCount / 4 * 2;
+				inputs[3] = inputs[0] + mPipelineState.VSOutputByteCount / 4 * 3;
+				
+				UINT32 depths[4], newDepths[4];
+				bool pixelMask[4] = { true, true, true, true };
+
+				// 2 * 2 quad
+				for (int u = 0; u < 2; u++) {
+					for (int v = 0; v < 2; v++) {
+						UINT pxInt = tileXInt + 2 * ix + u;
+						UINT pyInt = tileYInt + 2 * iy + v;
+						UINT pos = w * pyInt + pxInt;
+						int pixelId = 2 * u + v;
+
+						// out of screen test
+						if (pxInt >= w || pyInt >= h)
+							pixelMask[pixelId] = false;
+
+						// suffix C means coordinate base on upper-left corner
+						float pxC = 2.0f * ix + u, pyC = 2.0f * iy + v;
+
+						// used the linear property of edge equation.
+						// ks.w = 0.0f
+						XMVECTOR ks = XMVectorAdd(edgeCorner0,
+							XMVectorAdd(XMVectorScale(edgeA, pxC), XMVectorScale(edgeB, pyC)));
+
+						// pixel level edge test
+						if (!IsAllPixelsValid) {
+							if (isTopLeftMask(ks, topLeftMask) != 0xf)
+								pixelMask[pixelId] = false;
 						}
-						
-						// Z-prepass
-						if (EnableZPrepass)
-							for (int i = 0; i < 4; i++)
-								if (newDepths[i] >= depths[i])
-									pixelMask[i] = false;
-
-						if (pixelMask[0] == false && pixelMask[1] == false && pixelMask[2] == false && pixelMask[3] == false)
-							continue;
 
-						/***************
-						 * quad pixel shader
-						 */
-						XMFLOAT4 pixels[4];
-						(*mPipelineState.QuadPS)(reinterpret_cast<BYTE**>(inputs), &pixels, constBuffers);
-
-						/****************
-						 * Output Merger
-						 */
-						for (int i = 0; i < 4; i++) {
-							if (!EnableZPrepass) {
-								if (inputs[i][2] > 1.0f || inputs[i][2] < 0.0f)
-									pixelMask[i] = false;
-								newDepths[i] = float2Depth(inputs[i][2]);
-							}
-							if (pixelMask[i] == false)
-								continue;
-							if (EnableZPrepass || IsAllDepthPass || newDepths[i] < depths[i]) {
-								UINT pxInt = tileXInt + 2 * ix + i / 2;
-								UINT pyInt = tileYInt + 2 * iy + i % 2;
-								UINT pos = w * pyInt + pxInt;
-								BYTE* imagePos = target.ptr + pos * 4;
-								imagePos[0] = BYTE(clamp(pixels[i].x) * 255);
-								imagePos[1] = BYTE(clamp(pixels[i].y) * 255);
-								imagePos[2] = BYTE(clamp(pixels[i].z) * 255);
-								imagePos[3] = BYTE(clamp(pixels[i].w) * 255);
-
-								*(pDepthStencil + pos) = (newDepths[i] << 8) | (*(pDepthStencil + pos) & 0xff);
-
-								TileHiZMin = min(newDepths[i], TileHiZMin);
-
-								if (depths[i] == TileHiZMax)
-									IsMaxDepthChange = true;
-							}
+						// homogenes berycentric coordinate
+						XMVECTOR k = XMVectorMultiply(ks, reci_pW); // k.w = 0.0f
+						XMVECTOR ksDiv_pWSum = XMVectorSum(k);
+						k = XMVectorDivide(k, ksDiv_pWSum);
+
+						// SV_POSITION
+						float* input = inputs[pixelId];
+						input[0] = tileX + pxC;
+						input[1] = tileY + pyC;
+						input[2] = XMVectorGetX(XMVectorSum(XMVectorMultiply(ks, sZ)));
+						input[3] = XMVectorGetX(XMVectorReciprocal(ksDiv_pWSum));
+
+						if (input[2] > 1.0f || input[2] < 0.0f)
+							pixelMask[pixelId] = false;
+						depths[pixelId] = *(pDepthStencil + pos) >> 8;
+						newDepths[pixelId] = float2Depth(input[2]);
+
+
+						// homogenes linear interploate
+						for (UINT i = 0; i < mPipelineState.VSOutputByteCount / 4 - 4; i++) {
+							input[i + 4] = XMVectorGetX(
+								XMVectorSum(XMVectorMultiply(k, XMLoadFloat3(&toInterpolate[i]))));
 						}
 					}
-					else {
-#endif
-					// 2 * 2 quad
-					for (int u = 0; u < 2; u++) {
-						for (int v = 0; v < 2; v++) {
-							UINT pxInt = tileXInt + 2 * ix + u;
-							UINT pyInt = tileYInt + 2 * iy + v;
-							UINT pos = w * pyInt + pxInt;
-
-							// out of screen test
-							if (pxInt >= w || pyInt >= h)
-								continue;
-
-							// suffix C means coordinate base on upper-left corner
-							float pxC = 2.0f * ix + u, pyC = 2.0f * iy + v;
-
-							// used the linear property of edge equation.
-							// ks.w = 0.0f
-							XMVECTOR ks = XMVectorAdd(edgeCorner0,
-								XMVectorAdd(XMVectorScale(edgeA, pxC), XMVectorScale(edgeB, pyC)));
-
-							// pixel level edge test
-							if (!IsAllPixelsValid) {
-								if (isTopLeftMask(ks, topLeftMask) != 0xf)
-									continue;
-							}
-
-							// homogenes berycentric coordinate
-							XMVECTOR k = XMVectorMultiply(ks, reci_pW); // k.w = 0.0f
-							XMVECTOR ksDiv_pWSum = XMVectorSum(k);
-							k = XMVectorDivide(k, ksDiv_pWSum);
-
-							// SV_POSITION
-							float* input = reinterpret_cast<float*>(psInputs[omp_get_thread_num()]);
-							input[0] = tileX + pxC;
-							input[1] = tileY + pyC;
-							input[2] = XMVectorGetX(XMVectorSum(XMVectorMultiply(ks, sZ)));
-							input[3] = XMVectorGetX(XMVectorReciprocal(ksDiv_pWSum));
-
-							if (input[2] > 1.0f || input[2] < 0.0f)
-								continue;
-							// Z-prepass
-							UINT32 depth = *(pDepthStencil + pos) >> 8;
-							UINT32 newDepth = float2Depth(input[2]);
-							if (EnableZPrepass && newDepth >= depth)
-								continue;
-
-							// homogenes linear interploate
-							for (UINT i = 0; i < mPipelineState.VSOutputByteCount / 4 - 4; i++) {
-								input[i + 4] = XMVectorGetX(
-									XMVectorSum(XMVectorMultiply(k, XMLoadFloat3(&toInterpolate[i]))));
-							}
-
-
-							/***************
-								* pixel shader
-								*/
-							XMFLOAT4 pixel;
-							(*mPipelineState.PS)(reinterpret_cast<BYTE*>(input), &pixel, constBuffers);
-
-							/****************
-								* Output Merger
-								*/
-							if (!EnableZPrepass) {
-								if (input[2] > 1.0f || input[2] < 0.0f)
-									continue;
-								newDepth = float2Depth(input[2]);
-							}
-							if (EnableZPrepass || IsAllDepthPass || newDepth < depth) {
-								BYTE* imagePos = target.ptr + pos * 4;
-								imagePos[0] = BYTE(clamp(pixel.x) * 255);
-								imagePos[1] = BYTE(clamp(pixel.y) * 255);
-								imagePos[2] = BYTE(clamp(pixel.z) * 255);
-								imagePos[3] = BYTE(clamp(pixel.w) * 255);
-
-								*(pDepthStencil + pos) = (newDepth << 8) | (*(pDepthStencil + pos) & 0xff);
-
-								TileHiZMin = min(newDepth, TileHiZMin);
-
-								if (depth == TileHiZMax)
-									IsMaxDepthChange = true;
-							}
-						}
+				}
+				
+				// Z-prepass
+				if (EnableZPrepass)
+					for (int i = 0; i < 4; i++)
+						if (newDepths[i] >= depths[i])
+							pixelMask[i] = false;
+
+				if (pixelMask[0] == false && pixelMask[1] == false && pixelMask[2] == false && pixelMask[3] == false)
+					continue;
+
+				/***************
+				 * quad pixel shader
+				 */
+				XMFLOAT4 pixels[4];
+				(*mPipelineState.QuadPS)(reinterpret_cast<BYTE**>(inputs), &pixels, constBuffers);
+				// helper pixels are shaded as well
+				stats.PSInvocations += 4;
+
+				/****************
+				 * Output Merger
+				 */
+				for (int i = 0; i < 4; i++) {
+					if (!EnableZPrepass) {
+						if (inputs[i][2] > 1.0f || inputs[i][2] < 0.0f)
+							pixelMask[i] = false;
+						newDepths[i] = float2Depth(inputs[i][2]);
 					}
-#ifdef AllowQuadPS
+					if (pixelMask[i] == false)
+						continue;
+					if (EnableZPrepass || IsAllDepthPass || newDepths[i] < depths[i]) {
+						UINT pxInt = tileXInt + 2 * ix + i / 2;
+						UINT pyInt = tileYInt + 2 * iy + i % 2;
+						UINT pos = w * pyInt + pxInt;
+						BYTE* imagePos = setup.pRenderTarget + pos * 4;
+						imagePos[0] = BYTE(clamp(pixels[i].x) * 255);
+						imagePos[1] = BYTE(clamp(pixels[i].y) * 255);
+						imagePos[2] = BYTE(clamp(pixels[i].z) * 255);
+						imagePos[3] = BYTE(clamp(pixels[i].w) * 255);
+
+						*(pDepthStencil + pos) = (newDepths[i] << 8) | (*(pDepthStencil + pos) & 0xff);
+						stats.PixelsWritten++;
+
+						TileHiZMin = (std::min)(newDepths[i], TileHiZMin);
+
+						if (depths[i] == TileHiZMax)
+							IsMaxDepthChange = true;
 					}
-#endif
 				}
 			}
-			if (IsMaxDepthChange && !(IsAllPixelsValid && IsAllDepthPass)) {
-				UINT32 max = TileHiZMin;
-				for (int j = 0; j < 8; j++) {
-					for (int i = 0; i < 8; i++) {
-						UINT px = tileXInt + i;
-						UINT py = tileYInt + j;
-						if (px >= w || py >= h)
+			else {
+#endif
+			// 2 * 2 quad
+			for (int u = 0; u < 2; u++) {
+				for (int v = 0; v < 2; v++) {
+					UINT pxInt = tileXInt + 2 * ix + u;
+					UINT pyInt = tileYInt + 2 * iy + v;
+					UINT pos = w * pyInt + pxInt;
+
+					// out of screen test
+					if (pxInt >= w || pyInt >= h)
+						continue;
+
+					// suffix C means coordinate base on upper-left corner
+					float pxC = 2.0f * ix + u, pyC = 2.0f * iy + v;
+
+					// used the linear property of edge equation.
+					// ks.w = 0.0f
+					XMVECTOR ks = XMVectorAdd(edgeCorner0,
+						XMVectorAdd(XMVectorScale(edgeA, pxC), XMVectorScale(edgeB, pyC)));
+
+					// pixel level edge test
+					if (!IsAllPixelsValid) {
+						if (isTopLeftMask(ks, topLeftMask) != 0xf)
 							continue;
-						UINT pos = w * py+ px;
-						max = max(*(pDepthStencil + pos) >> 8, max);
+					}
+
+					UINT32 depth, newDepth;
+					if (ShadePixel(setup, ks, tileX + pxC, tileY + pyC, pos, IsAllDepthPass,
+						reinterpret_cast<float*>(psInput), constBuffers, stats, depth, newDepth))
+					{
+						TileHiZMin = (std::min)(newDepth, TileHiZMin);
+
+						if (depth == TileHiZMax)
+							IsMaxDepthChange = true;
 					}
 				}
-				TileHiZMax = max;
 			}
-			*pTileHiZ = TileHiZMin;
-			*(pTileHiZ + 1) = TileHiZMax;
+#ifdef AllowQuadPS
+			}
+#endif
 		}
-	//}
-end:
-	_aligned_free(psInputPool);
-	free(toInterpolate);
+	}
+	if (IsMaxDepthChange && !(IsAllPixelsValid && IsAllDepthPass)) {
+		TileHiZMax = tileMaxDepth(pDepthStencil, w, h, tileXInt, tileYInt, TileHiZMin);
+	}
+	*pTileHiZ = TileHiZMin;
+	*(pTileHiZ + 1) = TileHiZMax;
+
+	if (pTileCounters != nullptr) {
+		pTileCounters->TrianglesAccepted++;
+		pTileCounters->PixelsShaded += UINT(stats.PSInvocations - shadedBefore);
+		pTileCounters->PixelsWritten += UINT(stats.PixelsWritten - writtenBefore);
+	}
 }
@@ -1,11 +1,40 @@
 #pragma once
 
 #include "SRUtils.h"
+#include <algorithm>
+#include <assert.h>
 
 using namespace DirectX;
 
-#define minOf3(a, b, c) (min(min((a),(b)),(c)))
-#define maxOf3(a, b, c) (max(max((a),(b)),(c)))
+#define minOf3(a, b, c) ((std::min)((std::min)((a),(b)),(c)))
+#define maxOf3(a, b, c) ((std::max)((std::max)((a),(b)),(c)))
+
+/*
+ * Everything the traversal needs to know about a triangle after setup.
+ * Edge values are normalized by the area, so they are also the
+ * screen space barycentric coordinates.
+ */
+typedef struct SRTriangleSetup {
+	XMMATRIX edgeMatrix;		// row i: [a_i b_i c_i 0]
+	XMVECTOR edgeA;				// [a1 a2 a3 0]
+	XMVECTOR edgeB;				// [b1 b2 b3 0]
+	XMVECTOR edgeC;				// [c1 c2 c3 0]
+	XMVECTOR cornerSelect1;
+	XMVECTOR cornerSelect2;
+	XMVECTOR reci_pW;
+	XMVECTOR sZ;
+	XMVECTOR topLeftMask;
+	const XMFLOAT3* toInterpolate;
+
+	// inclusive bounding box of the covered pixel centers, clamped to the target
+	UINT minX, maxX;
+	UINT minY, maxY;
+
+	// render target
+	BYTE* pRenderTarget;
+	UINT32* pDepthStencil;
+	UINT width, height;
+} SRTriangleSetup;
 
 inline UINT findCorner(XMFLOAT3 v) {
 	return (v.x >= 0 ? 1 : 0) + (v.y >= 0 ? 2 : 0);
@@ -20,7 +49,7 @@ inline int XM_CALLCONV isTopLeftMask(FXMVECTOR edgeValue, FXMVECTOR topLeftMask)
 		XMVectorAndInt(XMVectorEqual(edgeValue, XMVectorZero()), topLeftMask)));
 }
 
-XMVECTOR indexToSelect1(UINT indices[3]) {
+inline XMVECTOR indexToSelect1(UINT indices[3]) {
 	XMVECTORU32 ans = {
 			indices[0] % 2 == 0 ? XM_SELECT_0 : XM_SELECT_1,
 			indices[1] % 2 == 0 ? XM_SELECT_0 : XM_SELECT_1,
@@ -30,7 +59,7 @@ XMVECTOR indexToSelect1(UINT indices[3]) {
 	return XMVECTOR(ans);
 }
 
-XMVECTOR indexToSelect2(UINT indices[3]) {
+inline XMVECTOR indexToSelect2(UINT indices[3]) {
 	XMVECTORU32 ans = {
 			indices[0] / 2 == 0 ? XM_SELECT_0 : XM_SELECT_1,
 			indices[1] / 2 == 0 ? XM_SELECT_0 : XM_SELECT_1,
@@ -65,11 +94,129 @@ inline XMVECTOR XM_CALLCONV selectMinCorner(FXMMATRIX mat, XMVECTOR select1, XMV
 	return XMVectorSelect(first2, second2, select2);
 }
 
+inline bool isSingleTile(const SRTriangleSetup& setup) {
+	return setup.minX / 8 == setup.maxX / 8 && setup.minY / 8 == setup.maxY / 8;
+}
+
+// position of tile (i, j) along the Z-order curve
+inline UINT64 mortonIndex(UINT i, UINT j) {
+	UINT64 d = 0;
+	for (UINT bit = 0; bit < 32; bit++) {
+		d |= UINT64((i >> bit) & 1) << (2 * bit);
+		d |= UINT64((j >> bit) & 1) << (2 * bit + 1);
+	}
+	return d;
+}
+
+// position of tile (i, j) along the Hilbert curve filling a n * n square, n is a power of 2
+inline UINT64 hilbertIndex(UINT n, UINT i, UINT j) {
+	UINT64 d = 0;
+	for (UINT s = n / 2; s > 0; s /= 2) {
+		UINT ri = (i & s) > 0 ? 1 : 0;
+		UINT rj = (j & s) > 0 ? 1 : 0;
+		d += UINT64(s) * s * ((3 * ri) ^ rj);
+		// rotate the quadrant
+		if (rj == 0) {
+			if (ri == 1) {
+				i = n - 1 - i;
+				j = n - 1 - j;
+			}
+			UINT t = i;
+			i = j;
+			j = t;
+		}
+	}
+	return d;
+}
+
+// maximum depth in a 8 * 8 tile, pixels out of screen are skipped
+inline UINT32 tileMaxDepth(const UINT32* pDepthStencil, UINT w, UINT h, UINT tileXInt, UINT tileYInt, UINT32 init) {
+	UINT32 maxDepth = init;
+	for (UINT j = 0; j < 8; j++) {
+		for (UINT i = 0; i < 8; i++) {
+			UINT px = tileXInt + i;
+			UINT py = tileYInt + j;
+			if (px >= w || py >= h)
+				continue;
+			maxDepth = (std::max)(*(pDepthStencil + w * py + px) >> 8, maxDepth);
+		}
+	}
+	return maxDepth;
+}
+
+/*
+ * tile corners
+ * 0--1
+ * |  |
+ * 2--3
+ */
+// m_ij = j-th corner's i-th edge value, (tileX, tileY) is the center of corner 0
+inline XMMATRIX XM_CALLCONV tileCornerEdges(const SRTriangleSetup& setup, float tileX, float tileY) {
+	XMMATRIX cornersT = {
+		XMVectorSet(tileX, tileX + 7.0f, tileX, tileX + 7.0f),
+		XMVectorSet(tileY, tileY, tileY + 7.0f, tileY + 7.0f),
+		g_XMOne,
+		g_XMZero
+	};
+	return XMMatrixMultiply(setup.edgeMatrix, cornersT);
+}
+
+// ks: screen space barycentric coordinate of the pixel.
+// write depth and 1 / w of SV_POSITION into input[2], input[3],
+// return the perspective correct barycentric coordinate.
+inline XMVECTOR XM_CALLCONV perspectiveBarycentric(const SRTriangleSetup& setup, FXMVECTOR ks, float* input) {
+	// homogenes berycentric coordinate
+	XMVECTOR k = XMVectorMultiply(ks, setup.reci_pW); // k.w = 0.0f
+	XMVECTOR ksDiv_pWSum = XMVectorSum(k);
+	k = XMVectorDivide(k, ksDiv_pWSum);
+
+	input[2] = XMVectorGetX(XMVectorSum(XMVectorMultiply(ks, setup.sZ)));
+	input[3] = XMVectorGetX(XMVectorReciprocal(ksDiv_pWSum));
+	return k;
+}
+
+// homogenes linear interploate the values after SV_POSITION
+inline void XM_CALLCONV interpolateAttributes(const SRTriangleSetup& setup, FXMVECTOR k, UINT count, float* input) {
+	for (UINT i = 0; i < count; i++) {
+		input[i + 4] = XMVectorGetX(
+			XMVectorSum(XMVectorMultiply(k, XMLoadFloat3(&setup.toInterpolate[i]))));
+	}
+}
+
+// perspective correct barycentric coordinate of a point of the triangle plane
+inline XMVECTOR XM_CALLCONV perspectiveWeights(const SRTriangleSetup& setup, FXMVECTOR ks) {
+	XMVECTOR k = XMVectorMultiply(ks, setup.reci_pW);
+	return XMVectorDivide(k, XMVectorSum(k));
+}
+
+// derivatives of the first count attributes across the 2 * 2 quad of pixel (px, py),
+// written after the attributeCount attributes: all ddx, then all ddy.
+// the neighbour in the quad is evaluated on the triangle plane, covered or not.
+inline void XM_CALLCONV quadDerivatives(const SRTriangleSetup& setup, FXMVECTOR ks, float px, float py,
+	UINT attributeCount, UINT count, float* input)
+{
+	const bool isOddX = (UINT(px) & 1) != 0;
+	const bool isOddY = (UINT(py) & 1) != 0;
+	XMVECTOR kx = perspectiveWeights(setup, isOddX ? XMVectorSubtract(ks, setup.edgeA) : XMVectorAdd(ks, setup.edgeA));
+	XMVECTOR ky = perspectiveWeights(setup, isOddY ? XMVectorSubtract(ks, setup.edgeB) : XMVectorAdd(ks, setup.edgeB));
+
+	const float* attributes = input + 4;
+	float* ddx = input + 4 + attributeCount;
+	float* ddy = ddx + count;
+	for (UINT i = 0; i < count; i++) {
+		XMVECTOR values = XMLoadFloat3(&setup.toInterpolate[i]);
+		float valueX = XMVectorGetX(XMVectorSum(XMVectorMultiply(kx, values)));
+		float valueY = XMVectorGetX(XMVectorSum(XMVectorMultiply(ky, values)));
+		ddx[i] = isOddX ? attributes[i] - valueX : valueX - attributes[i];
+		ddy[i] = isOddY ? attributes[i] - valueY : valueY - attributes[i];
+	}
+}
+
 inline float IntersectParameter(float a0, float a1) {
 	return a0 / (a0 - a1);
 }
 
-void InterpolateLine(BYTE* p0, BYTE* p1, float t, int count, BYTE* pOut) {
+inline void InterpolateLine(BYTE* p0, BYTE* p1, float t, int count, BYTE* pOut) {
 	// note: alias is possible
 	float *p0f = reinterpret_cast<float*>(p0);
 	float *p1f = reinterpret_cast<float*>(p1);
@@ -79,16 +226,94 @@ void InterpolateLine(BYTE* p0, BYTE* p1, float t, int count, BYTE* pOut) {
 	}
 }
 
-// return pointer needs to be freed by caller
-const BYTE*const* SRDevice::AssempleConstantBuffers() {
-	const BYTE** constBuffersTmp = nullptr;
-	if (mPipelineState.NumConstantBuffer != 0) {
-		constBuffersTmp = (const BYTE**)malloc(mPipelineState.NumConstantBuffer * sizeof(BYTE*));
-		assert(constBuffersTmp != nullptr);
-		for (UINT i = 0; i < mPipelineState.NumConstantBuffer; i++) {
-			assert(mConstantsBufferHandle[i] != InvalidHandle);
-			constBuffersTmp[i] = mResources[mConstantsBufferHandle[i]].ptr;
-		}
+// screen mapping and triangle setup, the render target part of setup has to be filled already.
+// return false if the triangle is culled.
+inline bool setupTriangle(const BYTE* vsOutput1, const BYTE* vsOutput2, const BYTE* vsOutput3,
+	UINT interpolateCount, XMFLOAT3* toInterpolate, SRTriangleSetup& setup)
+{
+	const UINT w = setup.width, h = setup.height;
+
+	/****************
+	 * Rasterization
+	 * screen mapping and triangle setup
+	 */
+	const float* vsOutput1f = reinterpret_cast<const float*>(vsOutput1);
+	const float* vsOutput2f = reinterpret_cast<const float*>(vsOutput2);
+	const float* vsOutput3f = reinterpret_cast<const float*>(vsOutput3);
+
+	XMFLOAT4 p1 = XMFLOAT4(vsOutput1f);
+	XMFLOAT4 p2 = XMFLOAT4(vsOutput2f);
+	XMFLOAT4 p3 = XMFLOAT4(vsOutput3f);
+
+	// 16.8 fixed-point
+	XMStoreFloat4(&p1, XMVectorScale(XMVectorRound(XMVectorScale(XMLoadFloat4(&p1), 256.0f)), 1/256.0f));
+	XMStoreFloat4(&p2, XMVectorScale(XMVectorRound(XMVectorScale(XMLoadFloat4(&p2), 256.0f)), 1/256.0f));
+	XMStoreFloat4(&p3, XMVectorScale(XMVectorRound(XMVectorScale(XMLoadFloat4(&p3), 256.0f)), 1/256.0f));
+
+	XMFLOAT3 s1 = XMFLOAT3((p1.x / p1.w + 1) * w * 0.5f, (1 - p1.y / p1.w) * h * 0.5f, p1.z / p1.w); //(1.0f - p1.z / p1.w) * 0.5f);
+	XMFLOAT3 s2 = XMFLOAT3((p2.x / p2.w + 1) * w * 0.5f, (1 - p2.y / p2.w) * h * 0.5f, p2.z / p2.w); //(1.0f - p2.z / p2.w) * 0.5f);
+	XMFLOAT3 s3 = XMFLOAT3((p3.x / p3.w + 1) * w * 0.5f, (1 - p3.y / p3.w) * h * 0.5f, p3.z / p3.w); //(1.0f - p3.z / p3.w) * 0.5f);
+
+	XMFLOAT3 edge1 = XMFLOAT3(s3.y - s2.y, s2.x - s3.x, s3.x * s2.y - s2.x * s3.y);
+	XMFLOAT3 edge2 = XMFLOAT3(s1.y - s3.y, s3.x - s1.x, s1.x * s3.y - s3.x * s1.y);
+	XMFLOAT3 edge3 = XMFLOAT3(s2.y - s1.y, s1.x - s2.x, s2.x * s1.y - s1.x * s2.y);
+
+	XMVECTOR area = XMVectorReplicate(edge1.z + edge2.z + edge3.z);
+
+	// clockwise culling
+	if (XMVectorGetX(area) <= 0.0f)
+		return false;
+
+	// bounding box of the pixel centers, pixel (x, y) has its center at (x + 0.5, y + 0.5).
+	// a triangle falls between pixel centers covers nothing.
+	// clamp before converting to integer, the guard-band is assumed infinity.
+	int minPx = int(ceilf((std::min)((std::max)(minOf3(s1.x, s2.x, s3.x) - 0.5f, 0.0f), float(w))));
+	int maxPx = int(floorf((std::max)((std::min)(maxOf3(s1.x, s2.x, s3.x) - 0.5f, float(w) - 1.0f), -1.0f)));
+	int minPy = int(ceilf((std::min)((std::max)(minOf3(s1.y, s2.y, s3.y) - 0.5f, 0.0f), float(h))));
+	int maxPy = int(floorf((std::max)((std::min)(maxOf3(s1.y, s2.y, s3.y) - 0.5f, float(h) - 1.0f), -1.0f)));
+	if (minPx > maxPx || minPy > maxPy)
+		return false;
+	setup.minX = UINT(minPx);
+	setup.maxX = UINT(maxPx);
+	setup.minY = UINT(minPy);
+	setup.maxY = UINT(maxPy);
+
+	XMMATRIX edgeMatrix = {
+		XMVectorDivide(XMLoadFloat3(&edge1), area),
+		XMVectorDivide(XMLoadFloat3(&edge2), area),
+		XMVectorDivide(XMLoadFloat3(&edge3), area),
+		g_XMZero
+	};
+	setup.edgeMatrix = edgeMatrix;
+
+	UINT testCorners[3] = {
+		findCorner(edge1),
+		findCorner(edge2),
+		findCorner(edge3)
+	};
+	setup.cornerSelect1 = indexToSelect1(testCorners);
+	setup.cornerSelect2 = indexToSelect2(testCorners);
+
+	// helper variable
+	setup.reci_pW = XMVectorReciprocal(XMVectorSet(p1.w, p2.w, p3.w, INFINITY));
+	setup.sZ = XMVectorSet(s1.z, s2.z, s3.z, 0.0f);
+	setup.topLeftMask = XMVectorSet(isTopLeftEdge(edge1), isTopLeftEdge(edge2), isTopLeftEdge(edge3), -0.0f);
+
+	XMVECTOR edgeA = _mm_shuffle_ps(edgeMatrix.r[0], edgeMatrix.r[1], _MM_SHUFFLE(1, 0, 1, 0)); // [a1 b1 a2 b2]
+	setup.edgeB = _mm_shuffle_ps(edgeA, edgeMatrix.r[2], _MM_SHUFFLE(3, 1, 3, 1)); // [b1 b2 b3 0]
+	setup.edgeA = _mm_shuffle_ps(edgeA, edgeMatrix.r[2], _MM_SHUFFLE(3, 0, 2, 0)); // [a1 a2 a3 0]
+	XMVECTOR edgeC = _mm_shuffle_ps(edgeMatrix.r[0], edgeMatrix.r[1], _MM_SHUFFLE(2, 2, 2, 2)); // [c1 c1 c2 c2]
+	setup.edgeC = _mm_shuffle_ps(edgeC, edgeMatrix.r[2], _MM_SHUFFLE(3, 2, 2, 0)); // [c1 c2 c3 0]
+
+
+	// value to be interpolated
+	for (UINT i = 0; i < interpolateCount; i++) {
+		toInterpolate[i] = XMFLOAT3(
+			vsOutput1f[i + 4],
+			vsOutput2f[i + 4],
+			vsOutput3f[i + 4]);
 	}
-	return constBuffersTmp;
-}
\ No newline at end of file
+	setup.toInterpolate = toInterpolate;
+
+	return true;
+}
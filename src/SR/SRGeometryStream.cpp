@@ -0,0 +1,696 @@
+#include "SRGeometryStream.h"
+#include <algorithm>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace DirectX;
+
+static const UINT NoSlot = UINT(-1);
+// the finest grid cell, of the largest extent of the mesh
+static const UINT GridLevels = 16;
+
+static inline UINT64 alignOffset(UINT64 offset) {
+	return (offset + SRMeshFileAlignment - 1) & ~UINT64(SRMeshFileAlignment - 1);
+}
+
+static inline bool seekFile(FILE* file, UINT64 offset) {
+#ifdef _WIN32
+	return _fseeki64(file, INT64(offset), SEEK_SET) == 0;
+#else
+	return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+static inline const XMFLOAT3& positionOf(const BYTE* vertex) {
+	return *reinterpret_cast<const XMFLOAT3*>(vertex);
+}
+
+static inline float component(const XMFLOAT3& p, UINT axis) {
+	return axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+}
+
+static inline void growBounds(SRMeshBounds& bounds, const XMFLOAT3& p) {
+	bounds.Min = XMFLOAT3((std::min)(bounds.Min.x, p.x), (std::min)(bounds.Min.y, p.y), (std::min)(bounds.Min.z, p.z));
+	bounds.Max = XMFLOAT3((std::max)(bounds.Max.x, p.x), (std::max)(bounds.Max.y, p.y), (std::max)(bounds.Max.z, p.z));
+}
+
+/*
+ * builder
+ */
+namespace {
+
+// geometry of a node while its parent is built
+struct ClusterGeometry {
+	std::vector<BYTE> vertices;
+	std::vector<UINT32> indices;
+	UINT level;						// of the grid, GridLevels + 1 for the original triangles
+	float error;
+};
+
+class ClusterBuilder
+{
+public:
+	ClusterBuilder(FILE* file, const SRMeshFileDesc& desc, UINT clusterTriangles) :
+		mFile(file), mDesc(desc), mStride(desc.StreamStrides[0]), mClusterTriangles(clusterTriangles) {
+		mVertices = static_cast<const BYTE*>(desc.pStreams[0]);
+		mBounds = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+		for (UINT i = 0; i < desc.IndexCount; i++) {
+			growBounds(mBounds, positionOf(mVertices + size_t(Index(i)) * mStride));
+		}
+		const float extent = (std::max)((std::max)(mBounds.Max.x - mBounds.Min.x, mBounds.Max.y - mBounds.Min.y),
+			(std::max)(mBounds.Max.z - mBounds.Min.z, FLT_MIN));
+		mFinestCell = extent / float(1u << GridLevels);
+	}
+
+	// the subtree of the triangles, post-order. false on write errors.
+	bool Build(UINT32* triangles, size_t count, UINT& node, ClusterGeometry& geometry) {
+		SRClusterNode record = {};
+		record.Bounds = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+		for (size_t t = 0; t < count; t++) {
+			for (UINT k = 0; k < 3; k++) {
+				growBounds(record.Bounds, Position(3 * triangles[t] + k));
+			}
+		}
+
+		if (count <= mClusterTriangles) {
+			Leaf(triangles, count, geometry);
+			record.Children[0] = record.Children[1] = SRClusterNoChild;
+		}
+		else {
+			// halves at the median centroid along the longest axis
+			const XMFLOAT3& min = record.Bounds.Min;
+			const XMFLOAT3& max = record.Bounds.Max;
+			const UINT axis = max.x - min.x >= max.y - min.y && max.x - min.x >= max.z - min.z ? 0 :
+				max.y - min.y >= max.z - min.z ? 1 : 2;
+			auto centroid = [&](UINT32 t) {
+				return component(Position(3 * t), axis) + component(Position(3 * t + 1), axis) + component(Position(3 * t + 2), axis);
+			};
+			const size_t half = count / 2;
+			std::nth_element(triangles, triangles + half, triangles + count,
+				[&](UINT32 a, UINT32 b) { return centroid(a) < centroid(b); });
+
+			ClusterGeometry children[2];
+			if (!Build(triangles, half, record.Children[0], children[0]) ||
+				!Build(triangles + half, count - half, record.Children[1], children[1]))
+				return false;
+			Simplify(children, geometry);
+		}
+
+		record.Error = geometry.error;
+		record.VertexCount = UINT32(geometry.vertices.size() / mStride);
+		record.IndexCount = UINT32(geometry.indices.size());
+		if (!Write(geometry, record.Offset))
+			return false;
+		node = UINT(mNodes.size());
+		mNodes.push_back(record);
+		mMaxVertexCount = (std::max)(mMaxVertexCount, record.VertexCount);
+		mMaxIndexCount = (std::max)(mMaxIndexCount, record.IndexCount);
+		return true;
+	}
+
+	const SRMeshBounds& Bounds() const { return mBounds; };
+	const std::vector<SRClusterNode>& Nodes() const { return mNodes; };
+	UINT MaxVertexCount() const { return mMaxVertexCount; };
+	UINT MaxIndexCount() const { return mMaxIndexCount; };
+	UINT64& Offset() { return mOffset; };
+
+private:
+	FILE* mFile;
+	const SRMeshFileDesc& mDesc;
+	const UINT mStride;
+	const UINT mClusterTriangles;
+	const BYTE* mVertices;
+	SRMeshBounds mBounds;
+	float mFinestCell;
+	std::vector<SRClusterNode> mNodes;
+	UINT mMaxVertexCount = 0;
+	UINT mMaxIndexCount = 0;
+	UINT64 mOffset = sizeof(SRClusterFileHeader);
+
+	UINT Index(size_t n) const {
+		return mDesc.IndexFormat == DXGI_FORMAT_R16_UINT ?
+			static_cast<const UINT16*>(mDesc.pIndices)[n] : static_cast<const UINT32*>(mDesc.pIndices)[n];
+	}
+	const XMFLOAT3& Position(size_t n) const {
+		return positionOf(mVertices + size_t(Index(n)) * mStride);
+	}
+
+	// the original triangles with their vertices
+	void Leaf(const UINT32* triangles, size_t count, ClusterGeometry& geometry) {
+		std::unordered_map<UINT, UINT32> remap;
+		for (size_t t = 0; t < count; t++) {
+			for (UINT k = 0; k < 3; k++) {
+				const UINT vertex = Index(3 * size_t(triangles[t]) + k);
+				auto inserted = remap.emplace(vertex, UINT32(remap.size()));
+				if (inserted.second) {
+					const BYTE* source = mVertices + size_t(vertex) * mStride;
+					geometry.vertices.insert(geometry.vertices.end(), source, source + mStride);
+				}
+				geometry.indices.push_back(inserted.first->second);
+			}
+		}
+		geometry.level = GridLevels + 1;
+		geometry.error = 0.0f;
+	}
+
+	// the vertices of both children snapped to the centers of the cells of the finest grid coarser than theirs
+	// that leaves no more than mClusterTriangles triangles. the grids nest, snapping the snapped vertices again
+	// is the same as snapping the originals, so the error is that of the grid alone.
+	void Simplify(const ClusterGeometry children[2], ClusterGeometry& geometry) {
+		// level 0 is a single cell over the whole mesh, GridLevels the finest
+		std::vector<BYTE> vertices(children[0].vertices);
+		vertices.insert(vertices.end(), children[1].vertices.begin(), children[1].vertices.end());
+		std::vector<UINT32> indices(children[0].indices);
+		const UINT32 base = UINT32(children[0].vertices.size() / mStride);
+		for (UINT32 index : children[1].indices) {
+			indices.push_back(base + index);
+		}
+
+		UINT level = (std::min)((std::min)(children[0].level, children[1].level), GridLevels);
+		std::unordered_map<UINT64, UINT32> cells;
+		std::vector<UINT32> cellOf(vertices.size() / mStride);
+		std::vector<UINT32> kept;
+		// the sorted cells of the kept triangles, 21 bits each as the vertices of two nodes are under 2^17
+		std::unordered_set<UINT64> triangles;
+		while (true) {
+			const float cell = mFinestCell * float(1u << (GridLevels - level));
+			cells.clear();
+			for (size_t v = 0; v < cellOf.size(); v++) {
+				const XMFLOAT3& p = positionOf(vertices.data() + v * mStride);
+				const UINT64 x = UINT64((p.x - mBounds.Min.x) / cell);
+				const UINT64 y = UINT64((p.y - mBounds.Min.y) / cell);
+				const UINT64 z = UINT64((p.z - mBounds.Min.z) / cell);
+				cellOf[v] = cells.emplace((x << 42) | (y << 21) | z, UINT32(cells.size())).first->second;
+			}
+			// without the triangles collapsed to a line or a point and those collapsed onto a kept one
+			kept.clear();
+			triangles.clear();
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				UINT64 a = cellOf[indices[i]], b = cellOf[indices[i + 1]], c = cellOf[indices[i + 2]];
+				if (a == b || b == c || a == c)
+					continue;
+				if (a > b)
+					std::swap(a, b);
+				if (b > c)
+					std::swap(b, c);
+				if (a > b)
+					std::swap(a, b);
+				if (triangles.insert((a << 42) | (b << 21) | c).second)
+					kept.push_back(UINT32(i));
+			}
+			if (kept.size() <= mClusterTriangles || level == 0)
+				break;
+			level--;
+		}
+
+		// the cells the kept triangles use, the first vertex of each with the position of the center
+		const float cell = mFinestCell * float(1u << (GridLevels - level));
+		std::vector<UINT32> remap(cells.size(), UINT32(-1));
+		geometry.vertices.clear();
+		geometry.indices.clear();
+		for (UINT32 i : kept) {
+			for (UINT k = 0; k < 3; k++) {
+				const UINT32 vertex = indices[i + k];
+				UINT32& target = remap[cellOf[vertex]];
+				if (target == UINT32(-1)) {
+					target = UINT32(geometry.vertices.size() / mStride);
+					const BYTE* source = vertices.data() + size_t(vertex) * mStride;
+					geometry.vertices.insert(geometry.vertices.end(), source, source + mStride);
+					XMFLOAT3& p = *reinterpret_cast<XMFLOAT3*>(geometry.vertices.data() + size_t(target) * mStride);
+					p.x = mBounds.Min.x + (floorf((p.x - mBounds.Min.x) / cell) + 0.5f) * cell;
+					p.y = mBounds.Min.y + (floorf((p.y - mBounds.Min.y) / cell) + 0.5f) * cell;
+					p.z = mBounds.Min.z + (floorf((p.z - mBounds.Min.z) / cell) + 0.5f) * cell;
+				}
+				geometry.indices.push_back(target);
+			}
+		}
+		geometry.level = level;
+		// half the diagonal of a cell
+		geometry.error = (std::max)((std::max)(children[0].error, children[1].error), 0.8660254f * cell);
+	}
+
+	// at the next aligned offset, returned in offset
+	bool Write(const ClusterGeometry& geometry, UINT64& offset) {
+		static const BYTE zeros[SRMeshFileAlignment] = {};
+		const UINT64 aligned = alignOffset(mOffset);
+		if (fwrite(zeros, 1, size_t(aligned - mOffset), mFile) != aligned - mOffset)
+			return false;
+		mOffset = offset = aligned;
+		std::vector<UINT16> indices(geometry.indices.begin(), geometry.indices.end());
+		if (fwrite(geometry.vertices.data(), 1, geometry.vertices.size(), mFile) != geometry.vertices.size() ||
+			fwrite(indices.data(), sizeof(UINT16), indices.size(), mFile) != indices.size())
+			return false;
+		mOffset += geometry.vertices.size() + indices.size() * sizeof(UINT16);
+		return true;
+	}
+};
+
+}
+
+bool SRWriteClusterFile(const char* pFileName, const SRMeshFileDesc& Desc, UINT ClusterTriangles) {
+	if (ClusterTriangles == 0 || ClusterTriangles > SRMaxClusterTriangles || Desc.pStreams[0] == nullptr ||
+		Desc.StreamStrides[0] < sizeof(XMFLOAT3) || Desc.VertexCount == 0 || Desc.pIndices == nullptr ||
+		Desc.IndexCount == 0 || Desc.IndexCount % 3 != 0 ||
+		(Desc.IndexFormat != DXGI_FORMAT_R16_UINT && Desc.IndexFormat != DXGI_FORMAT_R32_UINT))
+		return false;
+
+	FILE* file = fopen(pFileName, "wb");
+	if (file == nullptr)
+		return false;
+	// the header is written again once the nodes are placed
+	SRClusterFileHeader header = {};
+	bool isSucceeded = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	std::vector<UINT32> triangles(Desc.IndexCount / 3);
+	for (UINT32 t = 0; t < UINT32(triangles.size()); t++) {
+		triangles[t] = t;
+	}
+	ClusterBuilder builder(file, Desc, ClusterTriangles);
+	ClusterGeometry root;
+	isSucceeded = isSucceeded && builder.Build(triangles.data(), triangles.size(), header.Root, root);
+
+	header.Magic = SRClusterFileMagic;
+	header.Version = SRClusterFileVersion;
+	header.VertexStride = Desc.StreamStrides[0];
+	header.NodeCount = UINT32(builder.Nodes().size());
+	header.MaxVertexCount = builder.MaxVertexCount();
+	header.MaxIndexCount = builder.MaxIndexCount();
+	header.Bounds = builder.Bounds();
+	header.NodesOffset = alignOffset(builder.Offset());
+	static const BYTE zeros[SRMeshFileAlignment] = {};
+	isSucceeded = isSucceeded &&
+		fwrite(zeros, 1, size_t(header.NodesOffset - builder.Offset()), file) == header.NodesOffset - builder.Offset() &&
+		fwrite(builder.Nodes().data(), sizeof(SRClusterNode), builder.Nodes().size(), file) == builder.Nodes().size() &&
+		fseek(file, 0, SEEK_SET) == 0 &&
+		fwrite(&header, sizeof(header), 1, file) == 1;
+	return fclose(file) == 0 && isSucceeded;
+}
+
+/*
+ * stream
+ */
+SRGeometryStream::~SRGeometryStream() {
+	Close();
+}
+
+void SRGeometryStream::Close() {
+	if (mThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWakeUp.notify_one();
+		mThread.join();
+	}
+	mThread = std::thread();
+	mQuit = false;
+	mLoads.clear();
+	mCompleted.clear();
+	if (mFile != nullptr)
+		fclose(mFile);
+	mFile = nullptr;
+	if (mVertexPool != SRDevice::InvalidHandle)
+		mDevice.SRReleaseResource(mVertexPool);
+	if (mIndexPool != SRDevice::InvalidHandle)
+		mDevice.SRReleaseResource(mIndexPool);
+	mVertexPool = mIndexPool = SRDevice::InvalidHandle;
+	mVertices = mIndices = nullptr;
+
+	mHeader = {};
+	mNodes.clear();
+	mStates.clear();
+	mSelected.clear();
+	mWanted.clear();
+	mRequests.clear();
+	mSlotCount = 0;
+	mFreeSlots.clear();
+	mLRU.clear();
+	mStaging.clear();
+	mFrame = 0;
+	mStats = SRGeometryStreamStatistics();
+}
+
+bool SRGeometryStream::Open(const char* pFileName, const SRGeometryStreamDesc& Desc) {
+	if (mFile != nullptr)
+		return false;
+	if (!OpenFile(pFileName, Desc)) {
+		Close();
+		return false;
+	}
+	mThread = std::thread(&SRGeometryStream::ThreadMain, this);
+	return true;
+}
+
+bool SRGeometryStream::OpenFile(const char* pFileName, const SRGeometryStreamDesc& Desc) {
+	mFile = fopen(pFileName, "rb");
+	if (mFile == nullptr)
+		return false;
+	SRClusterFileHeader& header = mHeader;
+	if (fread(&header, sizeof(header), 1, mFile) != 1 || header.Magic != SRClusterFileMagic ||
+		header.Version != SRClusterFileVersion || header.NodeCount == 0 || header.Root >= header.NodeCount ||
+		header.VertexStride == 0 || header.MaxVertexCount > 0xFFFF)
+		return false;
+	mNodes.resize(header.NodeCount);
+	if (!seekFile(mFile, header.NodesOffset) ||
+		fread(mNodes.data(), sizeof(SRClusterNode), mNodes.size(), mFile) != mNodes.size())
+		return false;
+	// the children come before their parent and the geometry before the node table, as SRWriteClusterFile writes
+	// them, so that the tree has no cycles and the reads stay in the file. the index values are checked by ReadNode.
+	for (UINT i = 0; i < header.NodeCount; i++) {
+		const SRClusterNode& node = mNodes[i];
+		const UINT64 size = UINT64(node.VertexCount) * header.VertexStride + UINT64(node.IndexCount) * sizeof(UINT16);
+		if (node.VertexCount > header.MaxVertexCount || node.IndexCount > header.MaxIndexCount || node.IndexCount % 3 != 0 ||
+			(node.Children[0] != SRClusterNoChild && (node.Children[0] >= i || node.Children[1] >= i)) ||
+			node.Offset < sizeof(header) || node.Offset > header.NodesOffset || size > header.NodesOffset - node.Offset)
+			return false;
+	}
+	mStates.assign(header.NodeCount, Node());
+	mDesc = Desc;
+
+	// as many slots as the budget holds, the root's at least, the vertex pool within a buffer
+	const UINT64 vertexSlot = UINT64((std::max)(header.MaxVertexCount, 1u)) * header.VertexStride;
+	const UINT64 indexSlot = UINT64((std::max)(header.MaxIndexCount, 3u)) * sizeof(UINT16);
+	UINT64 slots = Desc.MemoryBudget / (vertexSlot + indexSlot);
+	slots = (std::min)((std::max)(slots, UINT64(1)), UINT64(UINT_MAX) / vertexSlot);
+	slots = (std::min)(slots, UINT64(header.NodeCount));
+
+	SRResourceDescription desc;
+	desc.DIMENSION = SRResourceDimensionBuffer;
+	desc.FORMAT = DXGI_FORMAT_UNKNOWN;
+	desc.HEIGHT = 1;
+	desc.DEPTH = 1;
+	desc.WIDTH = UINT(slots * vertexSlot);
+	if (!mDevice.SRCreateResource(desc, &mVertexPool))
+		return false;
+	desc.WIDTH = UINT(slots * indexSlot);
+	if (!mDevice.SRCreateResource(desc, &mIndexPool))
+		return false;
+	const SRRange noRead = { 0, 0 };
+	void* pVertices;
+	void* pIndices;
+	if (!mDevice.SRMapResource(mVertexPool, &noRead, &pVertices) || !mDevice.SRMapResource(mIndexPool, &noRead, &pIndices))
+		return false;
+	mVertices = static_cast<BYTE*>(pVertices);
+	mIndices = static_cast<BYTE*>(pIndices);
+	mSlotCount = UINT(slots);
+	for (UINT slot = UINT(slots); slot > 0; slot--) {
+		mFreeSlots.push_back(slot - 1);
+	}
+
+	// the root stays, there is always something to draw
+	Load root = { header.Root, TakeSlot(), true };
+	if (!ReadNode(header.Root, root.data))
+		return false;
+	Adopt(root);
+	return true;
+}
+
+bool SRGeometryStream::ReadNode(UINT node, std::vector<BYTE>& data) {
+	const SRClusterNode& record = mNodes[node];
+	const size_t vertexBytes = size_t(record.VertexCount) * mHeader.VertexStride;
+	const size_t indexBytes = size_t(record.IndexCount) * sizeof(UINT16);
+	data.resize(vertexBytes + indexBytes);
+	if (!seekFile(mFile, record.Offset) || fread(data.data(), 1, data.size(), mFile) != data.size())
+		return false;
+	const UINT16* values = reinterpret_cast<const UINT16*>(data.data() + vertexBytes);
+	for (UINT n = 0; n < record.IndexCount; n++) {
+		if (values[n] >= record.VertexCount)
+			return false;
+	}
+	return true;
+}
+
+void SRGeometryStream::ThreadMain() {
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		mWakeUp.wait(lock, [&]() { return mQuit || !mLoads.empty(); });
+		if (mQuit)
+			return;
+		Load load = std::move(mLoads.front());
+		mLoads.pop_front();
+		lock.unlock();
+		load.isSucceeded = ReadNode(load.node, load.data);
+		lock.lock();
+		mCompleted.push_back(std::move(load));
+	}
+}
+
+void SRGeometryStream::Adopt(Load& load) {
+	Node& node = mStates[load.node];
+	mStaging.push_back(std::move(load.data));
+	if (!load.isSucceeded) {
+		// reading it again would fail again
+		node.state = NodeFailed;
+		mFreeSlots.push_back(load.slot);
+		mStats.FailedLoads++;
+		return;
+	}
+	const SRClusterNode& record = mNodes[load.node];
+	const size_t vertexBytes = size_t(record.VertexCount) * mHeader.VertexStride;
+	const size_t indexBytes = size_t(record.IndexCount) * sizeof(UINT16);
+	const size_t vertexBegin = size_t(load.slot) * mHeader.MaxVertexCount * mHeader.VertexStride;
+	const size_t indexBegin = size_t(load.slot) * mHeader.MaxIndexCount * sizeof(UINT16);
+	memcpy(mVertices + vertexBegin, mStaging.back().data(), vertexBytes);
+	memcpy(mIndices + indexBegin, mStaging.back().data() + vertexBytes, indexBytes);
+	const SRRange vertexRange = { vertexBegin, vertexBegin + vertexBytes };
+	const SRRange indexRange = { indexBegin, indexBegin + indexBytes };
+	mDevice.SRUnmapResource(mVertexPool, &vertexRange);
+	mDevice.SRUnmapResource(mIndexPool, &indexRange);
+
+	node.state = NodeResident;
+	node.slot = load.slot;
+	node.lastUsed = mFrame;
+	if (load.node != mHeader.Root) {
+		mLRU.push_front(load.node);
+		node.lru = mLRU.begin();
+	}
+	mStats.ResidentNodes++;
+	mStats.ResidentBytes += UINT64(mHeader.MaxVertexCount) * mHeader.VertexStride + UINT64(mHeader.MaxIndexCount) * sizeof(UINT16);
+	mStats.Loads++;
+}
+
+UINT SRGeometryStream::TakeSlot() {
+	if (!mFreeSlots.empty()) {
+		const UINT slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+		return slot;
+	}
+	if (mLRU.empty())
+		return NoSlot;
+	Node& victim = mStates[mLRU.back()];
+	if (victim.lastUsed + mDesc.FramesInFlight >= mFrame)
+		return NoSlot;
+	mLRU.pop_back();
+	victim.state = NodeAbsent;
+	mStats.ResidentNodes--;
+	mStats.ResidentBytes -= UINT64(mHeader.MaxVertexCount) * mHeader.VertexStride + UINT64(mHeader.MaxIndexCount) * sizeof(UINT16);
+	mStats.Evictions++;
+	return victim.slot;
+}
+
+void SRGeometryStream::Touch(UINT index) {
+	Node& node = mStates[index];
+	node.lastUsed = mFrame;
+	if (index != mHeader.Root)
+		mLRU.splice(mLRU.begin(), mLRU, node.lru);
+}
+
+// the box is outside if all its corners are behind one of the planes
+static bool isCulled(const SRMeshBounds& bounds, const XMFLOAT4 planes[6]) {
+	for (UINT i = 0; i < 6; i++) {
+		const XMFLOAT4& plane = planes[i];
+		const float x = plane.x >= 0.0f ? bounds.Max.x : bounds.Min.x;
+		const float y = plane.y >= 0.0f ? bounds.Max.y : bounds.Min.y;
+		const float z = plane.z >= 0.0f ? bounds.Max.z : bounds.Min.z;
+		if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f)
+			return true;
+	}
+	return false;
+}
+
+static float projectedError(const SRClusterNode& node, const SRGeometryView& view) {
+	// from the nearest point of the box, inside it nothing is coarse enough
+	const float dx = (std::max)((std::max)(node.Bounds.Min.x - view.Eye.x, view.Eye.x - node.Bounds.Max.x), 0.0f);
+	const float dy = (std::max)((std::max)(node.Bounds.Min.y - view.Eye.y, view.Eye.y - node.Bounds.Max.y), 0.0f);
+	const float dz = (std::max)((std::max)(node.Bounds.Min.z - view.Eye.z, view.Eye.z - node.Bounds.Max.z), 0.0f);
+	const float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+	return node.Error == 0.0f ? 0.0f : distance == 0.0f ? FLT_MAX : node.Error * view.PixelsPerUnit / distance;
+}
+
+void SRGeometryStream::Refine(const XMFLOAT4 planes[6], const SRGeometryView& view) {
+	// a max heap of the nodes over MaxPixelError
+	std::vector<std::pair<float, UINT>>& candidates = mCandidates;
+	candidates.clear();
+	auto consider = [&](UINT index) {
+		const SRClusterNode& record = mNodes[index];
+		// a leaf, or children that can not be loaded
+		if (record.Children[0] == SRClusterNoChild ||
+			mStates[record.Children[0]].state == NodeFailed || mStates[record.Children[1]].state == NodeFailed)
+			return;
+		const float error = projectedError(record, view);
+		if (error > mDesc.MaxPixelError) {
+			candidates.emplace_back(error, index);
+			std::push_heap(candidates.begin(), candidates.end());
+		}
+	};
+	if (isCulled(mNodes[mHeader.Root].Bounds, planes))
+		return;
+	consider(mHeader.Root);
+
+	// slots of the selection: its nodes, and the resident nodes drawn until all their children are
+	UINT64 used = 1;
+	while (!candidates.empty()) {
+		const UINT index = candidates.front().second;
+		const SRClusterNode& record = mNodes[index];
+		UINT visible = 0;
+		bool isComplete = true;
+		for (UINT child : record.Children) {
+			if (isCulled(mNodes[child].Bounds, planes))
+				continue;
+			visible++;
+			isComplete = isComplete && mStates[child].state == NodeResident;
+		}
+		const UINT64 slots = used - 1 + visible + (!isComplete && mStates[index].state == NodeResident ? 1 : 0);
+		if (slots > mSlotCount)
+			break;
+		std::pop_heap(candidates.begin(), candidates.end());
+		candidates.pop_back();
+		used = slots;
+		mStates[index].refined = mFrame;
+		for (UINT child : record.Children) {
+			if (!isCulled(mNodes[child].Bounds, planes))
+				consider(child);
+		}
+	}
+	mStats.CoarseNodes = candidates.size();
+}
+
+bool SRGeometryStream::Select(UINT index, float parentError, const XMFLOAT4 planes[6], const SRGeometryView& view) {
+	const SRClusterNode& record = mNodes[index];
+	if (isCulled(record.Bounds, planes))
+		return true;
+	Node& node = mStates[index];
+	if (node.refined == mFrame) {
+		// all the children or this node instead
+		const float error = projectedError(record, view);
+		const size_t selected = mSelected.size();
+		const bool isLeftComplete = Select(record.Children[0], error, planes, view);
+		const bool isRightComplete = Select(record.Children[1], error, planes, view);
+		if (isLeftComplete && isRightComplete)
+			return true;
+		mSelected.resize(selected);
+		if (node.state != NodeResident)
+			return false;
+	}
+	else if (node.state != NodeResident) {
+		mStats.MissingNodes++;
+		if (node.state == NodeAbsent)
+			mRequests.push_back({ index, parentError });
+		return false;
+	}
+	else {
+		mWanted.push_back(index);
+	}
+	mSelected.push_back(index);
+	return true;
+}
+
+void SRGeometryStream::Update(const SRGeometryView& View) {
+	if (mThread.get_id() == std::thread::id())
+		return;
+	mFrame++;
+
+	std::vector<Load> completed;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		completed.swap(mCompleted);
+	}
+	for (Load& load : completed) {
+		Adopt(load);
+	}
+	mStats.PendingLoads -= completed.size();
+
+	// the planes of the frustum from the columns of the matrix, for row vectors
+	// w + x, w - x, w + y, w - y, z and w - z
+	const XMFLOAT4X4& m = View.WorldViewProj;
+	auto column = [&](UINT c, float w, float s) {
+		return XMFLOAT4(w * m.m[0][3] + s * m.m[0][c], w * m.m[1][3] + s * m.m[1][c], w * m.m[2][3] + s * m.m[2][c],
+			w * m.m[3][3] + s * m.m[3][c]);
+	};
+	const XMFLOAT4 planes[6] = {
+		column(0, 1.0f, 1.0f), column(0, 1.0f, -1.0f),
+		column(1, 1.0f, 1.0f), column(1, 1.0f, -1.0f),
+		column(2, 0.0f, 1.0f), column(2, 1.0f, -1.0f)
+	};
+	mSelected.clear();
+	mWanted.clear();
+	mRequests.clear();
+	mStats.MissingNodes = 0;
+	mStats.CoarseNodes = 0;
+	Refine(planes, View);
+	Select(mHeader.Root, FLT_MAX, planes, View);
+	// the drawn nodes and the ones waiting for their siblings stay, Refine left room for the missing ones
+	for (UINT index : mWanted) {
+		Touch(index);
+	}
+	for (UINT index : mSelected) {
+		Touch(index);
+	}
+	mStats.SelectedNodes = mSelected.size();
+	mStats.SelectedTriangles = 0;
+	for (UINT index : mSelected) {
+		mStats.SelectedTriangles += mNodes[index].IndexCount / 3;
+	}
+
+	// the nodes standing in for the largest errors on screen first, the coarser ones
+	std::stable_sort(mRequests.begin(), mRequests.end(), [](const Request& a, const Request& b) { return a.priority > b.priority; });
+	UINT requested = 0;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (const Request& request : mRequests) {
+			if (requested == mDesc.MaxLoadsPerFrame)
+				break;
+			const UINT slot = TakeSlot();
+			if (slot == NoSlot)
+				break;
+			mStates[request.node].state = NodePending;
+			Load load = { request.node, slot, false };
+			if (!mStaging.empty()) {
+				load.data.swap(mStaging.back());
+				mStaging.pop_back();
+			}
+			mLoads.push_back(std::move(load));
+			requested++;
+		}
+	}
+	mStats.PendingLoads += requested;
+	if (requested != 0)
+		mWakeUp.notify_one();
+}
+
+template<class Target>
+void SRGeometryStream::DrawTo(Target& target) {
+	if (mSelected.empty())
+		return;
+	target.SRIASetVertexBuffers(mVertexPool);
+	target.SRIASetIndexBuffers(mIndexPool, DXGI_FORMAT_R16_UINT);
+	for (UINT index : mSelected) {
+		const SRClusterNode& record = mNodes[index];
+		if (record.IndexCount == 0)
+			continue;
+		const UINT slot = mStates[index].slot;
+		target.SRDrawIndexedInstanced(record.IndexCount, 1, slot * mHeader.MaxIndexCount, slot * mHeader.MaxVertexCount, 0);
+	}
+}
+
+void SRGeometryStream::Draw() {
+	DrawTo(mDevice);
+}
+
+void SRGeometryStream::Record(SRCommandList& List) {
+	DrawTo(List);
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include "SRCommandList.h"
+
+/*
+ * Out-of-core meshes with a cluster LOD hierarchy.
+ * SRWriteClusterFile splits a mesh into clusters of at most ClusterTriangles triangles, the leaves of a binary tree.
+ * Every node above them holds its two children merged and simplified back to ClusterTriangles triangles by
+ * clustering the vertices on a grid, coarser the higher the node, together with the object space error of that.
+ * The grids of all nodes are aligned, neighbours drawn at the same error meet without cracks, neighbours drawn
+ * at different errors may leave gaps as wide as the larger error, under a pixel with the default MaxPixelError.
+ *
+ * SRGeometryStream draws such a file without loading it: every frame it selects the coarsest nodes whose error
+ * projects under MaxPixelError, so the triangle count follows the pixels covered rather than the mesh, requests
+ * the missing ones from a loader thread and draws the nearest resident coarser node meanwhile. The nodes live in
+ * the slots of a fixed geometry pool, the least recently selected ones are evicted to make room. When the pool
+ * can not hold that selection, the nodes of the largest projected errors are refined first as long as it fits.
+ */
+#define SRClusterFileMagic 0x4C435253u		// "SRCL"
+#define SRClusterFileVersion 1
+#define SRClusterNoChild 0xFFFFFFFFu
+// 3 vertices per triangle at most, within 16 bit indices
+#define SRMaxClusterTriangles 21845
+
+typedef struct SRClusterNode {
+	SRMeshBounds Bounds;		// of the original triangles below the node
+	float Error;				// object space distance the geometry may be off the original, 0 for the leaves
+	UINT32 Children[2];			// SRClusterNoChild for the leaves
+	UINT32 VertexCount;
+	UINT32 IndexCount;			// 16 bit, following the vertices
+	UINT32 Reserved;
+	UINT64 Offset;				// of the vertices in the file
+} SRClusterNode;
+
+typedef struct SRClusterFileHeader {
+	UINT32 Magic;
+	UINT32 Version;
+	UINT32 VertexStride;
+	UINT32 NodeCount;
+	UINT32 Root;
+	UINT32 MaxVertexCount;		// over all nodes
+	UINT32 MaxIndexCount;
+	UINT32 Reserved;
+	SRMeshBounds Bounds;
+	UINT64 NodesOffset;			// the SRClusterNode table, at the end of the file
+} SRClusterFileHeader;
+
+// the vertices of stream 0 of Desc with the float3 position at their start and all of its indices,
+// the other streams, the submeshes and the meshlets are not used.
+bool SRWriteClusterFile(const char* pFileName, const SRMeshFileDesc& Desc, UINT ClusterTriangles = 4096);
+
+typedef struct SRGeometryStreamDesc {
+	// bytes of the geometry pool, one slot per resident node of the largest size in the file.
+	// the selection gets coarser than MaxPixelError rather than outgrow it.
+	UINT64 MemoryBudget = UINT64(256) << 20;
+	// loads requested per Update, the others wait for the next frames
+	UINT MaxLoadsPerFrame = 32;
+	// the selected nodes are as coarse as this allows
+	float MaxPixelError = 1.0f;
+	// Updates a drawn node is kept for, the frames submitted to an SRCommandQueue and not completed yet
+	UINT FramesInFlight = 1;
+} SRGeometryStreamDesc;
+
+typedef struct SRGeometryView {
+	// world * view * projection of the mesh, for the frustum culling
+	DirectX::XMFLOAT4X4 WorldViewProj;
+	// camera position in the object space of the mesh
+	DirectX::XMFLOAT3 Eye;
+	// render target height / (2 * tan(fovY / 2)): pixels covered by a unit at distance 1
+	float PixelsPerUnit;
+} SRGeometryView;
+
+typedef struct SRGeometryStreamStatistics {
+	UINT64 ResidentNodes = 0;
+	UINT64 ResidentBytes = 0;		// of the slots in use
+	UINT64 Loads = 0;
+	UINT64 FailedLoads = 0;			// read errors or corrupted nodes, not requested again
+	UINT64 Evictions = 0;
+	UINT64 PendingLoads = 0;		// on the loader thread
+	UINT64 SelectedNodes = 0;		// by the last Update
+	UINT64 SelectedTriangles = 0;
+	UINT64 MissingNodes = 0;		// selected but not resident, a coarser node is drawn instead
+	UINT64 CoarseNodes = 0;			// over MaxPixelError and not refined, the pool is full
+} SRGeometryStreamStatistics;
+
+/*
+ * One cluster file streamed into a geometry pool of the device, a vertex buffer and a 16 bit index buffer
+ * created by Open. The root node is loaded by Open and stays resident, so there is always something to draw.
+ * Update and the draws on the thread that renders, the device outlives the stream.
+ * With an SRCommandQueue, FramesInFlight must cover the frames not completed when Update is called.
+ */
+class SRGeometryStream
+{
+public:
+	explicit SRGeometryStream(SRDevice& device) : mDevice(device) {};
+	SRGeometryStream(const SRGeometryStream& rhs) = delete;
+	SRGeometryStream& operator=(const SRGeometryStream& rhs) = delete;
+	// waits for the load in progress, releases the pool
+	~SRGeometryStream();
+
+	// false if the file can not be read or is corrupted, the pool can not be created or the stream is open already.
+	// a failed Open leaves the stream closed, it can be opened again.
+	bool Open(const char* pFileName, const SRGeometryStreamDesc& Desc);
+	void GetStatistics(SRGeometryStreamStatistics* pStats) const { *pStats = mStats; };
+
+	// take the finished loads, select the nodes for the view and request the missing ones
+	void Update(const SRGeometryView& View);
+	// bind the pool and draw the selected nodes, the pipeline state and the targets are the caller's
+	void Draw();
+	void Record(SRCommandList& List);
+
+private:
+	typedef enum NodeState {
+		NodeAbsent,
+		NodePending,
+		NodeResident,
+		NodeFailed							// the coarser nodes are drawn instead
+	} NodeState;
+
+	struct Node {
+		NodeState state = NodeAbsent;
+		UINT slot = 0;
+		UINT64 lastUsed = 0;				// Update of the last selection
+		UINT64 refined = 0;					// Update that replaced it by its children
+		std::list<UINT>::iterator lru;		// valid for the resident nodes but the root
+	};
+	struct Load {
+		UINT node;
+		UINT slot;
+		bool isSucceeded;
+		// the vertices then the indices read by the loader thread, copied into the slot by Adopt,
+		// so that the pool is only written on the application thread, as SRBeginCapture reads it
+		std::vector<BYTE> data;
+	};
+	struct Request {
+		UINT node;
+		float priority;						// projected error of the parent, the largest ones first
+	};
+
+	SRDevice& mDevice;
+	SRGeometryStreamDesc mDesc;
+	SRGeometryStreamStatistics mStats;
+	SRClusterFileHeader mHeader = {};
+	std::vector<SRClusterNode> mNodes;
+	std::vector<Node> mStates;
+	std::vector<UINT> mSelected;
+	// resident nodes of the selection, drawn or waiting for a sibling to load
+	std::vector<UINT> mWanted;
+	std::vector<Request> mRequests;
+	std::vector<std::pair<float, UINT>> mCandidates;	// (projected error, node) heap of Refine
+	UINT64 mFrame = 0;
+
+	// the pool, mapped as long as it lives
+	SRResourceHandle mVertexPool = SRDevice::InvalidHandle;
+	SRResourceHandle mIndexPool = SRDevice::InvalidHandle;
+	BYTE* mVertices = nullptr;
+	BYTE* mIndices = nullptr;
+	UINT mSlotCount = 0;
+	std::vector<UINT> mFreeSlots;
+	std::list<UINT> mLRU;					// resident nodes, most recently selected first
+	std::vector<std::vector<BYTE>> mStaging;	// data of the adopted loads, for the next ones
+
+	// loader thread, it alone reads the file after Open
+	FILE* mFile = nullptr;
+	std::thread mThread;
+	std::mutex mMutex;
+	std::condition_variable mWakeUp;
+	std::deque<Load> mLoads;
+	std::vector<Load> mCompleted;
+	bool mQuit = false;
+
+	// the part of Open that the stream is closed again after when it fails
+	bool OpenFile(const char* pFileName, const SRGeometryStreamDesc& Desc);
+	// stops the loader thread, releases the pool and forgets the file
+	void Close();
+	// false on read errors and for indices past the vertices of the node
+	bool ReadNode(UINT node, std::vector<BYTE>& data);
+	void ThreadMain();
+	// the nodes to draw their children instead, as many as the pool holds
+	void Refine(const DirectX::XMFLOAT4 planes[6], const SRGeometryView& view);
+	// nodes selected below index, false if some are missing with nothing resident to draw instead
+	bool Select(UINT index, float parentError, const DirectX::XMFLOAT4 planes[6], const SRGeometryView& view);
+	void Touch(UINT index);
+	// a free slot, evicting if all are used. none if the resident nodes are all in use.
+	UINT TakeSlot();
+	void Adopt(Load& load);
+	template<class Target> void DrawTo(Target& target);
+};
@@ -0,0 +1,213 @@
+#include "SRHeap.h"
+#include <algorithm>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static const size_t LargePageSize = size_t(2) << 20;
+static const UINT NoSlab = UINT(-1);
+
+static inline size_t alignSize(size_t size, size_t alignment) {
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+// memory of a slab, in large pages if asked for and the system has them
+static BYTE* allocateSlab(size_t size, bool useLargePages, bool& isLargePages) {
+	isLargePages = false;
+	if (useLargePages && size >= LargePageSize) {
+#ifdef _WIN32
+		SIZE_T pageSize = GetLargePageMinimum();
+		if (pageSize != 0) {
+			void* memory = VirtualAlloc(nullptr, alignSize(size, pageSize), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+				PAGE_READWRITE);
+			if (memory != nullptr) {
+				isLargePages = true;
+				return static_cast<BYTE*>(memory);
+			}
+		}
+#elif defined(__linux__)
+		// whole aligned 2 MB pages, the kernel backs them with huge pages as it can
+		const size_t alignedSize = alignSize(size, LargePageSize);
+		BYTE* memory = static_cast<BYTE*>(_aligned_malloc(alignedSize, LargePageSize));
+		if (memory != nullptr) {
+			isLargePages = madvise(memory, alignedSize, MADV_HUGEPAGE) == 0;
+			return memory;
+		}
+#endif
+	}
+	return static_cast<BYTE*>(_aligned_malloc(size, SRHeapAlignment));
+}
+
+static void freeSlab(BYTE* memory, bool isLargePages) {
+#ifdef _WIN32
+	if (isLargePages) {
+		VirtualFree(memory, 0, MEM_RELEASE);
+		return;
+	}
+#else
+	(void)isLargePages;
+#endif
+	_aligned_free(memory);
+}
+
+SRHeap::~SRHeap() {
+	for (const Slab& slab : mSlabs) {
+		if (slab.memory != nullptr)
+			freeSlab(slab.memory, slab.isLargePages);
+	}
+}
+
+UINT SRHeap::CreateSlab(size_t size, bool isDedicated) {
+	size = alignSize(size, SRHeapAlignment);
+	bool isLargePages;
+	BYTE* memory = allocateSlab(size, isDedicated && mDesc.LargePages, isLargePages);
+	if (memory == nullptr)
+		return NoSlab;
+
+	UINT index;
+	if (!mUnusedSlabs.empty()) {
+		index = mUnusedSlabs.back();
+		mUnusedSlabs.pop_back();
+	}
+	else {
+		index = UINT(mSlabs.size());
+		mSlabs.emplace_back();
+	}
+	Slab& slab = mSlabs[index];
+	slab.memory = memory;
+	slab.size = size;
+	slab.isDedicated = isDedicated;
+	slab.isLargePages = isLargePages;
+	slab.allocated = 0;
+	if (!isDedicated)
+		InsertFreeRange(index, 0, size);
+
+	(isDedicated ? mStats.DedicatedSlabs : mStats.Slabs)++;
+	if (isLargePages)
+		mStats.LargePageSlabs++;
+	mStats.ReservedBytes += size;
+	return index;
+}
+
+void SRHeap::DestroySlab(UINT index) {
+	Slab& slab = mSlabs[index];
+	for (auto& range : slab.freeRanges) {
+		mFreeBySize.erase(range.second);
+	}
+	slab.freeRanges.clear();
+	freeSlab(slab.memory, slab.isLargePages);
+	slab.memory = nullptr;
+	mUnusedSlabs.push_back(index);
+
+	(slab.isDedicated ? mStats.DedicatedSlabs : mStats.Slabs)--;
+	if (slab.isLargePages)
+		mStats.LargePageSlabs--;
+	mStats.ReservedBytes -= slab.size;
+}
+
+void SRHeap::InsertFreeRange(UINT slab, size_t offset, size_t size) {
+	mSlabs[slab].freeRanges[offset] = mFreeBySize.emplace(size, std::make_pair(slab, offset));
+}
+
+void SRHeap::EraseFreeRange(UINT slab, std::map<size_t, FreeBySize::iterator>::iterator range) {
+	mFreeBySize.erase(range->second);
+	mSlabs[slab].freeRanges.erase(range);
+}
+
+BYTE* SRHeap::Allocate(size_t size) {
+	size = alignSize((std::max)(size, size_t(1)), SRHeapAlignment);
+	UINT slab;
+	size_t offset = 0;
+	if (size > mDesc.SlabSize / 4) {
+		slab = CreateSlab(size, true);
+		if (slab == NoSlab)
+			return nullptr;
+	}
+	else {
+		// the smallest free range that fits
+		auto fit = mFreeBySize.lower_bound(size);
+		if (fit == mFreeBySize.end()) {
+			if (CreateSlab(size_t(mDesc.SlabSize), false) == NoSlab)
+				return nullptr;
+			fit = mFreeBySize.lower_bound(size);
+		}
+		slab = fit->second.first;
+		offset = fit->second.second;
+		const size_t rangeSize = fit->first;
+		EraseFreeRange(slab, mSlabs[slab].freeRanges.find(offset));
+		if (rangeSize > size)
+			InsertFreeRange(slab, offset + size, rangeSize - size);
+		if (slab == mEmptySlab)
+			mEmptySlab = NoSlab;
+	}
+
+	mSlabs[slab].allocated += size;
+	BYTE* ptr = mSlabs[slab].memory + offset;
+	mBlocks[ptr] = { slab, offset, size };
+	mStats.Allocations++;
+	mStats.AllocatedBytes += size;
+	return ptr;
+}
+
+BYTE* SRHeap::Reallocate(BYTE* ptr, size_t size) {
+	if (ptr == nullptr)
+		return Allocate(size);
+	auto block = mBlocks.find(ptr);
+	if (block == mBlocks.end())
+		return nullptr;
+	const size_t oldSize = block->second.size;
+	if (alignSize((std::max)(size, size_t(1)), SRHeapAlignment) == oldSize)
+		return ptr;
+	BYTE* newPtr = Allocate(size);
+	if (newPtr == nullptr)
+		return nullptr;
+	memcpy(newPtr, ptr, (std::min)(oldSize, size));
+	Free(ptr);
+	return newPtr;
+}
+
+void SRHeap::Free(BYTE* ptr) {
+	if (ptr == nullptr)
+		return;
+	auto found = mBlocks.find(ptr);
+	if (found == mBlocks.end())
+		return;
+	const Block block = found->second;
+	mBlocks.erase(found);
+	mStats.Allocations--;
+	mStats.AllocatedBytes -= block.size;
+
+	Slab& slab = mSlabs[block.slab];
+	slab.allocated -= block.size;
+	if (slab.isDedicated) {
+		DestroySlab(block.slab);
+		return;
+	}
+
+	// merged with the free ranges right after and right before it
+	size_t offset = block.offset, size = block.size;
+	auto next = slab.freeRanges.lower_bound(offset);
+	if (next != slab.freeRanges.end() && next->first == offset + size) {
+		size += next->second->first;
+		EraseFreeRange(block.slab, next);
+	}
+	auto previous = slab.freeRanges.lower_bound(offset);
+	if (previous != slab.freeRanges.begin()) {
+		--previous;
+		if (previous->first + previous->second->first == offset) {
+			offset = previous->first;
+			size += previous->second->first;
+			EraseFreeRange(block.slab, previous);
+		}
+	}
+	InsertFreeRange(block.slab, offset, size);
+
+	if (slab.allocated == 0 && block.slab != mEmptySlab) {
+		// one empty slab is kept, creating and releasing a small resource does not allocate a slab every time
+		if (mEmptySlab != NoSlab)
+			DestroySlab(mEmptySlab);
+		mEmptySlab = block.slab;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "SRPlatform.h"
+
+// every allocation starts on a cache line, for the aligned SIMD loads / stores and streaming stores
+#define SRHeapAlignment 64
+
+/*
+ * Memory of the resources of a device, after ID3D12Heap.
+ * Small resources are placed in large slabs, best fit with the free ranges merged again on release,
+ * so that many small buffers share a few allocations. Resources larger than a quarter of a slab
+ * get a slab of their own, returned to the system when released.
+ */
+typedef struct SRHeapDesc {
+	// bytes of a shared slab
+	UINT64 SlabSize = UINT64(16) << 20;
+	// back the resources with a slab of their own (render targets, depth buffers, large textures)
+	// with 2 MB pages: transparent huge pages on Linux, large pages on Windows when the process
+	// holds SeLockMemoryPrivilege. falls back to normal pages.
+	bool LargePages = false;
+} SRHeapDesc;
+
+typedef struct SRHeapStatistics {
+	UINT64 Allocations = 0;
+	UINT64 AllocatedBytes = 0;		// aligned sizes of the allocations
+	UINT64 Slabs = 0;				// shared slabs
+	UINT64 DedicatedSlabs = 0;		// slabs of a single allocation
+	UINT64 LargePageSlabs = 0;		// of those, the ones backed by large pages
+	UINT64 ReservedBytes = 0;		// all slabs
+} SRHeapStatistics;
+
+class SRHeap
+{
+public:
+	SRHeap() = default;
+	SRHeap(const SRHeap& rhs) = delete;
+	SRHeap& operator=(const SRHeap& rhs) = delete;
+	~SRHeap();
+
+	// applies to the slabs created from then on
+	void SetDesc(const SRHeapDesc& desc) { mDesc = desc; };
+	void GetStatistics(SRHeapStatistics* pStats) const { *pStats = mStats; };
+
+	// SRHeapAlignment aligned, nullptr when out of memory
+	BYTE* Allocate(size_t size);
+	// the contents up to the smaller size are kept, ptr stays valid when this fails
+	BYTE* Reallocate(BYTE* ptr, size_t size);
+	// ptr may be nullptr
+	void Free(BYTE* ptr);
+
+private:
+	typedef std::multimap<size_t, std::pair<UINT, size_t>> FreeBySize;	// size -> (slab, offset)
+	struct Slab {
+		BYTE* memory;
+		size_t size;
+		bool isDedicated;
+		bool isLargePages;
+		size_t allocated;
+		std::map<size_t, FreeBySize::iterator> freeRanges;	// by offset, merged with their neighbours
+	};
+	struct Block {
+		UINT slab;
+		size_t offset;
+		size_t size;
+	};
+
+	UINT CreateSlab(size_t size, bool isDedicated);
+	void DestroySlab(UINT slab);
+	void InsertFreeRange(UINT slab, size_t offset, size_t size);
+	void EraseFreeRange(UINT slab, std::map<size_t, FreeBySize::iterator>::iterator range);
+
+	SRHeapDesc mDesc;
+	SRHeapStatistics mStats;
+	std::vector<Slab> mSlabs;
+	std::vector<UINT> mUnusedSlabs;								// indices of destroyed slabs
+	FreeBySize mFreeBySize;										// all free ranges, for the best fit
+	std::unordered_map<const BYTE*, Block> mBlocks;
+	UINT mEmptySlab = UINT(-1);									// a shared slab kept for the next allocations
+};
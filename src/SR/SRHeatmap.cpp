@@ -0,0 +1,152 @@
+#include "SRDevice.h"
+#include "SRUtils.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Per tile diagnostic counters and their export.
+ * The images are written at render target resolution, one flat 8 * 8 block per tile,
+ * so they can be laid over the frame.
+ */
+
+static double CounterValue(const SRTileCounters& counters, SRHeatmapCounter counter, UINT tilePixels) {
+	switch (counter) {
+	case SRHeatmapCounterTrianglesTested:
+		return counters.TrianglesTested;
+	case SRHeatmapCounterTrianglesAccepted:
+		return counters.TrianglesAccepted;
+	case SRHeatmapCounterPixelsShaded:
+		return counters.PixelsShaded;
+	case SRHeatmapCounterOverdraw:
+		return double(counters.PixelsShaded) / tilePixels;
+	default:
+		return double(counters.Cycles);
+	}
+}
+
+// blue - cyan - green - yellow - red
+static void FalseColor(double t, BYTE rgb[3]) {
+	static const float Stops[5][3] = {
+		{ 0.0f, 0.0f, 1.0f },
+		{ 0.0f, 1.0f, 1.0f },
+		{ 0.0f, 1.0f, 0.0f },
+		{ 1.0f, 1.0f, 0.0f },
+		{ 1.0f, 0.0f, 0.0f }
+	};
+	double x = clamp(float(t)) * 4.0;
+	int n = (std::min)(int(x), 3);
+	double f = x - n;
+	for (int c = 0; c < 3; c++) {
+		rgb[c] = BYTE((Stops[n][c] + (Stops[n + 1][c] - Stops[n][c]) * f) * 255.0 + 0.5);
+	}
+}
+
+void SRDevice::SREnableTileHeatmap(bool Enable) {
+	if (Enable == mTileHeatmap)
+		return;
+	mTileHeatmap = Enable;
+	ResizeTileCounters(((mInternalRenderTargetWidth + 7) / 8) * ((mInternalRenderTargetHeight + 7) / 8));
+}
+
+void SRDevice::ResizeTileCounters(UINT tileCount) {
+	free(mInternalTileCounters);
+	free(mInternalTileCountersHistory);
+	mInternalTileCounters = nullptr;
+	mInternalTileCountersHistory = nullptr;
+
+	if (!mTileHeatmap || tileCount == 0)
+		return;
+
+	mInternalTileCounters = (SRTileCounters*)calloc(tileCount, sizeof(SRTileCounters));
+	mInternalTileCountersHistory = (SRTileCounters*)calloc(tileCount, sizeof(SRTileCounters));
+	if (mInternalTileCounters == nullptr || mInternalTileCountersHistory == nullptr) {
+		free(mInternalTileCounters);
+		free(mInternalTileCountersHistory);
+		mInternalTileCounters = nullptr;
+		mInternalTileCountersHistory = nullptr;
+		SRFatal(L"Tile counter alloc error.");
+	}
+}
+
+void SRDevice::SRGetTileHeatmap(const SRTileCounters** ppCounters, UINT* pTileWidth, UINT* pTileHeight) {
+	*ppCounters = mInternalTileCountersHistory;
+	*pTileWidth = (mInternalRenderTargetWidth + 7) / 8;
+	*pTileHeight = (mInternalRenderTargetHeight + 7) / 8;
+}
+
+bool SRDevice::SRSaveTileHeatmap(const char* pFileName, SRHeatmapCounter Counter, SRHeatmapFormat Format) {
+	const SRTileCounters* counters = mInternalTileCountersHistory;
+	if (counters == nullptr) {
+		SRError(L"Tile heatmap is not enabled.");
+		return false;
+	}
+
+	const UINT w = mInternalRenderTargetWidth, h = mInternalRenderTargetHeight;
+	const UINT tileWidth = (w + 7) / 8;
+	const UINT tileCount = tileWidth * ((h + 7) / 8);
+	// tiles on the right and bottom border may be cut by the render target
+	auto tilePixels = [=](UINT tile) {
+		UINT i = tile % tileWidth, j = tile / tileWidth;
+		return (std::min)(8u, w - 8 * i) * (std::min)(8u, h - 8 * j);
+	};
+
+	FILE* file = fopen(pFileName, Format == SRHeatmapFormatCSV ? "w" : "wb");
+	if (file == nullptr) {
+		SRError(L"Unable to open the heatmap file.");
+		return false;
+	}
+
+	if (Format == SRHeatmapFormatCSV) {
+		fprintf(file, "tile_x,tile_y,triangles_tested,triangles_accepted,pixels_shaded,pixels_written,overdraw,cycles\n");
+		for (UINT tile = 0; tile < tileCount; tile++) {
+			const SRTileCounters& c = counters[tile];
+			fprintf(file, "%u,%u,%u,%u,%u,%u,%.4f,%llu\n", tile % tileWidth, tile / tileWidth,
+				c.TrianglesTested, c.TrianglesAccepted, c.PixelsShaded, c.PixelsWritten,
+				CounterValue(c, SRHeatmapCounterOverdraw, tilePixels(tile)), (unsigned long long)c.Cycles);
+		}
+		fclose(file);
+		return true;
+	}
+
+	// normalized by the 99th percentile, a single preempted tile would flatten the cycles otherwise
+	double* values = (double*)malloc(tileCount * sizeof(double));
+	if (values == nullptr) {
+		fclose(file);
+		SRError(L"Out of memory");
+		return false;
+	}
+	for (UINT tile = 0; tile < tileCount; tile++) {
+		values[tile] = CounterValue(counters[tile], Counter, tilePixels(tile));
+	}
+	UINT percentile = UINT(0.99 * (tileCount - 1));
+	std::nth_element(values, values + percentile, values + tileCount);
+	double maxValue = values[percentile];
+	if (maxValue <= 0.0)
+		maxValue = *std::max_element(values, values + tileCount);
+	free(values);
+	const double scale = maxValue > 0.0 ? 1.0 / maxValue : 0.0;
+
+	const UINT channels = Format == SRHeatmapFormatGrayscale ? 1 : 3;
+	BYTE* row = (BYTE*)malloc(w * channels);
+	if (row == nullptr) {
+		fclose(file);
+		SRError(L"Out of memory");
+		return false;
+	}
+	fprintf(file, "%s\n%u %u\n255\n", channels == 1 ? "P5" : "P6", w, h);
+	for (UINT y = 0; y < h; y++) {
+		for (UINT x = 0; x < w; x++) {
+			UINT tile = (y / 8) * tileWidth + x / 8;
+			double t = (std::min)(CounterValue(counters[tile], Counter, tilePixels(tile)) * scale, 1.0);
+			if (channels == 1)
+				row[x] = BYTE(t * 255.0 + 0.5);
+			else
+				FalseColor(t, row + 3 * x);
+		}
+		fwrite(row, channels, w, file);
+	}
+	free(row);
+	fclose(file);
+	return true;
+}
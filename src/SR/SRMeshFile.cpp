@@ -0,0 +1,337 @@
+#include "SRMeshFile.h"
+#include "SRDevice.h"
+#include "SRCapture.h"
+#include "SRUtils.h"
+#include <algorithm>
+#include <float.h>
+#include <limits.h>
+#include <stdio.h>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DirectX;
+
+static inline UINT64 alignOffset(UINT64 offset) {
+	return (offset + SRMeshFileAlignment - 1) & ~UINT64(SRMeshFileAlignment - 1);
+}
+
+static inline UINT indexAt(const void* pIndices, DXGI_FORMAT format, size_t n) {
+	return format == DXGI_FORMAT_R16_UINT ? static_cast<const UINT16*>(pIndices)[n] : static_cast<const UINT32*>(pIndices)[n];
+}
+
+// the indices [start, start + count) plus baseVertex address vertices below vertexCount
+static bool validIndices(const void* pIndices, DXGI_FORMAT format, UINT start, UINT count, UINT baseVertex, UINT vertexCount) {
+	UINT largest = 0;
+	for (size_t n = start; n < size_t(start) + count; n++) {
+		largest = (std::max)(largest, indexAt(pIndices, format, n));
+	}
+	return count == 0 || UINT64(baseVertex) + largest < vertexCount;
+}
+
+static inline SRMeshBounds emptyBounds() {
+	return { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+}
+
+static inline void growBounds(SRMeshBounds& bounds, const XMFLOAT3& p) {
+	bounds.Min = XMFLOAT3((std::min)(bounds.Min.x, p.x), (std::min)(bounds.Min.y, p.y), (std::min)(bounds.Min.z, p.z));
+	bounds.Max = XMFLOAT3((std::max)(bounds.Max.x, p.x), (std::max)(bounds.Max.y, p.y), (std::max)(bounds.Max.z, p.z));
+}
+
+static inline void growBounds(SRMeshBounds& bounds, const SRMeshBounds& other) {
+	growBounds(bounds, other.Min);
+	growBounds(bounds, other.Max);
+}
+
+/*
+ * writer
+ */
+// the positions of the indices [start, start + count) of stream 0
+static SRMeshBounds boundsOf(const SRMeshFileDesc& desc, UINT start, UINT count, UINT baseVertex) {
+	SRMeshBounds bounds = emptyBounds();
+	const BYTE* positions = static_cast<const BYTE*>(desc.pStreams[0]);
+	for (UINT n = start; n < start + count; n++) {
+		const size_t vertex = size_t(baseVertex) + indexAt(desc.pIndices, desc.IndexFormat, n);
+		growBounds(bounds, *reinterpret_cast<const XMFLOAT3*>(positions + vertex * desc.StreamStrides[0]));
+	}
+	return bounds;
+}
+
+static bool writeSection(FILE* file, UINT64& offset, const void* pData, UINT64 size, SRMeshFileSection& section) {
+	static const BYTE zeros[SRMeshFileAlignment] = {};
+	const UINT64 aligned = alignOffset(offset);
+	if (fwrite(zeros, 1, size_t(aligned - offset), file) != aligned - offset)
+		return false;
+	section = { aligned, size };
+	offset = aligned + size;
+	return size == 0 || fwrite(pData, 1, size_t(size), file) == size;
+}
+
+bool SRWriteMeshFile(const char* pFileName, const SRMeshFileDesc& Desc) {
+	if (Desc.StreamCount == 0 || Desc.StreamCount > SRMeshMaxStreams || Desc.VertexCount == 0 ||
+		Desc.pIndices == nullptr || Desc.IndexCount == 0 || Desc.IndexCount % 3 != 0 ||
+		(Desc.IndexFormat != DXGI_FORMAT_R16_UINT && Desc.IndexFormat != DXGI_FORMAT_R32_UINT) || Desc.StreamStrides[0] < sizeof(XMFLOAT3))
+		return false;
+	for (UINT i = 0; i < Desc.StreamCount; i++) {
+		if (Desc.pStreams[i] == nullptr || Desc.StreamStrides[i] == 0)
+			return false;
+	}
+
+	std::vector<SRSubmesh> submeshes;
+	if (Desc.pSubmeshes != nullptr)
+		submeshes.assign(Desc.pSubmeshes, Desc.pSubmeshes + Desc.SubmeshCount);
+	else
+		submeshes.push_back({ 0, Desc.IndexCount, 0, 0, {} });
+
+	SRMeshFileHeader header = {};
+	header.Bounds = emptyBounds();
+	std::vector<SRMeshlet> meshlets;
+	for (UINT s = 0; s < UINT(submeshes.size()); s++) {
+		SRSubmesh& submesh = submeshes[s];
+		// empty submeshes have no bounds to merge into the mesh's
+		if (UINT64(submesh.StartIndex) + submesh.IndexCount > Desc.IndexCount || submesh.IndexCount == 0 ||
+			submesh.IndexCount % 3 != 0 ||
+			!validIndices(Desc.pIndices, Desc.IndexFormat, submesh.StartIndex, submesh.IndexCount, submesh.BaseVertex, Desc.VertexCount))
+			return false;
+		submesh.Bounds = boundsOf(Desc, submesh.StartIndex, submesh.IndexCount, submesh.BaseVertex);
+		growBounds(header.Bounds, submesh.Bounds);
+		if (Desc.MeshletTriangles == 0)
+			continue;
+		for (UINT start = 0; start < submesh.IndexCount; start += 3 * Desc.MeshletTriangles) {
+			SRMeshlet meshlet;
+			meshlet.StartIndex = submesh.StartIndex + start;
+			meshlet.IndexCount = (std::min)(3 * Desc.MeshletTriangles, submesh.IndexCount - start);
+			meshlet.BaseVertex = submesh.BaseVertex;
+			meshlet.Submesh = s;
+			meshlet.Bounds = boundsOf(Desc, meshlet.StartIndex, meshlet.IndexCount, meshlet.BaseVertex);
+			meshlets.push_back(meshlet);
+		}
+	}
+
+	FILE* file = fopen(pFileName, "wb");
+	if (file == nullptr)
+		return false;
+	header.Magic = SRMeshFileMagic;
+	header.Version = SRMeshFileVersion;
+	header.VertexCount = Desc.VertexCount;
+	header.IndexCount = Desc.IndexCount;
+	header.IndexFormat = UINT32(Desc.IndexFormat);
+	header.StreamCount = Desc.StreamCount;
+	header.SubmeshCount = UINT32(submeshes.size());
+	header.MeshletCount = UINT32(meshlets.size());
+
+	// the header is written again once the sections are placed
+	bool isSucceeded = fwrite(&header, sizeof(header), 1, file) == 1;
+	UINT64 offset = sizeof(header);
+	for (UINT i = 0; i < Desc.StreamCount && isSucceeded; i++) {
+		header.StreamStrides[i] = Desc.StreamStrides[i];
+		isSucceeded = writeSection(file, offset, Desc.pStreams[i], UINT64(Desc.VertexCount) * Desc.StreamStrides[i], header.Streams[i]);
+	}
+	const UINT indexSize = Desc.IndexFormat == DXGI_FORMAT_R16_UINT ? sizeof(UINT16) : sizeof(UINT32);
+	isSucceeded = isSucceeded &&
+		writeSection(file, offset, Desc.pIndices, UINT64(Desc.IndexCount) * indexSize, header.Indices) &&
+		writeSection(file, offset, submeshes.data(), submeshes.size() * sizeof(SRSubmesh), header.Submeshes) &&
+		writeSection(file, offset, meshlets.data(), meshlets.size() * sizeof(SRMeshlet), header.Meshlets) &&
+		fseek(file, 0, SEEK_SET) == 0 &&
+		fwrite(&header, sizeof(header), 1, file) == 1;
+	return fclose(file) == 0 && isSucceeded;
+}
+
+/*
+ * mapping
+ */
+SRMappedFile::~SRMappedFile() {
+	if (mData == nullptr)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(mData);
+#else
+	munmap(const_cast<BYTE*>(mData), mSize);
+#endif
+}
+
+bool SRMappedFile::Open(const char* pFileName) {
+	if (mData != nullptr)
+		return false;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &size) && size.QuadPart != 0)
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr)
+		return false;
+	// the view keeps the mapping alive
+	mData = static_cast<const BYTE*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	CloseHandle(mapping);
+	if (mData == nullptr)
+		return false;
+	mSize = size_t(size.QuadPart);
+#else
+	int file = open(pFileName, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	void* data = MAP_FAILED;
+	if (fstat(file, &status) == 0 && status.st_size != 0)
+		data = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+	if (data == MAP_FAILED)
+		return false;
+	mData = static_cast<const BYTE*>(data);
+	mSize = size_t(status.st_size);
+#endif
+	return true;
+}
+
+/*
+ * loader
+ */
+static bool validSection(const SRMeshFileSection& section, UINT64 expectedSize, size_t fileSize) {
+	return section.Size == expectedSize && section.Offset % SRMeshFileAlignment == 0 &&
+		section.Offset <= fileSize && section.Size <= fileSize - section.Offset;
+}
+
+bool SRDevice::SRLoadMeshFile(const char* pFileName, SRMesh* pMesh) {
+	auto file = std::make_shared<SRMappedFile>();
+	if (!file->Open(pFileName)) {
+		SRError(L"Can not map the mesh file.");
+		return false;
+	}
+	if (file->Size() < sizeof(SRMeshFileHeader)) {
+		SRError(L"Not a mesh file.");
+		return false;
+	}
+	const SRMeshFileHeader& header = *reinterpret_cast<const SRMeshFileHeader*>(file->Data());
+	if (header.Magic != SRMeshFileMagic || header.Version != SRMeshFileVersion) {
+		SRError(L"Not a mesh file or of another version.");
+		return false;
+	}
+
+	const DXGI_FORMAT indexFormat = DXGI_FORMAT(header.IndexFormat);
+	bool isValid = header.StreamCount != 0 && header.StreamCount <= SRMeshMaxStreams && header.VertexCount != 0 &&
+		header.IndexCount != 0 && ValidIndexFormat(indexFormat);
+	for (UINT i = 0; i < header.StreamCount && isValid; i++) {
+		isValid = header.StreamStrides[i] != 0 &&
+			validSection(header.Streams[i], UINT64(header.VertexCount) * header.StreamStrides[i], file->Size());
+	}
+	const UINT indexSize = indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(UINT16) : sizeof(UINT32);
+	isValid = isValid &&
+		validSection(header.Indices, UINT64(header.IndexCount) * indexSize, file->Size()) &&
+		validSection(header.Submeshes, UINT64(header.SubmeshCount) * sizeof(SRSubmesh), file->Size()) &&
+		validSection(header.Meshlets, UINT64(header.MeshletCount) * sizeof(SRMeshlet), file->Size());
+	if (!isValid) {
+		SRError(L"Corrupted mesh file.");
+		return false;
+	}
+	// draws of the submeshes and meshlets stay in the index buffer. the index values are checked by the draws
+	// reading them, see ValidMeshFileDraw, scanning them here would read every page of the indices.
+	const SRSubmesh* submeshes = reinterpret_cast<const SRSubmesh*>(file->Data() + header.Submeshes.Offset);
+	const SRMeshlet* meshlets = reinterpret_cast<const SRMeshlet*>(file->Data() + header.Meshlets.Offset);
+	for (UINT i = 0; i < header.SubmeshCount && isValid; i++) {
+		const SRSubmesh& submesh = submeshes[i];
+		isValid = UINT64(submesh.StartIndex) + submesh.IndexCount <= header.IndexCount;
+	}
+	for (UINT i = 0; i < header.MeshletCount && isValid; i++) {
+		const SRMeshlet& meshlet = meshlets[i];
+		isValid = UINT64(meshlet.StartIndex) + meshlet.IndexCount <= header.IndexCount && meshlet.Submesh < header.SubmeshCount;
+	}
+	if (!isValid) {
+		SRError(L"Corrupted mesh file.");
+		return false;
+	}
+
+	SRMesh mesh;
+	mesh.StreamCount = header.StreamCount;
+	mesh.VertexCount = header.VertexCount;
+	mesh.IndexFormat = indexFormat;
+	mesh.IndexCount = header.IndexCount;
+	mesh.Bounds = header.Bounds;
+	mesh.pSubmeshes = submeshes;
+	mesh.SubmeshCount = header.SubmeshCount;
+	mesh.pMeshlets = meshlets;
+	mesh.MeshletCount = header.MeshletCount;
+	std::vector<SRResourceHandle> handles;
+	for (UINT i = 0; i <= header.StreamCount; i++) {
+		const SRMeshFileSection& section = i < header.StreamCount ? header.Streams[i] : header.Indices;
+		SRResourceHandle handle;
+		if (!CreateMappedBuffer(file, section.Offset, section.Size, &handle)) {
+			for (SRResourceHandle created : handles) {
+				mInternalMappedFiles.erase(created);
+				mResources[created].ptr = nullptr;
+				mInternalFreeHandles.push_back(created);
+			}
+			return false;
+		}
+		handles.push_back(handle);
+	}
+	for (UINT i = 0; i < SRMeshMaxStreams; i++) {
+		mesh.Streams[i] = i < header.StreamCount ? handles[i] : InvalidHandle;
+		mesh.StreamStrides[i] = i < header.StreamCount ? header.StreamStrides[i] : 0;
+	}
+	mesh.IndexBuffer = handles.back();
+
+	// the replay creates the buffers from their contents
+	if (mCapture != nullptr) {
+		for (SRResourceHandle handle : handles) {
+			const SRResource& resource = mResources[handle];
+			SRResourceDescription desc;
+			desc.DIMENSION = SRResourceDimensionBuffer;
+			desc.FORMAT = DXGI_FORMAT_UNKNOWN;
+			desc.WIDTH = resource.WIDTH;
+			desc.HEIGHT = 1;
+			desc.DEPTH = 1;
+			mCapture->CreateResource(desc, handle);
+			mCapture->CopyToResource(handle, resource.ptr, resource.WIDTH);
+		}
+	}
+	*pMesh = mesh;
+	return true;
+}
+
+bool SRDevice::ValidMeshFileDraw(SRResourceHandle vertexBuffer, UINT stride, SRResourceHandle indexBuffer, DXGI_FORMAT format,
+	UINT start, UINT count, UINT baseVertex)
+{
+	if (!IsReadOnly(vertexBuffer) && !IsReadOnly(indexBuffer))
+		return true;
+	const SRResource& indices = mResources[indexBuffer];
+	const UINT64 indexSize = format == DXGI_FORMAT_R16_UINT ? sizeof(UINT16) : sizeof(UINT32);
+	if ((UINT64(start) + count) * indexSize > indices.WIDTH)
+		return false;
+	const UINT vertexCount = stride == 0 ? UINT_MAX : mResources[vertexBuffer].WIDTH / stride;
+	return validIndices(indices.ptr, format, start, count, baseVertex, vertexCount);
+}
+
+bool SRDevice::CreateMappedBuffer(const std::shared_ptr<SRMappedFile>& file, UINT64 offset, UINT64 size, SRResourceHandle* pHandle) {
+	if (size > UINT_MAX) {
+		SRError(L"Buffer larger than 4 GB.");
+		return false;
+	}
+	if (mInternalFreeHandles.empty()) {
+		SRError(L"No available handle.");
+		return false;
+	}
+	SRResourceDescription desc;
+	desc.DIMENSION = SRResourceDimensionBuffer;
+	desc.FORMAT = DXGI_FORMAT_UNKNOWN;
+	desc.WIDTH = UINT(size);
+	desc.HEIGHT = 1;
+	desc.DEPTH = 1;
+	const SRResourceHandle handle = mInternalFreeHandles.back();
+	SRResource& resource = mResources[handle];
+	FillResouceAttribute(desc, resource);
+	// never written through, the write paths check IsReadOnly
+	resource.ptr = const_cast<BYTE*>(file->Data() + offset);
+	mInternalFreeHandles.pop_back();
+	mInternalMappedFiles[handle] = file;
+	*pHandle = handle;
+	return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include "SRPlatform.h"
+
+/*
+ * Binary mesh container, laid out to be drawn in place.
+ * SRDevice::SRLoadMeshFile maps the file read-only and creates buffer resources pointing into the mapping:
+ * loading copies nothing, the pages are read from disk when first drawn and are shared through the page cache
+ * with every process mapping the same file. SRWriteMeshFile writes one.
+ *
+ * Layout, little-endian: SRMeshFileHeader, then the sections it points to, each one SRMeshFileAlignment aligned:
+ * the vertex streams, the indices, the submeshes and the meshlets.
+ */
+#define SRMeshFileMagic 0x464D5253u		// "SRMF"
+#define SRMeshFileVersion 1
+#define SRMeshFileAlignment 64
+// vertex streams of a mesh, e.g. the positions alone for the depth pass and the other attributes
+#define SRMeshMaxStreams 4
+
+typedef struct SRMeshBounds {
+	DirectX::XMFLOAT3 Min;
+	DirectX::XMFLOAT3 Max;
+} SRMeshBounds;
+
+// a part of the mesh, drawn with one SRDrawIndexedInstanced
+typedef struct SRSubmesh {
+	UINT StartIndex;
+	UINT IndexCount;
+	UINT BaseVertex;
+	UINT Reserved;
+	SRMeshBounds Bounds;
+} SRSubmesh;
+
+// a run of triangles of a submesh, to cull finer than submeshes
+typedef struct SRMeshlet {
+	UINT StartIndex;
+	UINT IndexCount;
+	UINT BaseVertex;
+	UINT Submesh;
+	SRMeshBounds Bounds;
+} SRMeshlet;
+
+typedef struct SRMeshFileSection {
+	UINT64 Offset;			// from the start of the file
+	UINT64 Size;			// bytes
+} SRMeshFileSection;
+
+typedef struct SRMeshFileHeader {
+	UINT32 Magic;
+	UINT32 Version;
+	UINT32 VertexCount;
+	UINT32 IndexCount;
+	UINT32 IndexFormat;		// DXGI_FORMAT_R16_UINT or DXGI_FORMAT_R32_UINT
+	UINT32 StreamCount;
+	UINT32 StreamStrides[SRMeshMaxStreams];
+	UINT32 SubmeshCount;
+	UINT32 MeshletCount;
+	SRMeshBounds Bounds;
+	SRMeshFileSection Streams[SRMeshMaxStreams];
+	SRMeshFileSection Indices;
+	SRMeshFileSection Submeshes;
+	SRMeshFileSection Meshlets;
+} SRMeshFileHeader;
+
+// what SRWriteMeshFile writes. the bounds are taken from the float3 position at the start of every vertex of stream 0.
+typedef struct SRMeshFileDesc {
+	UINT StreamCount = 1;
+	const void* pStreams[SRMeshMaxStreams] = {};
+	UINT StreamStrides[SRMeshMaxStreams] = {};
+	UINT VertexCount = 0;
+	const void* pIndices = nullptr;
+	DXGI_FORMAT IndexFormat = DXGI_FORMAT_R32_UINT;
+	UINT IndexCount = 0;
+	// their bounds are filled in, none may be empty. nullptr for one submesh of all indices.
+	const SRSubmesh* pSubmeshes = nullptr;
+	UINT SubmeshCount = 0;
+	// triangles per meshlet, the submeshes are cut into runs of them. 0 for no meshlets.
+	UINT MeshletTriangles = 0;
+} SRMeshFileDesc;
+
+// false as well when an index of a submesh plus its BaseVertex is not below VertexCount
+bool SRWriteMeshFile(const char* pFileName, const SRMeshFileDesc& Desc);
+
+// a mesh loaded by SRDevice::SRLoadMeshFile
+typedef struct SRMesh {
+	UINT StreamCount;
+	UINT Streams[SRMeshMaxStreams];			// vertex buffer handles
+	UINT StreamStrides[SRMeshMaxStreams];
+	UINT VertexCount;
+	UINT IndexBuffer;						// handle, bound with IndexFormat
+	DXGI_FORMAT IndexFormat;
+	UINT IndexCount;
+	SRMeshBounds Bounds;
+	// in the mapping, valid as long as any of the buffers is
+	const SRSubmesh* pSubmeshes;
+	UINT SubmeshCount;
+	const SRMeshlet* pMeshlets;
+	UINT MeshletCount;
+} SRMesh;
+
+/*
+ * A file mapped read-only, unmapped when destroyed.
+ */
+class SRMappedFile
+{
+public:
+	SRMappedFile() = default;
+	SRMappedFile(const SRMappedFile& rhs) = delete;
+	SRMappedFile& operator=(const SRMappedFile& rhs) = delete;
+	~SRMappedFile();
+
+	// fails for empty files
+	bool Open(const char* pFileName);
+	const BYTE* Data() const { return mData; };
+	size_t Size() const { return mSize; };
+
+private:
+	const BYTE* mData = nullptr;
+	size_t mSize = 0;
+};
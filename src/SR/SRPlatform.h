@@ -0,0 +1,39 @@
+#pragma once
+
+/*
+ * The SR core only needs a few Windows types and intrinsics,
+ * everything else is plain C++ so it builds with GCC / Clang on Linux.
+ */
+#ifdef _WIN32
+
+#include <windows.h>
+#include <intrin.h>
+#include <dxgiformat.h>
+
+#else
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+// src/SR/compat on non-Windows
+#include <dxgiformat.h>
+
+typedef unsigned char BYTE;
+typedef int INT;
+typedef unsigned int UINT;
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef int64_t INT64;
+
+inline void* _aligned_malloc(size_t size, size_t alignment) {
+	void* ptr = nullptr;
+	return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+}
+
+inline void _aligned_free(void* ptr) {
+	free(ptr);
+}
+
+#endif
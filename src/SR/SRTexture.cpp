@@ -0,0 +1,927 @@
+#include "SRTexture.h"
+#include "SRUtils.h"
+#include <algorithm>
+#include <atomic>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+using namespace DirectX;
+
+// texel coordinates beyond this are not worth wrapping precisely, and stay in int range
+static const float MaxTexelCoordinate = float(1 << 24);
+
+/*
+ * layout
+ */
+UINT SRFullMipLevels(UINT width, UINT height) {
+	UINT size = (std::max)(width, height);
+	UINT levels = 1;
+	while (size > 1) {
+		size /= 2;
+		levels++;
+	}
+	return levels;
+}
+
+static inline UINT alignToBlock(UINT size) {
+	return (size + SRSwizzleBlockSize - 1) & ~(SRSwizzleBlockSize - 1);
+}
+
+bool SRIsBlockCompressed(DXGI_FORMAT format) {
+	return format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM;
+}
+
+UINT SRVirtualPageShift(DXGI_FORMAT format) {
+	// 128 * 128 texels of 4 bytes, 64 * 64 of 16
+	switch (SizeOfFormat(format)) {
+	case 4:
+		return 7;
+	case 16:
+		return 6;
+	default:
+		return 0;
+	}
+}
+
+size_t SRVirtualPageCount(DXGI_FORMAT format, UINT width, UINT height, UINT mipLevels, size_t* pFirstPages) {
+	const UINT shift = SRVirtualPageShift(format);
+	const UINT side = 1u << shift;
+	size_t pages = 0;
+	for (UINT level = 0; level < mipLevels; level++) {
+		if (pFirstPages != nullptr)
+			pFirstPages[level] = pages;
+		UINT w = (std::max)(width >> level, 1u);
+		UINT h = (std::max)(height >> level, 1u);
+		pages += size_t((w + side - 1) >> shift) * ((h + side - 1) >> shift);
+	}
+	return pages;
+}
+
+size_t SRTextureLayout(SRResourceDimension dimension, DXGI_FORMAT format, UINT width, UINT height, UINT depth,
+	UINT mipLevels, SRResourceLayout layout, size_t* pMipOffsets)
+{
+	if (layout == SRResourceLayoutVirtual) {
+		size_t pages = SRVirtualPageCount(format, width, height, mipLevels, pMipOffsets);
+		return pages * sizeof(BYTE*) + (pages + 31) / 32 * sizeof(UINT32);
+	}
+
+	// the size of a 4 * 4 block for the compressed formats
+	const size_t texelSize = SizeOfFormat(format);
+	const bool isCompressed = SRIsBlockCompressed(format);
+	size_t offset = 0;
+	for (UINT level = 0; level < mipLevels; level++) {
+		if (pMipOffsets != nullptr)
+			pMipOffsets[level] = offset;
+		UINT w = (std::max)(width >> level, 1u);
+		UINT h = (std::max)(height >> level, 1u);
+		if (isCompressed) {
+			w = (w + 3) / 4;
+			h = (h + 3) / 4;
+		}
+		else if (layout == SRResourceLayoutSwizzled) {
+			w = alignToBlock(w);
+			h = alignToBlock(h);
+		}
+		// 3D textures shrink in depth as well, the faces of a cube do not
+		UINT d = dimension == SRResourceDimensionTexture3D ? (std::max)(depth >> level, 1u) : depth;
+		offset += size_t(w) * h * d * texelSize;
+	}
+	return offset;
+}
+
+// index of texel (x, y) in a swizzled level, blocks are row-major and so are the texels in a block
+static inline size_t swizzledIndex(UINT width, UINT x, UINT y) {
+	return (size_t(y / SRSwizzleBlockSize) * alignToBlock(width) + (x & ~(SRSwizzleBlockSize - 1)) + y % SRSwizzleBlockSize) *
+		SRSwizzleBlockSize + x % SRSwizzleBlockSize;
+}
+
+void SRSwizzleRow(BYTE* pSwizzled, const BYTE* pRow, UINT width, UINT texelSize, UINT y, UINT texelCount) {
+	// a row of a block is contiguous
+	for (UINT x = 0; x < texelCount; x += SRSwizzleBlockSize) {
+		UINT count = (std::min)(texelCount - x, UINT(SRSwizzleBlockSize));
+		memcpy(pSwizzled + swizzledIndex(width, x, y) * texelSize, pRow + size_t(x) * texelSize, count * texelSize);
+	}
+}
+
+void SRUnswizzleRow(BYTE* pRow, const BYTE* pSwizzled, UINT width, UINT texelSize, UINT y, UINT texelCount) {
+	for (UINT x = 0; x < texelCount; x += SRSwizzleBlockSize) {
+		UINT count = (std::min)(texelCount - x, UINT(SRSwizzleBlockSize));
+		memcpy(pRow + size_t(x) * texelSize, pSwizzled + swizzledIndex(width, x, y) * texelSize, count * texelSize);
+	}
+}
+
+bool SRIsSampleableFormat(DXGI_FORMAT format) {
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC5_UNORM:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * block compression, decoded to RGBA8 a 4 * 4 block at a time
+ */
+static inline UINT32 packRGBA8(UINT r, UINT g, UINT b, UINT a) {
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+// BC1 color block, BC3 uses the 4 color mode only
+static void decodeColorBlock(const BYTE* block, bool isFourColorOnly, UINT32 texels[16]) {
+	UINT c0 = block[0] | (block[1] << 8);
+	UINT c1 = block[2] | (block[3] << 8);
+	UINT r[4], g[4], b[4];
+	r[0] = (c0 >> 11) * 255 / 31;	g[0] = ((c0 >> 5) & 63) * 255 / 63;	b[0] = (c0 & 31) * 255 / 31;
+	r[1] = (c1 >> 11) * 255 / 31;	g[1] = ((c1 >> 5) & 63) * 255 / 63;	b[1] = (c1 & 31) * 255 / 31;
+
+	UINT32 palette[4];
+	palette[0] = packRGBA8(r[0], g[0], b[0], 255);
+	palette[1] = packRGBA8(r[1], g[1], b[1], 255);
+	if (c0 > c1 || isFourColorOnly) {
+		palette[2] = packRGBA8((2 * r[0] + r[1] + 1) / 3, (2 * g[0] + g[1] + 1) / 3, (2 * b[0] + b[1] + 1) / 3, 255);
+		palette[3] = packRGBA8((r[0] + 2 * r[1] + 1) / 3, (g[0] + 2 * g[1] + 1) / 3, (b[0] + 2 * b[1] + 1) / 3, 255);
+	}
+	else {
+		// 3 colors and transparent black
+		palette[2] = packRGBA8((r[0] + r[1]) / 2, (g[0] + g[1]) / 2, (b[0] + b[1]) / 2, 255);
+		palette[3] = 0;
+	}
+
+	UINT32 indices = block[4] | (block[5] << 8) | (block[6] << 16) | (UINT32(block[7]) << 24);
+	for (int i = 0; i < 16; i++) {
+		texels[i] = palette[(indices >> (2 * i)) & 3];
+	}
+}
+
+// BC4 block, also the alpha of BC3 and each channel of BC5
+static void decodeChannelBlock(const BYTE* block, BYTE values[16]) {
+	UINT v[8];
+	v[0] = block[0];
+	v[1] = block[1];
+	if (v[0] > v[1]) {
+		for (UINT i = 1; i < 7; i++) {
+			v[i + 1] = ((7 - i) * v[0] + i * v[1] + 3) / 7;
+		}
+	}
+	else {
+		for (UINT i = 1; i < 5; i++) {
+			v[i + 1] = ((5 - i) * v[0] + i * v[1] + 2) / 5;
+		}
+		v[6] = 0;
+		v[7] = 255;
+	}
+
+	UINT64 indices = 0;
+	for (int i = 0; i < 6; i++) {
+		indices |= UINT64(block[2 + i]) << (8 * i);
+	}
+	for (int i = 0; i < 16; i++) {
+		values[i] = BYTE(v[(indices >> (3 * i)) & 7]);
+	}
+}
+
+static void decodeBlock(DXGI_FORMAT format, const BYTE* block, UINT32 texels[16]) {
+	BYTE channels[2][16];
+	switch (format) {
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		decodeColorBlock(block, false, texels);
+		break;
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+		decodeColorBlock(block + 8, true, texels);
+		decodeChannelBlock(block, channels[0]);
+		for (int i = 0; i < 16; i++) {
+			texels[i] = (texels[i] & 0x00ffffff) | (UINT32(channels[0][i]) << 24);
+		}
+		break;
+	case DXGI_FORMAT_BC4_UNORM:
+		decodeChannelBlock(block, channels[0]);
+		for (int i = 0; i < 16; i++) {
+			texels[i] = packRGBA8(channels[0][i], 0, 0, 255);
+		}
+		break;
+	case DXGI_FORMAT_BC5_UNORM:
+		decodeChannelBlock(block, channels[0]);
+		decodeChannelBlock(block + 8, channels[1]);
+		for (int i = 0; i < 16; i++) {
+			texels[i] = packRGBA8(channels[0][i], channels[1][i], 0, 255);
+		}
+		break;
+	default:
+		memset(texels, 0, 16 * sizeof(UINT32));
+		break;
+	}
+}
+
+// blocks decoded by the calling thread, direct mapped by the address of the compressed block.
+// an entry is valid for the generation it was decoded in, see SRInvalidateDecodedBlocks.
+typedef struct SRDecodedBlock {
+	const BYTE* block;
+	UINT64 generation;
+	UINT32 texels[16];
+} SRDecodedBlock;
+
+static const UINT DecodedBlockCount = 64;
+static thread_local SRDecodedBlock DecodedBlocks[DecodedBlockCount];
+static std::atomic<UINT64> DecodedGeneration(1);
+
+void SRInvalidateDecodedBlocks() {
+	DecodedGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+UINT64 SRDecodedBlocksGeneration() {
+	return DecodedGeneration.load(std::memory_order_relaxed);
+}
+
+static inline const UINT32* decodedBlock(DXGI_FORMAT format, const BYTE* block, UINT64 generation) {
+	// the blocks below each other are a row of blocks apart, mix the row into the slot
+	uintptr_t key = reinterpret_cast<uintptr_t>(block) >> 3;
+	SRDecodedBlock& entry = DecodedBlocks[(key ^ (key >> 6) ^ (key >> 12)) % DecodedBlockCount];
+	if (entry.block != block || entry.generation != generation) {
+		decodeBlock(format, block, entry.texels);
+		entry.block = block;
+		entry.generation = generation;
+	}
+	return entry.texels;
+}
+
+/*
+ * texel fetch
+ */
+// sRGB to linear for every 8 bit value
+struct SRGBTable {
+	float values[256];
+	SRGBTable() {
+		for (int i = 0; i < 256; i++) {
+			float c = i / 255.0f;
+			values[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+	}
+};
+static const SRGBTable SRGBToLinear;
+
+// texel (x, y) is at index ((y >> shift) * rowStride + (x >> shift << 2 * shift) + ((y & mask) << shift) + (x & mask)),
+// which covers both layouts: row-major has shift 0 and the width as stride.
+typedef struct SRMipLevel {
+	const BYTE* ptr;
+	UINT width;
+	UINT height;
+	UINT shift;
+	UINT mask;
+	size_t rowStride;
+} SRMipLevel;
+
+static inline SRMipLevel mipLevel(const SRTextureView& texture, UINT level) {
+	SRMipLevel mip;
+	mip.ptr = texture.ptr + texture.MipOffsets[level];
+	mip.width = (std::max)(texture.Width >> level, 1u);
+	mip.height = (std::max)(texture.Height >> level, 1u);
+	if (texture.Layout == SRResourceLayoutSwizzled) {
+		mip.shift = 2;
+		mip.mask = SRSwizzleBlockSize - 1;
+		mip.rowStride = size_t(alignToBlock(mip.width)) * SRSwizzleBlockSize;
+	}
+	else {
+		mip.shift = 0;
+		mip.mask = 0;
+		mip.rowStride = mip.width;
+	}
+	return mip;
+}
+
+static inline size_t texelIndex(const SRMipLevel& level, UINT x, UINT y) {
+	return (y >> level.shift) * level.rowStride + ((x >> level.shift) << (2 * level.shift)) +
+		((y & level.mask) << level.shift) + (x & level.mask);
+}
+
+// texels in a slice of a level
+static inline size_t sliceTexels(const SRMipLevel& level) {
+	return level.rowStride * ((level.height + level.mask) >> level.shift);
+}
+
+// bytes of a face of a cube level or a slice of a 3D level
+static inline size_t sliceBytes(const SRTextureView& texture, const SRMipLevel& level) {
+	if (SRIsBlockCompressed(texture.Format))
+		return size_t((level.width + 3) / 4) * ((level.height + 3) / 4) * SizeOfFormat(texture.Format);
+	return sliceTexels(level) * SizeOfFormat(texture.Format);
+}
+
+// RGBA8 texel (x, y) of a compressed level
+static inline UINT32 fetchCompressed(const SRTextureView& texture, const SRMipLevel& level, UINT x, UINT y) {
+	const size_t blockSize = (texture.Format >= DXGI_FORMAT_BC1_TYPELESS && texture.Format <= DXGI_FORMAT_BC1_UNORM_SRGB) ||
+		(texture.Format >= DXGI_FORMAT_BC4_TYPELESS && texture.Format <= DXGI_FORMAT_BC4_SNORM) ? 8 : 16;
+	const BYTE* block = level.ptr + (size_t(y / 4) * ((level.width + 3) / 4) + x / 4) * blockSize;
+	return decodedBlock(texture.Format, block, texture.Generation)[(y % 4) * 4 + x % 4];
+}
+
+// what the texels of a compressed format are decoded to
+static inline DXGI_FORMAT decodedFormat(DXGI_FORMAT format) {
+	return format == DXGI_FORMAT_BC1_UNORM_SRGB || format == DXGI_FORMAT_BC3_UNORM_SRGB ?
+		DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+}
+
+static inline XMVECTOR XM_CALLCONV loadTexel(DXGI_FORMAT format, const BYTE* texel) {
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+		return XMVectorScale(XMVectorSet(texel[0], texel[1], texel[2], texel[3]), 1.0f / 255.0f);
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		return XMVectorSet(SRGBToLinear.values[texel[0]], SRGBToLinear.values[texel[1]],
+			SRGBToLinear.values[texel[2]], texel[3] / 255.0f);
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+		return XMVectorScale(XMVectorSet(texel[2], texel[1], texel[0], texel[3]), 1.0f / 255.0f);
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(texel));
+	default:
+		return XMVectorZero();
+	}
+}
+
+static inline XMVECTOR XM_CALLCONV fetchTexel(const SRTextureView& texture, const SRMipLevel& level, UINT x, UINT y) {
+	if (SRIsBlockCompressed(texture.Format)) {
+		UINT32 texel = fetchCompressed(texture, level, x, y);
+		return loadTexel(decodedFormat(texture.Format), reinterpret_cast<const BYTE*>(&texel));
+	}
+	return loadTexel(texture.Format, level.ptr + texelIndex(level, x, y) * SizeOfFormat(texture.Format));
+}
+
+// four RGBA8 texels widened and converted at once
+static inline void widenRGBA8(__m128i packed, XMVECTOR texels[4]) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i low = _mm_unpacklo_epi8(packed, zero);
+	__m128i high = _mm_unpackhi_epi8(packed, zero);
+	const XMVECTOR scale = XMVectorReplicate(1.0f / 255.0f);
+	texels[0] = XMVectorMultiply(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), scale);
+	texels[1] = XMVectorMultiply(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), scale);
+	texels[2] = XMVectorMultiply(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), scale);
+	texels[3] = XMVectorMultiply(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), scale);
+}
+
+// the 2 * 2 footprint of a bilinear lookup: (x0, y0), (x1, y0), (x0, y1), (x1, y1)
+static inline void fetchFootprint(const SRTextureView& texture, const SRMipLevel& level, const UINT x[2], const UINT y[2],
+	XMVECTOR texels[4])
+{
+	const DXGI_FORMAT format = texture.Format;
+	if (format == DXGI_FORMAT_R8G8B8A8_UNORM || format == DXGI_FORMAT_B8G8R8A8_UNORM) {
+		const UINT32* texels32 = reinterpret_cast<const UINT32*>(level.ptr);
+		widenRGBA8(_mm_set_epi32(
+			int(texels32[texelIndex(level, x[1], y[1])]), int(texels32[texelIndex(level, x[0], y[1])]),
+			int(texels32[texelIndex(level, x[1], y[0])]), int(texels32[texelIndex(level, x[0], y[0])])), texels);
+		if (format == DXGI_FORMAT_B8G8R8A8_UNORM) {
+			for (int i = 0; i < 4; i++) {
+				texels[i] = XMVectorSwizzle<2, 1, 0, 3>(texels[i]);
+			}
+		}
+		return;
+	}
+	if (SRIsBlockCompressed(format) && decodedFormat(format) == DXGI_FORMAT_R8G8B8A8_UNORM) {
+		widenRGBA8(_mm_set_epi32(
+			int(fetchCompressed(texture, level, x[1], y[1])), int(fetchCompressed(texture, level, x[0], y[1])),
+			int(fetchCompressed(texture, level, x[1], y[0])), int(fetchCompressed(texture, level, x[0], y[0]))), texels);
+		return;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		texels[i] = fetchTexel(texture, level, x[i % 2], y[i / 2]);
+	}
+}
+
+static inline UINT address(float coordinate, UINT size, SRTextureAddressMode mode) {
+	coordinate = (std::max)((std::min)(coordinate, MaxTexelCoordinate), -MaxTexelCoordinate);
+	int x = int(coordinate);
+	if (mode == SRTextureAddressWrap) {
+		int wrapped = x % int(size);
+		return UINT(wrapped < 0 ? wrapped + int(size) : wrapped);
+	}
+	return UINT(x < 0 ? 0 : (x >= int(size) ? int(size) - 1 : x));
+}
+
+/*
+ * virtual textures
+ */
+// the page of texel (x, y) of a level, nullptr while it is not populated. the lookup is recorded either way,
+// the pages looked up during a frame are populated / kept at its end.
+static inline const BYTE* virtualPage(const SRTextureView& texture, UINT level, UINT width, UINT shift, UINT x, UINT y) {
+	const UINT pagesPerRow = (width + (1u << shift) - 1) >> shift;
+	const size_t page = texture.MipOffsets[level] + size_t(y >> shift) * pagesPerRow + (x >> shift);
+	std::atomic<UINT32>& feedback = texture.Feedback[page / 32];
+	const UINT32 bit = 1u << (page % 32);
+	// the bit is set by the first lookup, the following ones only read the line
+	if ((feedback.load(std::memory_order_relaxed) & bit) == 0)
+		feedback.fetch_or(bit, std::memory_order_relaxed);
+	return reinterpret_cast<const BYTE* const*>(texture.ptr)[page];
+}
+
+// point / bilinear lookup in the finest level from level on that has the texels populated,
+// transparent black if none of them has.
+static XMVECTOR XM_CALLCONV sampleVirtual(const SRTextureView& texture, const SRSamplerDesc& sampler, UINT level,
+	XMFLOAT2 uv, bool isBilinear)
+{
+	const UINT shift = SRVirtualPageShift(texture.Format);
+	const UINT mask = (1u << shift) - 1;
+	const size_t texelSize = SizeOfFormat(texture.Format);
+	for (; level < texture.MipLevels; level++) {
+		const UINT width = (std::max)(texture.Width >> level, 1u);
+		const UINT height = (std::max)(texture.Height >> level, 1u);
+		if (!isBilinear) {
+			UINT x = address(floorf(uv.x * width), width, sampler.AddressU);
+			UINT y = address(floorf(uv.y * height), height, sampler.AddressV);
+			const BYTE* page = virtualPage(texture, level, width, shift, x, y);
+			if (page != nullptr)
+				return loadTexel(texture.Format, page + (size_t(y & mask) << shift | (x & mask)) * texelSize);
+			continue;
+		}
+
+		float x = uv.x * width - 0.5f;
+		float y = uv.y * height - 0.5f;
+		float x0 = floorf(x);
+		float y0 = floorf(y);
+		UINT xs[2] = { address(x0, width, sampler.AddressU), address(x0 + 1.0f, width, sampler.AddressU) };
+		UINT ys[2] = { address(y0, height, sampler.AddressV), address(y0 + 1.0f, height, sampler.AddressV) };
+		// every page of the footprint is recorded, also after a missing one
+		XMVECTOR texels[4];
+		bool isPopulated = true;
+		for (int i = 0; i < 4; i++) {
+			const UINT tx = xs[i % 2], ty = ys[i / 2];
+			const BYTE* page = virtualPage(texture, level, width, shift, tx, ty);
+			if (page == nullptr)
+				isPopulated = false;
+			else
+				texels[i] = loadTexel(texture.Format, page + (size_t(ty & mask) << shift | (tx & mask)) * texelSize);
+		}
+		if (!isPopulated)
+			continue;
+		XMVECTOR top = XMVectorLerp(texels[0], texels[1], x - x0);
+		XMVECTOR bottom = XMVectorLerp(texels[2], texels[3], x - x0);
+		return XMVectorLerp(top, bottom, y - y0);
+	}
+	return XMVectorZero();
+}
+
+/*
+ * filtering
+ */
+static XMVECTOR XM_CALLCONV samplePoint(const SRTextureView& texture, const SRSamplerDesc& sampler, UINT level,
+	XMFLOAT2 uv)
+{
+	if (texture.Layout == SRResourceLayoutVirtual)
+		return sampleVirtual(texture, sampler, level, uv, false);
+	SRMipLevel mip = mipLevel(texture, level);
+	UINT x = address(floorf(uv.x * mip.width), mip.width, sampler.AddressU);
+	UINT y = address(floorf(uv.y * mip.height), mip.height, sampler.AddressV);
+	return fetchTexel(texture, mip, x, y);
+}
+
+static XMVECTOR XM_CALLCONV sampleBilinear(const SRTextureView& texture, const SRSamplerDesc& sampler, UINT level,
+	XMFLOAT2 uv)
+{
+	if (texture.Layout == SRResourceLayoutVirtual)
+		return sampleVirtual(texture, sampler, level, uv, true);
+	SRMipLevel mip = mipLevel(texture, level);
+	// texel centers are at half integers
+	float x = uv.x * mip.width - 0.5f;
+	float y = uv.y * mip.height - 0.5f;
+	float x0 = floorf(x);
+	float y0 = floorf(y);
+	UINT xs[2] = { address(x0, mip.width, sampler.AddressU), address(x0 + 1.0f, mip.width, sampler.AddressU) };
+	UINT ys[2] = { address(y0, mip.height, sampler.AddressV), address(y0 + 1.0f, mip.height, sampler.AddressV) };
+
+	XMVECTOR texels[4];
+	fetchFootprint(texture, mip, xs, ys, texels);
+	XMVECTOR top = XMVectorLerp(texels[0], texels[1], x - x0);
+	XMVECTOR bottom = XMVectorLerp(texels[2], texels[3], x - x0);
+	return XMVectorLerp(top, bottom, y - y0);
+}
+
+// the levels and the filter of a lookup at lod, sampleLevel(level, isLinear) filters a single level
+template <typename SampleLevel>
+static inline XMVECTOR XM_CALLCONV filterLevels(const SRTextureView& texture, const SRSamplerDesc& sampler, float lod,
+	SampleLevel sampleLevel)
+{
+	const float maxLod = (std::max)((std::min)(sampler.MaxLOD, float(texture.MipLevels - 1)), 0.0f);
+	lod += sampler.MipLODBias;
+	// also catches the NaN of degenerate gradients
+	lod = lod > 0.0f ? (std::min)(lod, maxLod) : 0.0f;
+
+	switch (sampler.Filter) {
+	case SRFilterPoint:
+		return sampleLevel(UINT(lod + 0.5f), false);
+	case SRFilterBilinear:
+		return sampleLevel(UINT(lod + 0.5f), true);
+	default: {
+		UINT level = UINT(lod);
+		float blend = lod - float(level);
+		XMVECTOR color = sampleLevel(level, true);
+		if (blend == 0.0f)
+			return color;
+		return XMVectorLerp(color, sampleLevel(level + 1, true), blend);
+	}
+	}
+}
+
+static XMVECTOR XM_CALLCONV sampleAtLod(const SRTextureView& texture, const SRSamplerDesc& sampler, XMFLOAT2 uv, float lod) {
+	return filterLevels(texture, sampler, lod, [&](UINT level, bool isLinear) {
+		return isLinear ? sampleBilinear(texture, sampler, level, uv) : samplePoint(texture, sampler, level, uv);
+	});
+}
+
+/*
+ * shader interface
+ */
+float SRCalculateLevelOfDetail(const SRTextureView& texture, XMFLOAT2 ddx, XMFLOAT2 ddy) {
+	// footprint of the pixel in texels of level 0, the longer axis decides
+	float dxU = ddx.x * texture.Width, dxV = ddx.y * texture.Height;
+	float dyU = ddy.x * texture.Width, dyV = ddy.y * texture.Height;
+	float rho2 = (std::max)(dxU * dxU + dxV * dxV, dyU * dyU + dyV * dyV);
+	return 0.5f * log2f(rho2);
+}
+
+XMVECTOR SRSampleLevel(const SRTextureView& texture, const SRSamplerDesc& sampler, XMFLOAT2 uv, float lod) {
+	return sampleAtLod(texture, sampler, uv, lod);
+}
+
+XMVECTOR SRSampleGrad(const SRTextureView& texture, const SRSamplerDesc& sampler, XMFLOAT2 uv,
+	XMFLOAT2 ddx, XMFLOAT2 ddy)
+{
+	return sampleAtLod(texture, sampler, uv, SRCalculateLevelOfDetail(texture, ddx, ddy));
+}
+
+void SRSampleQuad(const SRTextureView& texture, const SRSamplerDesc& sampler, const XMFLOAT2 uv[4], XMVECTOR color[4]) {
+	// pixel 2 is right of pixel 0, pixel 1 below it
+	XMFLOAT2 ddx(uv[2].x - uv[0].x, uv[2].y - uv[0].y);
+	XMFLOAT2 ddy(uv[1].x - uv[0].x, uv[1].y - uv[0].y);
+	float lod = SRCalculateLevelOfDetail(texture, ddx, ddy);
+	for (int i = 0; i < 4; i++) {
+		color[i] = sampleAtLod(texture, sampler, uv[i], lod);
+	}
+}
+
+/*
+ * cube maps
+ */
+// the axes of a face: the major axis and the axes u and v grow along, with their signs
+typedef struct SRCubeFace {
+	int major;
+	int u;
+	int v;
+	float majorSign;
+	float uSign;
+	float vSign;
+} SRCubeFace;
+
+static const SRCubeFace CubeFaces[6] = {
+	{ 0, 2, 1, 1.0f, -1.0f, -1.0f },	// +X
+	{ 0, 2, 1, -1.0f, 1.0f, -1.0f },	// -X
+	{ 1, 0, 2, 1.0f, 1.0f, 1.0f },		// +Y
+	{ 1, 0, 2, -1.0f, 1.0f, -1.0f },	// -Y
+	{ 2, 0, 1, 1.0f, 1.0f, -1.0f },		// +Z
+	{ 2, 0, 1, -1.0f, -1.0f, -1.0f },	// -Z
+};
+
+// the face of the major axis of a direction, ties go to x, then y
+static inline UINT cubeFace(const float direction[3]) {
+	const float x = fabsf(direction[0]), y = fabsf(direction[1]), z = fabsf(direction[2]);
+	const UINT axis = x >= y && x >= z ? 0 : (y >= z ? 1 : 2);
+	return 2 * axis + (direction[axis] < 0.0f ? 1 : 0);
+}
+
+// a direction projected onto the plane of a face, [0, 1] covers the face
+static inline void faceCoordinates(UINT face, const float direction[3], float& u, float& v) {
+	const SRCubeFace& axes = CubeFaces[face];
+	const float scale = 0.5f / (std::max)(axes.majorSign * direction[axes.major], FLT_MIN);
+	u = axes.uSign * direction[axes.u] * scale + 0.5f;
+	v = axes.vSign * direction[axes.v] * scale + 0.5f;
+}
+
+// cubeFace and faceCoordinates of 4 directions at once
+static inline void XM_CALLCONV cubeCoordinates(FXMVECTOR x, FXMVECTOR y, FXMVECTOR z, UINT faces[4], float u[4], float v[4]) {
+	const XMVECTOR ax = XMVectorAbs(x), ay = XMVectorAbs(y), az = XMVectorAbs(z);
+	const XMVECTOR isX = XMVectorAndInt(XMVectorGreaterOrEqual(ax, ay), XMVectorGreaterOrEqual(ax, az));
+	const XMVECTOR isY = XMVectorAndCInt(XMVectorGreaterOrEqual(ay, az), isX);
+	const XMVECTOR major = XMVectorSelect(XMVectorSelect(z, y, isY), x, isX);
+	const XMVECTOR isNegative = XMVectorLess(major, XMVectorZero());
+	const XMVECTOR sign = XMVectorSelect(XMVectorReplicate(1.0f), XMVectorReplicate(-1.0f), isNegative);
+
+	// u along -z, z, x, x, x, -x and v along -y, -y, z, -z, -y, -y for +X -X +Y -Y +Z -Z
+	const XMVECTOR su = XMVectorSelect(XMVectorSelect(XMVectorMultiply(x, sign), x, isY),
+		XMVectorNegate(XMVectorMultiply(z, sign)), isX);
+	const XMVECTOR sv = XMVectorSelect(XMVectorNegate(y), XMVectorMultiply(z, sign), isY);
+	const XMVECTOR half = XMVectorReplicate(0.5f);
+	const XMVECTOR scale = XMVectorDivide(half, XMVectorMax(XMVectorAbs(major), XMVectorReplicate(FLT_MIN)));
+	XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(u), XMVectorMultiplyAdd(su, scale, half));
+	XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(v), XMVectorMultiplyAdd(sv, scale, half));
+
+	const __m128i isXOrY = _mm_castps_si128(XMVectorOrInt(isX, isY));
+	__m128i face = _mm_and_si128(_mm_castps_si128(isY), _mm_set1_epi32(2));
+	face = _mm_or_si128(face, _mm_andnot_si128(isXOrY, _mm_set1_epi32(4)));
+	face = _mm_or_si128(face, _mm_and_si128(_mm_castps_si128(isNegative), _mm_set1_epi32(1)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(faces), face);
+}
+
+static inline UINT clampTexel(float coordinate, UINT size) {
+	int x = int((std::max)(coordinate, 0.0f));
+	return UINT((std::min)(x, int(size) - 1));
+}
+
+// texel (x, y) of a face, or the texel that stands in for it on the neighbouring face when it is beyond an edge
+static inline void cubeTexel(UINT& face, int x, int y, UINT size, UINT& tx, UINT& ty) {
+	if (x >= 0 && y >= 0 && x < int(size) && y < int(size)) {
+		tx = UINT(x);
+		ty = UINT(y);
+		return;
+	}
+	// the direction through the texel center on the plane of the face points into the neighbouring face
+	const SRCubeFace& axes = CubeFaces[face];
+	float direction[3];
+	direction[axes.major] = axes.majorSign;
+	direction[axes.u] = axes.uSign * ((2 * x + 1) / float(size) - 1.0f);
+	direction[axes.v] = axes.vSign * ((2 * y + 1) / float(size) - 1.0f);
+	face = cubeFace(direction);
+	float u, v;
+	faceCoordinates(face, direction, u, v);
+	tx = clampTexel(u * size, size);
+	ty = clampTexel(v * size, size);
+}
+
+static XMVECTOR XM_CALLCONV sampleCubeFace(const SRTextureView& texture, UINT level, UINT face, float u, float v,
+	bool isBilinear)
+{
+	SRMipLevel mip = mipLevel(texture, level);
+	const size_t faceBytes = sliceBytes(texture, mip);
+	const BYTE* faces = mip.ptr;
+	const UINT size = mip.width;
+	if (!isBilinear) {
+		mip.ptr = faces + face * faceBytes;
+		return fetchTexel(texture, mip, clampTexel(u * size, size), clampTexel(v * size, size));
+	}
+
+	float x = u * size - 0.5f;
+	float y = v * size - 0.5f;
+	float x0 = floorf(x);
+	float y0 = floorf(y);
+	const int xi = int(x0), yi = int(y0);
+	XMVECTOR texels[4];
+	if (xi >= 0 && yi >= 0 && xi + 1 < int(size) && yi + 1 < int(size)) {
+		mip.ptr = faces + face * faceBytes;
+		UINT xs[2] = { UINT(xi), UINT(xi + 1) };
+		UINT ys[2] = { UINT(yi), UINT(yi + 1) };
+		fetchFootprint(texture, mip, xs, ys, texels);
+	}
+	else {
+		for (int i = 0; i < 4; i++) {
+			UINT texelFace = face, tx, ty;
+			cubeTexel(texelFace, xi + i % 2, yi + i / 2, size, tx, ty);
+			mip.ptr = faces + texelFace * faceBytes;
+			texels[i] = fetchTexel(texture, mip, tx, ty);
+		}
+	}
+	XMVECTOR top = XMVectorLerp(texels[0], texels[1], x - x0);
+	XMVECTOR bottom = XMVectorLerp(texels[2], texels[3], x - x0);
+	return XMVectorLerp(top, bottom, y - y0);
+}
+
+XMVECTOR SRSampleCubeLevel(const SRTextureView& texture, const SRSamplerDesc& sampler, XMFLOAT3 direction, float lod) {
+	const float d[3] = { direction.x, direction.y, direction.z };
+	const UINT face = cubeFace(d);
+	float u, v;
+	faceCoordinates(face, d, u, v);
+	return filterLevels(texture, sampler, lod, [&](UINT level, bool isLinear) {
+		return sampleCubeFace(texture, level, face, u, v, isLinear);
+	});
+}
+
+void SRSampleCubeQuad(const SRTextureView& texture, const SRSamplerDesc& sampler, const XMFLOAT3 direction[4], XMVECTOR color[4]) {
+	UINT faces[4];
+	float u[4], v[4];
+	cubeCoordinates(XMVectorSet(direction[0].x, direction[1].x, direction[2].x, direction[3].x),
+		XMVectorSet(direction[0].y, direction[1].y, direction[2].y, direction[3].y),
+		XMVectorSet(direction[0].z, direction[1].z, direction[2].z, direction[3].z), faces, u, v);
+
+	// the differences across the quad on the face of pixel 0, the others may be just across an edge
+	const float right[3] = { direction[2].x, direction[2].y, direction[2].z };
+	const float below[3] = { direction[1].x, direction[1].y, direction[1].z };
+	float u2, v2, u1, v1;
+	faceCoordinates(faces[0], right, u2, v2);
+	faceCoordinates(faces[0], below, u1, v1);
+	float lod = SRCalculateLevelOfDetail(texture, XMFLOAT2(u2 - u[0], v2 - v[0]), XMFLOAT2(u1 - u[0], v1 - v[0]));
+	for (int i = 0; i < 4; i++) {
+		color[i] = filterLevels(texture, sampler, lod, [&](UINT level, bool isLinear) {
+			return sampleCubeFace(texture, level, faces[i], u[i], v[i], isLinear);
+		});
+	}
+}
+
+/*
+ * 3D textures
+ */
+static XMVECTOR XM_CALLCONV sampleVolume(const SRTextureView& texture, const SRSamplerDesc& sampler, UINT level,
+	XMFLOAT3 uvw, bool isLinear)
+{
+	SRMipLevel mip = mipLevel(texture, level);
+	const UINT depth = (std::max)(texture.Depth >> level, 1u);
+	const size_t sliceSize = sliceBytes(texture, mip);
+	const BYTE* slices = mip.ptr;
+	if (!isLinear) {
+		UINT x = address(floorf(uvw.x * mip.width), mip.width, sampler.AddressU);
+		UINT y = address(floorf(uvw.y * mip.height), mip.height, sampler.AddressV);
+		UINT z = address(floorf(uvw.z * depth), depth, sampler.AddressW);
+		mip.ptr = slices + z * sliceSize;
+		return fetchTexel(texture, mip, x, y);
+	}
+
+	float x = uvw.x * mip.width - 0.5f;
+	float y = uvw.y * mip.height - 0.5f;
+	float z = uvw.z * depth - 0.5f;
+	float x0 = floorf(x);
+	float y0 = floorf(y);
+	float z0 = floorf(z);
+	UINT xs[2] = { address(x0, mip.width, sampler.AddressU), address(x0 + 1.0f, mip.width, sampler.AddressU) };
+	UINT ys[2] = { address(y0, mip.height, sampler.AddressV), address(y0 + 1.0f, mip.height, sampler.AddressV) };
+	UINT zs[2] = { address(z0, depth, sampler.AddressW), address(z0 + 1.0f, depth, sampler.AddressW) };
+
+	// a bilinear footprint in each of the 2 slices
+	XMVECTOR layers[2];
+	for (int k = 0; k < 2; k++) {
+		XMVECTOR texels[4];
+		mip.ptr = slices + zs[k] * sliceSize;
+		fetchFootprint(texture, mip, xs, ys, texels);
+		XMVECTOR top = XMVectorLerp(texels[0], texels[1], x - x0);
+		XMVECTOR bottom = XMVectorLerp(texels[2], texels[3], x - x0);
+		layers[k] = XMVectorLerp(top, bottom, y - y0);
+	}
+	return XMVectorLerp(layers[0], layers[1], z - z0);
+}
+
+XMVECTOR SRSampleVolumeLevel(const SRTextureView& texture, const SRSamplerDesc& sampler, XMFLOAT3 uvw, float lod) {
+	return filterLevels(texture, sampler, lod, [&](UINT level, bool isLinear) {
+		return sampleVolume(texture, sampler, level, uvw, isLinear);
+	});
+}
+
+void SRSampleVolumeQuad(const SRTextureView& texture, const SRSamplerDesc& sampler, const XMFLOAT3 uvw[4], XMVECTOR color[4]) {
+	// footprint of the pixel in texels of level 0, as SRCalculateLevelOfDetail with the depth
+	const XMVECTOR size = XMVectorSet(float(texture.Width), float(texture.Height), float(texture.Depth), 0.0f);
+	const XMVECTOR origin = XMLoadFloat3(&uvw[0]);
+	const XMVECTOR ddx = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&uvw[2]), origin), size);
+	const XMVECTOR ddy = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&uvw[1]), origin), size);
+	float rho2 = (std::max)(XMVectorGetX(XMVector3LengthSq(ddx)), XMVectorGetX(XMVector3LengthSq(ddy)));
+	float lod = 0.5f * log2f(rho2);
+	for (int i = 0; i < 4; i++) {
+		color[i] = SRSampleVolumeLevel(texture, sampler, uvw[i], lod);
+	}
+}
+
+/*
+ * mip generation
+ */
+// linear to 8 bit sRGB: the linear values at which the encoding rounds up to the next value,
+// and the encoding at the start of 4096 equal steps of [0, 1]. the steps are narrower than
+// the distance between two thresholds, so at most one threshold lies inside a step.
+struct SRGBEncodeTable {
+	static const int Steps = 4096;
+	float thresholds[256];
+	BYTE starts[Steps + 1];
+	SRGBEncodeTable() {
+		for (int i = 0; i < 255; i++) {
+			float c = (i + 0.5f) / 255.0f;
+			thresholds[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		thresholds[255] = 2.0f;
+		int encoded = 0;
+		for (int i = 0; i <= Steps; i++) {
+			while (encoded < 255 && thresholds[encoded] <= float(i) / Steps) {
+				encoded++;
+			}
+			starts[i] = BYTE(encoded);
+		}
+	}
+};
+static const SRGBEncodeTable LinearToSRGB;
+
+// linear in [0, 1]
+static inline BYTE encodeSRGB(float linear) {
+	UINT encoded = LinearToSRGB.starts[int(linear * SRGBEncodeTable::Steps)];
+	return BYTE(encoded + (linear >= LinearToSRGB.thresholds[encoded]));
+}
+
+static inline void XM_CALLCONV storeTexel(DXGI_FORMAT format, BYTE* texel, XMVECTOR color) {
+	XMFLOAT4 value;
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+		if (format == DXGI_FORMAT_B8G8R8A8_UNORM)
+			color = XMVectorSwizzle<2, 1, 0, 3>(color);
+		XMStoreFloat4(&value, XMVectorMultiplyAdd(XMVectorSaturate(color), XMVectorReplicate(255.0f), XMVectorReplicate(0.5f)));
+		texel[0] = BYTE(value.x);
+		texel[1] = BYTE(value.y);
+		texel[2] = BYTE(value.z);
+		texel[3] = BYTE(value.w);
+		break;
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		XMStoreFloat4(&value, XMVectorSaturate(color));
+		texel[0] = encodeSRGB(value.x);
+		texel[1] = encodeSRGB(value.y);
+		texel[2] = encodeSRGB(value.z);
+		texel[3] = BYTE(value.w * 255.0f + 0.5f);
+		break;
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(texel), color);
+		break;
+	default:
+		break;
+	}
+}
+
+// the texels of the level above that texel i of a level is filtered from, returns their count.
+// an odd size 2n + 1 shrinks to n, every texel then covers 2 + 1 / n texels of the level above,
+// so that each of them contributes the same in total.
+static inline UINT downsampleTaps(UINT size, UINT i, UINT index[3], float weight[3]) {
+	if (size == 1) {
+		index[0] = 0;
+		weight[0] = 1.0f;
+		return 1;
+	}
+	index[0] = 2 * i;
+	index[1] = 2 * i + 1;
+	if (size % 2 == 0) {
+		weight[0] = weight[1] = 0.5f;
+		return 2;
+	}
+	const UINT n = size / 2;
+	const float scale = 1.0f / size;
+	index[2] = 2 * i + 2;
+	weight[0] = (n - i) * scale;
+	weight[1] = n * scale;
+	weight[2] = (i + 1) * scale;
+	return 3;
+}
+
+void SRGenerateMipRows(const SRTextureView& texture, UINT level, UINT slice, UINT rowBegin, UINT rowEnd) {
+	const SRMipLevel src = mipLevel(texture, level - 1);
+	const SRMipLevel dst = mipLevel(texture, level);
+	const DXGI_FORMAT format = texture.Format;
+	const size_t texelSize = SizeOfFormat(format);
+	BYTE* dstSlice = const_cast<BYTE*>(dst.ptr) + slice * sliceTexels(dst) * texelSize;
+
+	// 3D textures filter the slices above as well, the faces of a cube only their own face
+	UINT zIndex[3];
+	float zWeight[3];
+	UINT zTaps = 1;
+	zIndex[0] = slice;
+	zWeight[0] = 1.0f;
+	if (texture.Dimension == SRResourceDimensionTexture3D)
+		zTaps = downsampleTaps((std::max)(texture.Depth >> (level - 1), 1u), slice, zIndex, zWeight);
+
+	// 8 bit linear formats halving exactly are a plain 2 * 2 average, 2 texels at a time.
+	// 4 texels in a row starting at a multiple of 4 are contiguous in both layouts.
+	const bool isBox = (format == DXGI_FORMAT_R8G8B8A8_UNORM || format == DXGI_FORMAT_B8G8R8A8_UNORM) &&
+		src.width == 2 * dst.width && src.height == 2 * dst.height && zTaps == 1;
+	const UINT boxWidth = isBox ? dst.width & ~1u : 0;
+	const BYTE* srcSlice = src.ptr + zIndex[0] * sliceTexels(src) * texelSize;
+	const __m128i zero = _mm_setzero_si128();
+
+	for (UINT y = rowBegin; y < rowEnd; y++) {
+		UINT x = 0;
+		for (; x < boxWidth; x += 2) {
+			__m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcSlice + texelIndex(src, 2 * x, 2 * y) * 4));
+			__m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcSlice + texelIndex(src, 2 * x, 2 * y + 1) * 4));
+			__m128i left = _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero));
+			__m128i right = _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero));
+			left = _mm_add_epi16(left, _mm_srli_si128(left, 8));
+			right = _mm_add_epi16(right, _mm_srli_si128(right, 8));
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_set1_epi16(2));
+			sum = _mm_srli_epi16(sum, 2);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dstSlice + texelIndex(dst, x, y) * 4), _mm_packus_epi16(sum, sum));
+		}
+
+		UINT yIndex[3];
+		float yWeight[3];
+		const UINT yTaps = downsampleTaps(src.height, y, yIndex, yWeight);
+		for (; x < dst.width; x++) {
+			UINT xIndex[3];
+			float xWeight[3];
+			const UINT xTaps = downsampleTaps(src.width, x, xIndex, xWeight);
+			XMVECTOR color = XMVectorZero();
+			for (UINT k = 0; k < zTaps; k++) {
+				const BYTE* texels = src.ptr + zIndex[k] * sliceTexels(src) * texelSize;
+				for (UINT j = 0; j < yTaps; j++) {
+					for (UINT i = 0; i < xTaps; i++) {
+						XMVECTOR texel = loadTexel(format, texels + texelIndex(src, xIndex[i], yIndex[j]) * texelSize);
+						color = XMVectorMultiplyAdd(texel, XMVectorReplicate(zWeight[k] * yWeight[j] * xWeight[i]), color);
+					}
+				}
+			}
+			storeTexel(format, dstSlice + texelIndex(dst, x, y) * texelSize, color);
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <DirectXMath.h>
+#include "SRPlatform.h"
+#include "SRenum.h"
+
+// a 32768 texels wide texture has 16 levels
+#define SRMaxMipLevels 16
+// edge of the texel blocks of SRResourceLayoutSwizzled, a block of RGBA8 texels fills a cache line
+#define SRSwizzleBlockSize 4
+// bytes of a page of SRResourceLayoutVirtual, a square of texels stored row-major
+#define SRVirtualPageSize (64 * 1024)
+
+/*
+ * Sampler state, after D3D12_SAMPLER_DESC.
+ * Coordinates are normalized, [0, 1] covers the texture.
+ */
+typedef struct SRSamplerDesc {
+	SRFilter Filter = SRFilterTrilinear;
+	SRTextureAddressMode AddressU = SRTextureAddressWrap;
+	SRTextureAddressMode AddressV = SRTextureAddressWrap;
+	SRTextureAddressMode AddressW = SRTextureAddressWrap;	// 3D textures only
+	float MipLODBias = 0.0f;
+	float MaxLOD = float(SRMaxMipLevels);
+} SRSamplerDesc;
+
+/*
+ * A bound shader resource as the shaders see it, see SRPipelineState::NumShaderResources.
+ * The levels of the mip chain follow each other in memory, the largest first.
+ */
+typedef struct SRTextureView {
+	const BYTE* ptr;
+	UINT Width;
+	UINT Height;
+	UINT Depth;
+	UINT MipLevels;
+	DXGI_FORMAT Format;
+	SRResourceDimension Dimension;
+	SRResourceLayout Layout;
+	UINT64 Generation;						// SRDecodedBlocksGeneration() when bound
+	size_t MipOffsets[SRMaxMipLevels];		// bytes from ptr to each level, the first page of it when virtual
+	std::atomic<UINT32>* Feedback;			// virtual only, a bit per page looked up
+} SRTextureView;
+
+// levels of a full mip chain down to 1 * 1
+UINT SRFullMipLevels(UINT width, UINT height);
+// byte offsets of the levels (pMipOffsets may be nullptr), returns the size of the whole chain.
+// swizzled levels are padded to whole blocks. a virtual texture is its page table, a pointer to each page
+// (nullptr while not populated) followed by the feedback bits, and the offsets are the first page of each level.
+size_t SRTextureLayout(SRResourceDimension dimension, DXGI_FORMAT format, UINT width, UINT height, UINT depth,
+	UINT mipLevels, SRResourceLayout layout, size_t* pMipOffsets);
+// texelCount row-major texels of row y of a level from / to the swizzled level
+void SRSwizzleRow(BYTE* pSwizzled, const BYTE* pRow, UINT width, UINT texelSize, UINT y, UINT texelCount);
+void SRUnswizzleRow(BYTE* pRow, const BYTE* pSwizzled, UINT width, UINT texelSize, UINT y, UINT texelCount);
+// formats the sample functions can read
+bool SRIsSampleableFormat(DXGI_FORMAT format);
+// BC1 - BC5, stored as rows of 4 * 4 blocks of SizeOfFormat bytes
+bool SRIsBlockCompressed(DXGI_FORMAT format);
+// log2 of the edge of a virtual page in texels, 0 if the format can not be virtual
+UINT SRVirtualPageShift(DXGI_FORMAT format);
+// pages of a virtual texture, pFirstPages (may be nullptr) receives the first page of each level
+size_t SRVirtualPageCount(DXGI_FORMAT format, UINT width, UINT height, UINT mipLevels, size_t* pFirstPages);
+
+/*
+ * Compressed textures are sampled as they are, every thread keeps a few decoded blocks.
+ * The decoded blocks are dropped when compressed texels change.
+ */
+void SRInvalidateDecodedBlocks();
+UINT64 SRDecodedBlocksGeneration();
+
+/*
+ * Sampling, callable from vertex and pixel shaders.
+ * lod is the mip level, 0 the largest; it is biased by the sampler and clamped to the chain.
+ * sRGB formats are returned linear.
+ */
+DirectX::XMVECTOR SRSampleLevel(const SRTextureView& texture, const SRSamplerDesc& sampler, DirectX::XMFLOAT2 uv, float lod);
+// ddx / ddy: change of uv to the next pixel in x / y, see SRPipelineState::PSDerivativeCount
+DirectX::XMVECTOR SRSampleGrad(const SRTextureView& texture, const SRSamplerDesc& sampler, DirectX::XMFLOAT2 uv,
+	DirectX::XMFLOAT2 ddx, DirectX::XMFLOAT2 ddy);
+// the 4 pixels of a 2 * 2 quad in the order of SRQuadPixelShader, lod from the differences across the quad.
+void SRSampleQuad(const SRTextureView& texture, const SRSamplerDesc& sampler, const DirectX::XMFLOAT2 uv[4],
+	DirectX::XMVECTOR color[4]);
+// the lod SRSampleGrad uses, before bias and clamping
+float SRCalculateLevelOfDetail(const SRTextureView& texture, DirectX::XMFLOAT2 ddx, DirectX::XMFLOAT2 ddy);
+
+/*
+ * Cube maps, looked up by direction. The face is the one of the major axis, in the order +X -X +Y -Y +Z -Z
+ * as in D3D, the address modes are ignored: bilinear footprints crossing the edge of a face continue on the
+ * neighbouring face. The faces of the 4 directions of a quad are selected at once.
+ */
+DirectX::XMVECTOR SRSampleCubeLevel(const SRTextureView& texture, const SRSamplerDesc& sampler, DirectX::XMFLOAT3 direction,
+	float lod);
+void SRSampleCubeQuad(const SRTextureView& texture, const SRSamplerDesc& sampler, const DirectX::XMFLOAT3 direction[4],
+	DirectX::XMVECTOR color[4]);
+
+/*
+ * 3D textures, linear filtering blends 8 texels of a level, AddressW addresses the depth.
+ */
+DirectX::XMVECTOR SRSampleVolumeLevel(const SRTextureView& texture, const SRSamplerDesc& sampler, DirectX::XMFLOAT3 uvw,
+	float lod);
+void SRSampleVolumeQuad(const SRTextureView& texture, const SRSamplerDesc& sampler, const DirectX::XMFLOAT3 uvw[4],
+	DirectX::XMVECTOR color[4]);
+
+/*
+ * Mip generation, for the sampleable formats that are not compressed.
+ * Rows [rowBegin, rowEnd) of a slice of a 3D level or a face of a cube level are box filtered from level - 1,
+ * sRGB is filtered linear. Writes through texture.ptr, the rows of a level can be generated in parallel.
+ */
+void SRGenerateMipRows(const SRTextureView& texture, UINT level, UINT slice, UINT rowBegin, UINT rowEnd);
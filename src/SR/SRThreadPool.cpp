@@ -0,0 +1,240 @@
+#include "SRThreadPool.h"
+#include <stdio.h>
+#include <emmintrin.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// spin this many times before a idle worker goes to sleep,
+// draws come in quick succession and waking a sleeping thread is expensive.
+static const int SpinCount = 4096;
+
+static inline UINT64 PackRange(UINT begin, UINT end) {
+	return (UINT64(end) << 32) | begin;
+}
+
+static inline void UnpackRange(UINT64 range, UINT& begin, UINT& end) {
+	begin = UINT(range);
+	end = UINT(range >> 32);
+}
+
+SRThreadPool::~SRThreadPool() {
+	Shutdown();
+}
+
+bool SRThreadPool::Initialize(UINT NumThreads) {
+	Shutdown();
+
+	mThreadCount = NumThreads == 0 ? 1 : NumThreads;
+	mWorkers = new Worker[mThreadCount];
+	for (UINT i = 0; i < mThreadCount; i++) {
+		mWorkers[i].range.store(0, std::memory_order_relaxed);
+	}
+
+	mQuit = false;
+	try {
+		// a thread may only start running after the first task was published,
+		// so it must not take the generation it sees then as done.
+		UINT64 generation = mGeneration.load();
+		for (UINT i = 1; i < mThreadCount; i++) {
+			mThreads.emplace_back(&SRThreadPool::WorkerMain, this, i, generation);
+		}
+	}
+	catch (const std::system_error&) {
+		Shutdown();
+		return false;
+	}
+	return true;
+}
+
+void SRThreadPool::Shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWakeUp.notify_all();
+	for (auto& thread : mThreads) {
+		thread.join();
+	}
+	mThreads.clear();
+
+	delete[] mWorkers;
+	mWorkers = nullptr;
+	mThreadCount = 1;
+}
+
+UINT SRThreadPool::DefaultThreadCount() {
+	UINT count = std::thread::hardware_concurrency();
+
+#ifdef __linux__
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		count = UINT(CPU_COUNT(&set));
+	}
+
+	// containers usually limit cpu time by cgroup quota instead of affinity
+	long long quota = -1, period = 0;
+	FILE* file = fopen("/sys/fs/cgroup/cpu.max", "r");
+	if (file != nullptr) {
+		// cgroup v2: "<quota> <period>" or "max <period>"
+		if (fscanf(file, "%lld %lld", &quota, &period) != 2)
+			quota = -1;
+		fclose(file);
+	}
+	else {
+		// cgroup v1
+		file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+		if (file != nullptr) {
+			if (fscanf(file, "%lld", &quota) != 1)
+				quota = -1;
+			fclose(file);
+		}
+		file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+		if (file != nullptr) {
+			if (fscanf(file, "%lld", &period) != 1)
+				period = 0;
+			fclose(file);
+		}
+	}
+	if (quota > 0 && period > 0) {
+		UINT quotaCount = UINT((quota + period - 1) / period);
+		if (quotaCount < count)
+			count = quotaCount;
+	}
+#endif
+
+	return count == 0 ? 1 : count;
+}
+
+void SRThreadPool::Run(UINT count, UINT grain, TaskFunc func, const void* context, bool isStealing) {
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	// not worth waking anyone up
+	if (mThreadCount == 1 || count <= grain) {
+		func(context, 0, count, 0);
+		return;
+	}
+
+	// Publish the task. Workers that are still leaving the previous task may
+	// read the task at any time, so wait for them after marking the generation
+	// odd, which keeps late comers out.
+	UINT64 generation = mGeneration.load();
+	mGeneration.store(generation + 1);
+	int spin = 0;
+	while (mActiveWorkers.load() != 0)
+		Backoff(spin);
+
+	mTaskFunc = func;
+	mTaskContext = context;
+	mTaskGrain = grain;
+	mTaskStealing = isStealing;
+	// contiguous shares at first, stealing balances the rest
+	for (UINT i = 0; i < mThreadCount; i++) {
+		UINT begin = UINT(UINT64(count) * i / mThreadCount);
+		UINT end = UINT(UINT64(count) * (i + 1) / mThreadCount);
+		mWorkers[i].range.store(PackRange(begin, end), std::memory_order_relaxed);
+	}
+	mTaskRemaining.store(count);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mGeneration.store(generation + 2);
+	}
+	mWakeUp.notify_all();
+
+	// Work only returns after every index has been processed.
+	Work(0);
+}
+
+void SRThreadPool::WorkerMain(UINT threadIndex, UINT64 seen) {
+	for (;;) {
+		// wait for a new task
+		int spin = 0;
+		for (;;) {
+			UINT64 generation = mGeneration.load();
+			if (generation != seen && generation % 2 == 0)
+				break;
+			if (++spin < SpinCount) {
+				_mm_pause();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWakeUp.wait(lock, [&] {
+				UINT64 g = mGeneration.load();
+				return mQuit || (g != seen && g % 2 == 0);
+			});
+			if (mQuit)
+				return;
+			break;
+		}
+
+		// announce before looking at the task, see Run()
+		mActiveWorkers.fetch_add(1);
+		UINT64 generation = mGeneration.load();
+		if (generation != seen && generation % 2 == 0) {
+			seen = generation;
+			Work(threadIndex);
+		}
+		mActiveWorkers.fetch_sub(1);
+	}
+}
+
+void SRThreadPool::Work(UINT threadIndex) {
+	int spin = 0;
+	for (;;) {
+		UINT begin, end;
+		if (TakeChunk(threadIndex, begin, end)) {
+			mTaskFunc(mTaskContext, begin, end, threadIndex);
+			mTaskRemaining.fetch_sub(end - begin);
+			continue;
+		}
+		if (mTaskStealing && Steal(threadIndex))
+			continue;
+		if (mTaskRemaining.load() == 0)
+			return;
+		// the rest is being executed by others, chunks may still be split though
+		Backoff(spin);
+	}
+}
+
+bool SRThreadPool::TakeChunk(UINT threadIndex, UINT& begin, UINT& end) {
+	std::atomic<UINT64>& range = mWorkers[threadIndex].range;
+	UINT64 old = range.load();
+	for (;;) {
+		UINT rangeBegin, rangeEnd;
+		UnpackRange(old, rangeBegin, rangeEnd);
+		if (rangeBegin >= rangeEnd)
+			return false;
+		UINT chunkEnd = rangeEnd - rangeBegin > mTaskGrain ? rangeBegin + mTaskGrain : rangeEnd;
+		if (range.compare_exchange_weak(old, PackRange(chunkEnd, rangeEnd))) {
+			begin = rangeBegin;
+			end = chunkEnd;
+			return true;
+		}
+	}
+}
+
+bool SRThreadPool::Steal(UINT threadIndex) {
+	for (UINT n = 1; n < mThreadCount; n++) {
+		std::atomic<UINT64>& victim = mWorkers[(threadIndex + n) % mThreadCount].range;
+		UINT64 old = victim.load();
+		for (;;) {
+			UINT rangeBegin, rangeEnd;
+			UnpackRange(old, rangeBegin, rangeEnd);
+			if (rangeBegin >= rangeEnd)
+				break;
+			// take the back half, or everything if only one chunk is left
+			UINT middle = rangeEnd - rangeBegin > mTaskGrain ? rangeBegin + (rangeEnd - rangeBegin) / 2 : rangeBegin;
+			if (victim.compare_exchange_weak(old, PackRange(rangeBegin, middle))) {
+				// our own range is empty, so nobody steals from it right now
+				mWorkers[threadIndex].range.store(PackRange(middle, rangeEnd));
+				return true;
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SRPlatform.h"
+
+/*
+ * Persistent worker threads with per-worker work-stealing ranges.
+ * Only one ParallelFor can be in flight at a time, and it can not be nested.
+ */
+class SRThreadPool
+{
+public:
+	SRThreadPool() = default;
+	SRThreadPool(const SRThreadPool& rhs) = delete;
+	SRThreadPool& operator=(const SRThreadPool& rhs) = delete;
+	~SRThreadPool();
+
+	// NumThreads counts the calling thread, which always takes part in the work.
+	bool Initialize(UINT NumThreads);
+	void Shutdown();
+	UINT GetThreadCount() const { return mThreadCount; };
+
+	// hardware concurrency, limited by the process affinity and the cgroup cpu quota.
+	static UINT DefaultThreadCount();
+
+	// busy wait a little, then give the core away in case we are oversubscribed
+	static void Backoff(int& spin) {
+		if (++spin < 64)
+			_mm_pause();
+		else
+			std::this_thread::yield();
+	}
+
+	// Call func(begin, end, threadIndex) on disjoint ranges covering [0, count),
+	// each of them at most grain long. Return after all of them finished.
+	// threadIndex is in [0, GetThreadCount()), 0 is the calling thread.
+	template<typename Func>
+	void ParallelFor(UINT count, UINT grain, const Func& func) {
+		Run(count, grain, &Invoke<Func>, static_cast<const void*>(&func), true);
+	}
+
+	// Call func(threadIndex) once on every thread, all of them running at the same time,
+	// for work split into roles that wait on each other. Return after all of them finished.
+	template<typename Func>
+	void RunOnEachThread(const Func& func) {
+		auto each = [&func](UINT begin, UINT end, UINT threadIndex) { func(threadIndex); };
+		Run(mThreadCount, 1, &Invoke<decltype(each)>, static_cast<const void*>(&each), false);
+	}
+
+private:
+	typedef void (*TaskFunc)(const void* context, UINT begin, UINT end, UINT threadIndex);
+
+	template<typename Func>
+	static void Invoke(const void* context, UINT begin, UINT end, UINT threadIndex) {
+		(*static_cast<const Func*>(context))(begin, end, threadIndex);
+	}
+
+	void Run(UINT count, UINT grain, TaskFunc func, const void* context, bool isStealing);
+	void WorkerMain(UINT threadIndex, UINT64 seen);
+	void Work(UINT threadIndex);
+	bool TakeChunk(UINT threadIndex, UINT& begin, UINT& end);
+	bool Steal(UINT threadIndex);
+
+	/*
+	 * Every worker owns a range of indices packed as [end : 32 | begin : 32].
+	 * The owner takes grain sized chunks from the front,
+	 * thieves take the back half of it.
+	 * Padded to a cache line so that the owners do not fight each other.
+	 */
+	struct Worker {
+		std::atomic<UINT64> range;
+		char padding[64 - sizeof(std::atomic<UINT64>)];
+	};
+
+	Worker* mWorkers = nullptr;
+	std::vector<std::thread> mThreads;
+	UINT mThreadCount = 1;
+
+	// current task, only written while no worker is inside Work()
+	TaskFunc mTaskFunc = nullptr;
+	const void* mTaskContext = nullptr;
+	UINT mTaskGrain = 1;
+	bool mTaskStealing = true;
+	std::atomic<UINT> mTaskRemaining{ 0 };
+
+	// odd while a task is being published
+	std::atomic<UINT64> mGeneration{ 0 };
+	std::atomic<UINT> mActiveWorkers{ 0 };
+	std::mutex mMutex;
+	std::condition_variable mWakeUp;
+	bool mQuit = false;
+};
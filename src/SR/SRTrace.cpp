@@ -0,0 +1,119 @@
+#include "SRTrace.h"
+#include <chrono>
+#include <stdarg.h>
+#include <stdlib.h>
+
+static INT64 SteadyNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SRTracer::~SRTracer() {
+	End();
+}
+
+bool SRTracer::Begin(const char* fileName, UINT threadCount, UINT eventsPerThread) {
+	End();
+
+	mFile = fopen(fileName, "w");
+	if (mFile == nullptr)
+		return false;
+
+	mThreadCount = threadCount;
+	mEventsPerThread = eventsPerThread;
+	mBuffers = (ThreadBuffer*)_aligned_malloc(threadCount * sizeof(ThreadBuffer), 64);
+	if (mBuffers == nullptr) {
+		fclose(mFile);
+		mFile = nullptr;
+		return false;
+	}
+	bool isAllocated = true;
+	for (UINT i = 0; i < threadCount; i++) {
+		mBuffers[i].events = (Event*)malloc(eventsPerThread * sizeof(Event));
+		mBuffers[i].count = 0;
+		mBuffers[i].dropped = 0;
+		isAllocated = isAllocated && mBuffers[i].events != nullptr;
+	}
+	if (!isAllocated) {
+		End();
+		return false;
+	}
+
+	fprintf(mFile, "[");
+	mIsFirstEvent = true;
+	for (UINT i = 0; i < threadCount; i++) {
+		WriteEvent("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, \"args\": {\"name\": \"%s %u\"}}",
+			i, i == 0 ? "submit / worker" : "worker", i);
+	}
+
+	mFrame = 0;
+	mStartNs = SteadyNs();
+	mStartCycle = readCycleCounter();
+	mFrameStartCycle = mStartCycle;
+	mEnabled.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+void SRTracer::End() {
+	if (mFile != nullptr) {
+		// events recorded after the last frame end
+		bool isPending = false;
+		const bool isEnabled = mEnabled.load(std::memory_order_relaxed);
+		for (UINT i = 0; isEnabled && i < mThreadCount; i++) {
+			isPending = isPending || mBuffers[i].count != 0 || mBuffers[i].dropped != 0;
+		}
+		if (isPending)
+			EndFrame();
+		fprintf(mFile, "\n]\n");
+		fclose(mFile);
+		mFile = nullptr;
+	}
+	if (mBuffers != nullptr) {
+		for (UINT i = 0; i < mThreadCount; i++) {
+			free(mBuffers[i].events);
+		}
+		_aligned_free(mBuffers);
+		mBuffers = nullptr;
+	}
+	mEnabled.store(false, std::memory_order_relaxed);
+}
+
+void SRTracer::EndFrame() {
+	if (!mEnabled.load(std::memory_order_relaxed))
+		return;
+
+	const UINT64 endCycle = readCycleCounter();
+	const double elapsedUs = (SteadyNs() - mStartNs) * 1e-3;
+	// cycles per microsecond, measured over the whole trace
+	const double rate = elapsedUs > 0.0 ? (endCycle - mStartCycle) / elapsedUs : 1.0;
+
+	UINT dropped = 0;
+	for (UINT i = 0; i < mThreadCount; i++) {
+		ThreadBuffer& buffer = mBuffers[i];
+		for (UINT n = 0; n < buffer.count; n++) {
+			const Event& e = buffer.events[n];
+			WriteEvent("{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"n\": %u}}",
+				e.name, i, (e.begin - mStartCycle) / rate, (e.end - e.begin) / rate, e.arg);
+		}
+		dropped += buffer.dropped;
+		buffer.count = 0;
+		buffer.dropped = 0;
+	}
+
+	WriteEvent("{\"name\": \"Frame %u\", \"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"dropped\": %u}}",
+		mFrame, (mFrameStartCycle - mStartCycle) / rate, (endCycle - mFrameStartCycle) / rate, dropped);
+	fflush(mFile);
+
+	mFrame++;
+	mFrameStartCycle = readCycleCounter();
+}
+
+void SRTracer::WriteEvent(const char* format, ...) {
+	fprintf(mFile, mIsFirstEvent ? "\n" : ",\n");
+	mIsFirstEvent = false;
+
+	va_list args;
+	va_start(args, format);
+	vfprintf(mFile, format, args);
+	va_end(args);
+}
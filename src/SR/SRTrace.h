@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <stdio.h>
+#include "SRPlatform.h"
+#include "SRUtils.h"
+
+/*
+ * Timeline of what every thread of the pool did, written as Chrome trace events
+ * (chrome://tracing, ui.perfetto.dev) at the end of every frame.
+ * Each thread appends to its own buffer, so recording takes no lock.
+ * Compiled in unless SR_DISABLE_TRACE is defined, a disabled tracer costs one branch per scope.
+ */
+class SRTracer
+{
+public:
+	SRTracer() = default;
+	SRTracer(const SRTracer& rhs) = delete;
+	SRTracer& operator=(const SRTracer& rhs) = delete;
+	~SRTracer();
+
+	// eventsPerThread events are kept per thread and frame, the rest is dropped and counted.
+	bool Begin(const char* fileName, UINT threadCount, UINT eventsPerThread);
+	void End();
+	bool IsEnabled() const { return mEnabled.load(std::memory_order_relaxed); };
+
+	// threadIndex as in SRThreadPool::ParallelFor, name has to be a string literal.
+	void Record(UINT threadIndex, const char* name, UINT64 begin, UINT64 end, UINT arg) {
+		ThreadBuffer& buffer = mBuffers[threadIndex];
+		if (buffer.count == mEventsPerThread) {
+			buffer.dropped++;
+			return;
+		}
+		buffer.events[buffer.count++] = { name, begin, end, arg };
+	}
+
+	// flush the events recorded since the previous frame into the file,
+	// only when no other thread is recording.
+	void EndFrame();
+
+private:
+	struct Event {
+		const char* name;
+		UINT64 begin;
+		UINT64 end;
+		UINT arg;
+	};
+
+	// padded to a cache line so that the threads do not share the counters
+	struct alignas(64) ThreadBuffer {
+		Event* events;
+		UINT count;
+		UINT dropped;
+	};
+
+	// read by every thread of the pool, only changed between the frames
+	std::atomic<bool> mEnabled{ false };
+	FILE* mFile = nullptr;
+	ThreadBuffer* mBuffers = nullptr;
+	UINT mThreadCount = 0;
+	UINT mEventsPerThread = 0;
+	UINT mFrame = 0;
+	bool mIsFirstEvent = true;
+
+	// rdtsc is converted into microseconds by comparing it with the steady clock since Begin
+	UINT64 mStartCycle = 0;
+	INT64 mStartNs = 0;
+	UINT64 mFrameStartCycle = 0;
+
+	void WriteEvent(const char* format, ...);
+};
+
+/*
+ * Records the lifetime of the scope.
+ */
+class SRTraceScope
+{
+public:
+	SRTraceScope(SRTracer& tracer, UINT threadIndex, const char* name, UINT arg = 0) {
+		if (tracer.IsEnabled()) {
+			mTracer = &tracer;
+			mThreadIndex = threadIndex;
+			mName = name;
+			mArg = arg;
+			mBegin = readCycleCounter();
+		}
+	}
+	~SRTraceScope() {
+		if (mTracer != nullptr)
+			mTracer->Record(mThreadIndex, mName, mBegin, readCycleCounter(), mArg);
+	}
+	SRTraceScope(const SRTraceScope& rhs) = delete;
+	SRTraceScope& operator=(const SRTraceScope& rhs) = delete;
+
+private:
+	SRTracer* mTracer = nullptr;
+	UINT mThreadIndex = 0;
+	const char* mName = nullptr;
+	UINT mArg = 0;
+	UINT64 mBegin = 0;
+};
+
+#ifndef SR_DISABLE_TRACE
+#define SR_TRACE_CONCAT_(a, b) a##b
+#define SR_TRACE_CONCAT(a, b) SR_TRACE_CONCAT_(a, b)
+#define SRTrace(tracer, threadIndex, ...) \
+	SRTraceScope SR_TRACE_CONCAT(srTraceScope, __LINE__)((tracer), (threadIndex), __VA_ARGS__)
+#else
+#define SRTrace(tracer, threadIndex, ...) ((void)0)
+#endif
@@ -1,6 +1,6 @@
 #include "SRUtils.h"
 
-constexpr int SizeOfFormat(DXGI_FORMAT format) {
+int SizeOfFormat(DXGI_FORMAT format) {
 	switch (format)
 	{
 	case DXGI_FORMAT_R32G32B32A32_TYPELESS:
@@ -1,14 +1,15 @@
 #pragma once
 
-#include <dxgi1_4.h>
+#include "SRPlatform.h"
 #include <math.h>
 
-#define SRError(x) if (mDebugLayer) MessageBox(mhMainWnd, (x), L"SR Error", 0)
-#define SRFatal(x) MessageBox(mhMainWnd, (x), L"SR Fatal", 0)
+// only usable inside SRDevice, see SRDevice::ReportError
+#define SRError(x) if (mDebugLayer) ReportError((x), false)
+#define SRFatal(x) ReportError((x), true)
 
 #define DepthMax ((1 << 24) - 1)
 
-extern constexpr int SizeOfFormat(DXGI_FORMAT format);
+int SizeOfFormat(DXGI_FORMAT format);
 
 inline float clamp(float x) {
 	return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
@@ -25,3 +26,7 @@ inline UINT32 float2DpethCeil(float depth) {
 inline float depth2Float(UINT32 depth) {
 	return depth * (1.0f / DepthMax);
 }
+
+inline UINT64 readCycleCounter() {
+	return __rdtsc();
+}
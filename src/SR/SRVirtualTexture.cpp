@@ -0,0 +1,136 @@
+#include "SRVirtualTexture.h"
+#include "SRUtils.h"
+#include <algorithm>
+
+SRResidencyManager::~SRResidencyManager() {
+	for (const PageRef& ref : mLRU) {
+		_aligned_free(ref.memory);
+	}
+}
+
+void SRResidencyManager::Reserve(UINT handle, BYTE* pPageTable, DXGI_FORMAT format, UINT width, UINT height, UINT mipLevels) {
+	Texture& texture = mTextures[handle];
+	texture.pageCount = UINT(SRVirtualPageCount(format, width, height, mipLevels, texture.firstPages));
+	texture.pages = reinterpret_cast<BYTE**>(pPageTable);
+	texture.feedback = reinterpret_cast<std::atomic<UINT32>*>(pPageTable + texture.pageCount * sizeof(BYTE*));
+	texture.width = width;
+	texture.height = height;
+	texture.mipLevels = mipLevels;
+	texture.shift = SRVirtualPageShift(format);
+	texture.texelSize = SizeOfFormat(format);
+	texture.lru.assign(texture.pageCount, mLRU.end());
+	texture.lastUsed.assign(texture.pageCount, 0);
+}
+
+void SRResidencyManager::Release(UINT handle) {
+	auto it = mTextures.find(handle);
+	if (it == mTextures.end())
+		return;
+	Texture& texture = it->second;
+	for (UINT page = 0; page < texture.pageCount; page++) {
+		if (texture.pages[page] == nullptr)
+			continue;
+		_aligned_free(texture.pages[page]);
+		texture.pages[page] = nullptr;
+		mLRU.erase(texture.lru[page]);
+		mStats.ResidentPages--;
+		mStats.ResidentBytes -= SRVirtualPageSize;
+	}
+	mTextures.erase(it);
+}
+
+SRVirtualPage SRResidencyManager::PageOf(const Texture& texture, UINT page, UINT level) const {
+	const UINT side = 1u << texture.shift;
+	const UINT width = (std::max)(texture.width >> level, 1u);
+	const UINT height = (std::max)(texture.height >> level, 1u);
+	const UINT pagesPerRow = (width + side - 1) >> texture.shift;
+	const UINT index = UINT(page - texture.firstPages[level]);
+	SRVirtualPage info;
+	info.Level = level;
+	info.X = index % pagesPerRow;
+	info.Y = index / pagesPerRow;
+	info.Width = (std::min)(side, width - info.X * side);
+	info.Height = (std::min)(side, height - info.Y * side);
+	info.RowPitch = UINT(side * texture.texelSize);
+	return info;
+}
+
+bool SRResidencyManager::EvictLeastRecentlyUsed() {
+	if (mLRU.empty())
+		return false;
+	PageRef ref = mLRU.back();
+	Texture& texture = mTextures[ref.handle];
+	if (texture.lastUsed[ref.page] == mFrame)
+		return false;
+	_aligned_free(texture.pages[ref.page]);
+	texture.pages[ref.page] = nullptr;
+	mLRU.pop_back();
+	mStats.ResidentPages--;
+	mStats.ResidentBytes -= SRVirtualPageSize;
+	mStats.Evictions++;
+	return true;
+}
+
+BYTE* SRResidencyManager::TakePage() {
+	while (mStats.ResidentBytes + SRVirtualPageSize > mDesc.MemoryBudget) {
+		if (!EvictLeastRecentlyUsed())
+			return nullptr;
+	}
+	return static_cast<BYTE*>(_aligned_malloc(SRVirtualPageSize, 64));
+}
+
+void SRResidencyManager::Resolve() {
+	mFrame++;
+
+	// the pages looked up since the last frame end, the populated ones are refreshed
+	std::vector<Fault> faults;
+	for (auto& entry : mTextures) {
+		Texture& texture = entry.second;
+		UINT level = 0;
+		for (UINT word = 0; word < (texture.pageCount + 31) / 32; word++) {
+			UINT32 bits = texture.feedback[word].load(std::memory_order_relaxed);
+			if (bits == 0)
+				continue;
+			texture.feedback[word].store(0, std::memory_order_relaxed);
+			for (UINT page = word * 32; bits != 0; page++, bits >>= 1) {
+				if ((bits & 1) == 0)
+					continue;
+				while (level + 1 < texture.mipLevels && texture.firstPages[level + 1] <= page) {
+					level++;
+				}
+				texture.lastUsed[page] = mFrame;
+				if (texture.pages[page] != nullptr)
+					mLRU.splice(mLRU.begin(), mLRU, texture.lru[page]);
+				else
+					faults.push_back({ entry.first, page, level });
+			}
+		}
+	}
+
+	// the coarse levels first, a few of their pages stand in for many missing fine ones
+	std::stable_sort(faults.begin(), faults.end(), [](const Fault& a, const Fault& b) { return a.level > b.level; });
+	size_t faulted = 0, populated = 0;
+	for (; faulted < faults.size() && faulted < mDesc.MaxPageFaultsPerFrame && mDesc.PageFault != nullptr; faulted++) {
+		const Fault& fault = faults[faulted];
+		Texture& texture = mTextures[fault.handle];
+		BYTE* page = TakePage();
+		if (page == nullptr)
+			break;
+		if (!mDesc.PageFault(mDesc.pContext, fault.handle, PageOf(texture, fault.page, fault.level), page)) {
+			_aligned_free(page);
+			mStats.FailedPageFaults++;
+			continue;
+		}
+		texture.pages[fault.page] = page;
+		mLRU.push_front({ fault.handle, fault.page, page });
+		texture.lru[fault.page] = mLRU.begin();
+		mStats.ResidentPages++;
+		mStats.ResidentBytes += SRVirtualPageSize;
+		mStats.PageFaults++;
+		populated++;
+	}
+	mStats.MissingPages = faults.size() - populated;
+
+	// the budget may have been lowered
+	while (mStats.ResidentBytes > mDesc.MemoryBudget && EvictLeastRecentlyUsed());
+}
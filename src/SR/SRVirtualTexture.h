@@ -0,0 +1,109 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <vector>
+#include "SRPlatform.h"
+#include "SRTexture.h"
+
+/*
+ * Virtual textures, SRResourceLayoutVirtual.
+ * Creating one only reserves its page table, no texel memory. The sampler records every page it
+ * looks up and falls back to the coarser levels while a page is missing. At the end of the frame
+ * the pages looked up become the most recently used ones, and the missing ones are faulted in
+ * through SRVirtualTextureDesc::PageFault, coarse levels first, evicting the least recently used
+ * pages to stay within the memory budget. Pages looked up in the current frame are never evicted.
+ */
+
+// a page to be filled by SRPageFaultCallback
+typedef struct SRVirtualPage {
+	UINT Level;
+	UINT X;					// in pages
+	UINT Y;
+	UINT Width;				// texels of the level inside the page, the rest of it is never sampled
+	UINT Height;
+	UINT RowPitch;			// bytes between the rows of the page
+} SRVirtualPage;
+
+// write the texels of the page of the resource to pPage, from disk or wherever they live.
+// false leaves the page missing, it is asked for again as long as it is looked up.
+// called from SRDevice::SREndFrame.
+typedef bool (*SRPageFaultCallback)(void* pContext, UINT Handle, const SRVirtualPage& Page, BYTE* pPage);
+
+typedef struct SRVirtualTextureDesc {
+	// bytes of populated pages over all virtual textures
+	UINT64 MemoryBudget = UINT64(256) << 20;
+	// callbacks per frame, the other missing pages wait for the next frames
+	UINT MaxPageFaultsPerFrame = 64;
+	SRPageFaultCallback PageFault = nullptr;
+	void* pContext = nullptr;
+} SRVirtualTextureDesc;
+
+typedef struct SRVirtualTextureStatistics {
+	UINT64 ResidentPages = 0;
+	UINT64 ResidentBytes = 0;
+	UINT64 PageFaults = 0;			// pages filled by the callback
+	UINT64 FailedPageFaults = 0;	// the callback returned false
+	UINT64 Evictions = 0;
+	UINT64 MissingPages = 0;		// looked up in the last frame and still missing after it
+} SRVirtualTextureStatistics;
+
+/*
+ * Populated pages of all virtual textures of a device, the least recently used first to go.
+ * The page tables belong to the resources, only the pages in them are managed here.
+ */
+class SRResidencyManager
+{
+public:
+	SRResidencyManager() = default;
+	SRResidencyManager(const SRResidencyManager& rhs) = delete;
+	SRResidencyManager& operator=(const SRResidencyManager& rhs) = delete;
+	~SRResidencyManager();
+
+	void SetDesc(const SRVirtualTextureDesc& desc) { mDesc = desc; };
+	void GetStatistics(SRVirtualTextureStatistics* pStats) const { *pStats = mStats; };
+
+	// a new virtual texture with its page table cleared
+	void Reserve(UINT handle, BYTE* pPageTable, DXGI_FORMAT format, UINT width, UINT height, UINT mipLevels);
+	// free the populated pages of the texture, before its page table is
+	void Release(UINT handle);
+	// at frame end, nothing may sample meanwhile: consume the feedback, fault in and evict
+	void Resolve();
+
+private:
+	// the memory is kept here as well, the page table may be gone before the manager
+	struct PageRef {
+		UINT handle;
+		UINT page;
+		BYTE* memory;
+	};
+	struct Texture {
+		BYTE** pages;
+		std::atomic<UINT32>* feedback;
+		UINT pageCount;
+		UINT width;
+		UINT height;
+		UINT mipLevels;
+		UINT shift;
+		size_t texelSize;
+		size_t firstPages[SRMaxMipLevels];
+		std::vector<std::list<PageRef>::iterator> lru;	// valid for the populated pages
+		std::vector<UINT64> lastUsed;					// frame of the last lookup
+	};
+	struct Fault {
+		UINT handle;
+		UINT page;
+		UINT level;
+	};
+
+	SRVirtualPage PageOf(const Texture& texture, UINT page, UINT level) const;
+	// memory for one more page, evicting if the budget is used up. nullptr if all pages are in use.
+	BYTE* TakePage();
+	bool EvictLeastRecentlyUsed();
+
+	SRVirtualTextureDesc mDesc;
+	SRVirtualTextureStatistics mStats;
+	std::map<UINT, Texture> mTextures;
+	std::list<PageRef> mLRU;		// most recently used first
+	UINT64 mFrame = 0;
+};
@@ -0,0 +1,169 @@
+#include "SRWindowDevice.h"
+
+bool SRWindowDevice::Initialize(UINT NumWorkerThreads) {
+	mMainWndCaption = L"SR";
+	if (!D3DApp::Initialize())
+		return false;
+
+	if (!SRDevice::Initialize(NumWorkerThreads))
+		return false;
+
+	for (int i = 0; i < mInternalSwapChainNum; i++) {
+		mInternalFences[i] = 0;
+		TF(md3dDevice->CreateCommandAllocator(
+			D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(mInternalCmdListAllocs[i].GetAddressOf())));
+	}
+
+	InitializeMagPresent();
+
+	//mUMA = !mUMA; //uncomment this line to test the other case
+	return true;
+}
+
+void SRWindowDevice::ReportError(const wchar_t* message, bool isFatal) {
+	MessageBox(mhMainWnd, message, isFatal ? L"SR Fatal" : L"SR Error", 0);
+}
+
+void SRWindowDevice::OnRenderTargetResize(UINT width, UINT height) {
+	FlushCommandQueue();
+
+	if (width * height == 0) {
+		for (UINT i = 0; i < mInternalSwapChainNum; i++) {
+			mRenderTargetHelper[i].Reset();
+		}
+		return;
+	}
+
+	for (UINT i = 0; i < mInternalSwapChainNum; i++) {
+		mRenderTargetHelper[i].Reset();
+		TF(md3dDevice->CreateCommittedResource(
+			mUMA ?
+			&CD3DX12_HEAP_PROPERTIES(D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE, D3D12_MEMORY_POOL_L0) :
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM,
+				width, height, 1, 1),
+			mUMA ?
+			D3D12_RESOURCE_STATE_GENERIC_READ :
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(mRenderTargetHelper[i].GetAddressOf())));
+
+		if (!mUMA) {
+			mRenderTargetUploader[i].Reset();
+			const UINT64 uploadBufferSize = GetRequiredIntermediateSize(mRenderTargetHelper[i].Get(), 0, 1);
+			TF(md3dDevice->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+				D3D12_HEAP_FLAG_NONE,
+				&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
+				D3D12_RESOURCE_STATE_GENERIC_READ,
+				nullptr,
+				IID_PPV_ARGS(mRenderTargetUploader[i].GetAddressOf())));
+		}
+	}
+
+	CreateMagDescriptor();
+}
+
+void SRWindowDevice::Draw(const GameTimer& gt) {
+	DrawScene(gt);
+	SREndFrame();
+
+
+	mInternalSwapChainIndex = (mInternalSwapChainIndex + 1) % mInternalSwapChainNum;
+	UINT64 prevFence= mInternalFences[mInternalSwapChainIndex];
+	if (mFence->GetCompletedValue() < prevFence) {
+		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+		TF(mFence->SetEventOnCompletion(prevFence, eventHandle));
+		WaitForSingleObject(eventHandle, INFINITE);
+		CloseHandle(eventHandle);
+	}
+
+
+	auto& cmdListAlloc = mInternalCmdListAllocs[mInternalSwapChainIndex];
+	auto& helperResource = mRenderTargetHelper[mInternalSwapChainIndex];
+	auto& uploaderResource = mRenderTargetUploader[mInternalSwapChainIndex];
+
+	TF(cmdListAlloc->Reset());
+	const SRResource* renderTarget = GetRenderTarget();
+	if (renderTarget != nullptr) {
+		UINT rowPitch = sizeof(renderTarget->FORMAT) * renderTarget->WIDTH;
+		UINT depthPitch = rowPitch * renderTarget->HEIGHT;
+
+		mCommandList->Reset(cmdListAlloc.Get(), nullptr);
+
+		if (mUMA) {
+			helperResource->WriteToSubresource(0, nullptr, renderTarget->ptr, rowPitch, depthPitch);
+		}
+		else {
+			D3D12_SUBRESOURCE_DATA data;
+			data.pData = renderTarget->ptr;
+			data.RowPitch = rowPitch;
+			data.SlicePitch = depthPitch;
+			UpdateSubresources(mCommandList.Get(),
+				helperResource.Get(), uploaderResource.Get(), 0, 0, 1, &data);
+		}
+
+		if (!mMagPresent) {
+			DirectPresent(helperResource.Get(), renderTarget->WIDTH, renderTarget->HEIGHT);
+		}
+		else {
+			MagnificationPresent(helperResource.Get());
+		}
+
+		TF(mCommandList->Close());
+
+		ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+		mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+		TF(mSwapChain->Present(0, GetAllowTearing() ? DXGI_PRESENT_ALLOW_TEARING : 0));
+		mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+
+		mInternalFences[mInternalSwapChainIndex] = ++mCurrentFence;
+		mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+	}
+}
+
+void SRWindowDevice::DirectPresent(ID3D12Resource* presentResource, UINT width, UINT height) {
+	if (!mUMA) {
+		mCommandList->ResourceBarrier(1,
+			&CD3DX12_RESOURCE_BARRIER::Transition(
+				presentResource, D3D12_RESOURCE_STATE_COPY_DEST,
+				D3D12_RESOURCE_STATE_COPY_SOURCE));
+	}
+
+	D3D12_TEXTURE_COPY_LOCATION src, dest;
+	src.pResource = presentResource;
+	src.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	src.SubresourceIndex = 0;
+	dest.pResource = CurrentBackBuffer();
+	dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	dest.SubresourceIndex = 0;
+	D3D12_BOX box = { 0, 0, 0,
+		min(UINT(mClientWidth), width),
+		min(UINT(mClientHeight), height), 1 };
+	mCommandList->CopyTextureRegion(&dest, 0, 0, 0, &src, &box);
+
+	if (mUMA) {
+		mCommandList->ResourceBarrier(1,
+			&CD3DX12_RESOURCE_BARRIER::Transition(
+				CurrentBackBuffer(), D3D12_RESOURCE_STATE_COPY_DEST,
+				D3D12_RESOURCE_STATE_PRESENT));
+	}
+	else {
+		D3D12_RESOURCE_BARRIER barriers[] = {
+			CD3DX12_RESOURCE_BARRIER::Transition(
+				presentResource, D3D12_RESOURCE_STATE_COPY_SOURCE,
+				D3D12_RESOURCE_STATE_COPY_DEST),
+			CD3DX12_RESOURCE_BARRIER::Transition(
+				CurrentBackBuffer(), D3D12_RESOURCE_STATE_COPY_DEST,
+				D3D12_RESOURCE_STATE_PRESENT)
+		};
+		mCommandList->ResourceBarrier(2, barriers);
+	}
+}
+
+SRWindowDevice::~SRWindowDevice() {
+	// flush at here, otherwise render target helper will be release before all command execute.
+	FlushCommandQueue();
+}
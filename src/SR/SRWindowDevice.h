@@ -0,0 +1,84 @@
+#pragma once
+
+#include "d3dApp.h"
+#include "SRDevice.h"
+
+/*
+ * D3D12 front-end of SRDevice.
+ * Owns a Win32 window and presents the bound render target after every DrawScene.
+ */
+class SRWindowDevice : public SRDevice, D3DApp
+{
+public:
+	SRWindowDevice() = delete;
+	SRWindowDevice(const SRWindowDevice& rhs) = delete;
+	SRWindowDevice& operator=(const SRWindowDevice& rhs) = delete;
+	SRWindowDevice(HINSTANCE hInstance) : D3DApp(hInstance) {};
+	~SRWindowDevice();
+	// 0 worker thread means one per available core
+	virtual bool Initialize(UINT NumWorkerThreads = 0) override;
+
+public:
+	// Debug API
+	void SRSetMagMode(bool EnableMag, UINT MagLevel);
+
+private:
+	bool mMagPresent = false;
+	UINT mMagLevel = 0;
+
+	/*
+	 * Internal variable
+	 */
+	static constexpr int mInternalSwapChainNum = 3;
+	int mInternalSwapChainIndex = 0;
+	UINT64 mInternalFences[mInternalSwapChainNum];
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mInternalCmdListAllocs[mInternalSwapChainNum];
+
+	virtual void ReportError(const wchar_t* message, bool isFatal) override;
+	virtual void OnRenderTargetResize(UINT width, UINT height) override;
+
+	void DirectPresent(ID3D12Resource* presentResource, UINT width, UINT height);
+	void MagnificationPresent(ID3D12Resource* presentResource);
+	void InitializeMagPresent();
+	void CreateMagDescriptor();
+
+private:
+	/*
+	 * D3D12 Interaction Layer
+	 */
+	virtual void Draw(const GameTimer& gt) override;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mRenderTargetUploader[mInternalSwapChainNum];
+	Microsoft::WRL::ComPtr<ID3D12Resource> mRenderTargetHelper[mInternalSwapChainNum];
+
+	// Mag
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mMagHeap = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> mMagRootSignature = nullptr;
+	Microsoft::WRL::ComPtr<ID3DBlob> mMagTriVS = nullptr;
+	Microsoft::WRL::ComPtr<ID3DBlob> mMagTriPS = nullptr;
+	Microsoft::WRL::ComPtr<ID3DBlob> mMagLineVS = nullptr;
+	Microsoft::WRL::ComPtr<ID3DBlob> mMagLinePS = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> mMagTriPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> mMagLinePSO;
+
+	/*
+	 * forward functions
+	 */
+public:
+	int Run() { return D3DApp::Run(); };
+
+protected:
+	virtual void Update(const GameTimer& gt) = 0;
+	virtual void DrawScene(const GameTimer& gt) = 0;
+	virtual void OnResize() { D3DApp::OnResize(); };
+
+	virtual void OnMouseDown(WPARAM btnState, int x, int y) {};
+	virtual void OnMouseUp(WPARAM btnState, int x, int y) {};
+	virtual void OnMouseMove(WPARAM btnState, int x, int y) {};
+
+	int GetClientWidth() { return mClientWidth; };
+	int GetClientHeight() { return mClientHeight; };
+	float GetAspectRatio() const { return AspectRatio(); };
+	HWND GetMainWnd() { return mhMainWnd; };
+	bool GetDebugMode() { return mDebugMode; };
+};
@@ -42,6 +42,55 @@ enum SRBlendOp {
 	SRBlendOpMax = 5,
 } SRBlendOp;
 
+typedef
+enum SRTileScheduling {
+	SRTileSchedulingStatic = 0,			// zigzag order, a contiguous share of tiles per worker
+	SRTileSchedulingCostHistory = 1		// the most expensive tiles of the previous frame first
+} SRTileScheduling;
+
+typedef
+enum SRTileOrder {
+	SRTileOrderZigzag = 0,		// row by row, every other row reversed
+	SRTileOrderMorton = 1,		// Z-order curve
+	SRTileOrderHilbert = 2		// Hilbert curve
+} SRTileOrder;
+
+typedef
+enum SRHeatmapCounter {
+	SRHeatmapCounterTrianglesTested = 0,
+	SRHeatmapCounterTrianglesAccepted = 1,
+	SRHeatmapCounterPixelsShaded = 2,
+	SRHeatmapCounterOverdraw = 3,		// pixels shaded per pixel of the tile
+	SRHeatmapCounterCycles = 4
+} SRHeatmapCounter;
+
+typedef
+enum SRHeatmapFormat {
+	SRHeatmapFormatCSV = 0,				// every counter, one line per tile
+	SRHeatmapFormatGrayscale = 1,		// binary PGM at render target resolution
+	SRHeatmapFormatFalseColor = 2		// binary PPM at render target resolution, blue (cold) to red (hot)
+} SRHeatmapFormat;
+
+typedef
+enum SRResourceLayout {
+	SRResourceLayoutRowMajor = 0,		// rows of texels one after the other
+	SRResourceLayoutSwizzled = 1,		// 4 * 4 texel blocks, see SRSwizzleBlockSize
+	SRResourceLayoutVirtual = 2			// pages populated on demand, see SRVirtualTexture.h
+} SRResourceLayout;
+
+typedef
+enum SRFilter {
+	SRFilterPoint = 0,			// nearest texel of the nearest mip level
+	SRFilterBilinear = 1,		// 2 * 2 texels of the nearest mip level
+	SRFilterTrilinear = 2		// 2 * 2 texels of the two nearest mip levels
+} SRFilter;
+
+typedef
+enum SRTextureAddressMode {
+	SRTextureAddressWrap = 0,
+	SRTextureAddressClamp = 1
+} SRTextureAddressMode;
+
 typedef
 enum SRPrimitiveTopology
 {